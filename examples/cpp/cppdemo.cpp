@@ -86,5 +86,47 @@ int main()
 		std::cerr << "Response error: " << e.what() << std::endl;
 	}
 
+	// The same with handlers known at compile time, which can be inlined
+	uint16_t registers[16] = {0};
+	llm::StaticSlave staticSlave([&registers](const ModbusRegisterCallbackArgs &args, ModbusRegisterCallbackResult &result)
+	{
+		if (args.type != MODBUS_HOLDING_REGISTER || args.index >= 16)
+		{
+			result.exceptionCode = MODBUS_EXCEP_ILLEGAL_ADDRESS;
+			return MODBUS_OK;
+		}
+
+		result.exceptionCode = MODBUS_EXCEP_NONE;
+		if (args.query == MODBUS_REGQ_R)
+			result.value = registers[args.index];
+		else if (args.query == MODBUS_REGQ_W)
+			registers[args.index] = args.value;
+		return MODBUS_OK;
+	});
+
+	llm::StaticMaster staticMaster([](const ModbusDataCallbackArgs &args)
+	{
+		std::cout << "Register " << args.index << " = " << args.value << std::endl;
+	});
+
+	try
+	{
+		uint16_t values[3] = {100, 200, 300};
+		staticMaster.buildRequest16RTU(1, 2, 3, values);
+		staticSlave.parseRequestRTU(1, staticMaster.getRequest(), staticMaster.getRequestLength());
+
+		staticMaster.buildRequest03RTU(1, 1, 4);
+		staticSlave.parseRequestRTU(1, staticMaster.getRequest(), staticMaster.getRequestLength());
+		staticMaster.parseResponseRTU(
+			staticMaster.getRequest(),
+			staticMaster.getRequestLength(),
+			staticSlave.getResponse(),
+			staticSlave.getResponseLength());
+	}
+	catch (const std::exception &e)
+	{
+		std::cerr << "Error: " << e.what() << std::endl;
+	}
+
 	return 0;
 }
\ No newline at end of file
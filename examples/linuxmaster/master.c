@@ -7,9 +7,11 @@
 #include <time.h>
 #include <fcntl.h>
 #include <termios.h>
+#include <poll.h>
 #include <sys/time.h>
 
 #define LIGHTMODBUS_MASTER_FULL
+#define LIGHTMODBUS_STREAM
 #define LIGHTMODBUS_DEBUG
 #define LIGHTMODBUS_IMPL
 #include <lightmodbus/lightmodbus.h>
@@ -51,38 +53,44 @@ int serialopen(const char *path, int speed, int parity, int blocking)
 	return fd;
 }
 
-int serialrecv(int fd, uint8_t *buf, int buflen)
+/*
+	Receives a single response frame. Frame boundaries are found by
+	ModbusRTUStream, so the function returns as soon as the last byte of the
+	response arrives. Returns frame length, 0 on timeout or -1 on error.
+*/
+int serialrecv(int fd, ModbusRTUStream *stream, const uint8_t **frame, int timeout_ms)
 {
-	// Number of bytes received
-	int len = 0;
+	struct timeval start;
+	gettimeofday(&start, NULL);
 
-	// Time of last received byte
-	struct timeval last;
-	gettimeofday(&last, NULL);
-
-	while (len < buflen)
+	uint16_t len;
+	while (1)
 	{
-		// Check timeout
-		struct timeval current;
+		// Sleep until data arrives or the timeout expires
+		struct timeval current, tdiff;
 		gettimeofday(&current, NULL);
-		struct timeval tdiff;
-		timersub(&current, &last, &tdiff);
-		struct timeval timeout = {.tv_sec = 0, .tv_usec = 10e-3 * 10e9}; // 10ms
-		if (timercmp(&tdiff, &timeout, >))
-			break;
+		timersub(&current, &start, &tdiff);
+		int left = timeout_ms - (tdiff.tv_sec * 1000 + tdiff.tv_usec / 1000);
+		if (left <= 0)
+			return 0;
+
+		struct pollfd pfd = {.fd = fd, .events = POLLIN};
+		int ready = poll(&pfd, 1, left);
+		if (ready == -1)
+			return -1;
+		if (ready == 0)
+			continue;
 
-		// Attempt to read
-		int n = read(fd, buf + len, buflen - len);
+		// Attempt to read - the buffer must stay valid until the frame is retrieved
+		static uint8_t buf[256];
+		int n = read(fd, buf, sizeof(buf));
 		if (n == -1)
 			return -1;
 
-		if (n > 0)
-			gettimeofday(&last, NULL);
-
-		len += n;
+		modbusRTUStreamFeed(stream, buf, n);
+		if (modbusRTUStreamNext(stream, frame, &len))
+			return len;
 	}
-
-	return len;
 }
 
 int convbaud(int baudrate)
@@ -321,21 +329,23 @@ int main(int argc, char *argv[])
 		exit(EXIT_FAILURE);
 	}
 
-	// Wait 50ms
-	{
-		struct timespec ts = {.tv_sec = 0, .tv_nsec = 0.05 * 1e9};
-		nanosleep(&ts, NULL);
-	}
-
 	// Receive response
-	uint8_t response[256];
-	int len = serialrecv(serialfd, response, sizeof(response));
+	ModbusRTUStream stream;
+	modbusRTUStreamInit(&stream, MODBUS_RTU_STREAM_RESPONSES);
+	const uint8_t *response;
+	int len = serialrecv(serialfd, &stream, &response, 1000);
 	if (len < 0)
 	{
 		fprintf(stderr, "read() error: %s\n", strerror(errno));
 		exit(EXIT_FAILURE);
 	}
 
+	if (len == 0)
+	{
+		fprintf(stderr, "Response timeout\n");
+		exit(EXIT_FAILURE);
+	}
+
 	// Print out response length
 	printf("RESP LEN: %03d\n", len);
 
@@ -42,6 +42,11 @@
 #define MODBUS_TCP_ADU_PADDING 7   //!< Number of extra bytes added to the PDU in Modbus TCP
 #define MODBUS_TCP_PDU_OFFSET  7   //!< Offset of PDU relative to the frame beginning in Modbus TCP
 
+#define MODBUS_ASCII_ADU_MIN     9   //!< Minimum length of ADU in Modbus ASCII
+#define MODBUS_ASCII_ADU_MAX     513 //!< Maximum length of ADU in Modbus ASCII
+#define MODBUS_ASCII_ADU_PADDING 2   //!< Number of extra bytes added to the PDU in Modbus ASCII (before hex encoding)
+#define MODBUS_ASCII_PDU_OFFSET  1   //!< Offset of PDU relative to the frame beginning in Modbus ASCII (before hex encoding)
+
 /**
 	\def LIGHTMODBUS_RET_ERROR
 	\brief Return type for library functions returning ModbusErrorInfo that should be handled properly.
@@ -193,14 +198,14 @@ typedef enum ModbusError
 	MODBUS_ERROR_RANGE,
 
 	/**
-		\brief CRC invalid
-		\note Only in Modbus RTU
+		\brief CRC invalid (LRC in Modbus ASCII)
+		\note Only in Modbus RTU and Modbus ASCII
 	*/
 	MODBUS_ERROR_CRC,
 
 	/**
-		\brief Invalid protocol ID (nonzero)
-		\note Only in Modbus TCP
+		\brief Invalid protocol ID (nonzero) or malformed Modbus ASCII frame
+		\note Only in Modbus TCP and Modbus ASCII
 	*/
 	MODBUS_ERROR_BAD_PROTOCOL,
 
@@ -234,7 +239,10 @@ typedef enum ModbusExceptionCode
 	MODBUS_EXCEP_ILLEGAL_VALUE = 3,    //!< Illegal data value
 	MODBUS_EXCEP_SLAVE_FAILURE = 4,    //!< Slave could not process the request
 	MODBUS_EXCEP_ACK = 5,              //!< Acknowledge
-	MODBUS_EXCEP_NACK = 7              //!< Negative acknowledge
+	MODBUS_EXCEP_SLAVE_BUSY = 6,       //!< Slave is busy processing another request
+	MODBUS_EXCEP_NACK = 7,             //!< Negative acknowledge
+	MODBUS_EXCEP_GATEWAY_PATH = 10,    //!< Gateway path unavailable
+	MODBUS_EXCEP_GATEWAY_TARGET = 11   //!< Gateway target device failed to respond
 } ModbusExceptionCode;
 
 /**
@@ -296,6 +304,10 @@ LIGHTMODBUS_WARN_UNUSED ModbusError modbusBufferAllocateADU(ModbusBuffer *buffer
 void modbusBufferFree(ModbusBuffer *buffer, void *context);
 
 uint16_t modbusCRC(const uint8_t *data, uint16_t length);
+uint8_t modbusLRC(const uint8_t *data, uint16_t length);
+void modbusHexEncode(uint8_t *hex, const uint8_t *data, uint16_t length);
+LIGHTMODBUS_WARN_UNUSED uint8_t modbusHexDecode(uint8_t *data, const uint8_t *hex, uint16_t length);
+LIGHTMODBUS_WARN_UNUSED ModbusError modbusBufferPackASCII(ModbusBuffer *buffer, uint8_t address, void *context);
 
 /**
 	\brief Prepares buffer to only store a Modbus PDU
@@ -324,6 +336,18 @@ static inline void modbusBufferModeTCP(ModbusBuffer *buffer)
 	buffer->pduOffset = MODBUS_TCP_PDU_OFFSET;
 }
 
+/**
+	\brief Prepares buffer to store a Modbus ASCII message
+
+	The frame is built in binary form (address, PDU and LRC) and converted
+	to text by modbusBufferPackASCII().
+*/
+static inline void modbusBufferModeASCII(ModbusBuffer *buffer)
+{
+	buffer->padding = MODBUS_ASCII_ADU_PADDING;
+	buffer->pduOffset = MODBUS_ASCII_PDU_OFFSET;
+}
+
 /**
 	\brief Reads n-th bit from an array
 	\param mask A pointer to the array
@@ -411,6 +435,17 @@ static inline uint8_t modbusCheckRangeU16(uint16_t index, uint16_t count)
 	return index > UINT16_MAX - count + 1;
 }
 
+/**
+	\brief Compares two wrapping 32-bit timestamps
+	\param a first timestamp
+	\param b second timestamp
+	\returns signed difference `a - b`, valid as long as the timestamps are less than 2^31 ticks apart
+*/
+LIGHTMODBUS_WARN_UNUSED static inline int32_t modbusTimeDiff(uint32_t a, uint32_t b)
+{
+	return (int32_t)(a - b);
+}
+
 /**
 	\brief Returns uint8_t describing error source of ModbusErrorInfo
 	\returns error source
@@ -606,4 +641,98 @@ LIGHTMODBUS_WARN_UNUSED LIGHTMODBUS_ALWAYS_INLINE static inline ModbusError modb
 	return MODBUS_OK;
 }
 
+/**
+	\brief Returns length of a Modbus ASCII frame
+	\param length Length of the frame before hex encoding (address, PDU and LRC)
+	\returns Length of the frame after hex encoding
+*/
+LIGHTMODBUS_WARN_UNUSED static inline uint16_t modbusASCIILength(uint16_t length)
+{
+	return 2 * length + 3;
+}
+
+/**
+	\brief Unpacks data from a Modbus ASCII frame and optionally checks LRC
+	\param frame Pointer to the frame data
+	\param length Length of the frame (valid range: 9 - 513)
+	\param checkLRC Controls whether the LRC of the frame should be checked
+	\param binary Output buffer for the decoded frame (at least `(length - 3) / 2` bytes)
+	\param pdu Output: pointer to the PDU (inside `binary`)
+	\param pduLength Output: length of the PDU
+	\param address Output: Slave address
+	\returns MODBUS_OK on success
+	\returns MODBUS_ERROR_LENGTH if the length of the frame is invalid
+	\returns MODBUS_ERROR_BAD_PROTOCOL if the frame is not delimited properly or contains
+		invalid characters
+	\returns MODBUS_ERROR_CRC if the LRC is incorrect
+*/
+LIGHTMODBUS_WARN_UNUSED LIGHTMODBUS_ALWAYS_INLINE static inline ModbusError modbusUnpackASCII(
+	const uint8_t *frame,
+	uint16_t length,
+	uint8_t checkLRC,
+	uint8_t *binary,
+	const uint8_t **pdu,
+	uint16_t *pduLength,
+	uint8_t *address)
+{
+	// Check length
+	if (length < MODBUS_ASCII_ADU_MIN || length > MODBUS_ASCII_ADU_MAX || length % 2 == 0)
+		return MODBUS_ERROR_LENGTH;
+
+	// Check delimiters
+	if (frame[0] != ':' || frame[length - 2] != '\r' || frame[length - 1] != '\n')
+		return MODBUS_ERROR_BAD_PROTOCOL;
+
+	uint16_t binaryLength = (length - 3) / 2;
+	if (!modbusHexDecode(binary, frame + 1, binaryLength))
+		return MODBUS_ERROR_BAD_PROTOCOL;
+
+	// Extract address
+	*address = binary[0];
+
+	// Check LRC
+	if (checkLRC && modbusLRC(binary, binaryLength - 1) != binary[binaryLength - 1])
+		return MODBUS_ERROR_CRC;
+
+	*pdu = binary + MODBUS_ASCII_PDU_OFFSET;
+	*pduLength = binaryLength - MODBUS_ASCII_ADU_PADDING;
+
+	return MODBUS_OK;
+}
+
+/**
+	\brief Sets up address and LRC in a Modbus ASCII frame and converts it to text
+	\param frame Pointer to the frame data - address, PDU and space for LRC. The buffer
+		must be able to hold `modbusASCIILength(length)` bytes.
+	\param length Length of the frame before hex encoding (valid range: 3 - 255)
+	\param address Address of the slave
+	\returns MODBUS_OK on success
+	\returns MODBUS_ERROR_LENGTH if the length of the frame is invalid
+*/
+LIGHTMODBUS_WARN_UNUSED LIGHTMODBUS_ALWAYS_INLINE static inline ModbusError modbusPackASCII(
+	uint8_t *frame,
+	uint16_t length,
+	uint8_t address)
+{
+	// Check length
+	if (length < MODBUS_ASCII_ADU_PADDING + MODBUS_PDU_MIN || length > MODBUS_ASCII_ADU_PADDING + MODBUS_PDU_MAX)
+		return MODBUS_ERROR_LENGTH;
+
+	// Write address and LRC
+	frame[0] = address;
+	frame[length - 1] = modbusLRC(frame, length - 1);
+
+	// Move the binary frame right before CR LF and encode it from there.
+	// The encoded data never overwrites bytes which haven't been read yet.
+	uint16_t offset = length + 1;
+	for (uint16_t i = length; i > 0; i--)
+		frame[offset + i - 1] = frame[i - 1];
+
+	modbusHexEncode(frame + 1, frame + offset, length);
+	frame[0] = ':';
+	frame[2 * length + 1] = '\r';
+	frame[2 * length + 2] = '\n';
+	return MODBUS_OK;
+}
+
 #endif
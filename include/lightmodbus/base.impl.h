@@ -3,6 +3,7 @@
 
 #include "base.h"
 #include <stdlib.h>
+#include <string.h>
 
 /**
 	\file base.impl.h
@@ -145,4 +146,194 @@ LIGHTMODBUS_WARN_UNUSED uint16_t modbusCRC(const uint8_t *data, uint16_t length)
 	return crc;
 }
 
+/**
+	\brief Calculates 8-bit Modbus LRC of provided data
+	\param data A pointer to the data to be processed
+	\param length Number of bytes, starting at the `data` pointer, to process
+	\returns 8-bit Modbus LRC value (two's complement of the sum of all bytes)
+*/
+LIGHTMODBUS_WARN_UNUSED uint8_t modbusLRC(const uint8_t *data, uint16_t length)
+{
+	uint8_t sum = 0;
+	for (uint16_t i = 0; i < length; i++)
+		sum += data[i];
+
+	return (uint8_t)(-sum);
+}
+
+/*
+	Hex digits are processed 8 at a time in 64-bit words on 64-bit little-endian hosts
+*/
+#if UINTPTR_MAX > 0xffffffffu && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define LIGHTMODBUS_HEX_SWAR
+#endif
+
+#ifdef LIGHTMODBUS_HEX_SWAR
+/**
+	\brief Encodes 4 bytes as 8 uppercase hex digits (little-endian in and out)
+*/
+LIGHTMODBUS_ALWAYS_INLINE static inline uint64_t modbusHexEncodeWord(uint32_t x)
+{
+	// Spread nibbles into separate bytes - high nibble first
+	uint64_t t = x;
+	t = (t | (t << 16)) & 0x0000ffff0000ffffull;
+	t = (t | (t << 8)) & 0x00ff00ff00ff00ffull;
+	uint64_t v = ((t >> 4) & 0x000f000f000f000full) | ((t & 0x000f000f000f000full) << 8);
+
+	// '0' + n, plus 7 for n >= 10
+	uint64_t letters = ((v + 0x0606060606060606ull) >> 4) & 0x0101010101010101ull;
+	return v + 0x3030303030303030ull + letters * 7;
+}
+
+/**
+	\brief Decodes 8 hex digits into 4 bytes (little-endian in and out)
+	\param bad Output: nonzero if any of the characters is not a hex digit
+*/
+LIGHTMODBUS_ALWAYS_INLINE static inline uint32_t modbusHexDecodeWord(uint64_t v, uint64_t *bad)
+{
+	const uint64_t ones = 0x0101010101010101ull;
+	const uint64_t high = 0x8080808080808080ull;
+
+	// Per-byte range checks - the high bit is set where `byte >= c`
+	uint64_t lower = v | 0x2020202020202020ull;
+	uint64_t digit = (v + ones * (0x80 - '0')) & ~(v + ones * (0x80 - '9' - 1));
+	uint64_t alpha = (lower + ones * (0x80 - 'a')) & ~(lower + ones * (0x80 - 'f' - 1));
+	*bad = (v | ~(digit | alpha)) & high;
+
+	// Nibble values and packing nibble pairs into bytes
+	uint64_t n = (v & 0x0f0f0f0f0f0f0f0full) + ((alpha & high) >> 7) * 9;
+	uint64_t w = ((n & 0x00ff00ff00ff00ffull) << 4) | ((n >> 8) & 0x00ff00ff00ff00ffull);
+	w = (w | (w >> 8)) & 0x0000ffff0000ffffull;
+	w = (w | (w >> 16)) & 0xffffffffull;
+	return (uint32_t) w;
+}
+#endif
+
+/**
+	\brief Returns value of a hex digit or 0xff if the character is not a hex digit
+*/
+static inline uint8_t modbusHexDigit(uint8_t c)
+{
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	return 0xff;
+}
+
+/**
+	\brief Encodes binary data as uppercase hex digits
+	\param hex Output buffer for `2 * length` characters
+	\param data Data to be encoded
+	\param length Number of bytes to encode
+
+	On 64-bit little-endian hosts 16 bytes are encoded at a time. `hex` may overlap `data`
+	as long as `data` is located at least `length` bytes after `hex`.
+*/
+void modbusHexEncode(uint8_t *hex, const uint8_t *data, uint16_t length)
+{
+	uint16_t i = 0;
+
+#ifdef LIGHTMODBUS_HEX_SWAR
+	for (; i + 16 <= length; i += 16)
+	{
+		// All input bytes are loaded before anything is stored
+		uint64_t a, b, v;
+		memcpy(&a, data + i, 8);
+		memcpy(&b, data + i + 8, 8);
+		v = modbusHexEncodeWord((uint32_t) a);
+		memcpy(hex + 2 * i, &v, 8);
+		v = modbusHexEncodeWord((uint32_t)(a >> 32));
+		memcpy(hex + 2 * i + 8, &v, 8);
+		v = modbusHexEncodeWord((uint32_t) b);
+		memcpy(hex + 2 * i + 16, &v, 8);
+		v = modbusHexEncodeWord((uint32_t)(b >> 32));
+		memcpy(hex + 2 * i + 24, &v, 8);
+	}
+#endif
+
+	for (; i < length; i++)
+	{
+		uint8_t b = data[i];
+		hex[2 * i] = "0123456789ABCDEF"[b >> 4];
+		hex[2 * i + 1] = "0123456789ABCDEF"[b & 15];
+	}
+}
+
+/**
+	\brief Decodes hex digits (either case) into binary data
+	\param data Output buffer for `length` bytes
+	\param hex Characters to be decoded
+	\param length Number of bytes to decode (`2 * length` characters are read)
+	\returns 0 if any of the characters is not a hex digit, 1 otherwise
+
+	On 64-bit little-endian hosts 16 bytes are decoded at a time. `data` may overlap `hex`
+	as long as it doesn't start after `hex`.
+*/
+LIGHTMODBUS_WARN_UNUSED uint8_t modbusHexDecode(uint8_t *data, const uint8_t *hex, uint16_t length)
+{
+	uint16_t i = 0;
+
+#ifdef LIGHTMODBUS_HEX_SWAR
+	for (; i + 16 <= length; i += 16)
+	{
+		uint64_t v0, v1, v2, v3, b0, b1, b2, b3;
+		memcpy(&v0, hex + 2 * i, 8);
+		memcpy(&v1, hex + 2 * i + 8, 8);
+		memcpy(&v2, hex + 2 * i + 16, 8);
+		memcpy(&v3, hex + 2 * i + 24, 8);
+		uint64_t a = modbusHexDecodeWord(v0, &b0) | ((uint64_t) modbusHexDecodeWord(v1, &b1) << 32);
+		uint64_t b = modbusHexDecodeWord(v2, &b2) | ((uint64_t) modbusHexDecodeWord(v3, &b3) << 32);
+		if (b0 | b1 | b2 | b3)
+			return 0;
+
+		memcpy(data + i, &a, 8);
+		memcpy(data + i + 8, &b, 8);
+	}
+#endif
+
+	for (; i < length; i++)
+	{
+		uint8_t hi = modbusHexDigit(hex[2 * i]);
+		uint8_t lo = modbusHexDigit(hex[2 * i + 1]);
+		if (hi == 0xff || lo == 0xff)
+			return 0;
+
+		data[i] = (uint8_t)((hi << 4) | lo);
+	}
+
+	return 1;
+}
+
+/**
+	\brief Converts a Modbus ASCII frame built in the buffer to text
+	\param address Slave address
+	\param context context pointer passed on to the allocator
+	\returns MODBUS_ERROR_LENGTH if the length of the frame is invalid
+	\returns MODBUS_ERROR_ALLOC on allocation failure
+	\returns MODBUS_OK on success
+
+	The buffer must be in ASCII mode (see modbusBufferModeASCII()) and hold
+	the complete frame. It's reallocated to `modbusASCIILength(buffer->length)`
+	bytes, so the allocator must preserve the buffer contents (like `realloc()` does).
+*/
+LIGHTMODBUS_WARN_UNUSED ModbusError modbusBufferPackASCII(ModbusBuffer *buffer, uint8_t address, void *context)
+{
+	uint16_t length = buffer->length;
+	if (length < MODBUS_ASCII_ADU_PADDING + MODBUS_PDU_MIN || length > MODBUS_ASCII_ADU_PADDING + MODBUS_PDU_MAX)
+		return MODBUS_ERROR_LENGTH;
+
+	ModbusError err = buffer->allocator(buffer, modbusASCIILength(length), context);
+	if (err != MODBUS_OK)
+	{
+		buffer->data = NULL;
+		buffer->pdu  = NULL;
+		buffer->length = 0;
+		return err;
+	}
+
+	buffer->pdu = buffer->data + buffer->pduOffset;
+	buffer->length = modbusASCIILength(length);
+	return modbusPackASCII(buffer->data, length, address);
+}
+
 #endif
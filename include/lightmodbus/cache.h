@@ -0,0 +1,117 @@
+#ifndef LIGHTMODBUS_CACHE_H
+#define LIGHTMODBUS_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "base.h"
+
+/**
+	\file cache.h
+	\brief Cache of read responses for gateways and proxies (header)
+*/
+
+/**
+	\brief Block of registers/coils of a single slave whose read responses can be cached
+
+	Reads falling entirely within the range are cached for \ref ttl.
+*/
+typedef struct ModbusCacheRange
+{
+	uint8_t address;  //!< Slave address
+	uint8_t function; //!< Read function (1-4)
+	uint16_t index;   //!< Index of the first register/coil
+	uint16_t count;   //!< Number of registers/coils
+	uint32_t ttl;     //!< Time for which responses are served from the cache
+} ModbusCacheRange;
+
+/**
+	\brief A cached response PDU and the read it answers
+*/
+typedef struct ModbusCacheEntry
+{
+	uint8_t valid;    //!< Whether the entry holds a response
+	uint8_t address;  //!< Slave address
+	uint8_t function; //!< Read function
+	uint16_t index;   //!< Index of the first register/coil read
+	uint16_t count;   //!< Number of registers/coils read
+	uint32_t expires; //!< Time after which the response is stale
+
+	uint8_t length;               //!< Length of the response PDU
+	uint8_t pdu[MODBUS_PDU_MAX]; //!< Response PDU
+} ModbusCacheEntry;
+
+/**
+	\brief Serves repeated reads from memory
+
+	Entries are keyed on slave address, function, index and count of the read.
+	Write requests passing through invalidate all entries overlapping the written
+	registers/coils. Timestamps are allowed to wrap around.
+
+	\see modbusResponseCacheInit()
+	\see modbusResponseCacheLookup()
+	\see modbusResponseCacheStore()
+	\see modbusResponseCacheInvalidate()
+*/
+typedef struct ModbusResponseCache
+{
+	const ModbusCacheRange *ranges; //!< A non-owning pointer to array of cacheable ranges
+	uint16_t rangeCount;            //!< Size of \ref ranges array
+	ModbusCacheEntry *entries;      //!< A non-owning pointer to array of entries
+	uint16_t entryCount;            //!< Size of \ref entries array
+
+	uint32_t hits;          //!< Number of reads served from the cache
+	uint32_t misses;        //!< Number of cacheable reads not found in the cache
+	uint32_t stores;        //!< Number of responses stored
+	uint32_t invalidations; //!< Number of entries invalidated by writes
+} ModbusResponseCache;
+
+LIGHTMODBUS_RET_ERROR modbusResponseCacheInit(
+	ModbusResponseCache *cache,
+	const ModbusCacheRange *ranges,
+	uint16_t rangeCount,
+	ModbusCacheEntry *entries,
+	uint16_t entryCount);
+
+void modbusResponseCacheClear(ModbusResponseCache *cache);
+
+LIGHTMODBUS_WARN_UNUSED uint8_t modbusResponseCacheLookup(
+	ModbusResponseCache *cache,
+	uint8_t address,
+	const uint8_t *requestPDU,
+	uint8_t requestLength,
+	uint32_t now,
+	const uint8_t **responsePDU,
+	uint8_t *responseLength);
+
+void modbusResponseCacheStore(
+	ModbusResponseCache *cache,
+	uint8_t address,
+	const uint8_t *requestPDU,
+	uint8_t requestLength,
+	const uint8_t *responsePDU,
+	uint8_t responseLength,
+	uint32_t now);
+
+void modbusResponseCacheInvalidate(
+	ModbusResponseCache *cache,
+	uint8_t address,
+	const uint8_t *requestPDU,
+	uint8_t requestLength);
+
+LIGHTMODBUS_WARN_UNUSED uint8_t modbusResponseCacheLookupTCP(
+	ModbusResponseCache *cache,
+	const uint8_t *request,
+	uint16_t requestLength,
+	uint32_t now,
+	uint8_t *response,
+	uint16_t *responseLength);
+
+void modbusResponseCacheStoreTCP(
+	ModbusResponseCache *cache,
+	const uint8_t *request,
+	uint16_t requestLength,
+	const uint8_t *response,
+	uint16_t responseLength,
+	uint32_t now);
+
+#endif
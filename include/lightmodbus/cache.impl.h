@@ -0,0 +1,395 @@
+#ifndef LIGHTMODBUS_CACHE_IMPL_H
+#define LIGHTMODBUS_CACHE_IMPL_H
+
+#include "cache.h"
+
+/**
+	\file cache.impl.h
+	\brief Cache of read responses for gateways and proxies (implementation)
+*/
+
+/**
+	\brief Initializes a ModbusResponseCache struct
+	\param cache ModbusResponseCache struct to be initialized
+	\param ranges Pointer to an array of cacheable ranges. Reads outside of them are never cached.
+		The lifetime of this array must not be shorter than the lifetime of the cache.
+	\param rangeCount Number of elements in the `ranges` array
+	\param entries Pointer to an array of entries (required). Its size limits the number of
+		responses cached at once. The lifetime of this array must not be shorter than the lifetime
+		of the cache.
+	\param entryCount Number of elements in the `entries` array
+	\returns MODBUS_GENERAL_ERROR(VALUE) if there are no entries, or if any of the ranges is empty,
+		exceeds the register space or has a function other than 1-4
+	\returns MODBUS_NO_ERROR() on success
+*/
+LIGHTMODBUS_RET_ERROR modbusResponseCacheInit(
+	ModbusResponseCache *cache,
+	const ModbusCacheRange *ranges,
+	uint16_t rangeCount,
+	ModbusCacheEntry *entries,
+	uint16_t entryCount)
+{
+	if (!entries || !entryCount)
+		return MODBUS_GENERAL_ERROR(VALUE);
+
+	for (uint16_t i = 0; i < rangeCount; i++)
+	{
+		const ModbusCacheRange *r = &ranges[i];
+		if (!r->count || (uint32_t) r->index + r->count > 0x10000 || r->function < 1 || r->function > 4)
+			return MODBUS_GENERAL_ERROR(VALUE);
+	}
+
+	cache->ranges = ranges;
+	cache->rangeCount = rangeCount;
+	cache->entries = entries;
+	cache->entryCount = entryCount;
+	modbusResponseCacheClear(cache);
+	return MODBUS_NO_ERROR();
+}
+
+/**
+	\brief Forgets all cached responses (e.g. after reconnecting to the slaves)
+	\note Statistics are reset as well
+*/
+void modbusResponseCacheClear(ModbusResponseCache *cache)
+{
+	for (uint16_t i = 0; i < cache->entryCount; i++)
+		cache->entries[i].valid = 0;
+
+	cache->hits = 0;
+	cache->misses = 0;
+	cache->stores = 0;
+	cache->invalidations = 0;
+}
+
+/**
+	\brief Extracts function, index and count of a read request PDU
+	\returns 1 if the PDU is a well-formed read request (functions 1-4)
+*/
+static inline uint8_t modbusResponseCacheParseRead(
+	const uint8_t *pdu,
+	uint8_t length,
+	uint16_t *index,
+	uint16_t *count)
+{
+	if (length != 5 || pdu[0] < 1 || pdu[0] > 4)
+		return 0;
+
+	*index = modbusRBE(&pdu[1]);
+	*count = modbusRBE(&pdu[3]);
+	return *count && (uint32_t) *index + *count <= 0x10000;
+}
+
+/**
+	\brief Returns TTL of the range containing the read, or 0 if there's none
+*/
+static inline uint32_t modbusResponseCacheTTL(
+	const ModbusResponseCache *cache,
+	uint8_t address,
+	uint8_t function,
+	uint16_t index,
+	uint16_t count)
+{
+	for (uint16_t i = 0; i < cache->rangeCount; i++)
+	{
+		const ModbusCacheRange *r = &cache->ranges[i];
+		if (r->address == address
+			&& r->function == function
+			&& index >= r->index
+			&& (uint32_t) index + count <= (uint32_t) r->index + r->count)
+			return r->ttl;
+	}
+
+	return 0;
+}
+
+/**
+	\brief Finds a fresh response to the given read request
+	\param address Slave address the request is sent to
+	\param requestPDU Request PDU
+	\param requestLength Length of the request PDU
+	\param now Current time
+	\param responsePDU Output: pointer to the cached response PDU, valid until the cache is
+		modified
+	\param responseLength Output: length of the response PDU
+	\returns 1 if the response has been found
+
+	Write requests (and all other requests that aren't reads) invalidate cached
+	responses like modbusResponseCacheInvalidate() does, and are never served from
+	the cache. Only reads within one of the cacheable ranges count as hits or misses.
+*/
+LIGHTMODBUS_WARN_UNUSED uint8_t modbusResponseCacheLookup(
+	ModbusResponseCache *cache,
+	uint8_t address,
+	const uint8_t *requestPDU,
+	uint8_t requestLength,
+	uint32_t now,
+	const uint8_t **responsePDU,
+	uint8_t *responseLength)
+{
+	*responsePDU = NULL;
+	*responseLength = 0;
+
+	uint16_t index, count;
+	if (!requestLength || requestPDU[0] < 1 || requestPDU[0] > 4)
+	{
+		modbusResponseCacheInvalidate(cache, address, requestPDU, requestLength);
+		return 0;
+	}
+
+	if (!modbusResponseCacheParseRead(requestPDU, requestLength, &index, &count)
+		|| !modbusResponseCacheTTL(cache, address, requestPDU[0], index, count))
+		return 0;
+
+	for (uint16_t i = 0; i < cache->entryCount; i++)
+	{
+		ModbusCacheEntry *e = &cache->entries[i];
+		if (e->valid
+			&& e->address == address
+			&& e->function == requestPDU[0]
+			&& e->index == index
+			&& e->count == count)
+		{
+			if (modbusTimeDiff(now, e->expires) >= 0)
+			{
+				e->valid = 0;
+				break;
+			}
+
+			*responsePDU = e->pdu;
+			*responseLength = e->length;
+			cache->hits++;
+			return 1;
+		}
+	}
+
+	cache->misses++;
+	return 0;
+}
+
+/**
+	\brief Stores a response to a read request
+	\param address Slave address the request was sent to
+	\param requestPDU Request PDU
+	\param requestLength Length of the request PDU
+	\param responsePDU Response PDU
+	\param responseLength Length of the response PDU
+	\param now Current time
+
+	Only valid (non-exception) responses to reads within one of the cacheable
+	ranges are stored. When there's no free entry, the one closest to expiring
+	is replaced.
+*/
+void modbusResponseCacheStore(
+	ModbusResponseCache *cache,
+	uint8_t address,
+	const uint8_t *requestPDU,
+	uint8_t requestLength,
+	const uint8_t *responsePDU,
+	uint8_t responseLength,
+	uint32_t now)
+{
+	uint16_t index, count;
+	if (!modbusResponseCacheParseRead(requestPDU, requestLength, &index, &count))
+		return;
+
+	uint32_t ttl = modbusResponseCacheTTL(cache, address, requestPDU[0], index, count);
+	if (!ttl)
+		return;
+
+	// The response must match the request
+	uint8_t function = requestPDU[0];
+	uint32_t bytes = function <= 2 ? modbusBitsToBytes(count) : (uint32_t) count * 2;
+	if (responseLength < 2
+		|| responsePDU[0] != function
+		|| responsePDU[1] != bytes
+		|| responseLength != 2 + bytes)
+		return;
+
+	// Same read, free entry or the one closest to expiring
+	ModbusCacheEntry *e = &cache->entries[0];
+	for (uint16_t i = 0; i < cache->entryCount; i++)
+	{
+		ModbusCacheEntry *c = &cache->entries[i];
+		if (c->valid
+			&& c->address == address
+			&& c->function == function
+			&& c->index == index
+			&& c->count == count)
+		{
+			e = c;
+			break;
+		}
+
+		if (e->valid && (!c->valid || modbusTimeDiff(c->expires, e->expires) < 0))
+			e = c;
+	}
+
+	e->valid = 1;
+	e->address = address;
+	e->function = function;
+	e->index = index;
+	e->count = count;
+	e->expires = now + ttl;
+	e->length = responseLength;
+	for (uint8_t i = 0; i < responseLength; i++)
+		e->pdu[i] = responsePDU[i];
+	cache->stores++;
+}
+
+/**
+	\brief Invalidates cached responses affected by a write request
+	\param address Slave address the request is sent to (0 for broadcast affects all slaves)
+	\param requestPDU Request PDU
+	\param requestLength Length of the request PDU
+
+	Writes of coils (05, 15) invalidate cached reads of coils (01) and writes of
+	holding registers (06, 16, 22) invalidate cached reads of holding registers (03)
+	overlapping the written ones. Any other request, except for reads, invalidates
+	all responses of the slave, as its effect is unknown.
+
+	This function should be called both when a write request is sent and when
+	its response arrives (or doesn't). This doesn't stop a read that was
+	already in flight when the write was sent from storing values from before
+	the write - responses to reads shouldn't be stored while a write to the
+	same slave is pending.
+*/
+void modbusResponseCacheInvalidate(
+	ModbusResponseCache *cache,
+	uint8_t address,
+	const uint8_t *requestPDU,
+	uint8_t requestLength)
+{
+	uint8_t function = 0;
+	uint16_t index = 0;
+	uint32_t count = 0x10000;
+
+	if (requestLength)
+	{
+		switch (requestPDU[0])
+		{
+			// Reads don't change anything
+			case 1:
+			case 2:
+			case 3:
+			case 4:
+				return;
+
+			case 5:
+			case 6:
+			case 22:
+				if (requestLength >= 3)
+				{
+					function = requestPDU[0] == 5 ? 1 : 3;
+					index = modbusRBE(&requestPDU[1]);
+					count = 1;
+				}
+				break;
+
+			case 15:
+			case 16:
+				if (requestLength >= 5)
+				{
+					function = requestPDU[0] == 15 ? 1 : 3;
+					index = modbusRBE(&requestPDU[1]);
+					count = modbusRBE(&requestPDU[3]);
+				}
+				break;
+
+			default:
+				break;
+		}
+	}
+
+	for (uint16_t i = 0; i < cache->entryCount; i++)
+	{
+		ModbusCacheEntry *e = &cache->entries[i];
+		if (e->valid
+			&& (!address || e->address == address)
+			&& (!function || e->function == function)
+			&& (uint32_t) e->index + e->count > index
+			&& e->index < (uint32_t) index + count)
+		{
+			e->valid = 0;
+			cache->invalidations++;
+		}
+	}
+}
+
+/**
+	\brief Looks up a response to a Modbus TCP request
+	\param request Request frame (ADU)
+	\param requestLength Length of the request frame
+	\param now Current time
+	\param response Output: buffer for the response frame, at least \ref MODBUS_TCP_ADU_MAX bytes
+	\param responseLength Output: length of the response frame
+	\returns 1 if the response has been found. It carries the transaction ID of the request.
+
+	\see modbusResponseCacheLookup()
+*/
+LIGHTMODBUS_WARN_UNUSED uint8_t modbusResponseCacheLookupTCP(
+	ModbusResponseCache *cache,
+	const uint8_t *request,
+	uint16_t requestLength,
+	uint32_t now,
+	uint8_t *response,
+	uint16_t *responseLength)
+{
+	*responseLength = 0;
+	if (requestLength < MODBUS_TCP_ADU_MIN || requestLength > MODBUS_TCP_ADU_MAX)
+		return 0;
+
+	const uint8_t *pdu;
+	uint8_t length;
+	if (!modbusResponseCacheLookup(cache, request[6], &request[7], (uint8_t)(requestLength - 7), now, &pdu, &length))
+		return 0;
+
+	// Transaction ID and protocol ID are taken from the request
+	for (uint8_t i = 0; i < 4; i++)
+		response[i] = request[i];
+	modbusWBE(&response[4], (uint16_t)(length + 1));
+	response[6] = request[6];
+	for (uint8_t i = 0; i < length; i++)
+		response[7 + i] = pdu[i];
+
+	*responseLength = (uint16_t)(length + 7);
+	return 1;
+}
+
+/**
+	\brief Stores a response to a Modbus TCP request
+	\param request Request frame (ADU)
+	\param requestLength Length of the request frame
+	\param response Response frame (ADU)
+	\param responseLength Length of the response frame
+	\param now Current time
+
+	The response is ignored if its transaction ID or unit ID don't match the request.
+
+	\see modbusResponseCacheStore()
+*/
+void modbusResponseCacheStoreTCP(
+	ModbusResponseCache *cache,
+	const uint8_t *request,
+	uint16_t requestLength,
+	const uint8_t *response,
+	uint16_t responseLength,
+	uint32_t now)
+{
+	if (requestLength < MODBUS_TCP_ADU_MIN || requestLength > MODBUS_TCP_ADU_MAX
+		|| responseLength < MODBUS_TCP_ADU_MIN || responseLength > MODBUS_TCP_ADU_MAX
+		|| modbusRBE(&request[0]) != modbusRBE(&response[0])
+		|| request[6] != response[6])
+		return;
+
+	modbusResponseCacheStore(
+		cache,
+		request[6],
+		&request[7],
+		(uint8_t)(requestLength - 7),
+		&response[7],
+		(uint8_t)(responseLength - 7),
+		now);
+}
+
+#endif
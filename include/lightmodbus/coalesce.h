@@ -0,0 +1,165 @@
+#ifndef LIGHTMODBUS_COALESCE_H
+#define LIGHTMODBUS_COALESCE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "base.h"
+#include "master.h"
+
+/**
+	\file coalesce.h
+	\brief Coalescing of single coil/register writes for master (header)
+*/
+
+typedef struct ModbusWriteCoalescer ModbusWriteCoalescer;
+
+/**
+	\brief Frame format used by the write coalescer
+*/
+typedef enum ModbusCoalesceFormat
+{
+	MODBUS_COALESCE_PDU = 0, //!< PDU-only frames
+	MODBUS_COALESCE_RTU,     //!< Modbus RTU frames
+	MODBUS_COALESCE_TCP      //!< Modbus TCP frames
+} ModbusCoalesceFormat;
+
+/**
+	\brief State of a write slot
+*/
+typedef enum ModbusWriteState
+{
+	MODBUS_WRITE_FREE = 0, //!< The slot is unused
+	MODBUS_WRITE_QUEUED,   //!< The write waits for its request to be sent
+	MODBUS_WRITE_SENT      //!< The write is a part of the request awaiting response
+} ModbusWriteState;
+
+/**
+	\brief Outcome of a write passed to the completion callback
+*/
+typedef enum ModbusWriteResult
+{
+	MODBUS_WRITE_OK = 0,    //!< The slave has confirmed the write
+	MODBUS_WRITE_EXCEPTION, //!< The slave has responded with an exception
+	MODBUS_WRITE_ERROR,     //!< The request couldn't be built or sent, or the response is invalid
+	MODBUS_WRITE_TIMEOUT    //!< The slave hasn't responded in time
+} ModbusWriteResult;
+
+/**
+	\brief A single coil/holding register write
+*/
+typedef struct ModbusPendingWrite
+{
+	ModbusWriteState state; //!< State of the slot
+	uint8_t superseded;     //!< Nonzero if a later write to the same coil/register has replaced the value
+	uint8_t address;        //!< Slave address or unit ID
+	ModbusDataType type;    //!< \ref MODBUS_COIL or \ref MODBUS_HOLDING_REGISTER
+	uint16_t index;         //!< Index of the coil/register
+	uint16_t value;         //!< New value (any nonzero value sets a coil)
+	uint32_t due;           //!< Time by which the write should be sent
+	void *context;          //!< User's context pointer
+} ModbusPendingWrite;
+
+/**
+	\brief A pointer to a callback used to send requests built by the coalescer
+	\returns MODBUS_OK if the request was sent
+*/
+typedef ModbusError (*ModbusCoalesceTransportCallback)(
+	ModbusWriteCoalescer *coalescer,
+	const uint8_t *frame,
+	uint16_t length);
+
+/**
+	\brief A pointer to a callback called once for each write when the request containing it completes
+	\param exceptionCode Exception code returned by the slave (only with \ref MODBUS_WRITE_EXCEPTION)
+*/
+typedef void (*ModbusWriteCallback)(
+	ModbusWriteCoalescer *coalescer,
+	const ModbusPendingWrite *write,
+	ModbusWriteResult result,
+	ModbusExceptionCode exceptionCode);
+
+/**
+	\brief Merges bursts of single writes into multiple write requests
+
+	Writes are queued for up to \ref window. Once the oldest write is due, it is
+	sent together with all queued writes of the same slave and type to adjacent
+	coils/registers as a single request 15/16 (or 05/06 if there's only one).
+	If the same coil/register is written more than once before the request is
+	sent, the last value wins. Each write is completed via the callback when the
+	request containing it completes.
+
+	As with the polling scheduler, at most one request is in flight and responses
+	are passed back with modbusWriteCoalescerParseResponse(). Timestamps are in
+	arbitrary units and are allowed to wrap around.
+
+	\see modbusWriteCoalescerInit()
+*/
+struct ModbusWriteCoalescer
+{
+	ModbusMaster *master;                   //!< A non-owning pointer to master used to build requests and parse responses
+	ModbusCoalesceTransportCallback transport; //!< A pointer to the transport callback (required)
+	ModbusWriteCallback callback;           //!< A pointer to the completion callback (optional)
+	ModbusCoalesceFormat format;               //!< Frame format of the requests
+
+	ModbusPendingWrite *writes; //!< A non-owning pointer to array of write slots
+	uint16_t capacity;          //!< Size of \ref writes array
+	uint16_t count;             //!< Number of queued and sent writes
+
+	uint32_t window;          //!< Time for which writes are held back to be merged with others
+	uint32_t timeout;         //!< Time after which a request is considered lost
+	uint8_t pending;          //!< Nonzero if a request awaits response
+	uint8_t pendingAddress;   //!< Slave address of the pending request
+	uint32_t pendingSince;    //!< Time at which the pending request was sent
+	uint16_t transactionID;   //!< Next Modbus TCP transaction ID
+
+	uint32_t writesAdded;  //!< Number of writes added
+	uint32_t requestsSent; //!< Number of requests sent
+	void *context;         //!< User's context pointer
+};
+
+LIGHTMODBUS_RET_ERROR modbusWriteCoalescerInit(
+	ModbusWriteCoalescer *coalescer,
+	ModbusMaster *master,
+	ModbusCoalesceFormat format,
+	ModbusCoalesceTransportCallback transport,
+	ModbusWriteCallback callback,
+	ModbusPendingWrite *writes,
+	uint16_t capacity,
+	uint32_t window,
+	uint32_t timeout);
+
+LIGHTMODBUS_RET_ERROR modbusWriteCoalescerAdd(
+	ModbusWriteCoalescer *coalescer,
+	uint8_t address,
+	ModbusDataType type,
+	uint16_t index,
+	uint16_t value,
+	void *context,
+	uint32_t now);
+
+LIGHTMODBUS_RET_ERROR modbusWriteCoalescerRun(ModbusWriteCoalescer *coalescer, uint32_t now);
+
+LIGHTMODBUS_RET_ERROR modbusWriteCoalescerParseResponse(
+	ModbusWriteCoalescer *coalescer,
+	const uint8_t *response,
+	uint16_t responseLength);
+
+uint8_t modbusWriteCoalescerNextWakeup(const ModbusWriteCoalescer *coalescer, uint32_t *wakeup);
+
+/**
+	\brief Allows user to set the custom context pointer
+*/
+static inline void modbusWriteCoalescerSetUserPointer(ModbusWriteCoalescer *coalescer, void *ptr)
+{
+	coalescer->context = ptr;
+}
+
+/**
+	\brief Retreieves the custom context pointer
+*/
+static inline void *modbusWriteCoalescerGetUserPointer(const ModbusWriteCoalescer *coalescer)
+{
+	return coalescer->context;
+}
+
+#endif
@@ -0,0 +1,403 @@
+#ifndef LIGHTMODBUS_COALESCE_IMPL_H
+#define LIGHTMODBUS_COALESCE_IMPL_H
+
+#include "coalesce.h"
+#include "master_func.h"
+
+/**
+	\file coalesce.impl.h
+	\brief Coalescing of single coil/register writes for master (implementation)
+*/
+
+/**
+	\brief Initializes a ModbusWriteCoalescer struct
+	\param coalescer ModbusWriteCoalescer struct to be initialized
+	\param master Master used to build requests and parse responses (required).
+		It must not be used for other requests while the coalescer is running.
+	\param format Frame format of the requests
+	\param transport Callback used to send the requests (required)
+	\param callback Callback called when a write completes (optional)
+	\param writes Pointer to an array of write slots (required). Its size limits the
+		number of writes queued at once. The lifetime of this array must not be shorter
+		than the lifetime of the coalescer.
+	\param capacity Number of elements in the `writes` array
+	\param window Time for which writes are held back to be merged with others
+	\param timeout Time after which a request is considered lost
+	\returns MODBUS_GENERAL_ERROR(VALUE) if there are no write slots
+	\returns MODBUS_NO_ERROR() on success
+*/
+LIGHTMODBUS_RET_ERROR modbusWriteCoalescerInit(
+	ModbusWriteCoalescer *coalescer,
+	ModbusMaster *master,
+	ModbusCoalesceFormat format,
+	ModbusCoalesceTransportCallback transport,
+	ModbusWriteCallback callback,
+	ModbusPendingWrite *writes,
+	uint16_t capacity,
+	uint32_t window,
+	uint32_t timeout)
+{
+	if (!writes || !capacity)
+		return MODBUS_GENERAL_ERROR(VALUE);
+
+	for (uint16_t i = 0; i < capacity; i++)
+		writes[i].state = MODBUS_WRITE_FREE;
+
+	coalescer->master = master;
+	coalescer->transport = transport;
+	coalescer->callback = callback;
+	coalescer->format = format;
+	coalescer->writes = writes;
+	coalescer->capacity = capacity;
+	coalescer->count = 0;
+	coalescer->window = window;
+	coalescer->timeout = timeout;
+	coalescer->pending = 0;
+	coalescer->pendingAddress = 0;
+	coalescer->pendingSince = 0;
+	coalescer->transactionID = 0;
+	coalescer->writesAdded = 0;
+	coalescer->requestsSent = 0;
+	coalescer->context = NULL;
+	return MODBUS_NO_ERROR();
+}
+
+/**
+	\brief Queues a write of a single coil or holding register
+	\param address Slave address or unit ID
+	\param type \ref MODBUS_COIL or \ref MODBUS_HOLDING_REGISTER
+	\param index Index of the coil/register
+	\param value New value (any nonzero value sets a coil)
+	\param context User's context pointer passed back to the callback with the write
+	\param now Current time. The write is sent no later than \ref ModbusWriteCoalescer::window from now.
+	\returns MODBUS_GENERAL_ERROR(VALUE) if `type` is neither a coil nor a holding register
+	\returns MODBUS_GENERAL_ERROR(ADDRESS) if `address` is 0 in Modbus RTU mode (broadcasts
+		aren't responded to)
+	\returns MODBUS_GENERAL_ERROR(ALLOC) if all write slots are in use
+	\returns MODBUS_NO_ERROR() on success
+
+	A queued write to the same coil/register is superseded - its value is replaced,
+	but it is still completed along with the new one.
+*/
+LIGHTMODBUS_RET_ERROR modbusWriteCoalescerAdd(
+	ModbusWriteCoalescer *coalescer,
+	uint8_t address,
+	ModbusDataType type,
+	uint16_t index,
+	uint16_t value,
+	void *context,
+	uint32_t now)
+{
+	if (type != MODBUS_COIL && type != MODBUS_HOLDING_REGISTER)
+		return MODBUS_GENERAL_ERROR(VALUE);
+
+	if (!address && coalescer->format == MODBUS_COALESCE_RTU)
+		return MODBUS_GENERAL_ERROR(ADDRESS);
+
+	ModbusPendingWrite *slot = NULL;
+	for (uint16_t i = 0; i < coalescer->capacity && !slot; i++)
+		if (coalescer->writes[i].state == MODBUS_WRITE_FREE)
+			slot = &coalescer->writes[i];
+
+	if (!slot)
+		return MODBUS_GENERAL_ERROR(ALLOC);
+
+	// Last write wins
+	for (uint16_t i = 0; i < coalescer->capacity; i++)
+	{
+		ModbusPendingWrite *w = &coalescer->writes[i];
+		if (w->state == MODBUS_WRITE_QUEUED
+			&& w->address == address
+			&& w->type == type
+			&& w->index == index)
+			w->superseded = 1;
+	}
+
+	slot->state = MODBUS_WRITE_QUEUED;
+	slot->superseded = 0;
+	slot->address = address;
+	slot->type = type;
+	slot->index = index;
+	slot->value = value;
+	slot->due = now + coalescer->window;
+	slot->context = context;
+	coalescer->count++;
+	coalescer->writesAdded++;
+	return MODBUS_NO_ERROR();
+}
+
+/**
+	\brief Completes all writes of the pending request and frees their slots
+*/
+static void modbusWriteCoalescerComplete(
+	ModbusWriteCoalescer *coalescer,
+	ModbusWriteResult result,
+	ModbusExceptionCode exceptionCode)
+{
+	coalescer->pending = 0;
+	modbusMasterFreeRequest(coalescer->master);
+
+	for (uint16_t i = 0; i < coalescer->capacity; i++)
+	{
+		ModbusPendingWrite *w = &coalescer->writes[i];
+		if (w->state != MODBUS_WRITE_SENT)
+			continue;
+
+		// The slot can be reused by the callback
+		ModbusPendingWrite write = *w;
+		w->state = MODBUS_WRITE_FREE;
+		coalescer->count--;
+		if (coalescer->callback)
+			coalescer->callback(coalescer, &write, result, exceptionCode);
+	}
+}
+
+/**
+	\brief Sends the due writes if no request is pending and handles timeouts
+	\param now Current time
+	\returns MODBUS_GENERAL_ERROR(OTHER) if the transport callback fails
+	\returns Any error returned while building the request
+	\returns MODBUS_NO_ERROR() if a request was sent or there was nothing to do
+
+	The writes of a request that couldn't be built or sent are completed
+	with \ref MODBUS_WRITE_ERROR. This function should be called whenever
+	the time returned by modbusWriteCoalescerNextWakeup() is reached, after
+	each response and after adding writes.
+*/
+LIGHTMODBUS_RET_ERROR modbusWriteCoalescerRun(ModbusWriteCoalescer *coalescer, uint32_t now)
+{
+	if (coalescer->pending)
+	{
+		if (modbusTimeDiff(now, coalescer->pendingSince + coalescer->timeout) < 0)
+			return MODBUS_NO_ERROR();
+
+		modbusWriteCoalescerComplete(coalescer, MODBUS_WRITE_TIMEOUT, MODBUS_EXCEP_NONE);
+	}
+
+	// The write that has waited the longest
+	ModbusPendingWrite *oldest = NULL;
+	for (uint16_t i = 0; i < coalescer->capacity; i++)
+	{
+		ModbusPendingWrite *w = &coalescer->writes[i];
+		if (w->state == MODBUS_WRITE_QUEUED && (!oldest || modbusTimeDiff(w->due, oldest->due) < 0))
+			oldest = w;
+	}
+
+	if (!oldest || modbusTimeDiff(now, oldest->due) < 0)
+		return MODBUS_NO_ERROR();
+
+	// Grow the range around the oldest write as long as there are adjacent writes
+	uint8_t address = oldest->address;
+	ModbusDataType type = oldest->type;
+	uint32_t maxCount = type == MODBUS_COIL ? 1968 : 123;
+	uint32_t first = oldest->index;
+	uint32_t end = first + 1;
+	uint8_t grown;
+	do
+	{
+		grown = 0;
+		for (uint16_t i = 0; i < coalescer->capacity && end - first < maxCount; i++)
+		{
+			const ModbusPendingWrite *w = &coalescer->writes[i];
+			if (w->state != MODBUS_WRITE_QUEUED || w->address != address || w->type != type)
+				continue;
+
+			if ((uint32_t) w->index + 1 == first)
+			{
+				first--;
+				grown = 1;
+			}
+			else if (w->index == end)
+			{
+				end++;
+				grown = 1;
+			}
+		}
+	} while (grown);
+
+	union
+	{
+		uint16_t registers[123];
+		uint8_t coils[246];
+	} values;
+
+	for (uint16_t i = 0; i < sizeof(values.coils); i++)
+		values.coils[i] = 0;
+
+	for (uint16_t i = 0; i < coalescer->capacity; i++)
+	{
+		ModbusPendingWrite *w = &coalescer->writes[i];
+		if (w->state != MODBUS_WRITE_QUEUED
+			|| w->address != address
+			|| w->type != type
+			|| w->index < first
+			|| w->index >= end)
+			continue;
+
+		w->state = MODBUS_WRITE_SENT;
+		if (w->superseded)
+			continue;
+
+		if (type == MODBUS_COIL)
+			modbusMaskWrite(values.coils, w->index - first, w->value != 0);
+		else
+			values.registers[w->index - first] = w->value;
+	}
+
+	ModbusMaster *master = coalescer->master;
+	uint16_t count = end - first;
+	ModbusErrorInfo err;
+	switch (coalescer->format)
+	{
+		case MODBUS_COALESCE_RTU: err = modbusBeginRequestRTU(master); break;
+		case MODBUS_COALESCE_TCP: err = modbusBeginRequestTCP(master); break;
+		default: err = modbusBeginRequestPDU(master); break;
+	}
+
+	if (modbusIsOk(err))
+	{
+		if (count == 1 && type == MODBUS_COIL)
+			err = modbusBuildRequest05(master, first, modbusMaskRead(values.coils, 0));
+		else if (count == 1)
+			err = modbusBuildRequest06(master, first, values.registers[0]);
+		else if (type == MODBUS_COIL)
+			err = modbusBuildRequest15(master, first, count, values.coils);
+		else
+			err = modbusBuildRequest16(master, first, count, values.registers);
+	}
+
+	if (modbusIsOk(err))
+	{
+		switch (coalescer->format)
+		{
+			case MODBUS_COALESCE_RTU: err = modbusEndRequestRTU(master, address); break;
+			case MODBUS_COALESCE_TCP: err = modbusEndRequestTCP(master, coalescer->transactionID++, address); break;
+			default: err = modbusEndRequestPDU(master); break;
+		}
+	}
+
+	if (!modbusIsOk(err))
+	{
+		modbusWriteCoalescerComplete(coalescer, MODBUS_WRITE_ERROR, MODBUS_EXCEP_NONE);
+		return err;
+	}
+
+	if (coalescer->transport(
+		coalescer,
+		modbusMasterGetRequest(master),
+		modbusMasterGetRequestLength(master)) != MODBUS_OK)
+	{
+		modbusWriteCoalescerComplete(coalescer, MODBUS_WRITE_ERROR, MODBUS_EXCEP_NONE);
+		return MODBUS_GENERAL_ERROR(OTHER);
+	}
+
+	coalescer->pending = 1;
+	coalescer->pendingAddress = address;
+	coalescer->pendingSince = now;
+	coalescer->requestsSent++;
+	return MODBUS_NO_ERROR();
+}
+
+/**
+	\brief Parses a response to the pending request and completes its writes
+	\param response Response frame (in the format used by the coalescer)
+	\param responseLength Length of the response frame
+	\returns MODBUS_RESPONSE_ERROR(OTHER) if no request is pending
+	\returns Any error returned by `modbusParseResponse*()`
+
+	The writes are completed with \ref MODBUS_WRITE_ERROR if the response is
+	invalid. In Modbus TCP mode, responses with mismatched transaction ID are
+	rejected and the coalescer keeps waiting for the right one.
+*/
+LIGHTMODBUS_RET_ERROR modbusWriteCoalescerParseResponse(
+	ModbusWriteCoalescer *coalescer,
+	const uint8_t *response,
+	uint16_t responseLength)
+{
+	if (!coalescer->pending)
+		return MODBUS_RESPONSE_ERROR(OTHER);
+
+	ModbusMaster *master = coalescer->master;
+	ModbusErrorInfo err;
+	uint8_t offset;
+	switch (coalescer->format)
+	{
+		case MODBUS_COALESCE_RTU:
+			offset = 1;
+			err = modbusParseResponseRTU(
+				master,
+				modbusMasterGetRequest(master),
+				modbusMasterGetRequestLength(master),
+				response,
+				responseLength);
+			break;
+
+		case MODBUS_COALESCE_TCP:
+			offset = 7;
+			err = modbusParseResponseTCP(
+				master,
+				modbusMasterGetRequest(master),
+				modbusMasterGetRequestLength(master),
+				response,
+				responseLength);
+
+			if (modbusGetResponseError(err) == MODBUS_ERROR_BAD_TRANSACTION)
+				return err;
+			break;
+
+		default:
+			offset = 0;
+			if (responseLength > MODBUS_PDU_MAX)
+			{
+				err = MODBUS_RESPONSE_ERROR(LENGTH);
+				break;
+			}
+
+			err = modbusParseResponsePDU(
+				master,
+				coalescer->pendingAddress,
+				modbusMasterGetRequest(master),
+				modbusMasterGetRequestLength(master),
+				response,
+				responseLength);
+			break;
+	}
+
+	if (!modbusIsOk(err))
+		modbusWriteCoalescerComplete(coalescer, MODBUS_WRITE_ERROR, MODBUS_EXCEP_NONE);
+	else if (response[offset] & 0x80)
+		modbusWriteCoalescerComplete(coalescer, MODBUS_WRITE_EXCEPTION, (ModbusExceptionCode) response[offset + 1]);
+	else
+		modbusWriteCoalescerComplete(coalescer, MODBUS_WRITE_OK, MODBUS_EXCEP_NONE);
+
+	return err;
+}
+
+/**
+	\brief Returns time at which modbusWriteCoalescerRun() should be called next
+	\param wakeup Output: time at which the oldest write is due or the pending request times out
+	\returns 0 if there's nothing to wait for, 1 otherwise
+*/
+uint8_t modbusWriteCoalescerNextWakeup(const ModbusWriteCoalescer *coalescer, uint32_t *wakeup)
+{
+	if (coalescer->pending)
+	{
+		*wakeup = coalescer->pendingSince + coalescer->timeout;
+		return 1;
+	}
+
+	uint8_t found = 0;
+	for (uint16_t i = 0; i < coalescer->capacity; i++)
+	{
+		const ModbusPendingWrite *w = &coalescer->writes[i];
+		if (w->state == MODBUS_WRITE_QUEUED && (!found || modbusTimeDiff(w->due, *wakeup) < 0))
+		{
+			*wakeup = w->due;
+			found = 1;
+		}
+	}
+
+	return found;
+}
+
+#endif
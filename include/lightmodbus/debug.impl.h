@@ -74,7 +74,10 @@ const char *modbusExceptionCodeStr(ModbusExceptionCode code)
 		ECASE(MODBUS_EXCEP_ILLEGAL_VALUE);
 		ECASE(MODBUS_EXCEP_SLAVE_FAILURE);
 		ECASE(MODBUS_EXCEP_ACK);
+		ECASE(MODBUS_EXCEP_SLAVE_BUSY);
 		ECASE(MODBUS_EXCEP_NACK);
+		ECASE(MODBUS_EXCEP_GATEWAY_PATH);
+		ECASE(MODBUS_EXCEP_GATEWAY_TARGET);
 
 		default: return "[invalid ModbusExceptionCode]";
 	};
@@ -98,6 +98,70 @@ extern "C" {
 	#include "master_func.h"
 #endif
 
+/**
+	\def LIGHTMODBUS_STREAM
+	\brief Includes reassembly of Modbus frames from byte streams.
+*/
+#ifdef LIGHTMODBUS_STREAM
+	#include "stream.h"
+#endif
+
+/**
+	\def LIGHTMODBUS_CACHE
+	\brief Includes the cache of read responses for gateways and proxies.
+*/
+#ifdef LIGHTMODBUS_CACHE
+	#include "cache.h"
+#endif
+
+/**
+	\def LIGHTMODBUS_PIPELINE
+	\brief Includes the transaction table for pipelined Modbus TCP requests. Requires `LIGHTMODBUS_MASTER`.
+*/
+#if defined(LIGHTMODBUS_PIPELINE) && defined(LIGHTMODBUS_MASTER)
+	#include "pipeline.h"
+#endif
+
+/**
+	\def LIGHTMODBUS_RTT
+	\brief Includes the adaptive response timeout estimator. Requires `LIGHTMODBUS_MASTER`.
+*/
+#if defined(LIGHTMODBUS_RTT) && defined(LIGHTMODBUS_MASTER)
+	#include "rtt.h"
+#endif
+
+/**
+	\def LIGHTMODBUS_SHADOW
+	\brief Includes the change-of-value filter for data received by master. Requires `LIGHTMODBUS_MASTER`.
+*/
+#if defined(LIGHTMODBUS_SHADOW) && defined(LIGHTMODBUS_MASTER)
+	#include "shadow.h"
+#endif
+
+/**
+	\def LIGHTMODBUS_SCHEDULER
+	\brief Includes the deadline-driven polling scheduler. Requires `LIGHTMODBUS_MASTER`.
+*/
+#if defined(LIGHTMODBUS_SCHEDULER) && defined(LIGHTMODBUS_MASTER)
+	#include "scheduler.h"
+#endif
+
+/**
+	\def LIGHTMODBUS_RTU_BUS
+	\brief Includes the multi-drop Modbus RTU bus scheduler. Requires `LIGHTMODBUS_MASTER`.
+*/
+#if defined(LIGHTMODBUS_RTU_BUS) && defined(LIGHTMODBUS_MASTER)
+	#include "rtubus.h"
+#endif
+
+/**
+	\def LIGHTMODBUS_COALESCE
+	\brief Includes the write coalescer merging single writes into multiple write requests. Requires `LIGHTMODBUS_MASTER`.
+*/
+#if defined(LIGHTMODBUS_COALESCE) && defined(LIGHTMODBUS_MASTER)
+	#include "coalesce.h"
+#endif
+
 /**
 	\def LIGHTMODBUS_DEBUG
 	\brief Configures the library to include debug utilties.
@@ -123,6 +187,38 @@ extern "C" {
 		#include "master_func.impl.h"
 	#endif
 
+	#ifdef LIGHTMODBUS_STREAM
+		#include "stream.impl.h"
+	#endif
+
+	#ifdef LIGHTMODBUS_CACHE
+		#include "cache.impl.h"
+	#endif
+
+	#if defined(LIGHTMODBUS_PIPELINE) && defined(LIGHTMODBUS_MASTER)
+		#include "pipeline.impl.h"
+	#endif
+
+	#if defined(LIGHTMODBUS_RTT) && defined(LIGHTMODBUS_MASTER)
+		#include "rtt.impl.h"
+	#endif
+
+	#if defined(LIGHTMODBUS_SHADOW) && defined(LIGHTMODBUS_MASTER)
+		#include "shadow.impl.h"
+	#endif
+
+	#if defined(LIGHTMODBUS_SCHEDULER) && defined(LIGHTMODBUS_MASTER)
+		#include "scheduler.impl.h"
+	#endif
+
+	#if defined(LIGHTMODBUS_RTU_BUS) && defined(LIGHTMODBUS_MASTER)
+		#include "rtubus.impl.h"
+	#endif
+
+	#if defined(LIGHTMODBUS_COALESCE) && defined(LIGHTMODBUS_MASTER)
+		#include "coalesce.impl.h"
+	#endif
+
 	#ifdef LIGHTMODBUS_DEBUG
 		#include "debug.impl.h"
 	#endif
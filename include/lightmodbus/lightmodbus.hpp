@@ -207,6 +207,327 @@ protected:
 	ModbusSlave m_slave;
 	bool m_ok = false;
 };
+
+/**
+	\brief A Modbus slave with a register handler known at compile time
+
+	Works like Slave, but instead of a register callback it takes a handler
+	object (e.g. a lambda) called as:
+	\code
+	ModbusError handler(const ModbusRegisterCallbackArgs &args, ModbusRegisterCallbackResult &result);
+	\endcode
+	with the same semantics as the register callback. The slave uses its own
+	function handlers, instantiated for `Handler`, so the handler can be
+	inlined into the loops parsing the requests instead of being called
+	through a pointer for every register. Supported functions are controlled
+	by the `LIGHTMODBUS_FxxS` macros, like in \ref modbusSlaveDefaultFunctions.
+
+	\note The user pointer of the underlying ModbusSlave is used internally -
+	the handler should hold any state it needs instead.
+*/
+template <typename Handler>
+class StaticSlave : public Slave
+{
+public:
+	explicit StaticSlave(
+		Handler handler,
+		ModbusSlaveExceptionCallback exceptionCallback = nullptr,
+		ModbusAllocator allocator = modbusDefaultAllocator) :
+		Slave(nullptr, exceptionCallback, allocator, functions(), functionCount()),
+		m_handler(handler)
+	{
+		modbusSlaveSetUserPointer(&m_slave, this);
+	}
+
+	Handler &handler()
+	{
+		return m_handler;
+	}
+
+	const Handler &handler() const
+	{
+		return m_handler;
+	}
+
+	void setUserPointer(void *ptr) = delete;
+	void *getUserPointer() const = delete;
+
+private:
+	Handler m_handler;
+
+	static Handler &handlerOf(ModbusSlave *status)
+	{
+		return static_cast<StaticSlave *>(modbusSlaveGetUserPointer(status))->m_handler;
+	}
+
+	// See modbusParseRequest01020304()
+	static ModbusErrorInfo parseRequest01020304(
+		ModbusSlave *status,
+		uint8_t function,
+		const uint8_t *requestPDU,
+		uint8_t requestLength)
+	{
+		Handler &handler = handlerOf(status);
+		if (requestLength != 5)
+			return modbusBuildException(status, function, MODBUS_EXCEP_ILLEGAL_VALUE);
+
+		ModbusDataType datatype;
+		uint16_t maxCount;
+		bool isCoilType;
+		switch (function)
+		{
+			case 1: datatype = MODBUS_COIL; maxCount = 2000; isCoilType = true; break;
+			case 2: datatype = MODBUS_DISCRETE_INPUT; maxCount = 2000; isCoilType = true; break;
+			case 3: datatype = MODBUS_HOLDING_REGISTER; maxCount = 125; isCoilType = false; break;
+			case 4: datatype = MODBUS_INPUT_REGISTER; maxCount = 125; isCoilType = false; break;
+			default: return MODBUS_GENERAL_ERROR(FUNCTION);
+		}
+
+		uint16_t index = modbusRBE(&requestPDU[1]);
+		uint16_t count = modbusRBE(&requestPDU[3]);
+
+		if (count == 0 || count > maxCount)
+			return modbusBuildException(status, function, MODBUS_EXCEP_ILLEGAL_VALUE);
+		if (modbusCheckRangeU16(index, count))
+			return modbusBuildException(status, function, MODBUS_EXCEP_ILLEGAL_ADDRESS);
+
+		ModbusRegisterCallbackResult cres;
+		ModbusRegisterCallbackArgs cargs;
+		cargs.type = datatype;
+		cargs.query = MODBUS_REGQ_R_CHECK;
+		cargs.value = 0;
+		cargs.function = function;
+
+		for (uint16_t i = 0; i < count; i++)
+		{
+			cargs.index = index + i;
+			if (handler(cargs, cres)) return modbusBuildException(status, function, MODBUS_EXCEP_SLAVE_FAILURE);
+			if (cres.exceptionCode) return modbusBuildException(status, function, cres.exceptionCode);
+		}
+
+		uint8_t dataLength = isCoilType ? modbusBitsToBytes(count) : (count << 1);
+		if (modbusSlaveAllocateResponse(status, 2 + dataLength))
+			return MODBUS_GENERAL_ERROR(ALLOC);
+
+		uint8_t *data = &status->response.pdu[2];
+		status->response.pdu[0] = function;
+		status->response.pdu[1] = dataLength;
+		for (uint8_t i = 0; i < dataLength; i++)
+			data[i] = 0;
+
+		cargs.query = MODBUS_REGQ_R;
+		for (uint16_t i = 0; i < count; i++)
+		{
+			cargs.index = index + i;
+			(void) handler(cargs, cres);
+
+			if (isCoilType)
+				modbusMaskWrite(data, i, cres.value != 0);
+			else
+				modbusWBE(&data[i << 1], cres.value);
+		}
+
+		return MODBUS_NO_ERROR();
+	}
+
+	// See modbusParseRequest0506()
+	static ModbusErrorInfo parseRequest0506(
+		ModbusSlave *status,
+		uint8_t function,
+		const uint8_t *requestPDU,
+		uint8_t requestLength)
+	{
+		Handler &handler = handlerOf(status);
+		if (requestLength != 5)
+			return modbusBuildException(status, function, MODBUS_EXCEP_ILLEGAL_VALUE);
+
+		ModbusDataType datatype = function == 5 ? MODBUS_COIL : MODBUS_HOLDING_REGISTER;
+		uint16_t index = modbusRBE(&requestPDU[1]);
+		uint16_t value = modbusRBE(&requestPDU[3]);
+
+		if (datatype == MODBUS_COIL && value != 0x0000 && value != 0xFF00)
+			return modbusBuildException(status, function, MODBUS_EXCEP_ILLEGAL_VALUE);
+
+		ModbusRegisterCallbackResult cres;
+		ModbusRegisterCallbackArgs cargs;
+		cargs.type = datatype;
+		cargs.query = MODBUS_REGQ_W_CHECK;
+		cargs.index = index;
+		cargs.value = datatype == MODBUS_COIL ? (value != 0) : value;
+		cargs.function = function;
+
+		if (handler(cargs, cres)) return modbusBuildException(status, function, MODBUS_EXCEP_SLAVE_FAILURE);
+		if (cres.exceptionCode) return modbusBuildException(status, function, cres.exceptionCode);
+
+		cargs.query = MODBUS_REGQ_W;
+		(void) handler(cargs, cres);
+
+		if (modbusSlaveAllocateResponse(status, 5))
+			return MODBUS_GENERAL_ERROR(ALLOC);
+
+		status->response.pdu[0] = function;
+		modbusWBE(&status->response.pdu[1], index);
+		modbusWBE(&status->response.pdu[3], value);
+		return MODBUS_NO_ERROR();
+	}
+
+	// See modbusParseRequest1516()
+	static ModbusErrorInfo parseRequest1516(
+		ModbusSlave *status,
+		uint8_t function,
+		const uint8_t *requestPDU,
+		uint8_t requestLength)
+	{
+		Handler &handler = handlerOf(status);
+		if (requestLength < 6)
+			return modbusBuildException(status, function, MODBUS_EXCEP_ILLEGAL_VALUE);
+
+		ModbusDataType datatype = function == 15 ? MODBUS_COIL : MODBUS_HOLDING_REGISTER;
+		uint16_t maxCount = datatype == MODBUS_COIL ? 1968 : 123;
+		uint16_t index = modbusRBE(&requestPDU[1]);
+		uint16_t count = modbusRBE(&requestPDU[3]);
+		uint8_t declaredLength = requestPDU[5];
+
+		if (declaredLength == 0 || declaredLength != requestLength - 6)
+			return modbusBuildException(status, function, MODBUS_EXCEP_ILLEGAL_VALUE);
+		if (count == 0
+			|| count > maxCount
+			|| declaredLength != (datatype == MODBUS_COIL ? modbusBitsToBytes(count) : (count << 1)))
+			return modbusBuildException(status, function, MODBUS_EXCEP_ILLEGAL_VALUE);
+		if (modbusCheckRangeU16(index, count))
+			return modbusBuildException(status, function, MODBUS_EXCEP_ILLEGAL_ADDRESS);
+
+		const uint8_t *data = &requestPDU[6];
+		ModbusRegisterCallbackResult cres;
+		ModbusRegisterCallbackArgs cargs;
+		cargs.type = datatype;
+		cargs.query = MODBUS_REGQ_W_CHECK;
+		cargs.function = function;
+
+		for (uint16_t i = 0; i < count; i++)
+		{
+			cargs.index = index + i;
+			cargs.value = datatype == MODBUS_COIL ? modbusMaskRead(data, i) : modbusRBE(&data[i << 1]);
+			if (handler(cargs, cres)) return modbusBuildException(status, function, MODBUS_EXCEP_SLAVE_FAILURE);
+			if (cres.exceptionCode) return modbusBuildException(status, function, cres.exceptionCode);
+		}
+
+		cargs.query = MODBUS_REGQ_W;
+		for (uint16_t i = 0; i < count; i++)
+		{
+			cargs.index = index + i;
+			cargs.value = datatype == MODBUS_COIL ? modbusMaskRead(data, i) : modbusRBE(&data[i << 1]);
+			(void) handler(cargs, cres);
+		}
+
+		if (modbusSlaveAllocateResponse(status, 5))
+			return MODBUS_GENERAL_ERROR(ALLOC);
+
+		status->response.pdu[0] = function;
+		modbusWBE(&status->response.pdu[1], index);
+		modbusWBE(&status->response.pdu[3], count);
+		return MODBUS_NO_ERROR();
+	}
+
+	// See modbusParseRequest22()
+	static ModbusErrorInfo parseRequest22(
+		ModbusSlave *status,
+		uint8_t function,
+		const uint8_t *requestPDU,
+		uint8_t requestLength)
+	{
+		Handler &handler = handlerOf(status);
+		if (requestLength != 7)
+			return modbusBuildException(status, function, MODBUS_EXCEP_ILLEGAL_VALUE);
+
+		uint16_t index   = modbusRBE(&requestPDU[1]);
+		uint16_t andmask = modbusRBE(&requestPDU[3]);
+		uint16_t ormask  = modbusRBE(&requestPDU[5]);
+
+		ModbusRegisterCallbackResult cres;
+		ModbusRegisterCallbackArgs cargs;
+		cargs.type = MODBUS_HOLDING_REGISTER;
+		cargs.query = MODBUS_REGQ_R_CHECK;
+		cargs.index = index;
+		cargs.value = 0;
+		cargs.function = function;
+
+		if (handler(cargs, cres)) return modbusBuildException(status, function, MODBUS_EXCEP_SLAVE_FAILURE);
+		if (cres.exceptionCode) return modbusBuildException(status, function, cres.exceptionCode);
+
+		cargs.query = MODBUS_REGQ_R;
+		(void) handler(cargs, cres);
+		uint16_t value = (cres.value & andmask) | (ormask & ~andmask);
+
+		cargs.query = MODBUS_REGQ_W_CHECK;
+		cargs.value = value;
+		if (handler(cargs, cres)) return modbusBuildException(status, function, MODBUS_EXCEP_SLAVE_FAILURE);
+		if (cres.exceptionCode) return modbusBuildException(status, function, cres.exceptionCode);
+
+		cargs.query = MODBUS_REGQ_W;
+		(void) handler(cargs, cres);
+
+		if (modbusSlaveAllocateResponse(status, 7))
+			return MODBUS_GENERAL_ERROR(ALLOC);
+
+		status->response.pdu[0] = function;
+		modbusWBE(&status->response.pdu[1], index);
+		modbusWBE(&status->response.pdu[3], andmask);
+		modbusWBE(&status->response.pdu[5], ormask);
+		return MODBUS_NO_ERROR();
+	}
+
+	/*
+		Same as modbusSlaveDefaultFunctions, with the parsing
+		functions instantiated for Handler
+	*/
+	static ModbusSlaveFunctionHandler *functions(uint16_t *count = nullptr)
+	{
+		static ModbusSlaveFunctionHandler table[] =
+		{
+#if defined(LIGHTMODBUS_F01S) || defined(LIGHTMODBUS_SLAVE_FULL)
+			{1, parseRequest01020304},
+#endif
+#if defined(LIGHTMODBUS_F02S) || defined(LIGHTMODBUS_SLAVE_FULL)
+			{2, parseRequest01020304},
+#endif
+#if defined(LIGHTMODBUS_F03S) || defined(LIGHTMODBUS_SLAVE_FULL)
+			{3, parseRequest01020304},
+#endif
+#if defined(LIGHTMODBUS_F04S) || defined(LIGHTMODBUS_SLAVE_FULL)
+			{4, parseRequest01020304},
+#endif
+#if defined(LIGHTMODBUS_F05S) || defined(LIGHTMODBUS_SLAVE_FULL)
+			{5, parseRequest0506},
+#endif
+#if defined(LIGHTMODBUS_F06S) || defined(LIGHTMODBUS_SLAVE_FULL)
+			{6, parseRequest0506},
+#endif
+#if defined(LIGHTMODBUS_F15S) || defined(LIGHTMODBUS_SLAVE_FULL)
+			{15, parseRequest1516},
+#endif
+#if defined(LIGHTMODBUS_F16S) || defined(LIGHTMODBUS_SLAVE_FULL)
+			{16, parseRequest1516},
+#endif
+#if defined(LIGHTMODBUS_F22S) || defined(LIGHTMODBUS_SLAVE_FULL)
+			{22, parseRequest22},
+#endif
+			// Guard - prevents 0 array size
+			{0, nullptr}
+		};
+
+		if (count)
+			*count = sizeof(table) / sizeof(table[0]) - 1;
+		return table;
+	}
+
+	static uint16_t functionCount()
+	{
+		uint16_t count;
+		functions(&count);
+		return count;
+	}
+};
 #endif
 
 #ifdef LIGHTMODBUS_MASTER
@@ -413,6 +734,159 @@ protected:
 	ModbusMaster m_master;
 	bool m_ok = false;
 };
+
+/**
+	\brief A Modbus master with a data handler known at compile time
+
+	Works like Master, but instead of a data callback it takes a handler
+	object (e.g. a lambda) called as:
+	\code
+	void handler(const ModbusDataCallbackArgs &args);
+	\endcode
+	for every register and coil value received. Responses to functions
+	01 - 04 are parsed by a function instantiated for `Handler`, so the
+	handler can be inlined into the loop reading the values. Supported
+	functions are controlled by the `LIGHTMODBUS_FxxM` macros, like in
+	\ref modbusMasterDefaultFunctions.
+
+	\note The user pointer of the underlying ModbusMaster is used internally -
+	the handler should hold any state it needs instead.
+*/
+template <typename Handler>
+class StaticMaster : public Master
+{
+public:
+	explicit StaticMaster(
+		Handler handler,
+		ModbusMasterExceptionCallback exceptionCallback = nullptr,
+		ModbusAllocator allocator = modbusDefaultAllocator) :
+		Master(nullptr, exceptionCallback, allocator, functions(), functionCount()),
+		m_handler(handler)
+	{
+		modbusMasterSetUserPointer(&m_master, this);
+	}
+
+	Handler &handler()
+	{
+		return m_handler;
+	}
+
+	const Handler &handler() const
+	{
+		return m_handler;
+	}
+
+	void setUserPointer(void *ptr) = delete;
+	void *getUserPointer() const = delete;
+
+private:
+	Handler m_handler;
+
+	// See modbusParseResponse01020304()
+	static ModbusErrorInfo parseResponse01020304(
+		ModbusMaster *status,
+		uint8_t address,
+		uint8_t function,
+		const uint8_t *requestPDU,
+		uint8_t requestLength,
+		const uint8_t *responsePDU,
+		uint8_t responseLength)
+	{
+		if (requestLength != 5) return MODBUS_REQUEST_ERROR(LENGTH);
+		if (responseLength < 3) return MODBUS_RESPONSE_ERROR(LENGTH);
+
+		ModbusDataType datatype;
+		uint16_t maxCount;
+		bool isCoilType;
+		switch (function)
+		{
+			case 1: datatype = MODBUS_COIL; maxCount = 2000; isCoilType = true; break;
+			case 2: datatype = MODBUS_DISCRETE_INPUT; maxCount = 2000; isCoilType = true; break;
+			case 3: datatype = MODBUS_HOLDING_REGISTER; maxCount = 125; isCoilType = false; break;
+			case 4: datatype = MODBUS_INPUT_REGISTER; maxCount = 125; isCoilType = false; break;
+			default: return MODBUS_GENERAL_ERROR(FUNCTION);
+		}
+
+		uint16_t index = modbusRBE(&requestPDU[1]);
+		uint16_t count = modbusRBE(&requestPDU[3]);
+
+		if (count == 0 || count > maxCount)
+			return MODBUS_REQUEST_ERROR(COUNT);
+		if (modbusCheckRangeU16(index, count))
+			return MODBUS_REQUEST_ERROR(RANGE);
+
+		uint8_t expected = isCoilType ? modbusBitsToBytes(count) : (count << 1);
+		if (responsePDU[1] != expected || responseLength != expected + 2)
+			return MODBUS_RESPONSE_ERROR(LENGTH);
+
+		Handler &handler = static_cast<StaticMaster *>(modbusMasterGetUserPointer(status))->m_handler;
+		const uint8_t *data = &responsePDU[2];
+		ModbusDataCallbackArgs cargs;
+		cargs.type = datatype;
+		cargs.function = function;
+		cargs.address = address;
+
+		for (uint16_t i = 0; i < count; i++)
+		{
+			cargs.index = index + i;
+			cargs.value = isCoilType ? modbusMaskRead(data, i) : modbusRBE(&data[i << 1]);
+			handler(cargs);
+		}
+
+		return MODBUS_NO_ERROR();
+	}
+
+	/*
+		Same as modbusMasterDefaultFunctions, with responses
+		to functions 01 - 04 parsed for Handler
+	*/
+	static ModbusMasterFunctionHandler *functions(uint16_t *count = nullptr)
+	{
+		static ModbusMasterFunctionHandler table[] =
+		{
+#if defined(LIGHTMODBUS_F01M) || defined(LIGHTMODBUS_MASTER_FULL)
+			{1, parseResponse01020304},
+#endif
+#if defined(LIGHTMODBUS_F02M) || defined(LIGHTMODBUS_MASTER_FULL)
+			{2, parseResponse01020304},
+#endif
+#if defined(LIGHTMODBUS_F03M) || defined(LIGHTMODBUS_MASTER_FULL)
+			{3, parseResponse01020304},
+#endif
+#if defined(LIGHTMODBUS_F04M) || defined(LIGHTMODBUS_MASTER_FULL)
+			{4, parseResponse01020304},
+#endif
+#if defined(LIGHTMODBUS_F05M) || defined(LIGHTMODBUS_MASTER_FULL)
+			{5, modbusParseResponse0506},
+#endif
+#if defined(LIGHTMODBUS_F06M) || defined(LIGHTMODBUS_MASTER_FULL)
+			{6, modbusParseResponse0506},
+#endif
+#if defined(LIGHTMODBUS_F15M) || defined(LIGHTMODBUS_MASTER_FULL)
+			{15, modbusParseResponse1516},
+#endif
+#if defined(LIGHTMODBUS_F16M) || defined(LIGHTMODBUS_MASTER_FULL)
+			{16, modbusParseResponse1516},
+#endif
+#if defined(LIGHTMODBUS_F22M) || defined(LIGHTMODBUS_MASTER_FULL)
+			{22, modbusParseResponse22},
+#endif
+			// Guard - prevents 0 size array
+			{0, nullptr}
+		};
+
+		if (count)
+			*count = sizeof(table) / sizeof(table[0]) - 1;
+		return table;
+	}
+
+	static uint16_t functionCount()
+	{
+		uint16_t count;
+		functions(&count);
+		return count;
+	}
+};
 #endif
 
 }
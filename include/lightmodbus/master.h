@@ -83,6 +83,64 @@ struct ModbusMaster
 	void *context; //!< User's context pointer
 };
 
+/**
+	\brief A prebuilt request frame which can be sent repeatedly
+
+	Frozen requests own their frame data and don't depend on the master's
+	allocator once created. Modbus TCP requests can be reused with different
+	transaction IDs using modbusFrozenRequestSetTransactionID().
+
+	\see modbusFreezeRequest()
+*/
+typedef struct ModbusFrozenRequest
+{
+	uint8_t data[MODBUS_TCP_ADU_MAX]; //!< The request frame
+	uint16_t length;                  //!< Length of the request frame
+	uint8_t pduOffset;                //!< PDU offset relative to the beginning of the frame
+} ModbusFrozenRequest;
+
+/**
+	\brief Several request frames stored back-to-back in a single buffer
+
+	Requests are built directly into the batch buffer by a master using
+	modbusRequestBatchAllocator(), so no copying or separate allocations are
+	involved. The whole batch can be then sent with a single call, which is
+	particularly useful for pipelined Modbus TCP requests.
+
+	\see modbusRequestBatchInit()
+*/
+typedef struct ModbusRequestBatch
+{
+	uint8_t *data;     //!< A non-owning pointer to the batch buffer
+	uint16_t capacity; //!< Size of the batch buffer
+	uint16_t length;   //!< Total length of the committed requests
+	uint16_t count;    //!< Number of committed requests
+} ModbusRequestBatch;
+
+/**
+	\def MODBUS_REQUEST_DESCRIPTOR_HEADER
+	\brief Number of request PDU bytes stored in ModbusRequestDescriptor
+
+	This is enough to hold the function code, register index and register count/value
+	(or both masks in case of function 22) of all requests built by the library.
+*/
+#define MODBUS_REQUEST_DESCRIPTOR_HEADER 7
+
+/**
+	\brief Compact description of a request, sufficient for validating the response
+
+	\see modbusRequestDescriptorInit()
+	\see modbusDescribeRequest()
+	\see modbusParseResponseDescriptorPDU()
+*/
+typedef struct ModbusRequestDescriptor
+{
+	uint8_t header[MODBUS_REQUEST_DESCRIPTOR_HEADER]; //!< The beginning of the request PDU
+	uint8_t pduLength;                                //!< Length of the entire request PDU
+	uint8_t address;                                  //!< Slave address or unit ID
+	uint8_t expectedLength;                           //!< Length of the expected response PDU (0 if unknown)
+} ModbusRequestDescriptor;
+
 LIGHTMODBUS_RET_ERROR modbusMasterInit(
 	ModbusMaster *status,
 	ModbusDataCallback dataCallback,
@@ -99,6 +157,24 @@ LIGHTMODBUS_RET_ERROR modbusBeginRequestRTU(ModbusMaster *status);
 LIGHTMODBUS_RET_ERROR modbusEndRequestRTU(ModbusMaster *status, uint8_t address);
 LIGHTMODBUS_RET_ERROR modbusBeginRequestTCP(ModbusMaster *status);
 LIGHTMODBUS_RET_ERROR modbusEndRequestTCP(ModbusMaster *status, uint16_t transaction, uint8_t unit);
+LIGHTMODBUS_RET_ERROR modbusBeginRequestASCII(ModbusMaster *status);
+LIGHTMODBUS_RET_ERROR modbusEndRequestASCII(ModbusMaster *status, uint8_t address);
+
+LIGHTMODBUS_RET_ERROR modbusFreezeRequest(ModbusFrozenRequest *frozen, const ModbusMaster *status);
+
+LIGHTMODBUS_RET_ERROR modbusRequestBatchInit(ModbusRequestBatch *batch, uint8_t *buffer, uint16_t capacity);
+LIGHTMODBUS_WARN_UNUSED ModbusError modbusRequestBatchAllocator(ModbusBuffer *buffer, uint16_t size, void *context);
+LIGHTMODBUS_RET_ERROR modbusRequestBatchCommit(ModbusRequestBatch *batch, ModbusMaster *status);
+
+LIGHTMODBUS_RET_ERROR modbusRequestDescriptorInit(
+	ModbusRequestDescriptor *desc,
+	uint8_t address,
+	const uint8_t *request,
+	uint8_t requestLength);
+
+LIGHTMODBUS_RET_ERROR modbusDescribeRequest(ModbusRequestDescriptor *desc, const ModbusMaster *status);
+
+LIGHTMODBUS_WARN_UNUSED uint8_t modbusExpectedResponseLength(const uint8_t *request, uint8_t requestLength);
 
 LIGHTMODBUS_RET_ERROR modbusParseResponsePDU(
 	ModbusMaster *status,
@@ -108,6 +184,12 @@ LIGHTMODBUS_RET_ERROR modbusParseResponsePDU(
 	const uint8_t *response,
 	uint8_t responseLength);
 
+LIGHTMODBUS_RET_ERROR modbusParseResponseDescriptorPDU(
+	ModbusMaster *status,
+	const ModbusRequestDescriptor *desc,
+	const uint8_t *response,
+	uint8_t responseLength);
+
 LIGHTMODBUS_RET_ERROR modbusParseResponseRTU(
 	ModbusMaster *status,
 	const uint8_t *request,
@@ -115,6 +197,12 @@ LIGHTMODBUS_RET_ERROR modbusParseResponseRTU(
 	const uint8_t *response,
 	uint16_t responseLength);
 
+LIGHTMODBUS_RET_ERROR modbusParseResponseDescriptorRTU(
+	ModbusMaster *status,
+	const ModbusRequestDescriptor *desc,
+	const uint8_t *response,
+	uint16_t responseLength);
+
 LIGHTMODBUS_RET_ERROR modbusParseResponseTCP(
 	ModbusMaster *status,
 	const uint8_t *request,
@@ -122,6 +210,20 @@ LIGHTMODBUS_RET_ERROR modbusParseResponseTCP(
 	const uint8_t *response,
 	uint16_t responseLength);
 
+LIGHTMODBUS_RET_ERROR modbusParseResponseDescriptorTCP(
+	ModbusMaster *status,
+	const ModbusRequestDescriptor *desc,
+	uint16_t transactionID,
+	const uint8_t *response,
+	uint16_t responseLength);
+
+LIGHTMODBUS_RET_ERROR modbusParseResponseASCII(
+	ModbusMaster *status,
+	const uint8_t *request,
+	uint16_t requestLength,
+	const uint8_t *response,
+	uint16_t responseLength);
+
 /**
 	\brief Returns a pointer to the request generated by the master
 */
@@ -174,6 +276,82 @@ static inline void modbusMasterFreeRequest(ModbusMaster *status)
 	modbusBufferFree(&status->request, modbusMasterGetUserPointer(status));
 }
 
+/**
+	\brief Removes all requests from the batch
+*/
+static inline void modbusRequestBatchClear(ModbusRequestBatch *batch)
+{
+	batch->length = 0;
+	batch->count = 0;
+}
+
+/**
+	\brief Returns a pointer to the batched request frames
+*/
+LIGHTMODBUS_WARN_UNUSED static inline const uint8_t *modbusRequestBatchGet(const ModbusRequestBatch *batch)
+{
+	return batch->data;
+}
+
+/**
+	\brief Returns the total length of the batched request frames
+*/
+LIGHTMODBUS_WARN_UNUSED static inline uint16_t modbusRequestBatchGetLength(const ModbusRequestBatch *batch)
+{
+	return batch->length;
+}
+
+/**
+	\brief Returns a pointer to the frozen request frame
+*/
+LIGHTMODBUS_WARN_UNUSED static inline const uint8_t *modbusFrozenRequestGet(const ModbusFrozenRequest *frozen)
+{
+	return frozen->data;
+}
+
+/**
+	\brief Returns the length of the frozen request frame
+*/
+LIGHTMODBUS_WARN_UNUSED static inline uint16_t modbusFrozenRequestGetLength(const ModbusFrozenRequest *frozen)
+{
+	return frozen->length;
+}
+
+/**
+	\brief Returns the function code of the described request
+*/
+LIGHTMODBUS_WARN_UNUSED static inline uint8_t modbusRequestDescriptorGetFunction(const ModbusRequestDescriptor *desc)
+{
+	return desc->header[0];
+}
+
+/**
+	\brief Returns the index of the first register/coil accessed by the described request
+*/
+LIGHTMODBUS_WARN_UNUSED static inline uint16_t modbusRequestDescriptorGetIndex(const ModbusRequestDescriptor *desc)
+{
+	return modbusRBE(&desc->header[1]);
+}
+
+/**
+	\brief Returns the register/coil count of the described request
+	\note For functions 05 and 06 this is the written value and for function 22 the AND mask
+*/
+LIGHTMODBUS_WARN_UNUSED static inline uint16_t modbusRequestDescriptorGetCount(const ModbusRequestDescriptor *desc)
+{
+	return modbusRBE(&desc->header[3]);
+}
+
+/**
+	\brief Overwrites the transaction ID in a frozen Modbus TCP request
+	\param transactionID new Modbus TCP transaction identifier
+	\warning This function must only be used on Modbus TCP requests.
+*/
+static inline void modbusFrozenRequestSetTransactionID(ModbusFrozenRequest *frozen, uint16_t transactionID)
+{
+	modbusWBE(&frozen->data[0], transactionID);
+}
+
 extern ModbusMasterFunctionHandler modbusMasterDefaultFunctions[];
 extern const uint8_t modbusMasterDefaultFunctionCount;
 
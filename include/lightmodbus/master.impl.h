@@ -182,6 +182,249 @@ LIGHTMODBUS_RET_ERROR modbusEndRequestTCP(ModbusMaster *status, uint16_t transac
 	return MODBUS_NO_ERROR();
 }
 
+/**
+	\brief Begins an ASCII request
+	\returns MODBUS_NO_ERROR()
+*/
+LIGHTMODBUS_RET_ERROR modbusBeginRequestASCII(ModbusMaster *status)
+{
+	modbusBufferModeASCII(&status->request);
+	return MODBUS_NO_ERROR();
+}
+
+/**
+	\brief Finalizes a Modbus ASCII request
+	\returns MODBUS_GENERAL_ERROR(LENGTH) if the allocated frame has invalid length
+	\returns MODBUS_GENERAL_ERROR(ALLOC) if the frame cannot be converted to text
+	\returns MODBUS_NO_ERROR() on success
+
+	The request is built in binary form and converted to text here. This requires
+	the allocator to preserve contents of the buffer when it's enlarged.
+*/
+LIGHTMODBUS_RET_ERROR modbusEndRequestASCII(ModbusMaster *status, uint8_t address)
+{
+	ModbusError err = modbusBufferPackASCII(
+		&status->request,
+		address,
+		modbusMasterGetUserPointer(status));
+
+	if (err != MODBUS_OK)
+		return MODBUS_MAKE_ERROR(MODBUS_ERROR_SOURCE_GENERAL, err);
+
+	return MODBUS_NO_ERROR();
+}
+
+/**
+	\brief Stores a copy of the request built by the master in a ModbusFrozenRequest
+	\param frozen ModbusFrozenRequest struct to store the request in
+	\param status Master holding a complete request (after a call to `modbusEndRequest*()`)
+	\returns MODBUS_GENERAL_ERROR(LENGTH) if the master holds no request or the request is too long
+	\returns MODBUS_NO_ERROR() on success
+
+	The frozen request can be passed directly to modbusParseResponsePDU(),
+	modbusParseResponseRTU() or modbusParseResponseTCP() as the request frame.
+	Once the request is frozen, the master's request buffer can be freed.
+*/
+LIGHTMODBUS_RET_ERROR modbusFreezeRequest(ModbusFrozenRequest *frozen, const ModbusMaster *status)
+{
+	uint16_t length = modbusMasterGetRequestLength(status);
+	if (!length || length > MODBUS_TCP_ADU_MAX)
+		return MODBUS_GENERAL_ERROR(LENGTH);
+
+	const uint8_t *request = modbusMasterGetRequest(status);
+	for (uint16_t i = 0; i < length; i++)
+		frozen->data[i] = request[i];
+
+	frozen->length = length;
+	frozen->pduOffset = status->request.pduOffset;
+	return MODBUS_NO_ERROR();
+}
+
+/**
+	\brief Initializes a ModbusRequestBatch struct
+	\param batch ModbusRequestBatch struct to be initialized
+	\param buffer Storage for the request frames. The lifetime of this buffer
+		must not be shorter than the lifetime of the batch.
+	\param capacity Size of the buffer
+	\returns MODBUS_GENERAL_ERROR(LENGTH) if capacity is 0
+	\returns MODBUS_NO_ERROR() on success
+*/
+LIGHTMODBUS_RET_ERROR modbusRequestBatchInit(ModbusRequestBatch *batch, uint8_t *buffer, uint16_t capacity)
+{
+	if (!capacity)
+		return MODBUS_GENERAL_ERROR(LENGTH);
+
+	batch->data = buffer;
+	batch->capacity = capacity;
+	modbusRequestBatchClear(batch);
+	return MODBUS_NO_ERROR();
+}
+
+/**
+	\brief Allocator placing requests directly in a ModbusRequestBatch
+	\param context Pointer to the ModbusRequestBatch (the master's user pointer)
+	\returns MODBUS_ERROR_ALLOC if there's no room left in the batch
+	\returns MODBUS_OK on success
+
+	The master using this allocator must have its user pointer set to the batch
+	with modbusMasterSetUserPointer(). Each request is allocated right after the
+	previously committed one.
+
+	\see allocators
+*/
+LIGHTMODBUS_WARN_UNUSED ModbusError modbusRequestBatchAllocator(ModbusBuffer *buffer, uint16_t size, void *context)
+{
+	ModbusRequestBatch *batch = (ModbusRequestBatch*) context;
+
+	// Committed requests are never freed
+	if (!size || size > batch->capacity - batch->length)
+	{
+		buffer->data = NULL;
+		return size ? MODBUS_ERROR_ALLOC : MODBUS_OK;
+	}
+
+	buffer->data = batch->data + batch->length;
+	return MODBUS_OK;
+}
+
+/**
+	\brief Appends the request built by the master to the batch
+	\param status Master using modbusRequestBatchAllocator() and holding a complete request
+		(after a call to `modbusEndRequest*()`)
+	\returns MODBUS_GENERAL_ERROR(LENGTH) if the master holds no request
+	\returns MODBUS_GENERAL_ERROR(OTHER) if the request is not located at the end of the batch
+	\returns MODBUS_NO_ERROR() on success
+
+	Once committed, the request is no longer held by the master and the next one can be built.
+*/
+LIGHTMODBUS_RET_ERROR modbusRequestBatchCommit(ModbusRequestBatch *batch, ModbusMaster *status)
+{
+	uint16_t length = modbusMasterGetRequestLength(status);
+	if (!length)
+		return MODBUS_GENERAL_ERROR(LENGTH);
+
+	if (modbusMasterGetRequest(status) != batch->data + batch->length)
+		return MODBUS_GENERAL_ERROR(OTHER);
+
+	batch->length += length;
+	batch->count++;
+	modbusMasterFreeRequest(status);
+	return MODBUS_NO_ERROR();
+}
+
+/**
+	\brief Extracts a request descriptor from a request PDU
+	\param desc ModbusRequestDescriptor struct to be filled
+	\param address Slave address or unit ID the request is sent to
+	\param request Pointer to the PDU section of the request frame
+	\param requestLength Length of the request PDU (valid range: 1 - 253)
+	\returns MODBUS_REQUEST_ERROR(LENGTH) if the request has invalid length
+	\returns MODBUS_NO_ERROR() on success
+
+	Once the descriptor is extracted, the request frame is no longer needed to
+	validate the response and its buffer can be reused.
+*/
+LIGHTMODBUS_RET_ERROR modbusRequestDescriptorInit(
+	ModbusRequestDescriptor *desc,
+	uint8_t address,
+	const uint8_t *request,
+	uint8_t requestLength)
+{
+	if (!requestLength || requestLength > MODBUS_PDU_MAX)
+		return MODBUS_REQUEST_ERROR(LENGTH);
+
+	for (uint8_t i = 0; i < MODBUS_REQUEST_DESCRIPTOR_HEADER; i++)
+		desc->header[i] = i < requestLength ? request[i] : 0;
+
+	desc->pduLength = requestLength;
+	desc->address = address;
+	desc->expectedLength = modbusExpectedResponseLength(request, requestLength);
+	return MODBUS_NO_ERROR();
+}
+
+/**
+	\brief Extracts a request descriptor from the request currently held by the master
+	\param desc ModbusRequestDescriptor struct to be filled
+	\returns MODBUS_GENERAL_ERROR(LENGTH) if the master doesn't hold a request
+	\returns MODBUS_NO_ERROR() on success
+
+	The slave address is taken from the frame. For PDU requests it's set to 0
+	and can be changed by the user.
+
+	Once the descriptor is extracted, the master can be used to build the next
+	request right away (or the request can be freed with modbusMasterFreeRequest()).
+*/
+LIGHTMODBUS_RET_ERROR modbusDescribeRequest(ModbusRequestDescriptor *desc, const ModbusMaster *status)
+{
+	const ModbusBuffer *buffer = &status->request;
+	if (buffer->length <= buffer->padding)
+		return MODBUS_GENERAL_ERROR(LENGTH);
+
+	const uint8_t *pdu = buffer->pdu;
+	uint16_t pduLength = buffer->length - buffer->padding;
+	uint8_t address = 0;
+
+	// Modbus ASCII requests are held as text
+	uint8_t binary[(MODBUS_ASCII_ADU_MAX - 3) / 2];
+	if (buffer->padding == MODBUS_ASCII_ADU_PADDING)
+	{
+		if (modbusUnpackASCII(buffer->data, buffer->length, 0, binary, &pdu, &pduLength, &address) != MODBUS_OK)
+			return MODBUS_GENERAL_ERROR(LENGTH);
+	}
+	else if (buffer->pduOffset == MODBUS_RTU_PDU_OFFSET)
+		address = buffer->data[0];
+	else if (buffer->pduOffset == MODBUS_TCP_PDU_OFFSET)
+		address = buffer->data[6];
+
+	ModbusErrorInfo err = modbusRequestDescriptorInit(
+		desc,
+		address,
+		pdu,
+		pduLength);
+
+	return modbusIsOk(err) ? MODBUS_NO_ERROR() : MODBUS_GENERAL_ERROR(LENGTH);
+}
+
+/**
+	\brief Computes length of the response PDU expected for a request
+	\param request Pointer to the PDU section of the request frame
+	\param requestLength Length of the request PDU
+	\returns Length of the expected response PDU
+	\returns 0 if the length cannot be determined (e.g. unsupported function or invalid request)
+	\note Exception responses are always 2 bytes long, regardless of the request
+*/
+LIGHTMODBUS_WARN_UNUSED uint8_t modbusExpectedResponseLength(const uint8_t *request, uint8_t requestLength)
+{
+	if (!requestLength)
+		return 0;
+
+	uint16_t count = requestLength >= 5 ? modbusRBE(&request[3]) : 0;
+	switch (request[0])
+	{
+		case 1:
+		case 2:
+			if (requestLength != 5 || count == 0 || count > 2000) return 0;
+			return 2 + modbusBitsToBytes(count);
+
+		case 3:
+		case 4:
+			if (requestLength != 5 || count == 0 || count > 125) return 0;
+			return 2 + (count << 1);
+
+		case 5:
+		case 6:
+		case 15:
+		case 16:
+			return 5;
+
+		case 22:
+			return 7;
+
+		default:
+			return 0;
+	}
+}
+
 /**
 	\brief Parses a PDU section of a slave response
 	\param address Value to be reported as slave address
@@ -244,6 +487,44 @@ LIGHTMODBUS_RET_ERROR modbusParseResponsePDU(
 	return MODBUS_GENERAL_ERROR(FUNCTION);
 }
 
+/**
+	\brief Parses a PDU section of a slave response using a request descriptor instead of the request
+	\param desc Descriptor of the request the response is for
+	\param response Pointer to the PDU section of the response
+	\param responseLength Length of the response PDU (valid range: 1 - 253)
+	\returns MODBUS_RESPONSE_ERROR(LENGTH) if the response length is not the expected one
+	\returns Same values as modbusParseResponsePDU()
+
+	The parsing function is provided with a request PDU reconstructed from the descriptor.
+	Only the first \ref MODBUS_REQUEST_DESCRIPTOR_HEADER bytes of it are meaningful - the remaining ones are zeros.
+	This is sufficient for all parsing functions provided by the library.
+*/
+LIGHTMODBUS_RET_ERROR modbusParseResponseDescriptorPDU(
+	ModbusMaster *status,
+	const ModbusRequestDescriptor *desc,
+	const uint8_t *response,
+	uint8_t responseLength)
+{
+	if (!desc->pduLength || desc->pduLength > MODBUS_PDU_MAX)
+		return MODBUS_REQUEST_ERROR(LENGTH);
+
+	// Reject responses of unexpected length early (exceptions excluded)
+	if (desc->expectedLength && responseLength && !(response[0] & 0x80) && responseLength != desc->expectedLength)
+		return MODBUS_RESPONSE_ERROR(LENGTH);
+
+	uint8_t request[MODBUS_PDU_MAX];
+	for (uint8_t i = 0; i < desc->pduLength; i++)
+		request[i] = i < MODBUS_REQUEST_DESCRIPTOR_HEADER ? desc->header[i] : 0;
+
+	return modbusParseResponsePDU(
+		status,
+		desc->address,
+		request,
+		desc->pduLength,
+		response,
+		responseLength);
+}
+
 /**
 	\brief Parses a Modbus RTU slave response
 	\param request Pointer to the request frame
@@ -312,6 +593,48 @@ LIGHTMODBUS_RET_ERROR modbusParseResponseRTU(
 		responsePDULength);
 }
 
+/**
+	\brief Parses a Modbus RTU slave response using a request descriptor instead of the request
+	\param desc Descriptor of the request the response is for
+	\param response Pointer to the response frame
+	\param responseLength Length of the response (valid range: 4 - 256)
+	\returns MODBUS_RESPONSE_ERROR(LENGTH) if the response has invalid length
+	\returns MODBUS_RESPONSE_ERROR(CRC) if the response CRC is invalid
+	\returns MODBUS_RESPONSE_ERROR(ADDRESS) if the request was a broadcast or if request/response addressess don't match
+	\returns Result of modbusParseResponseDescriptorPDU() otherwise
+*/
+LIGHTMODBUS_RET_ERROR modbusParseResponseDescriptorRTU(
+	ModbusMaster *status,
+	const ModbusRequestDescriptor *desc,
+	const uint8_t *response,
+	uint16_t responseLength)
+{
+	// Unpack response
+	const uint8_t *responsePDU;
+	uint16_t responsePDULength;
+	uint8_t responseAddress;
+	ModbusError err = modbusUnpackRTU(
+		response,
+		responseLength,
+		1,
+		&responsePDU,
+		&responsePDULength,
+		&responseAddress);
+
+	if (err != MODBUS_OK)
+		return MODBUS_MAKE_ERROR(MODBUS_ERROR_SOURCE_RESPONSE, err);
+
+	// Check addresses - response to a broadcast request or bad response address
+	if (desc->address == 0 || desc->address != responseAddress)
+		return MODBUS_RESPONSE_ERROR(ADDRESS);
+
+	return modbusParseResponseDescriptorPDU(
+		status,
+		desc,
+		responsePDU,
+		responsePDULength);
+}
+
 /**
 	\brief Parses a Modbus TCP slave response
 	\param request Pointer to the request frame
@@ -383,4 +706,126 @@ LIGHTMODBUS_RET_ERROR modbusParseResponseTCP(
 		responsePDULength);
 }
 
+/**
+	\brief Parses a Modbus TCP slave response using a request descriptor instead of the request
+	\param desc Descriptor of the request the response is for
+	\param transactionID Transaction ID of the request
+	\param response Pointer to the response frame
+	\param responseLength Length of the response (valid range: 8 - 260)
+	\returns MODBUS_RESPONSE_ERROR(LENGTH) if the response has invalid length or if the response frame has different from declared one
+	\returns MODBUS_RESPONSE_ERROR(BAD_PROTOCOL) if the protocol ID in response is not 0
+	\returns MODBUS_RESPONSE_ERROR(BAD_TRANSACTION) if the transaction ID in response is not the expected one
+	\returns MODBUS_RESPONSE_ERROR(ADDRESS) if the unit ID in response is not the same as in request
+	\returns Result of modbusParseResponseDescriptorPDU() otherwise
+*/
+LIGHTMODBUS_RET_ERROR modbusParseResponseDescriptorTCP(
+	ModbusMaster *status,
+	const ModbusRequestDescriptor *desc,
+	uint16_t transactionID,
+	const uint8_t *response,
+	uint16_t responseLength)
+{
+	// Unpack response
+	const uint8_t *responsePDU;
+	uint16_t responsePDULength;
+	uint16_t responseTransactionID;
+	uint8_t responseUnitID;
+	ModbusError err = modbusUnpackTCP(
+		response,
+		responseLength,
+		&responsePDU,
+		&responsePDULength,
+		&responseTransactionID,
+		&responseUnitID);
+
+	if (err != MODBUS_OK)
+		return MODBUS_MAKE_ERROR(MODBUS_ERROR_SOURCE_RESPONSE, err);
+
+	if (transactionID != responseTransactionID)
+		return MODBUS_RESPONSE_ERROR(BAD_TRANSACTION);
+
+	if (desc->address != responseUnitID)
+		return MODBUS_RESPONSE_ERROR(ADDRESS);
+
+	return modbusParseResponseDescriptorPDU(
+		status,
+		desc,
+		responsePDU,
+		responsePDULength);
+}
+
+/**
+	\brief Parses a Modbus ASCII slave response
+	\param request Pointer to the request frame
+	\param requestLength Length of the request (valid range: 9 - 513)
+	\param response Pointer to the response frame
+	\param responseLength Length of the response (valid range: 9 - 513)
+	\returns MODBUS_REQUEST_ERROR(LENGTH) if the request has invalid length
+	\returns MODBUS_RESPONSE_ERROR(LENGTH) if the response has invalid length
+	\returns MODBUS_REQUEST_ERROR(BAD_PROTOCOL) if the request is malformed
+	\returns MODBUS_RESPONSE_ERROR(BAD_PROTOCOL) if the response is malformed
+	\returns MODBUS_REQUEST_ERROR(CRC) if the request LRC is invalid
+	\returns MODBUS_RESPONSE_ERROR(CRC) if the response LRC is invalid
+	\returns MODBUS_RESPONSE_ERROR(ADDRESS) if the address is 0 or if request/response addressess don't match
+	\returns Result of modbusParseResponsePDU() otherwise
+*/
+LIGHTMODBUS_RET_ERROR modbusParseResponseASCII(
+	ModbusMaster *status,
+	const uint8_t *request,
+	uint16_t requestLength,
+	const uint8_t *response,
+	uint16_t responseLength)
+{
+	// Decode and unpack request
+	uint8_t requestBinary[(MODBUS_ASCII_ADU_MAX - 3) / 2];
+	const uint8_t *requestPDU = NULL;
+	uint16_t requestPDULength = 0;
+	uint8_t requestAddress    = 0;
+	ModbusError err = modbusUnpackASCII(
+		request,
+		requestLength,
+#ifdef LIGHTMODBUS_MASTER_OMIT_REQUEST_CRC
+		0,
+#else
+		1,
+#endif
+		requestBinary,
+		&requestPDU,
+		&requestPDULength,
+		&requestAddress);
+
+	if (err != MODBUS_OK)
+		return MODBUS_MAKE_ERROR(MODBUS_ERROR_SOURCE_REQUEST, err);
+
+	// Decode and unpack response
+	uint8_t responseBinary[(MODBUS_ASCII_ADU_MAX - 3) / 2];
+	const uint8_t *responsePDU;
+	uint16_t responsePDULength;
+	uint8_t responseAddress;
+	err = modbusUnpackASCII(
+		response,
+		responseLength,
+		1,
+		responseBinary,
+		&responsePDU,
+		&responsePDULength,
+		&responseAddress);
+
+	if (err != MODBUS_OK)
+		return MODBUS_MAKE_ERROR(MODBUS_ERROR_SOURCE_RESPONSE, err);
+
+	// Check addresses - response to a broadcast request or bad response address
+	if (requestAddress == 0 || requestAddress != responseAddress)
+		return MODBUS_RESPONSE_ERROR(ADDRESS);
+
+	// Parse the PDU itself
+	return modbusParseResponsePDU(
+		status,
+		requestAddress,
+		requestPDU,
+		requestPDULength,
+		responsePDU,
+		responsePDULength);
+}
+
 #endif
@@ -66,6 +66,25 @@
 		return modbusEndRequestTCP(status, transactionID, unitID); \
 	}
 
+/**
+	\def LIGHTMODBUS_DEFINE_BUILD_ASCII_HEADER
+	\brief Defines a header for a `modbusBuildRequest*ASCII()` function
+*/
+#define LIGHTMODBUS_DEFINE_BUILD_ASCII_HEADER(f_suffix, ...) \
+	LIGHTMODBUS_WARN_UNUSED static inline ModbusErrorInfo modbusBuildRequest##f_suffix##ASCII(ModbusMaster *status, uint8_t address, __VA_ARGS__)
+
+/**
+	\def LIGHTMODBUS_DEFINE_BUILD_ASCII_BODY
+	\brief Defines a body for a `modbusBuildRequest*ASCII()` function
+*/
+#define LIGHTMODBUS_DEFINE_BUILD_ASCII_BODY(f_suffix, ...) \
+	{ \
+		ModbusErrorInfo err; \
+		if (!modbusIsOk(err = modbusBeginRequestASCII(status))) return err; \
+		if (!modbusIsOk(err = modbusBuildRequest##f_suffix(status, __VA_ARGS__))) return err; \
+		return modbusEndRequestASCII(status, address); \
+	}
+
 LIGHTMODBUS_RET_ERROR modbusParseResponse01020304(
 	ModbusMaster *status,
 	uint8_t address,
@@ -216,6 +235,10 @@ LIGHTMODBUS_DEFINE_BUILD_RTU_BODY(01, index, count)
 //! \returns Any errors from modbusBeginRequestTCP() or modbusEndRequestTCP()
 LIGHTMODBUS_DEFINE_BUILD_TCP_HEADER(01, uint16_t index, uint16_t count)
 LIGHTMODBUS_DEFINE_BUILD_TCP_BODY(01, index, count)
+//! \copydoc modbusBuildRequest01
+//! \returns Any errors from modbusBeginRequestASCII() or modbusEndRequestASCII()
+LIGHTMODBUS_DEFINE_BUILD_ASCII_HEADER(01, uint16_t index, uint16_t count)
+LIGHTMODBUS_DEFINE_BUILD_ASCII_BODY(01, index, count)
 
 //! \copydoc modbusBuildRequest02
 //! \returns Any errors from modbusBeginRequestPDU() or modbusEndRequestPDU()
@@ -229,6 +252,10 @@ LIGHTMODBUS_DEFINE_BUILD_RTU_BODY(02, index, count)
 //! \returns Any errors from modbusBeginRequestTCP() or modbusEndRequestTCP()
 LIGHTMODBUS_DEFINE_BUILD_TCP_HEADER(02, uint16_t index, uint16_t count)
 LIGHTMODBUS_DEFINE_BUILD_TCP_BODY(02, index, count)
+//! \copydoc modbusBuildRequest02
+//! \returns Any errors from modbusBeginRequestASCII() or modbusEndRequestASCII()
+LIGHTMODBUS_DEFINE_BUILD_ASCII_HEADER(02, uint16_t index, uint16_t count)
+LIGHTMODBUS_DEFINE_BUILD_ASCII_BODY(02, index, count)
 
 //! \copydoc modbusBuildRequest03
 //! \returns Any errors from modbusBeginRequestPDU() or modbusEndRequestPDU()
@@ -242,6 +269,10 @@ LIGHTMODBUS_DEFINE_BUILD_RTU_BODY(03, index, count)
 //! \returns Any errors from modbusBeginRequestTCP() or modbusEndRequestTCP()
 LIGHTMODBUS_DEFINE_BUILD_TCP_HEADER(03, uint16_t index, uint16_t count)
 LIGHTMODBUS_DEFINE_BUILD_TCP_BODY(03, index, count)
+//! \copydoc modbusBuildRequest03
+//! \returns Any errors from modbusBeginRequestASCII() or modbusEndRequestASCII()
+LIGHTMODBUS_DEFINE_BUILD_ASCII_HEADER(03, uint16_t index, uint16_t count)
+LIGHTMODBUS_DEFINE_BUILD_ASCII_BODY(03, index, count)
 
 //! \copydoc modbusBuildRequest04
 //! \returns Any errors from modbusBeginRequestPDU() or modbusEndRequestPDU()
@@ -255,6 +286,10 @@ LIGHTMODBUS_DEFINE_BUILD_RTU_BODY(04, index, count)
 //! \returns Any errors from modbusBeginRequestTCP() or modbusEndRequestTCP()
 LIGHTMODBUS_DEFINE_BUILD_TCP_HEADER(04, uint16_t index, uint16_t count)
 LIGHTMODBUS_DEFINE_BUILD_TCP_BODY(04, index, count)
+//! \copydoc modbusBuildRequest04
+//! \returns Any errors from modbusBeginRequestASCII() or modbusEndRequestASCII()
+LIGHTMODBUS_DEFINE_BUILD_ASCII_HEADER(04, uint16_t index, uint16_t count)
+LIGHTMODBUS_DEFINE_BUILD_ASCII_BODY(04, index, count)
 
 //! \copydoc modbusBuildRequest05
 //! \returns Any errors from modbusBeginRequestPDU() or modbusEndRequestPDU()
@@ -268,6 +303,10 @@ LIGHTMODBUS_DEFINE_BUILD_RTU_BODY(05, index, count)
 //! \returns Any errors from modbusBeginRequestTCP() or modbusEndRequestTCP()
 LIGHTMODBUS_DEFINE_BUILD_TCP_HEADER(05, uint16_t index, uint16_t count)
 LIGHTMODBUS_DEFINE_BUILD_TCP_BODY(05, index, count)
+//! \copydoc modbusBuildRequest05
+//! \returns Any errors from modbusBeginRequestASCII() or modbusEndRequestASCII()
+LIGHTMODBUS_DEFINE_BUILD_ASCII_HEADER(05, uint16_t index, uint16_t count)
+LIGHTMODBUS_DEFINE_BUILD_ASCII_BODY(05, index, count)
 
 //! \copydoc modbusBuildRequest06
 //! \returns Any errors from modbusBeginRequestPDU() or modbusEndRequestPDU()
@@ -281,6 +320,10 @@ LIGHTMODBUS_DEFINE_BUILD_RTU_BODY(06, index, count)
 //! \returns Any errors from modbusBeginRequestTCP() or modbusEndRequestTCP()
 LIGHTMODBUS_DEFINE_BUILD_TCP_HEADER(06, uint16_t index, uint16_t count)
 LIGHTMODBUS_DEFINE_BUILD_TCP_BODY(06, index, count)
+//! \copydoc modbusBuildRequest06
+//! \returns Any errors from modbusBeginRequestASCII() or modbusEndRequestASCII()
+LIGHTMODBUS_DEFINE_BUILD_ASCII_HEADER(06, uint16_t index, uint16_t count)
+LIGHTMODBUS_DEFINE_BUILD_ASCII_BODY(06, index, count)
 
 //! \copydoc modbusBuildRequest15
 //! \returns Any errors from modbusBeginRequestPDU() or modbusEndRequestPDU()
@@ -294,6 +337,10 @@ LIGHTMODBUS_DEFINE_BUILD_RTU_BODY(15, index, count, values)
 //! \returns Any errors from modbusBeginRequestTCP() or modbusEndRequestTCP()
 LIGHTMODBUS_DEFINE_BUILD_TCP_HEADER(15, uint16_t index, uint16_t count, const uint8_t *values)
 LIGHTMODBUS_DEFINE_BUILD_TCP_BODY(15, index, count, values)
+//! \copydoc modbusBuildRequest15
+//! \returns Any errors from modbusBeginRequestASCII() or modbusEndRequestASCII()
+LIGHTMODBUS_DEFINE_BUILD_ASCII_HEADER(15, uint16_t index, uint16_t count, const uint8_t *values)
+LIGHTMODBUS_DEFINE_BUILD_ASCII_BODY(15, index, count, values)
 
 //! \copydoc modbusBuildRequest16
 //! \returns Any errors from modbusBeginRequestPDU() or modbusEndRequestPDU()
@@ -307,6 +354,10 @@ LIGHTMODBUS_DEFINE_BUILD_RTU_BODY(16, index, count, values)
 //! \returns Any errors from modbusBeginRequestTCP() or modbusEndRequestTCP()
 LIGHTMODBUS_DEFINE_BUILD_TCP_HEADER(16, uint16_t index, uint16_t count, const uint16_t *values)
 LIGHTMODBUS_DEFINE_BUILD_TCP_BODY(16, index, count, values)
+//! \copydoc modbusBuildRequest16
+//! \returns Any errors from modbusBeginRequestASCII() or modbusEndRequestASCII()
+LIGHTMODBUS_DEFINE_BUILD_ASCII_HEADER(16, uint16_t index, uint16_t count, const uint16_t *values)
+LIGHTMODBUS_DEFINE_BUILD_ASCII_BODY(16, index, count, values)
 
 //! \copydoc modbusBuildRequest22
 //! \returns Any errors from modbusBeginRequestPDU() or modbusEndRequestPDU()
@@ -320,5 +371,9 @@ LIGHTMODBUS_DEFINE_BUILD_RTU_BODY(22, index, andmask, ormask)
 //! \returns Any errors from modbusBeginRequestTCP() or modbusEndRequestTCP()
 LIGHTMODBUS_DEFINE_BUILD_TCP_HEADER(22, uint16_t index, uint16_t andmask, uint16_t ormask)
 LIGHTMODBUS_DEFINE_BUILD_TCP_BODY(22, index, andmask, ormask)
+//! \copydoc modbusBuildRequest22
+//! \returns Any errors from modbusBeginRequestASCII() or modbusEndRequestASCII()
+LIGHTMODBUS_DEFINE_BUILD_ASCII_HEADER(22, uint16_t index, uint16_t andmask, uint16_t ormask)
+LIGHTMODBUS_DEFINE_BUILD_ASCII_BODY(22, index, andmask, ormask)
 
 #endif
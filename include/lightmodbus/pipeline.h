@@ -0,0 +1,94 @@
+#ifndef LIGHTMODBUS_PIPELINE_H
+#define LIGHTMODBUS_PIPELINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "base.h"
+#include "master.h"
+
+/**
+	\file pipeline.h
+	\brief Transaction table for pipelined Modbus TCP requests (header)
+*/
+
+/**
+	\brief A single Modbus TCP transaction awaiting response
+*/
+typedef struct ModbusTransaction
+{
+	ModbusRequestDescriptor request; //!< Descriptor of the sent request
+	uint32_t deadline;               //!< Time at which the transaction expires
+	uint16_t transactionID;          //!< Modbus TCP transaction identifier
+	uint8_t active;                  //!< Nonzero if the transaction is awaiting response
+	void *context;                   //!< User's context pointer associated with the transaction
+} ModbusTransaction;
+
+/**
+	\brief Keeps track of Modbus TCP requests sent without waiting for responses
+
+	Responses can arrive in any order and are matched with requests using the
+	transaction ID. Transaction IDs are assigned by the table so that each
+	one maps directly onto a slot and lookups don't require searching. If the
+	capacity is a power of two, consecutive requests receive consecutive IDs.
+
+	Timestamps used by the table are in arbitrary units chosen by the user (e.g.
+	milliseconds) and are allowed to wrap around.
+
+	\see modbusTransactionTableInit()
+*/
+typedef struct ModbusTransactionTable
+{
+	ModbusTransaction *entries; //!< A non-owning pointer to storage for the transactions
+	uint16_t capacity;          //!< Size of the \ref entries array
+	uint16_t count;             //!< Number of transactions awaiting response
+	uint16_t nextTransactionID; //!< Transaction ID to be tried first during allocation
+} ModbusTransactionTable;
+
+LIGHTMODBUS_RET_ERROR modbusTransactionTableInit(
+	ModbusTransactionTable *table,
+	ModbusTransaction *entries,
+	uint16_t capacity);
+
+LIGHTMODBUS_RET_ERROR modbusTransactionTableAdd(
+	ModbusTransactionTable *table,
+	uint8_t *frame,
+	uint16_t length,
+	uint32_t deadline,
+	void *context,
+	uint16_t *transactionID);
+
+LIGHTMODBUS_RET_ERROR modbusTransactionTableAddRequest(
+	ModbusTransactionTable *table,
+	ModbusMaster *status,
+	uint32_t deadline,
+	void *context,
+	uint16_t *transactionID);
+
+LIGHTMODBUS_RET_ERROR modbusTransactionTableParseResponseTCP(
+	ModbusTransactionTable *table,
+	ModbusMaster *status,
+	const uint8_t *response,
+	uint16_t responseLength,
+	ModbusTransaction *completed);
+
+uint8_t modbusTransactionTableCancel(ModbusTransactionTable *table, uint16_t transactionID);
+uint8_t modbusTransactionTablePopExpired(ModbusTransactionTable *table, uint32_t now, ModbusTransaction *expired);
+uint8_t modbusTransactionTableNextDeadline(const ModbusTransactionTable *table, uint32_t *deadline);
+
+/**
+	\brief Returns number of transactions awaiting response
+*/
+LIGHTMODBUS_WARN_UNUSED static inline uint16_t modbusTransactionTableGetCount(const ModbusTransactionTable *table)
+{
+	return table->count;
+}
+
+/**
+	\brief Returns nonzero if no more transactions can be added to the table
+*/
+LIGHTMODBUS_WARN_UNUSED static inline uint8_t modbusTransactionTableIsFull(const ModbusTransactionTable *table)
+{
+	return table->count >= table->capacity;
+}
+
+#endif
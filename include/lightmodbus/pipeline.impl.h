@@ -0,0 +1,248 @@
+#ifndef LIGHTMODBUS_PIPELINE_IMPL_H
+#define LIGHTMODBUS_PIPELINE_IMPL_H
+
+#include "pipeline.h"
+
+/**
+	\file pipeline.impl.h
+	\brief Transaction table for pipelined Modbus TCP requests (implementation)
+*/
+
+/**
+	\brief Initializes a ModbusTransactionTable struct
+	\param table ModbusTransactionTable struct to be initialized
+	\param entries Storage for the transactions. The lifetime of this array
+		must not be shorter than the lifetime of the table.
+	\param capacity Number of elements in the `entries` array (maximum number of transactions in flight)
+	\returns MODBUS_GENERAL_ERROR(COUNT) if capacity is 0
+	\returns MODBUS_NO_ERROR() on success
+*/
+LIGHTMODBUS_RET_ERROR modbusTransactionTableInit(
+	ModbusTransactionTable *table,
+	ModbusTransaction *entries,
+	uint16_t capacity)
+{
+	if (!capacity)
+		return MODBUS_GENERAL_ERROR(COUNT);
+
+	table->entries = entries;
+	table->capacity = capacity;
+	table->count = 0;
+	table->nextTransactionID = 0;
+
+	for (uint16_t i = 0; i < capacity; i++)
+		entries[i].active = 0;
+
+	return MODBUS_NO_ERROR();
+}
+
+/**
+	\brief Registers a Modbus TCP request frame in the transaction table
+	\param frame Modbus TCP request frame. Its transaction ID is overwritten with the assigned one.
+	\param length Length of the frame
+	\param deadline Time at which the transaction expires
+	\param context User's context pointer to be associated with the transaction (optional)
+	\param transactionID Output: assigned transaction ID (optional)
+	\returns MODBUS_GENERAL_ERROR(ALLOC) if the table is full
+	\returns MODBUS_REQUEST_ERROR(LENGTH) or MODBUS_REQUEST_ERROR(BAD_PROTOCOL) if the frame is not a valid Modbus TCP frame
+	\returns MODBUS_NO_ERROR() on success
+
+	Once the request is registered, the frame buffer is no longer needed to
+	parse the response and can be reused for the next request.
+*/
+LIGHTMODBUS_RET_ERROR modbusTransactionTableAdd(
+	ModbusTransactionTable *table,
+	uint8_t *frame,
+	uint16_t length,
+	uint32_t deadline,
+	void *context,
+	uint16_t *transactionID)
+{
+	if (modbusTransactionTableIsFull(table))
+		return MODBUS_GENERAL_ERROR(ALLOC);
+
+	const uint8_t *pdu;
+	uint16_t pduLength;
+	uint16_t oldTransactionID;
+	uint8_t unitID;
+	ModbusError err = modbusUnpackTCP(
+		frame,
+		length,
+		&pdu,
+		&pduLength,
+		&oldTransactionID,
+		&unitID);
+
+	if (err != MODBUS_OK)
+		return MODBUS_MAKE_ERROR(MODBUS_ERROR_SOURCE_REQUEST, err);
+
+	// Find a transaction ID which maps onto a free slot
+	// This always succeeds, because the table is not full
+	uint16_t tid = table->nextTransactionID;
+	while (table->entries[tid % table->capacity].active)
+		tid++;
+
+	ModbusTransaction *t = &table->entries[tid % table->capacity];
+	ModbusErrorInfo errinfo = modbusRequestDescriptorInit(&t->request, unitID, pdu, pduLength);
+	if (!modbusIsOk(errinfo))
+		return errinfo;
+
+	modbusWBE(&frame[0], tid);
+	t->deadline = deadline;
+	t->transactionID = tid;
+	t->context = context;
+	t->active = 1;
+
+	table->count++;
+	table->nextTransactionID = tid + 1;
+	if (transactionID)
+		*transactionID = tid;
+
+	return MODBUS_NO_ERROR();
+}
+
+/**
+	\brief Registers the Modbus TCP request currently held by the master in the transaction table
+	\returns Same values as modbusTransactionTableAdd()
+
+	The transaction ID passed to modbusEndRequestTCP() is irrelevant and is overwritten.
+	\see modbusTransactionTableAdd()
+*/
+LIGHTMODBUS_RET_ERROR modbusTransactionTableAddRequest(
+	ModbusTransactionTable *table,
+	ModbusMaster *status,
+	uint32_t deadline,
+	void *context,
+	uint16_t *transactionID)
+{
+	return modbusTransactionTableAdd(
+		table,
+		status->request.data,
+		status->request.length,
+		deadline,
+		context,
+		transactionID);
+}
+
+/**
+	\brief Matches a Modbus TCP response with a pending transaction and parses it
+	\param status Master used to parse the response
+	\param response Modbus TCP response frame
+	\param responseLength Length of the response frame
+	\param completed Output: copy of the matched transaction (optional). If the response
+		could be matched with a transaction, its `active` field is nonzero. Otherwise it's zero.
+	\returns MODBUS_RESPONSE_ERROR(BAD_TRANSACTION) if there's no pending transaction with a matching ID
+	\returns MODBUS_RESPONSE_ERROR(ADDRESS) if the unit ID does not match the request
+	\returns MODBUS_RESPONSE_ERROR(LENGTH) or MODBUS_RESPONSE_ERROR(BAD_PROTOCOL) if the frame cannot be unpacked
+	\returns Any error returned by modbusParseResponseDescriptorPDU()
+
+	Matched transactions are removed from the table, even if the response turns out to be invalid.
+*/
+LIGHTMODBUS_RET_ERROR modbusTransactionTableParseResponseTCP(
+	ModbusTransactionTable *table,
+	ModbusMaster *status,
+	const uint8_t *response,
+	uint16_t responseLength,
+	ModbusTransaction *completed)
+{
+	if (completed)
+		completed->active = 0;
+
+	const uint8_t *pdu;
+	uint16_t pduLength;
+	uint16_t tid;
+	uint8_t unitID;
+	ModbusError err = modbusUnpackTCP(
+		response,
+		responseLength,
+		&pdu,
+		&pduLength,
+		&tid,
+		&unitID);
+
+	if (err != MODBUS_OK)
+		return MODBUS_MAKE_ERROR(MODBUS_ERROR_SOURCE_RESPONSE, err);
+
+	ModbusTransaction *t = &table->entries[tid % table->capacity];
+	if (!t->active || t->transactionID != tid)
+		return MODBUS_RESPONSE_ERROR(BAD_TRANSACTION);
+
+	if (completed)
+		*completed = *t;
+	t->active = 0;
+	table->count--;
+
+	if (t->request.address != unitID)
+		return MODBUS_RESPONSE_ERROR(ADDRESS);
+
+	return modbusParseResponseDescriptorPDU(status, &t->request, pdu, pduLength);
+}
+
+/**
+	\brief Removes a pending transaction from the table
+	\returns 1 if the transaction was found and removed, 0 otherwise
+*/
+uint8_t modbusTransactionTableCancel(ModbusTransactionTable *table, uint16_t transactionID)
+{
+	ModbusTransaction *t = &table->entries[transactionID % table->capacity];
+	if (!t->active || t->transactionID != transactionID)
+		return 0;
+
+	t->active = 0;
+	table->count--;
+	return 1;
+}
+
+/**
+	\brief Removes one expired transaction from the table
+	\param now Current time
+	\param expired Output: copy of the removed transaction (optional)
+	\returns 1 if an expired transaction was removed, 0 if there are none left
+
+	This function should be called repeatedly until it returns 0.
+	Late responses to the removed transactions are rejected with
+	MODBUS_RESPONSE_ERROR(BAD_TRANSACTION).
+*/
+uint8_t modbusTransactionTablePopExpired(ModbusTransactionTable *table, uint32_t now, ModbusTransaction *expired)
+{
+	if (!table->count)
+		return 0;
+
+	for (uint16_t i = 0; i < table->capacity; i++)
+	{
+		ModbusTransaction *t = &table->entries[i];
+		if (t->active && modbusTimeDiff(now, t->deadline) >= 0)
+		{
+			t->active = 0;
+			table->count--;
+			if (expired)
+				*expired = *t;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+	\brief Finds the earliest deadline of all pending transactions
+	\param deadline Output: the earliest deadline
+	\returns 1 on success, 0 if there are no pending transactions
+*/
+uint8_t modbusTransactionTableNextDeadline(const ModbusTransactionTable *table, uint32_t *deadline)
+{
+	uint8_t found = 0;
+	for (uint16_t i = 0; i < table->capacity && table->count; i++)
+	{
+		const ModbusTransaction *t = &table->entries[i];
+		if (t->active && (!found || modbusTimeDiff(t->deadline, *deadline) < 0))
+		{
+			*deadline = t->deadline;
+			found = 1;
+		}
+	}
+
+	return found;
+}
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef LIGHTMODBUS_RTT_H
+#define LIGHTMODBUS_RTT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "base.h"
+
+/**
+	\file rtt.h
+	\brief Adaptive response timeout estimation for master (header)
+*/
+
+/**
+	\brief Round-trip time statistics of a single (slave address, function) pair
+*/
+typedef struct ModbusRTTEntry
+{
+	uint32_t srtt;    //!< Smoothed round-trip time (scaled by 8)
+	uint32_t rttvar;  //!< Round-trip time mean deviation (scaled by 4)
+	uint32_t timeout; //!< Current response timeout
+	uint16_t samples; //!< Number of round-trip time samples (saturates)
+	uint8_t address;  //!< Slave address
+	uint8_t function; //!< Function code
+	uint8_t used;     //!< Nonzero if the entry is in use
+} ModbusRTTEntry;
+
+/**
+	\brief Estimates response timeouts from measured round-trip times
+
+	The estimator works just like TCP retransmission timer (RFC 6298) - it keeps
+	an exponentially weighted moving average of round-trip time and its mean
+	deviation, and the timeout is set to the average plus four deviations.
+	Each timeout doubles the timeout until a response arrives again.
+
+	Time is measured in arbitrary units chosen by the user (e.g. milliseconds).
+
+	\see modbusRTTEstimatorInit()
+*/
+typedef struct ModbusRTTEstimator
+{
+	ModbusRTTEntry *entries; //!< A non-owning pointer to storage for the statistics
+	uint16_t capacity;       //!< Size of the \ref entries array
+
+	uint32_t initialTimeout; //!< Timeout used before the first response is received
+	uint32_t minTimeout;     //!< Lower bound of the timeout
+	uint32_t maxTimeout;     //!< Upper bound of the timeout
+} ModbusRTTEstimator;
+
+LIGHTMODBUS_RET_ERROR modbusRTTEstimatorInit(
+	ModbusRTTEstimator *estimator,
+	ModbusRTTEntry *entries,
+	uint16_t capacity,
+	uint32_t initialTimeout,
+	uint32_t minTimeout,
+	uint32_t maxTimeout);
+
+LIGHTMODBUS_WARN_UNUSED uint32_t modbusRTTGetTimeout(
+	const ModbusRTTEstimator *estimator,
+	uint8_t address,
+	uint8_t function);
+
+void modbusRTTAddSample(ModbusRTTEstimator *estimator, uint8_t address, uint8_t function, uint32_t rtt);
+void modbusRTTAddTimeout(ModbusRTTEstimator *estimator, uint8_t address, uint8_t function);
+
+#endif
@@ -0,0 +1,175 @@
+#ifndef LIGHTMODBUS_RTT_IMPL_H
+#define LIGHTMODBUS_RTT_IMPL_H
+
+#include "rtt.h"
+
+/**
+	\file rtt.impl.h
+	\brief Adaptive response timeout estimation for master (implementation)
+*/
+
+/**
+	\brief Initializes a ModbusRTTEstimator struct
+	\param estimator ModbusRTTEstimator struct to be initialized
+	\param entries Storage for the statistics. The lifetime of this array must not
+		be shorter than the lifetime of the estimator.
+	\param capacity Number of elements in the `entries` array (maximum number of
+		tracked (slave address, function) pairs)
+	\param initialTimeout Timeout used before the first response is received
+	\param minTimeout Lower bound of the timeout
+	\param maxTimeout Upper bound of the timeout
+	\returns MODBUS_GENERAL_ERROR(COUNT) if capacity is 0
+	\returns MODBUS_GENERAL_ERROR(VALUE) if the initial timeout is not between the bounds
+	\returns MODBUS_NO_ERROR() on success
+*/
+LIGHTMODBUS_RET_ERROR modbusRTTEstimatorInit(
+	ModbusRTTEstimator *estimator,
+	ModbusRTTEntry *entries,
+	uint16_t capacity,
+	uint32_t initialTimeout,
+	uint32_t minTimeout,
+	uint32_t maxTimeout)
+{
+	if (!capacity)
+		return MODBUS_GENERAL_ERROR(COUNT);
+
+	if (initialTimeout < minTimeout || initialTimeout > maxTimeout)
+		return MODBUS_GENERAL_ERROR(VALUE);
+
+	estimator->entries = entries;
+	estimator->capacity = capacity;
+	estimator->initialTimeout = initialTimeout;
+	estimator->minTimeout = minTimeout;
+	estimator->maxTimeout = maxTimeout;
+
+	for (uint16_t i = 0; i < capacity; i++)
+		entries[i].used = 0;
+
+	return MODBUS_NO_ERROR();
+}
+
+/**
+	\brief Finds entry for the given slave address and function
+	\param create If nonzero, a new entry is allocated when none is found
+	\returns NULL if the entry doesn't exist and `create` is zero
+
+	Entries are never removed, so lookups use linear probing. If the storage
+	is full, a new pair takes over the entry it hashes onto.
+*/
+static ModbusRTTEntry *modbusRTTFind(
+	const ModbusRTTEstimator *estimator,
+	uint8_t address,
+	uint8_t function,
+	uint8_t create)
+{
+	uint16_t home = (uint16_t)(((uint16_t) address << 8 | function) % estimator->capacity);
+	for (uint16_t i = 0; i < estimator->capacity; i++)
+	{
+		ModbusRTTEntry *e = &estimator->entries[(home + i) % estimator->capacity];
+		if (e->used && e->address == address && e->function == function)
+			return e;
+
+		if (!e->used)
+		{
+			if (!create)
+				return NULL;
+			break;
+		}
+	}
+
+	if (!create)
+		return NULL;
+
+	// Find a free entry or evict the home one
+	ModbusRTTEntry *e = &estimator->entries[home];
+	for (uint16_t i = 0; i < estimator->capacity; i++)
+	{
+		ModbusRTTEntry *f = &estimator->entries[(home + i) % estimator->capacity];
+		if (!f->used)
+		{
+			e = f;
+			break;
+		}
+	}
+
+	e->used = 1;
+	e->address = address;
+	e->function = function;
+	e->samples = 0;
+	e->srtt = 0;
+	e->rttvar = 0;
+	e->timeout = estimator->initialTimeout;
+	return e;
+}
+
+/**
+	\brief Returns response timeout for a request
+	\param address Slave address
+	\param function Function code
+	\returns Current timeout estimate or the initial timeout if no responses
+		have been received so far
+*/
+LIGHTMODBUS_WARN_UNUSED uint32_t modbusRTTGetTimeout(
+	const ModbusRTTEstimator *estimator,
+	uint8_t address,
+	uint8_t function)
+{
+	const ModbusRTTEntry *e = modbusRTTFind(estimator, address, function, 0);
+	return e ? e->timeout : estimator->initialTimeout;
+}
+
+/**
+	\brief Updates the estimate with a measured round-trip time
+	\param address Slave address
+	\param function Function code
+	\param rtt Time elapsed between sending the request and receiving the response
+
+	Exception responses are valid samples too. Responses to requests which had
+	already timed out should not be sampled (Karn's algorithm).
+*/
+void modbusRTTAddSample(ModbusRTTEstimator *estimator, uint8_t address, uint8_t function, uint32_t rtt)
+{
+	ModbusRTTEntry *e = modbusRTTFind(estimator, address, function, 1);
+
+	if (!e->samples)
+	{
+		e->srtt = rtt << 3;
+		e->rttvar = rtt << 1;
+	}
+	else
+	{
+		uint32_t avg = e->srtt >> 3;
+		uint32_t delta = rtt > avg ? rtt - avg : avg - rtt;
+		e->rttvar = e->rttvar - (e->rttvar >> 2) + delta;
+		e->srtt = e->srtt - (e->srtt >> 3) + rtt;
+	}
+
+	if (e->samples < UINT16_MAX)
+		e->samples++;
+
+	uint32_t timeout = (e->srtt >> 3) + (e->rttvar ? e->rttvar : 1);
+	if (timeout < estimator->minTimeout)
+		timeout = estimator->minTimeout;
+	if (timeout > estimator->maxTimeout)
+		timeout = estimator->maxTimeout;
+	e->timeout = timeout;
+}
+
+/**
+	\brief Backs off the timeout after a request was left without response
+	\param address Slave address
+	\param function Function code
+
+	The timeout is doubled (up to the upper bound) and stays
+	so until the next round-trip time sample.
+*/
+void modbusRTTAddTimeout(ModbusRTTEstimator *estimator, uint8_t address, uint8_t function)
+{
+	ModbusRTTEntry *e = modbusRTTFind(estimator, address, function, 1);
+	if (e->timeout < estimator->maxTimeout / 2)
+		e->timeout *= 2;
+	else
+		e->timeout = estimator->maxTimeout;
+}
+
+#endif
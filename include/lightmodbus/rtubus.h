@@ -0,0 +1,124 @@
+#ifndef LIGHTMODBUS_RTUBUS_H
+#define LIGHTMODBUS_RTUBUS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "base.h"
+#include "master.h"
+
+/**
+	\file rtubus.h
+	\brief Multi-drop Modbus RTU bus scheduler for master (header)
+*/
+
+/**
+	\def MODBUS_RTU_CHAR_BITS
+	\brief Number of bits transmitted per character in Modbus RTU (start, 8 data, parity/stop, stop)
+*/
+#define MODBUS_RTU_CHAR_BITS 11
+
+/**
+	\brief State and statistics of a single slave on the bus
+
+	Only \ref address has to be set by the user. All times are in microseconds.
+*/
+typedef struct ModbusRTUSlave
+{
+	uint8_t address;    //!< Slave address
+	uint8_t failures;   //!< Number of consecutive failed transactions
+	uint32_t backoff;   //!< Current backoff time (0 if the slave is responding)
+	uint32_t probeAt;   //!< Time at which a slave in backoff is probed again
+
+	uint32_t requests;  //!< Number of requests sent to this slave
+	uint32_t responses; //!< Number of valid responses
+	uint32_t errors;    //!< Number of invalid responses
+	uint32_t timeouts;  //!< Number of requests left without response
+	uint32_t busyTime;  //!< Total bus time used by transactions with this slave
+	void *context;      //!< User's context pointer
+} ModbusRTUSlave;
+
+/**
+	\brief Schedules transactions with multiple slaves sharing a Modbus RTU line
+
+	All timestamps are in microseconds and are allowed to wrap around.
+
+	\see modbusRTUBusInit()
+*/
+typedef struct ModbusRTUBus
+{
+	uint32_t baudrate;        //!< Line baud rate
+	uint32_t charTime;        //!< Air time of a single character
+	uint32_t t35;             //!< Minimum silent interval between frames
+	uint32_t turnaround;      //!< Time allowed for the slave to start responding
+	uint32_t backoffMin;      //!< Backoff time after the first failure
+	uint32_t backoffMax;      //!< Maximum backoff time
+	uint8_t failureThreshold; //!< Number of consecutive failures after which a slave is put into backoff
+
+	ModbusRTUSlave *slaves; //!< A non-owning pointer to array of slaves
+	uint16_t slaveCount;    //!< Size of \ref slaves array
+	uint16_t next;          //!< Index of the slave to be considered first
+
+	ModbusRTUSlave *pending; //!< Slave whose response is awaited or NULL
+	uint8_t broadcast;       //!< Whether the pending request is a broadcast
+	uint32_t start;          //!< Time at which the pending transaction started
+	uint32_t deadline;       //!< Time at which the pending transaction times out
+	uint32_t idleFrom;       //!< Time from which the bus can be used for the next request
+	uint32_t busyTime;       //!< Total time used by all transactions
+} ModbusRTUBus;
+
+LIGHTMODBUS_RET_ERROR modbusRTUBusInit(
+	ModbusRTUBus *bus,
+	uint32_t baudrate,
+	uint32_t turnaround,
+	ModbusRTUSlave *slaves,
+	uint16_t slaveCount,
+	uint32_t now);
+
+ModbusRTUSlave *modbusRTUBusNextSlave(ModbusRTUBus *bus, uint32_t now);
+
+LIGHTMODBUS_RET_ERROR modbusRTUBusBeginTransaction(
+	ModbusRTUBus *bus,
+	ModbusRTUSlave *slave,
+	const ModbusMaster *master,
+	uint32_t now);
+
+LIGHTMODBUS_RET_ERROR modbusRTUBusParseResponse(
+	ModbusRTUBus *bus,
+	ModbusMaster *master,
+	const uint8_t *response,
+	uint16_t responseLength,
+	uint32_t now);
+
+uint8_t modbusRTUBusCheckTimeout(ModbusRTUBus *bus, uint32_t now);
+uint8_t modbusRTUBusNextWakeup(const ModbusRTUBus *bus, uint32_t *wakeup);
+
+/**
+	\brief Returns air time of a Modbus RTU character in microseconds (rounded up)
+*/
+LIGHTMODBUS_WARN_UNUSED static inline uint32_t modbusRTUCharTime(uint32_t baudrate)
+{
+	return (MODBUS_RTU_CHAR_BITS * 1000000ul + baudrate - 1) / baudrate;
+}
+
+/**
+	\brief Returns air time of a Modbus RTU frame in microseconds (rounded up)
+	\param length Length of the frame in bytes (valid range: 0 - 256)
+*/
+LIGHTMODBUS_WARN_UNUSED static inline uint32_t modbusRTUFrameTime(uint32_t baudrate, uint16_t length)
+{
+	return ((uint32_t) length * MODBUS_RTU_CHAR_BITS * 1000000ul + baudrate - 1) / baudrate;
+}
+
+/**
+	\brief Returns the t3.5 inter-frame delay in microseconds
+
+	Above 19200 baud a fixed value of 1750 us is used, as recommended by the specification.
+*/
+LIGHTMODBUS_WARN_UNUSED static inline uint32_t modbusRTUSilence(uint32_t baudrate)
+{
+	if (baudrate > 19200)
+		return 1750;
+	return (7 * MODBUS_RTU_CHAR_BITS * 1000000ul / 2 + baudrate - 1) / baudrate;
+}
+
+#endif
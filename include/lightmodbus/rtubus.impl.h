@@ -0,0 +1,298 @@
+#ifndef LIGHTMODBUS_RTUBUS_IMPL_H
+#define LIGHTMODBUS_RTUBUS_IMPL_H
+
+#include "rtubus.h"
+
+/**
+	\file rtubus.impl.h
+	\brief Multi-drop Modbus RTU bus scheduler for master (implementation)
+*/
+
+/**
+	\brief Initializes a ModbusRTUBus struct
+	\param bus ModbusRTUBus struct to be initialized
+	\param baudrate Line baud rate
+	\param turnaround Time in microseconds the slaves are given to start responding
+		once they receive the request
+	\param slaves Pointer to an array of slaves (required). Only addresses need to be set.
+		The lifetime of this array must not be shorter than the lifetime of the bus.
+	\param slaveCount Number of elements in the `slaves` array
+	\param now Current time. The bus can be used immediately.
+	\returns MODBUS_GENERAL_ERROR(VALUE) if the baud rate is 0
+	\returns MODBUS_NO_ERROR() on success
+
+	Slaves are put into backoff after 2 consecutive failures. The backoff starts at
+	100 ms and is doubled up to 10 s with each failed probe. These values can be
+	changed by modifying \ref ModbusRTUBus::failureThreshold, \ref ModbusRTUBus::backoffMin
+	and \ref ModbusRTUBus::backoffMax after initialization.
+*/
+LIGHTMODBUS_RET_ERROR modbusRTUBusInit(
+	ModbusRTUBus *bus,
+	uint32_t baudrate,
+	uint32_t turnaround,
+	ModbusRTUSlave *slaves,
+	uint16_t slaveCount,
+	uint32_t now)
+{
+	if (!baudrate)
+		return MODBUS_GENERAL_ERROR(VALUE);
+
+	bus->baudrate = baudrate;
+	bus->charTime = modbusRTUCharTime(baudrate);
+	bus->t35 = modbusRTUSilence(baudrate);
+	bus->turnaround = turnaround;
+	bus->backoffMin = 100000ul;
+	bus->backoffMax = 10000000ul;
+	bus->failureThreshold = 2;
+
+	bus->slaves = slaves;
+	bus->slaveCount = slaveCount;
+	bus->next = 0;
+
+	bus->pending = NULL;
+	bus->broadcast = 0;
+	bus->start = now;
+	bus->deadline = now;
+	bus->idleFrom = now;
+	bus->busyTime = 0;
+
+	for (uint16_t i = 0; i < slaveCount; i++)
+	{
+		ModbusRTUSlave *s = &slaves[i];
+		s->failures = 0;
+		s->backoff = 0;
+		s->probeAt = now;
+		s->requests = 0;
+		s->responses = 0;
+		s->errors = 0;
+		s->timeouts = 0;
+		s->busyTime = 0;
+	}
+
+	return MODBUS_NO_ERROR();
+}
+
+/**
+	\brief Selects the slave to be sent the next request
+	\param now Current time
+	\returns NULL if the bus is busy or all slaves are in backoff
+
+	Slaves are served in round-robin order. Slaves in backoff are skipped
+	until it's time to probe them again.
+*/
+ModbusRTUSlave *modbusRTUBusNextSlave(ModbusRTUBus *bus, uint32_t now)
+{
+	if (bus->pending || modbusTimeDiff(now, bus->idleFrom) < 0)
+		return NULL;
+
+	for (uint16_t i = 0; i < bus->slaveCount; i++)
+	{
+		uint16_t index = (bus->next + i) % bus->slaveCount;
+		ModbusRTUSlave *s = &bus->slaves[index];
+		if (s->backoff && modbusTimeDiff(now, s->probeAt) < 0)
+			continue;
+
+		bus->next = index + 1;
+		return s;
+	}
+
+	return NULL;
+}
+
+/**
+	\brief Registers a request sent to a slave
+	\param slave The slave the request is sent to
+	\param master Master holding the request (built with `modbusBuildRequest*RTU()`).
+		The request must be kept until the transaction is finished.
+	\param now Time at which the transmission of the request begins
+	\returns MODBUS_GENERAL_ERROR(OTHER) if another transaction is in progress
+	\returns MODBUS_REQUEST_ERROR(LENGTH) if the master doesn't hold a valid request
+	\returns MODBUS_NO_ERROR() on success
+
+	The transaction times out once the request is transmitted, the slave detects the end of
+	the frame, the turnaround time elapses and the longest response expected for the request
+	is transmitted. Broadcast requests finish without response after the turnaround time.
+*/
+LIGHTMODBUS_RET_ERROR modbusRTUBusBeginTransaction(
+	ModbusRTUBus *bus,
+	ModbusRTUSlave *slave,
+	const ModbusMaster *master,
+	uint32_t now)
+{
+	if (bus->pending)
+		return MODBUS_GENERAL_ERROR(OTHER);
+
+	uint16_t length = modbusMasterGetRequestLength(master);
+	const uint8_t *request = modbusMasterGetRequest(master);
+	if (length < MODBUS_RTU_ADU_MIN || length > MODBUS_RTU_ADU_MAX)
+		return MODBUS_REQUEST_ERROR(LENGTH);
+
+	uint32_t airtime = modbusRTUFrameTime(bus->baudrate, length);
+
+	bus->pending = slave;
+	bus->start = now;
+	slave->requests++;
+
+	// Broadcast - no response
+	bus->broadcast = request[0] == 0;
+	if (bus->broadcast)
+	{
+		bus->deadline = now + airtime + bus->turnaround;
+		return MODBUS_NO_ERROR();
+	}
+
+	uint8_t expected = modbusExpectedResponseLength(&request[MODBUS_RTU_PDU_OFFSET], length - MODBUS_RTU_ADU_PADDING);
+	uint16_t responseLength = expected ? expected + MODBUS_RTU_ADU_PADDING : MODBUS_RTU_ADU_MAX;
+	bus->deadline = now
+		+ airtime
+		+ bus->t35
+		+ bus->turnaround
+		+ modbusRTUFrameTime(bus->baudrate, responseLength);
+
+	return MODBUS_NO_ERROR();
+}
+
+/**
+	\brief Ends the pending transaction and accounts for its bus time
+*/
+static void modbusRTUBusFinish(ModbusRTUBus *bus, uint32_t now)
+{
+	uint32_t busy = now - bus->start + bus->t35;
+	bus->pending->busyTime += busy;
+	bus->busyTime += busy;
+	bus->idleFrom = now + bus->t35;
+	bus->pending = NULL;
+}
+
+/**
+	\brief Parses a response to the pending transaction
+	\param master Master holding the request
+	\param response Modbus RTU response frame
+	\param responseLength Length of the response frame
+	\param now Time at which the last byte of the response was received
+	\returns MODBUS_RESPONSE_ERROR(OTHER) if no transaction is in progress
+	\returns Any error returned by modbusParseResponseRTU()
+
+	Frames that can't be the response - with bad CRC (or too short to hold
+	one), from another slave or with another function code - are rejected
+	and the transaction stays pending, so it can still time out. Otherwise
+	the transaction ends and the next request can be sent as soon as the
+	t3.5 interval elapses. Only a valid response or exception brings the
+	slave out of backoff - a malformed one is counted as an error.
+*/
+LIGHTMODBUS_RET_ERROR modbusRTUBusParseResponse(
+	ModbusRTUBus *bus,
+	ModbusMaster *master,
+	const uint8_t *response,
+	uint16_t responseLength,
+	uint32_t now)
+{
+	ModbusRTUSlave *slave = bus->pending;
+	if (!slave)
+		return MODBUS_RESPONSE_ERROR(OTHER);
+
+	// Noise too short to hold a CRC. Exception frames are accepted
+	// by the parser regardless of the function, so it's checked here.
+	const uint8_t *request = modbusMasterGetRequest(master);
+	uint16_t requestLength = modbusMasterGetRequestLength(master);
+	if (responseLength < 4)
+		return MODBUS_RESPONSE_ERROR(LENGTH);
+	if (requestLength >= 2 && (response[1] & 0x7f) != request[1])
+		return MODBUS_RESPONSE_ERROR(FUNCTION);
+
+	ModbusErrorInfo err = modbusParseResponseRTU(
+		master,
+		request,
+		requestLength,
+		response,
+		responseLength);
+
+	if (modbusGetResponseError(err) == MODBUS_ERROR_CRC
+		|| modbusGetResponseError(err) == MODBUS_ERROR_ADDRESS
+		|| modbusGetResponseError(err) == MODBUS_ERROR_FUNCTION)
+		return err;
+
+	if (modbusIsOk(err))
+	{
+		slave->responses++;
+		slave->failures = 0;
+		slave->backoff = 0;
+	}
+	else
+		slave->errors++;
+
+	modbusRTUBusFinish(bus, now);
+	return err;
+}
+
+/**
+	\brief Checks whether the pending transaction has timed out
+	\param now Current time
+	\returns 1 if the transaction has timed out, 0 otherwise (also when a broadcast request is finished)
+
+	Slaves failing to respond \ref ModbusRTUBus::failureThreshold times in a row are put into
+	exponential backoff and only probed occasionally, until they respond again.
+*/
+uint8_t modbusRTUBusCheckTimeout(ModbusRTUBus *bus, uint32_t now)
+{
+	ModbusRTUSlave *slave = bus->pending;
+	if (!slave || modbusTimeDiff(now, bus->deadline) < 0)
+		return 0;
+
+	// Broadcast finished
+	if (bus->broadcast)
+	{
+		modbusRTUBusFinish(bus, now);
+		return 0;
+	}
+
+	slave->timeouts++;
+	if (slave->failures < UINT8_MAX)
+		slave->failures++;
+
+	if (slave->failures >= bus->failureThreshold)
+	{
+		if (!slave->backoff)
+			slave->backoff = bus->backoffMin;
+		else if (slave->backoff < bus->backoffMax / 2)
+			slave->backoff *= 2;
+		else
+			slave->backoff = bus->backoffMax;
+
+		slave->probeAt = now + slave->backoff;
+	}
+
+	modbusRTUBusFinish(bus, now);
+	return 1;
+}
+
+/**
+	\brief Returns time at which the bus needs attention
+	\param wakeup Output: the pending transaction's deadline or the time at which
+		the next request can be sent
+	\returns 0 if there are no slaves, 1 otherwise
+*/
+uint8_t modbusRTUBusNextWakeup(const ModbusRTUBus *bus, uint32_t *wakeup)
+{
+	if (bus->pending)
+	{
+		*wakeup = bus->deadline;
+		return 1;
+	}
+
+	uint8_t found = 0;
+	for (uint16_t i = 0; i < bus->slaveCount; i++)
+	{
+		const ModbusRTUSlave *s = &bus->slaves[i];
+		uint32_t t = s->backoff && modbusTimeDiff(s->probeAt, bus->idleFrom) > 0 ? s->probeAt : bus->idleFrom;
+		if (!found || modbusTimeDiff(t, *wakeup) < 0)
+		{
+			*wakeup = t;
+			found = 1;
+		}
+	}
+
+	return found;
+}
+
+#endif
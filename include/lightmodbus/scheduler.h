@@ -0,0 +1,184 @@
+#ifndef LIGHTMODBUS_SCHEDULER_H
+#define LIGHTMODBUS_SCHEDULER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "base.h"
+#include "master.h"
+
+/**
+	\file scheduler.h
+	\brief Deadline-driven polling scheduler for master (header)
+*/
+
+/**
+	\def MODBUS_POLL_HISTOGRAM_BINS
+	\brief Number of bins in the jitter and overrun histograms
+
+	Bin 0 counts zero values and bin `n` counts values in range `[2^(n-1), 2^n)`.
+	The last bin also counts all values larger than that.
+*/
+#ifndef MODBUS_POLL_HISTOGRAM_BINS
+#define MODBUS_POLL_HISTOGRAM_BINS 16
+#endif
+
+typedef struct ModbusPollScheduler ModbusPollScheduler;
+
+/**
+	\brief Frame format used by the polling scheduler
+*/
+typedef enum ModbusPollFormat
+{
+	MODBUS_POLL_PDU = 0, //!< PDU-only frames
+	MODBUS_POLL_RTU,     //!< Modbus RTU frames
+	MODBUS_POLL_TCP      //!< Modbus TCP frames
+} ModbusPollFormat;
+
+/**
+	\brief Polling statistics of a single poll group
+
+	All times are in the same units as the timestamps passed to the scheduler.
+*/
+typedef struct ModbusPollStats
+{
+	uint32_t polls;     //!< Number of sent requests
+	uint32_t responses; //!< Number of successfully parsed responses
+	uint32_t errors;    //!< Number of invalid responses and transport errors
+	uint32_t timeouts;  //!< Number of requests left without response
+	uint32_t overruns;  //!< Number of polls started after their deadline
+	uint32_t skipped;   //!< Number of poll cycles skipped entirely due to overruns
+
+	uint32_t firstStart;  //!< Time at which the first request was sent
+	uint32_t lastStart;   //!< Time at which the last request was sent
+	uint32_t lastPeriod;  //!< Last achieved polling period
+	uint32_t minPeriod;   //!< Shortest achieved polling period
+	uint32_t maxPeriod;   //!< Longest achieved polling period
+	uint32_t maxJitter;   //!< Largest delay between a poll becoming due and the request being sent
+	uint32_t lastLatency; //!< Last response time
+	uint32_t maxLatency;  //!< Longest response time
+
+	uint32_t jitterHistogram[MODBUS_POLL_HISTOGRAM_BINS];  //!< Histogram of poll start delays
+	uint32_t overrunHistogram[MODBUS_POLL_HISTOGRAM_BINS]; //!< Histogram of deadline misses
+} ModbusPollStats;
+
+/**
+	\brief A read request issued periodically by the scheduler
+
+	Fields above \ref release are configuration and should be set
+	by the user before the scheduler is initialized.
+*/
+typedef struct ModbusPollGroup
+{
+	uint32_t period;   //!< Polling period. The deadline of each poll is the beginning of the next cycle.
+	uint16_t index;    //!< Index of the first register/coil
+	uint16_t count;    //!< Number of registers/coils
+	uint8_t function;  //!< Read function (1 - 4)
+	uint8_t address;   //!< Slave address or unit ID
+	uint8_t priority;  //!< Priority used when deadlines can't be met (higher is more important)
+	void *context;     //!< User's context pointer
+
+	uint32_t release;      //!< Time at which the next poll becomes due (managed by the scheduler)
+	ModbusPollStats stats; //!< Polling statistics
+} ModbusPollGroup;
+
+/**
+	\brief A pointer to a callback used to send requests built by the scheduler
+	\returns MODBUS_OK if the request was sent
+*/
+typedef ModbusError (*ModbusPollTransportCallback)(
+	ModbusPollScheduler *scheduler,
+	const ModbusPollGroup *group,
+	const uint8_t *frame,
+	uint16_t length);
+
+/**
+	\brief Issues periodic read requests earliest-deadline-first
+
+	The scheduler keeps at most one request in flight. Requests are sent via
+	the transport callback and responses are passed back to the scheduler
+	with modbusPollSchedulerParseResponse().
+
+	\see modbusPollSchedulerInit()
+*/
+struct ModbusPollScheduler
+{
+	ModbusMaster *master;                  //!< A non-owning pointer to master used to build requests and parse responses
+	ModbusPollTransportCallback transport; //!< A pointer to the transport callback (required)
+	ModbusPollFormat format;               //!< Frame format of the requests
+
+	ModbusPollGroup *groups; //!< A non-owning pointer to array of poll groups
+	uint16_t groupCount;     //!< Size of \ref groups array
+
+	uint32_t timeout;         //!< Time after which a request is considered lost
+	ModbusPollGroup *pending; //!< Group whose request awaits response or NULL
+	uint32_t pendingSince;    //!< Time at which the pending request was sent
+	uint32_t pendingTimeout;  //!< Timeout of the pending request
+	uint32_t busyTime;        //!< Total time spent waiting for responses (bus occupancy)
+	uint16_t transactionID;   //!< Next Modbus TCP transaction ID
+
+	struct ModbusRTTEstimator *rtt; //!< Optional RTT estimator providing per-slave timeouts (requires `LIGHTMODBUS_RTT`)
+	void *context;                  //!< User's context pointer
+};
+
+LIGHTMODBUS_RET_ERROR modbusPollSchedulerInit(
+	ModbusPollScheduler *scheduler,
+	ModbusMaster *master,
+	ModbusPollFormat format,
+	ModbusPollTransportCallback transport,
+	ModbusPollGroup *groups,
+	uint16_t groupCount,
+	uint32_t timeout,
+	uint32_t now);
+
+LIGHTMODBUS_RET_ERROR modbusPollSchedulerRun(ModbusPollScheduler *scheduler, uint32_t now);
+
+LIGHTMODBUS_RET_ERROR modbusPollSchedulerParseResponse(
+	ModbusPollScheduler *scheduler,
+	const uint8_t *response,
+	uint16_t responseLength,
+	uint32_t now);
+
+uint8_t modbusPollSchedulerNextWakeup(const ModbusPollScheduler *scheduler, uint32_t *wakeup);
+void modbusPollGroupResetStats(ModbusPollGroup *group);
+
+/**
+	\brief Returns histogram bin for the given value
+*/
+LIGHTMODBUS_WARN_UNUSED static inline uint8_t modbusPollHistogramBin(uint32_t value)
+{
+	uint8_t bin = 0;
+	while (value && bin < MODBUS_POLL_HISTOGRAM_BINS - 1)
+	{
+		value >>= 1;
+		bin++;
+	}
+	return bin;
+}
+
+/**
+	\brief Returns average achieved polling period of a group or 0 if it has been polled less than twice
+*/
+LIGHTMODBUS_WARN_UNUSED static inline uint32_t modbusPollGroupGetAveragePeriod(const ModbusPollGroup *group)
+{
+	if (group->stats.polls < 2)
+		return 0;
+	return (group->stats.lastStart - group->stats.firstStart) / (group->stats.polls - 1);
+}
+
+/**
+	\brief Allows user to set the custom context pointer
+*/
+static inline void modbusPollSchedulerSetUserPointer(ModbusPollScheduler *scheduler, void *ptr)
+{
+	scheduler->context = ptr;
+}
+
+/**
+	\brief Retreieves the custom context pointer
+*/
+static inline void *modbusPollSchedulerGetUserPointer(const ModbusPollScheduler *scheduler)
+{
+	return scheduler->context;
+}
+
+#endif
@@ -0,0 +1,404 @@
+#ifndef LIGHTMODBUS_SCHEDULER_IMPL_H
+#define LIGHTMODBUS_SCHEDULER_IMPL_H
+
+#include "scheduler.h"
+#include "master_func.h"
+#ifdef LIGHTMODBUS_RTT
+#include "rtt.h"
+#endif
+
+/**
+	\file scheduler.impl.h
+	\brief Deadline-driven polling scheduler for master (implementation)
+*/
+
+/**
+	\brief Initializes a ModbusPollScheduler struct
+	\param scheduler ModbusPollScheduler struct to be initialized
+	\param master Master used to build requests and parse responses (required).
+		It must not be used for other requests while the scheduler is running.
+	\param format Frame format of the requests
+	\param transport Callback used to send the requests (required)
+	\param groups Pointer to an array of poll groups (required). Configuration fields of
+		each group must be already set up. The lifetime of this array must not be shorter
+		than the lifetime of the scheduler.
+	\param groupCount Number of elements in the `groups` array
+	\param timeout Time after which a request is considered lost. If \ref ModbusPollScheduler::rtt
+		is set after initialization, the timeouts are estimated for each slave and function instead.
+	\param now Current time. All groups become due immediately.
+	\returns MODBUS_GENERAL_ERROR(FUNCTION) if any of the groups uses function other than 1 - 4
+	\returns MODBUS_NO_ERROR() on success
+*/
+LIGHTMODBUS_RET_ERROR modbusPollSchedulerInit(
+	ModbusPollScheduler *scheduler,
+	ModbusMaster *master,
+	ModbusPollFormat format,
+	ModbusPollTransportCallback transport,
+	ModbusPollGroup *groups,
+	uint16_t groupCount,
+	uint32_t timeout,
+	uint32_t now)
+{
+	for (uint16_t i = 0; i < groupCount; i++)
+	{
+		if (groups[i].function < 1 || groups[i].function > 4)
+			return MODBUS_GENERAL_ERROR(FUNCTION);
+
+		groups[i].release = now;
+		modbusPollGroupResetStats(&groups[i]);
+	}
+
+	scheduler->master = master;
+	scheduler->transport = transport;
+	scheduler->format = format;
+	scheduler->groups = groups;
+	scheduler->groupCount = groupCount;
+	scheduler->timeout = timeout;
+	scheduler->pending = NULL;
+	scheduler->pendingSince = now;
+	scheduler->pendingTimeout = timeout;
+	scheduler->busyTime = 0;
+	scheduler->transactionID = 0;
+	scheduler->rtt = NULL;
+	scheduler->context = NULL;
+	return MODBUS_NO_ERROR();
+}
+
+/**
+	\brief Clears polling statistics of a group
+*/
+void modbusPollGroupResetStats(ModbusPollGroup *group)
+{
+	ModbusPollStats *s = &group->stats;
+	s->polls = 0;
+	s->responses = 0;
+	s->errors = 0;
+	s->timeouts = 0;
+	s->overruns = 0;
+	s->skipped = 0;
+	s->firstStart = 0;
+	s->lastStart = 0;
+	s->lastPeriod = 0;
+	s->minPeriod = UINT32_MAX;
+	s->maxPeriod = 0;
+	s->maxJitter = 0;
+	s->lastLatency = 0;
+	s->maxLatency = 0;
+
+	for (uint8_t i = 0; i < MODBUS_POLL_HISTOGRAM_BINS; i++)
+	{
+		s->jitterHistogram[i] = 0;
+		s->overrunHistogram[i] = 0;
+	}
+}
+
+/**
+	\brief Finishes the pending request and updates the bus occupancy
+*/
+static inline void modbusPollSchedulerFinish(ModbusPollScheduler *scheduler, uint32_t now)
+{
+	scheduler->busyTime += now - scheduler->pendingSince;
+	scheduler->pending = NULL;
+	modbusMasterFreeRequest(scheduler->master);
+}
+
+/**
+	\brief Selects the group to be polled next
+	\returns NULL if no group is due
+
+	Groups are served earliest-deadline-first. Once deadlines start being
+	missed (the bus is saturated), groups are served in order of priority
+	and deadlines only break ties.
+*/
+static ModbusPollGroup *modbusPollSchedulerSelect(ModbusPollScheduler *scheduler, uint32_t now)
+{
+	uint8_t saturated = 0;
+	for (uint16_t i = 0; i < scheduler->groupCount; i++)
+	{
+		const ModbusPollGroup *g = &scheduler->groups[i];
+		if (modbusTimeDiff(now, g->release) >= 0 && modbusTimeDiff(now, g->release + g->period) >= 0)
+			saturated = 1;
+	}
+
+	ModbusPollGroup *best = NULL;
+	for (uint16_t i = 0; i < scheduler->groupCount; i++)
+	{
+		ModbusPollGroup *g = &scheduler->groups[i];
+		if (modbusTimeDiff(now, g->release) < 0)
+			continue;
+
+		if (!best)
+		{
+			best = g;
+			continue;
+		}
+
+		int32_t diff = modbusTimeDiff(g->release + g->period, best->release + best->period);
+		if (saturated && g->priority != best->priority)
+		{
+			if (g->priority > best->priority)
+				best = g;
+		}
+		else if (diff < 0 || (diff == 0 && g->priority > best->priority))
+			best = g;
+	}
+
+	return best;
+}
+
+/**
+	\brief Updates group statistics and schedules its next poll
+*/
+static void modbusPollGroupStart(ModbusPollGroup *group, uint32_t now)
+{
+	ModbusPollStats *s = &group->stats;
+	uint32_t jitter = now - group->release;
+	uint32_t deadline = group->release + group->period;
+
+	if (s->polls)
+	{
+		uint32_t period = now - s->lastStart;
+		s->lastPeriod = period;
+		if (period < s->minPeriod) s->minPeriod = period;
+		if (period > s->maxPeriod) s->maxPeriod = period;
+	}
+	else
+		s->firstStart = now;
+
+	s->lastStart = now;
+	s->polls++;
+
+	if (jitter > s->maxJitter)
+		s->maxJitter = jitter;
+	s->jitterHistogram[modbusPollHistogramBin(jitter)]++;
+
+	// Poll started after its deadline - skip missed cycles
+	if (modbusTimeDiff(now, deadline) >= 0 && group->period)
+	{
+		uint32_t late = now - deadline;
+		uint32_t missed = late / group->period;
+
+		s->overruns++;
+		s->skipped += missed;
+		s->overrunHistogram[modbusPollHistogramBin(late)]++;
+		group->release = deadline + (missed + 1) * group->period;
+	}
+	else if (group->period)
+		group->release = deadline;
+	else
+		group->release = now;
+}
+
+/**
+	\brief Sends the next request if the scheduler is idle and handles timeouts
+	\param now Current time
+	\returns MODBUS_GENERAL_ERROR(OTHER) if the transport callback fails
+	\returns Any error returned while building the request
+	\returns MODBUS_NO_ERROR() if a request was sent or there was nothing to do
+
+	This function should be called whenever the time returned by
+	modbusPollSchedulerNextWakeup() is reached and after each response.
+*/
+LIGHTMODBUS_RET_ERROR modbusPollSchedulerRun(ModbusPollScheduler *scheduler, uint32_t now)
+{
+	if (scheduler->pending)
+	{
+		ModbusPollGroup *pending = scheduler->pending;
+		if (modbusTimeDiff(now, scheduler->pendingSince + scheduler->pendingTimeout) < 0)
+			return MODBUS_NO_ERROR();
+
+		pending->stats.timeouts++;
+#ifdef LIGHTMODBUS_RTT
+		if (scheduler->rtt)
+			modbusRTTAddTimeout(scheduler->rtt, pending->address, pending->function);
+#endif
+		modbusPollSchedulerFinish(scheduler, now);
+	}
+
+	ModbusPollGroup *group = modbusPollSchedulerSelect(scheduler, now);
+	if (!group)
+		return MODBUS_NO_ERROR();
+
+	modbusPollGroupStart(group, now);
+
+	ModbusMaster *master = scheduler->master;
+	ModbusErrorInfo err;
+	switch (scheduler->format)
+	{
+		case MODBUS_POLL_RTU: err = modbusBeginRequestRTU(master); break;
+		case MODBUS_POLL_TCP: err = modbusBeginRequestTCP(master); break;
+		default: err = modbusBeginRequestPDU(master); break;
+	}
+
+	if (modbusIsOk(err))
+		err = modbusBuildRequest01020304(master, group->function, group->index, group->count);
+
+	if (modbusIsOk(err))
+	{
+		switch (scheduler->format)
+		{
+			case MODBUS_POLL_RTU: err = modbusEndRequestRTU(master, group->address); break;
+			case MODBUS_POLL_TCP: err = modbusEndRequestTCP(master, scheduler->transactionID++, group->address); break;
+			default: err = modbusEndRequestPDU(master); break;
+		}
+	}
+
+	if (!modbusIsOk(err))
+	{
+		group->stats.errors++;
+		modbusMasterFreeRequest(master);
+		return err;
+	}
+
+	if (scheduler->transport(
+		scheduler,
+		group,
+		modbusMasterGetRequest(master),
+		modbusMasterGetRequestLength(master)) != MODBUS_OK)
+	{
+		group->stats.errors++;
+		modbusMasterFreeRequest(master);
+		return MODBUS_GENERAL_ERROR(OTHER);
+	}
+
+	scheduler->pending = group;
+	scheduler->pendingSince = now;
+	scheduler->pendingTimeout = scheduler->timeout;
+#ifdef LIGHTMODBUS_RTT
+	if (scheduler->rtt)
+		scheduler->pendingTimeout = modbusRTTGetTimeout(scheduler->rtt, group->address, group->function);
+#endif
+	return MODBUS_NO_ERROR();
+}
+
+/**
+	\brief Parses a response to the pending request
+	\param response Response frame (in the format used by the scheduler)
+	\param responseLength Length of the response frame
+	\param now Current time
+	\returns MODBUS_RESPONSE_ERROR(OTHER) if no request is pending
+	\returns Any error returned by `modbusParseResponse*()`
+
+	Frames that can't be the response to the pending request are rejected
+	and the scheduler keeps waiting for the right one (or the timeout):
+	in Modbus TCP mode responses with mismatched transaction ID (e.g. late
+	responses to timed out requests), in RTU mode frames with bad CRC (or
+	too short to hold one) or address and in RTU and PDU mode frames with
+	mismatched function code (including exceptions to other functions).
+	Latency is passed to the RTT estimator only for valid responses and
+	exceptions.
+*/
+LIGHTMODBUS_RET_ERROR modbusPollSchedulerParseResponse(
+	ModbusPollScheduler *scheduler,
+	const uint8_t *response,
+	uint16_t responseLength,
+	uint32_t now)
+{
+	ModbusPollGroup *group = scheduler->pending;
+	if (!group)
+		return MODBUS_RESPONSE_ERROR(OTHER);
+
+	ModbusMaster *master = scheduler->master;
+	ModbusErrorInfo err;
+	switch (scheduler->format)
+	{
+		case MODBUS_POLL_RTU:
+			// Noise too short to hold a CRC. Exception frames are accepted
+			// by the parser regardless of the function, so it's checked here.
+			if (responseLength < 4)
+				return MODBUS_RESPONSE_ERROR(LENGTH);
+			if ((response[1] & 0x7f) != group->function)
+				return MODBUS_RESPONSE_ERROR(FUNCTION);
+
+			err = modbusParseResponseRTU(
+				master,
+				modbusMasterGetRequest(master),
+				modbusMasterGetRequestLength(master),
+				response,
+				responseLength);
+
+			if (modbusGetResponseError(err) == MODBUS_ERROR_CRC
+				|| modbusGetResponseError(err) == MODBUS_ERROR_ADDRESS
+				|| modbusGetResponseError(err) == MODBUS_ERROR_FUNCTION)
+				return err;
+			break;
+
+		case MODBUS_POLL_TCP:
+			err = modbusParseResponseTCP(
+				master,
+				modbusMasterGetRequest(master),
+				modbusMasterGetRequestLength(master),
+				response,
+				responseLength);
+
+			if (modbusGetResponseError(err) == MODBUS_ERROR_BAD_TRANSACTION)
+				return err;
+			break;
+
+		default:
+			if (responseLength > MODBUS_PDU_MAX)
+			{
+				err = MODBUS_RESPONSE_ERROR(LENGTH);
+				break;
+			}
+
+			if (responseLength && (response[0] & 0x7f) != group->function)
+				return MODBUS_RESPONSE_ERROR(FUNCTION);
+
+			err = modbusParseResponsePDU(
+				master,
+				group->address,
+				modbusMasterGetRequest(master),
+				modbusMasterGetRequestLength(master),
+				response,
+				responseLength);
+			break;
+	}
+
+	uint32_t latency = now - scheduler->pendingSince;
+	group->stats.lastLatency = latency;
+	if (latency > group->stats.maxLatency)
+		group->stats.maxLatency = latency;
+
+#ifdef LIGHTMODBUS_RTT
+	if (scheduler->rtt && modbusIsOk(err))
+		modbusRTTAddSample(scheduler->rtt, group->address, group->function, latency);
+#endif
+
+	if (modbusIsOk(err))
+		group->stats.responses++;
+	else
+		group->stats.errors++;
+
+	modbusPollSchedulerFinish(scheduler, now);
+	return err;
+}
+
+/**
+	\brief Returns time at which modbusPollSchedulerRun() should be called next
+	\param wakeup Output: time of the next poll or the pending request timeout
+	\returns 0 if there are no poll groups, 1 otherwise
+*/
+uint8_t modbusPollSchedulerNextWakeup(const ModbusPollScheduler *scheduler, uint32_t *wakeup)
+{
+	if (scheduler->pending)
+	{
+		*wakeup = scheduler->pendingSince + scheduler->pendingTimeout;
+		return 1;
+	}
+
+	uint8_t found = 0;
+	for (uint16_t i = 0; i < scheduler->groupCount; i++)
+	{
+		uint32_t release = scheduler->groups[i].release;
+		if (!found || modbusTimeDiff(release, *wakeup) < 0)
+		{
+			*wakeup = release;
+			found = 1;
+		}
+	}
+
+	return found;
+}
+
+#endif
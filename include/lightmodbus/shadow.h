@@ -0,0 +1,106 @@
+#ifndef LIGHTMODBUS_SHADOW_H
+#define LIGHTMODBUS_SHADOW_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "base.h"
+#include "master.h"
+#include "master_func.h"
+
+/**
+	\file shadow.h
+	\brief Change-of-value filtering of data received by master (header)
+*/
+
+/**
+	\brief Last reported values of a block of registers/coils of a single slave
+*/
+typedef struct ModbusShadowRange
+{
+	ModbusDataType type; //!< Type of the registers/coils
+	uint8_t address;     //!< Slave address
+	uint16_t index;      //!< Index of the first register/coil
+	uint16_t count;      //!< Number of registers/coils
+
+	uint16_t *values;          //!< Storage for `count` last reported values (required)
+	uint8_t *known;            //!< Storage for `count` bits marking values reported at least once (required)
+	const uint16_t *deadbands; //!< Per-register deadbands (optional)
+	uint16_t unknown;          //!< Number of values never reported (set by the cache)
+} ModbusShadowRange;
+
+/**
+	\brief A run of consecutive values which changed in a single response
+*/
+typedef struct ModbusShadowRun
+{
+	ModbusDataType type;    //!< Type of the registers/coils
+	uint8_t address;        //!< Slave address
+	uint8_t function;       //!< Function that reported the values
+	uint16_t index;         //!< Index of the first changed register/coil
+	uint16_t count;         //!< Number of changed registers/coils
+	const uint16_t *values; //!< New values (stored in the range)
+} ModbusShadowRun;
+
+/**
+	\brief A pointer to a callback receiving runs of changed values
+	\see modbusShadowParseResponse01020304()
+*/
+typedef ModbusError (*ModbusShadowRunCallback)(
+	const ModbusMaster *status,
+	const ModbusShadowRun *run);
+
+/**
+	\brief Suppresses values which haven't changed since they were last reported
+
+	\see modbusShadowCacheInit()
+	\see modbusShadowUpdate()
+	\see modbusShadowParseResponse01020304()
+*/
+typedef struct ModbusShadowCache
+{
+	ModbusShadowRange *ranges; //!< A non-owning pointer to array of ranges
+	uint16_t rangeCount;       //!< Size of \ref ranges array
+	uint16_t last;             //!< Index of the range matched most recently
+
+	ModbusShadowRunCallback runCallback; //!< Callback receiving runs of changed values (optional)
+
+	uint32_t passed;     //!< Number of values reported as changed
+	uint32_t suppressed; //!< Number of values filtered out
+
+	void *context; //!< User's context pointer
+} ModbusShadowCache;
+
+LIGHTMODBUS_RET_ERROR modbusShadowCacheInit(
+	ModbusShadowCache *cache,
+	ModbusShadowRange *ranges,
+	uint16_t rangeCount);
+
+void modbusShadowCacheInvalidate(ModbusShadowCache *cache);
+LIGHTMODBUS_WARN_UNUSED uint8_t modbusShadowUpdate(ModbusShadowCache *cache, const ModbusDataCallbackArgs *args);
+
+LIGHTMODBUS_RET_ERROR modbusShadowParseResponse01020304(
+	ModbusMaster *status,
+	uint8_t address,
+	uint8_t function,
+	const uint8_t *requestPDU,
+	uint8_t requestLength,
+	const uint8_t *responsePDU,
+	uint8_t responseLength);
+
+/**
+	\brief Allows user to set the custom context pointer
+*/
+static inline void modbusShadowCacheSetUserPointer(ModbusShadowCache *cache, void *ptr)
+{
+	cache->context = ptr;
+}
+
+/**
+	\brief Retreieves the custom context pointer
+*/
+static inline void *modbusShadowCacheGetUserPointer(const ModbusShadowCache *cache)
+{
+	return cache->context;
+}
+
+#endif
@@ -0,0 +1,366 @@
+#ifndef LIGHTMODBUS_SHADOW_IMPL_H
+#define LIGHTMODBUS_SHADOW_IMPL_H
+
+#include <string.h>
+#include "shadow.h"
+
+/**
+	\file shadow.impl.h
+	\brief Change-of-value filtering of data received by master (implementation)
+*/
+
+/**
+	\brief Initializes a ModbusShadowCache struct
+	\param cache ModbusShadowCache struct to be initialized
+	\param ranges Pointer to an array of ranges (required). Configuration fields and storage
+		pointers of each range must be already set up. The lifetime of this array must not be
+		shorter than the lifetime of the cache.
+	\param rangeCount Number of elements in the `ranges` array
+	\returns MODBUS_GENERAL_ERROR(VALUE) if any of the ranges is empty, exceeds the register
+		space or lacks storage
+	\returns MODBUS_NO_ERROR() on success
+*/
+LIGHTMODBUS_RET_ERROR modbusShadowCacheInit(
+	ModbusShadowCache *cache,
+	ModbusShadowRange *ranges,
+	uint16_t rangeCount)
+{
+	for (uint16_t i = 0; i < rangeCount; i++)
+	{
+		const ModbusShadowRange *r = &ranges[i];
+		if (!r->count || (uint32_t) r->index + r->count > 0x10000 || !r->values || !r->known)
+			return MODBUS_GENERAL_ERROR(VALUE);
+	}
+
+	cache->ranges = ranges;
+	cache->rangeCount = rangeCount;
+	cache->last = 0;
+	cache->runCallback = NULL;
+	cache->context = NULL;
+	modbusShadowCacheInvalidate(cache);
+	return MODBUS_NO_ERROR();
+}
+
+/**
+	\brief Forgets all stored values, so the next received ones are reported
+	\note Statistics are reset as well
+*/
+void modbusShadowCacheInvalidate(ModbusShadowCache *cache)
+{
+	for (uint16_t i = 0; i < cache->rangeCount; i++)
+	{
+		ModbusShadowRange *r = &cache->ranges[i];
+		uint16_t bytes = modbusBitsToBytes(r->count);
+		for (uint16_t j = 0; j < bytes; j++)
+			r->known[j] = 0;
+		r->unknown = r->count;
+	}
+
+	cache->passed = 0;
+	cache->suppressed = 0;
+}
+
+/**
+	\brief Finds the range containing the given register/coil
+	\param length Output: number of values from `index` to the end of the returned range
+		or, if there's none, to the beginning of the next range (0 if there are no more ranges)
+	\returns NULL if there's none
+
+	Values arrive in order, so the range matched most recently is checked first.
+*/
+static ModbusShadowRange *modbusShadowFind(
+	ModbusShadowCache *cache,
+	ModbusDataType type,
+	uint8_t address,
+	uint16_t index,
+	uint32_t *length)
+{
+	*length = 0;
+	for (uint16_t i = 0; i < cache->rangeCount; i++)
+	{
+		uint16_t n = (uint16_t)((cache->last + i) % cache->rangeCount);
+		ModbusShadowRange *r = &cache->ranges[n];
+		if (r->type != type || r->address != address)
+			continue;
+
+		uint32_t end = (uint32_t) r->index + r->count;
+		if (index >= r->index && index < end)
+		{
+			cache->last = n;
+			*length = end - index;
+			return r;
+		}
+
+		if (r->index > index && (!*length || (uint32_t)(r->index - index) < *length))
+			*length = r->index - index;
+	}
+
+	return NULL;
+}
+
+/**
+	\brief Stores a received value if it's new or exceeds the deadband
+	\returns 1 if the value should be reported, 0 if it should be ignored
+*/
+static uint8_t modbusShadowStore(ModbusShadowCache *cache, ModbusShadowRange *r, uint16_t offset, uint16_t value)
+{
+	if (modbusMaskRead(r->known, offset))
+	{
+		uint16_t old = r->values[offset];
+		uint16_t delta = value > old ? value - old : old - value;
+		uint16_t deadband = 0;
+		if (r->deadbands && (r->type == MODBUS_HOLDING_REGISTER || r->type == MODBUS_INPUT_REGISTER))
+			deadband = r->deadbands[offset];
+
+		if (delta <= deadband)
+		{
+			cache->suppressed++;
+			return 0;
+		}
+	}
+	else
+	{
+		modbusMaskWrite(r->known, offset, 1);
+		r->unknown--;
+	}
+
+	r->values[offset] = value;
+	cache->passed++;
+	return 1;
+}
+
+/**
+	\brief Decides whether a value received by master should be reported
+	\param args Arguments passed to the data callback
+	\returns 1 if the value should be reported, 0 if it should be ignored
+
+	Values are reported when received for the first time and when they differ from
+	the last reported value by more than the register's deadband (if deadbands are used).
+	Deadbands are applied to raw, unsigned register values and are ignored for coils
+	and discrete inputs. Values outside of all ranges are always reported.
+
+	This function is meant to be called at the beginning of the data callback:
+	\code
+	if (!modbusShadowUpdate(&cache, args))
+		return MODBUS_OK;
+	\endcode
+
+	\see modbusShadowParseResponse01020304() for filtering whole responses at once
+*/
+LIGHTMODBUS_WARN_UNUSED uint8_t modbusShadowUpdate(ModbusShadowCache *cache, const ModbusDataCallbackArgs *args)
+{
+	uint32_t length;
+	ModbusShadowRange *r = modbusShadowFind(cache, args->type, args->address, args->index, &length);
+	if (!r)
+		return 1;
+
+	return modbusShadowStore(cache, r, args->index - r->index, args->value);
+}
+
+/*
+	Registers are compared 4 at a time in 64-bit words on 64-bit little-endian hosts
+*/
+#if UINTPTR_MAX > 0xffffffffu && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define LIGHTMODBUS_SHADOW_SWAR
+#endif
+
+#ifdef LIGHTMODBUS_SHADOW_SWAR
+/**
+	\brief Checks whether 4 registers in the response equal the stored values
+	\param data Big-endian register values from the response
+*/
+LIGHTMODBUS_ALWAYS_INLINE static inline uint8_t modbusShadowSame4(const uint16_t *values, const uint8_t *data)
+{
+	uint64_t received, stored;
+	memcpy(&received, data, 8);
+	memcpy(&stored, values, 8);
+	received = ((received >> 8) & 0x00ff00ff00ff00ffull) | ((received & 0x00ff00ff00ff00ffull) << 8);
+	return received == stored;
+}
+#endif
+
+/**
+	\brief Reports a run of changed values stored in a range
+*/
+static void modbusShadowReport(
+	const ModbusShadowCache *cache,
+	ModbusMaster *status,
+	const ModbusShadowRange *r,
+	uint8_t function,
+	uint16_t offset,
+	uint16_t count)
+{
+	if (!count)
+		return;
+
+	if (cache->runCallback)
+	{
+		ModbusShadowRun run = {
+			.type = r->type,
+			.address = r->address,
+			.function = function,
+			.index = (uint16_t)(r->index + offset),
+			.count = count,
+			.values = &r->values[offset],
+		};
+		cache->runCallback(status, &run);
+		return;
+	}
+
+	ModbusDataCallbackArgs cargs = {
+		.type = r->type,
+		.index = 0,
+		.value = 0,
+		.function = function,
+		.address = r->address,
+	};
+
+	for (uint16_t i = 0; i < count; i++)
+	{
+		cargs.index = r->index + offset + i;
+		cargs.value = r->values[offset + i];
+		status->dataCallback(status, &cargs);
+	}
+}
+
+/**
+	\brief Compares a block of received values with a range and reports the changed ones
+	\param data Response data (register values or coil bits)
+	\param first Index of the first value in `data`
+	\param offset Offset of the first value in the range
+*/
+static void modbusShadowCompare(
+	ModbusShadowCache *cache,
+	ModbusMaster *status,
+	ModbusShadowRange *r,
+	uint8_t function,
+	const uint8_t *data,
+	uint16_t first,
+	uint16_t offset,
+	uint16_t count)
+{
+	uint8_t bits = (function == 1 || function == 2) ? 1 : 16;
+	uint16_t run = 0; // Start of the current run of changed values (== i if there's none)
+	uint16_t i = 0;
+
+	while (i < count)
+	{
+#ifdef LIGHTMODBUS_SHADOW_SWAR
+		// Unchanged registers don't need deadbands to be checked
+		if (bits == 16 && !r->unknown && i + 4 <= count
+			&& modbusShadowSame4(&r->values[offset + i], &data[(first + i) << 1]))
+		{
+			modbusShadowReport(cache, status, r, function, offset + run, i - run);
+			cache->suppressed += 4;
+			i += 4;
+			run = i;
+			continue;
+		}
+#endif
+
+		uint16_t value;
+		if (bits == 1)
+			value = modbusMaskRead(data, first + i);
+		else
+			value = modbusRBE(&data[(first + i) << 1]);
+
+		if (!modbusShadowStore(cache, r, offset + i, value))
+		{
+			modbusShadowReport(cache, status, r, function, offset + run, i - run);
+			run = i + 1;
+		}
+		i++;
+	}
+
+	modbusShadowReport(cache, status, r, function, offset + run, count - run);
+}
+
+/**
+	\brief Parses a response to a read request and reports only the changed values
+	\param status Master whose user pointer points to a ModbusShadowCache
+	\returns Any error returned by modbusParseResponse01020304()
+
+	This function can replace modbusParseResponse01020304() in the master's function table.
+	The data block of the response is compared with the cached values directly (4 registers at a time
+	where possible), so the callback is only invoked for values that changed, as decided by
+	modbusShadowUpdate(). Consecutive changed values are passed to
+	\ref ModbusShadowCache::runCallback as a single run if it's set. Otherwise, and for values
+	outside of all ranges, the master's data callback is called for each value.
+
+	Invalid responses are handled by modbusParseResponse01020304() and leave the cache intact.
+
+	\warning The master's user pointer must point to the cache. The user's own context can be
+	kept in the cache (see modbusShadowCacheSetUserPointer()).
+*/
+LIGHTMODBUS_RET_ERROR modbusShadowParseResponse01020304(
+	ModbusMaster *status,
+	uint8_t address,
+	uint8_t function,
+	const uint8_t *requestPDU,
+	uint8_t requestLength,
+	const uint8_t *responsePDU,
+	uint8_t responseLength)
+{
+	ModbusShadowCache *cache = (ModbusShadowCache*) modbusMasterGetUserPointer(status);
+
+	// Anything unusual is left for the regular parser to report
+	uint8_t expected = modbusExpectedResponseLength(requestPDU, requestLength);
+	if (!expected
+		|| requestPDU[0] != function
+		|| function < 1 || function > 4
+		|| modbusCheckRangeU16(modbusRBE(&requestPDU[1]), modbusRBE(&requestPDU[3]))
+		|| responseLength != expected
+		|| responsePDU[1] != expected - 2)
+		return modbusParseResponse01020304(status, address, function, requestPDU, requestLength, responsePDU, responseLength);
+
+	static const ModbusDataType types[] = {
+		MODBUS_COIL,
+		MODBUS_DISCRETE_INPUT,
+		MODBUS_HOLDING_REGISTER,
+		MODBUS_INPUT_REGISTER,
+	};
+	ModbusDataType type = types[function - 1];
+	uint16_t index = modbusRBE(&requestPDU[1]);
+	uint16_t count = modbusRBE(&requestPDU[3]);
+	const uint8_t *data = &responsePDU[2];
+
+	uint16_t i = 0;
+	while (i < count)
+	{
+		uint32_t length;
+		ModbusShadowRange *r = modbusShadowFind(cache, type, address, index + i, &length);
+		uint16_t n = (!length || length > (uint32_t)(count - i)) ? count - i : (uint16_t) length;
+
+		if (r)
+		{
+			modbusShadowCompare(cache, status, r, function, data, i, index + i - r->index, n);
+			i += n;
+			continue;
+		}
+
+		// Values outside of all ranges are always reported
+		ModbusDataCallbackArgs cargs = {
+			.type = type,
+			.index = 0,
+			.value = 0,
+			.function = function,
+			.address = address,
+		};
+
+		for (uint16_t j = i; j < i + n; j++)
+		{
+			cargs.index = index + j;
+			if (function == 1 || function == 2)
+				cargs.value = modbusMaskRead(data, j);
+			else
+				cargs.value = modbusRBE(&data[j << 1]);
+
+			status->dataCallback(status, &cargs);
+		}
+		i += n;
+	}
+
+	return MODBUS_NO_ERROR();
+}
+
+#endif
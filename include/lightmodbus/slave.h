@@ -133,10 +133,27 @@ LIGHTMODBUS_RET_ERROR modbusBuildExceptionTCP(
 	uint8_t function,
 	ModbusExceptionCode code);
 
+LIGHTMODBUS_RET_ERROR modbusBuildExceptionASCII(
+	ModbusSlave *status,
+	uint8_t address,
+	uint8_t function,
+	ModbusExceptionCode code);
+
 LIGHTMODBUS_RET_ERROR modbusParseRequest(ModbusSlave *status, const uint8_t *request, uint8_t requestLength);
 LIGHTMODBUS_RET_ERROR modbusParseRequestPDU(ModbusSlave *status, const uint8_t *request, uint8_t requestLength);
 LIGHTMODBUS_RET_ERROR modbusParseRequestRTU(ModbusSlave *status, uint8_t slaveAddress, const uint8_t *request, uint16_t requestLength);
 LIGHTMODBUS_RET_ERROR modbusParseRequestTCP(ModbusSlave *status, const uint8_t *request, uint16_t requestLength);
+LIGHTMODBUS_RET_ERROR modbusParseRequestASCII(ModbusSlave *status, uint8_t slaveAddress, const uint8_t *request, uint16_t requestLength);
+
+LIGHTMODBUS_RET_ERROR modbusParseRequestTCPBatch(
+	ModbusSlave *status,
+	const uint8_t *input,
+	size_t inputLength,
+	uint8_t *output,
+	size_t outputCapacity,
+	size_t *consumed,
+	size_t *produced,
+	uint16_t *count);
 
 /**
 	\brief Returns a pointer to the response generated by the slave
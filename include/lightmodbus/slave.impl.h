@@ -232,6 +232,42 @@ LIGHTMODBUS_RET_ERROR modbusBuildExceptionTCP(
 	return MODBUS_NO_ERROR();
 }
 
+/**
+	\brief Builds a Modbus ASCII exception
+	\param address slave address to be reported in the excetion
+	\param function function that reported the exception
+	\param code Modbus exception code
+	\returns MODBUS_GENERAL_ERROR(ADDRESS) if address is 0
+	\returns MODBUS_GENERAL_ERROR(ALLOC) on memory allocation failure
+	\returns MODBUS_NO_ERROR() on success
+*/
+LIGHTMODBUS_RET_ERROR modbusBuildExceptionASCII(
+	ModbusSlave *status,
+	uint8_t address,
+	uint8_t function,
+	ModbusExceptionCode code)
+{
+	if (address == 0)
+		return MODBUS_GENERAL_ERROR(ADDRESS);
+
+	modbusBufferModeASCII(&status->response);
+
+	ModbusErrorInfo errinfo = modbusBuildException(status, function, code);
+
+	if (!modbusIsOk(errinfo))
+		return errinfo;
+
+	ModbusError err = modbusBufferPackASCII(
+		&status->response,
+		address,
+		modbusSlaveGetUserPointer(status));
+
+	if (err != MODBUS_OK)
+		return MODBUS_MAKE_ERROR(MODBUS_ERROR_SOURCE_GENERAL, err);
+
+	return MODBUS_NO_ERROR();
+}
+
 /**
 	\brief Parses provided PDU and generates response honorinng `pduOffset` and `padding`
 		set in ModbusSlave during response generation.
@@ -402,4 +438,147 @@ LIGHTMODBUS_RET_ERROR modbusParseRequestTCP(ModbusSlave *status, const uint8_t *
 	return MODBUS_NO_ERROR();
 }
 
+/**
+	\brief Parses all complete Modbus TCP request frames in the input and
+		appends the responses to a single output buffer
+	\param input Received data containing back-to-back Modbus TCP frames
+	\param inputLength Length of the input
+	\param output Buffer for the response frames
+	\param outputCapacity Size of the output buffer
+	\param consumed Output: number of input bytes taken by parsed requests
+	\param produced Output: number of bytes written to the output buffer
+	\param count Output: number of parsed requests
+	\returns MODBUS_REQUEST_ERROR(LENGTH) if a frame declares invalid length
+	\returns Any errors from modbusParseRequestTCP()
+	\returns MODBUS_NO_ERROR() on success
+
+	Parsing stops at the first incomplete frame, or when less than \ref MODBUS_TCP_ADU_MAX
+	bytes are left in the output buffer. The remaining `inputLength - consumed` bytes
+	should be passed again (prepended to the next received data, or once the output
+	has been sent).
+
+	If an error occurs, parsing stops as well and `consumed` points at the beginning of
+	the invalid frame. `produced` bytes of responses to preceding requests are still
+	valid and should be sent. Since Modbus TCP streams cannot be resynchronized,
+	the connection should usually be closed afterwards.
+
+	This way, all responses to pipelined requests can be sent with a single call.
+	The slave's response buffer is freed before this function returns.
+*/
+LIGHTMODBUS_RET_ERROR modbusParseRequestTCPBatch(
+	ModbusSlave *status,
+	const uint8_t *input,
+	size_t inputLength,
+	uint8_t *output,
+	size_t outputCapacity,
+	size_t *consumed,
+	size_t *produced,
+	uint16_t *count)
+{
+	ModbusErrorInfo errinfo = MODBUS_NO_ERROR();
+	*consumed = 0;
+	*produced = 0;
+	*count = 0;
+
+	while (inputLength - *consumed >= MODBUS_TCP_PDU_OFFSET
+		&& outputCapacity - *produced >= MODBUS_TCP_ADU_MAX)
+	{
+		const uint8_t *request = input + *consumed;
+		uint16_t declaredLength = modbusRBE(&request[4]);
+		if (declaredLength < MODBUS_TCP_ADU_MIN - 6 || declaredLength > MODBUS_TCP_ADU_MAX - 6)
+		{
+			errinfo = MODBUS_REQUEST_ERROR(LENGTH);
+			break;
+		}
+
+		uint16_t requestLength = declaredLength + 6;
+		if (inputLength - *consumed < requestLength)
+			break;
+
+		if (!modbusIsOk(errinfo = modbusParseRequestTCP(status, request, requestLength)))
+			break;
+
+		uint16_t responseLength = modbusSlaveGetResponseLength(status);
+		const uint8_t *response = modbusSlaveGetResponse(status);
+		for (uint16_t i = 0; i < responseLength; i++)
+			output[*produced + i] = response[i];
+
+		*produced += responseLength;
+		*consumed += requestLength;
+		(*count)++;
+	}
+
+	modbusSlaveFreeResponse(status);
+	return errinfo;
+}
+
+/**
+	\brief Parses provided Modbus ASCII request frame and generates a Modbus ASCII response
+	\param slaveAddress ID of the slave to match with the request
+	\param request pointer to a Modbus ASCII frame (including the leading colon and trailing CR LF)
+	\param requestLength length of the frame (valid range: 9 - 513)
+	\returns MODBUS_REQUEST_ERROR(LENGTH) if length of the frame is invalid
+	\returns MODBUS_REQUEST_ERROR(BAD_PROTOCOL) if the frame is malformed
+	\returns MODBUS_REQUEST_ERROR(CRC) if LRC is invalid
+	\returns MODBUS_REQUEST_ERROR(ADDRESS) if the request is meant for other slave
+	\returns MODBUS_GENERAL_ERROR(LENGTH) if the resulting response frame has invalid length
+	\returns MODBUS_GENERAL_ERROR(ALLOC) if the response frame cannot be converted to text
+	\returns Any errors from parsing functions
+
+	\warning The response frame can only be accessed if modbusIsOk() called
+		on the return value of this function evaluates to true.
+*/
+LIGHTMODBUS_RET_ERROR modbusParseRequestASCII(ModbusSlave *status, uint8_t slaveAddress, const uint8_t *request, uint16_t requestLength)
+{
+	// Decode and unpack the request
+	uint8_t binary[(MODBUS_ASCII_ADU_MAX - 3) / 2];
+	const uint8_t *pdu     = NULL;
+	uint16_t pduLength     = 0;
+	uint8_t requestAddress = 0;
+	ModbusError err = modbusUnpackASCII(
+		request,
+		requestLength,
+		1,
+		binary,
+		&pdu,
+		&pduLength,
+		&requestAddress
+	);
+
+	if (err != MODBUS_OK)
+		return MODBUS_MAKE_ERROR(MODBUS_ERROR_SOURCE_REQUEST, err);
+
+	// Verify if the frame is meant for us
+	if (requestAddress != 0 && requestAddress != slaveAddress)
+		return MODBUS_REQUEST_ERROR(ADDRESS);
+
+	// Parse the request
+	ModbusErrorInfo errinfo;
+	modbusBufferModeASCII(&status->response);
+	if (!modbusIsOk(errinfo = modbusParseRequest(status, pdu, pduLength)))
+		return errinfo;
+
+	if (status->response.length)
+	{
+		// Discard any response frames if the request
+		// was broadcast
+		if (requestAddress == 0)
+		{
+			modbusSlaveFreeResponse(status);
+			return MODBUS_NO_ERROR();
+		}
+
+		// Pack the response frame and convert it to text
+		err = modbusBufferPackASCII(
+			&status->response,
+			slaveAddress,
+			modbusSlaveGetUserPointer(status));
+
+		if (err != MODBUS_OK)
+			return MODBUS_MAKE_ERROR(MODBUS_ERROR_SOURCE_GENERAL, err);
+	}
+
+	return MODBUS_NO_ERROR();
+}
+
 #endif
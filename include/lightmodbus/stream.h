@@ -0,0 +1,117 @@
+#ifndef LIGHTMODBUS_STREAM_H
+#define LIGHTMODBUS_STREAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "base.h"
+
+#if defined(LIGHTMODBUS_SLAVE) || defined(LIGHTMODBUS_SLAVE_FULL) || defined(LIGHTMODBUS_FULL)
+#include "slave.h"
+#endif
+
+#if defined(LIGHTMODBUS_MASTER) || defined(LIGHTMODBUS_MASTER_FULL) || defined(LIGHTMODBUS_FULL)
+#include "master.h"
+#endif
+
+/**
+	\file stream.h
+	\brief Reassembly of Modbus frames from byte streams (header)
+*/
+
+/**
+	\brief Splits a Modbus TCP byte stream into complete frames (ADUs)
+
+	The stream is fed with chunks of arbitrary size (e.g. as returned by `recv()`).
+	Frames fully contained in a chunk are returned in place, without copying.
+	Frames split between chunks are carried over in the internal buffer, so each
+	byte is copied at most once.
+
+	\see modbusTCPStreamInit()
+	\see modbusTCPStreamFeed()
+	\see modbusTCPStreamNext()
+*/
+typedef struct ModbusTCPStream
+{
+	uint8_t buffer[MODBUS_TCP_ADU_MAX]; //!< Beginning of a frame split between chunks
+	uint16_t length;                    //!< Number of bytes in \ref buffer
+
+	const uint8_t *input; //!< Unprocessed part of the current chunk
+	size_t inputLength;   //!< Length of the unprocessed part of the current chunk
+
+	uint32_t frames; //!< Number of frames returned
+	uint32_t errors; //!< Number of invalid frame headers encountered
+} ModbusTCPStream;
+
+/**
+	\brief Kind of frames carried by a Modbus RTU stream
+*/
+typedef enum ModbusRTUStreamType
+{
+	MODBUS_RTU_STREAM_REQUESTS,  //!< Requests sent by a master (slave side)
+	MODBUS_RTU_STREAM_RESPONSES, //!< Responses sent by slaves (master side)
+} ModbusRTUStreamType;
+
+/**
+	\brief Finds Modbus RTU frame boundaries without relying on inter-character timing
+
+	Frame length is predicted from the function code and the byte count field
+	as soon as they arrive, and the boundary is confirmed with the CRC. When
+	the CRC does not match or the function code is unknown, the first buffered
+	byte is dropped and the search is restarted at the next one.
+
+	\see modbusRTUStreamInit()
+	\see modbusRTUStreamFeed()
+	\see modbusRTUStreamNext()
+*/
+typedef struct ModbusRTUStream
+{
+	uint8_t buffer[MODBUS_RTU_ADU_MAX]; //!< Bytes of the frame being assembled
+	uint16_t length;                    //!< Number of bytes in \ref buffer
+	uint16_t frameLength;               //!< Length of the frame returned by the last call to modbusRTUStreamNext()
+	ModbusRTUStreamType type;           //!< Kind of frames to look for
+
+	const uint8_t *input; //!< Unprocessed part of the current chunk
+	size_t inputLength;   //!< Length of the unprocessed part of the current chunk
+
+	uint32_t frames;    //!< Number of frames returned
+	uint32_t errors;    //!< Number of CRC mismatches
+	uint32_t discarded; //!< Number of bytes dropped while resynchronizing
+} ModbusRTUStream;
+
+void modbusTCPStreamInit(ModbusTCPStream *stream);
+void modbusTCPStreamReset(ModbusTCPStream *stream);
+void modbusTCPStreamFeed(ModbusTCPStream *stream, const uint8_t *data, size_t length);
+
+LIGHTMODBUS_WARN_UNUSED ModbusError modbusTCPStreamNext(
+	ModbusTCPStream *stream,
+	const uint8_t **frame,
+	uint16_t *frameLength);
+
+void modbusRTUStreamInit(ModbusRTUStream *stream, ModbusRTUStreamType type);
+void modbusRTUStreamReset(ModbusRTUStream *stream);
+void modbusRTUStreamFeed(ModbusRTUStream *stream, const uint8_t *data, size_t length);
+uint16_t modbusRTUStreamPredictLength(ModbusRTUStreamType type, const uint8_t *frame, uint16_t length);
+
+LIGHTMODBUS_WARN_UNUSED uint8_t modbusRTUStreamNext(
+	ModbusRTUStream *stream,
+	const uint8_t **frame,
+	uint16_t *frameLength);
+
+#if defined(LIGHTMODBUS_SLAVE) || defined(LIGHTMODBUS_SLAVE_FULL) || defined(LIGHTMODBUS_FULL)
+LIGHTMODBUS_RET_ERROR modbusParseRequestRTUStream(
+	ModbusSlave *status,
+	uint8_t slaveAddress,
+	ModbusRTUStream *stream,
+	uint8_t *parsed);
+#endif
+
+#if defined(LIGHTMODBUS_MASTER) || defined(LIGHTMODBUS_MASTER_FULL) || defined(LIGHTMODBUS_FULL)
+LIGHTMODBUS_RET_ERROR modbusParseResponseRTUStream(
+	ModbusMaster *status,
+	const uint8_t *request,
+	uint16_t requestLength,
+	ModbusRTUStream *stream,
+	uint8_t *parsed);
+#endif
+
+#endif
@@ -0,0 +1,433 @@
+#ifndef LIGHTMODBUS_STREAM_IMPL_H
+#define LIGHTMODBUS_STREAM_IMPL_H
+
+#include "stream.h"
+
+/**
+	\file stream.impl.h
+	\brief Reassembly of Modbus frames from byte streams (implementation)
+*/
+
+/**
+	\brief Initializes a ModbusTCPStream struct
+*/
+void modbusTCPStreamInit(ModbusTCPStream *stream)
+{
+	modbusTCPStreamReset(stream);
+	stream->frames = 0;
+	stream->errors = 0;
+}
+
+/**
+	\brief Discards all buffered data (e.g. after reconnecting)
+*/
+void modbusTCPStreamReset(ModbusTCPStream *stream)
+{
+	stream->length = 0;
+	stream->input = NULL;
+	stream->inputLength = 0;
+}
+
+/**
+	\brief Provides the stream with the next chunk of received data
+	\param data Received data. It must remain valid until modbusTCPStreamNext()
+		stops returning frames.
+	\param length Length of the data
+
+	All frames from the previous chunk must be retrieved before the next one is fed.
+*/
+void modbusTCPStreamFeed(ModbusTCPStream *stream, const uint8_t *data, size_t length)
+{
+	stream->input = data;
+	stream->inputLength = length;
+}
+
+/**
+	\brief Moves up to `count` bytes of input to the internal buffer
+*/
+static inline void modbusTCPStreamTake(ModbusTCPStream *stream, uint16_t count)
+{
+	if (count > stream->inputLength)
+		count = (uint16_t) stream->inputLength;
+
+	for (uint16_t i = 0; i < count; i++)
+		stream->buffer[stream->length++] = stream->input[i];
+
+	stream->input += count;
+	stream->inputLength -= count;
+}
+
+/**
+	\brief Checks MBAP header and returns the total length of the frame
+	\returns MODBUS_ERROR_BAD_PROTOCOL if the protocol ID is not 0
+	\returns MODBUS_ERROR_LENGTH if the declared length is invalid
+*/
+static inline ModbusError modbusTCPStreamCheckHeader(const uint8_t *header, uint16_t *frameLength)
+{
+	if (modbusRBE(&header[2]) != 0)
+		return MODBUS_ERROR_BAD_PROTOCOL;
+
+	uint16_t length = modbusRBE(&header[4]);
+	if (length < MODBUS_TCP_ADU_MIN - 6 || length > MODBUS_TCP_ADU_MAX - 6)
+		return MODBUS_ERROR_LENGTH;
+
+	*frameLength = length + 6;
+	return MODBUS_OK;
+}
+
+/**
+	\brief Retrieves the next complete frame from the stream
+	\param frame Output: pointer to the frame or NULL if more data is needed. The frame
+		remains valid until the next call to modbusTCPStreamNext() or modbusTCPStreamFeed().
+	\param frameLength Output: length of the frame
+	\returns MODBUS_ERROR_BAD_PROTOCOL or MODBUS_ERROR_LENGTH if an invalid frame header is
+		encountered. The stream cannot be resynchronized, so all buffered data and the rest of
+		the current chunk are discarded. The connection should be closed.
+	\returns MODBUS_OK otherwise
+
+	This function should be called repeatedly after each modbusTCPStreamFeed()
+	until no frame is returned.
+*/
+LIGHTMODBUS_WARN_UNUSED ModbusError modbusTCPStreamNext(
+	ModbusTCPStream *stream,
+	const uint8_t **frame,
+	uint16_t *frameLength)
+{
+	*frame = NULL;
+	*frameLength = 0;
+
+	uint16_t length;
+	ModbusError err;
+
+	// Complete the frame carried over from previous chunks
+	if (stream->length)
+	{
+		if (stream->length < 6)
+		{
+			modbusTCPStreamTake(stream, 6 - stream->length);
+			if (stream->length < 6)
+				return MODBUS_OK;
+		}
+
+		if ((err = modbusTCPStreamCheckHeader(stream->buffer, &length)) != MODBUS_OK)
+		{
+			modbusTCPStreamReset(stream);
+			stream->errors++;
+			return err;
+		}
+
+		modbusTCPStreamTake(stream, length - stream->length);
+		if (stream->length < length)
+			return MODBUS_OK;
+
+		*frame = stream->buffer;
+		*frameLength = length;
+		stream->length = 0;
+		stream->frames++;
+		return MODBUS_OK;
+	}
+
+	if (!stream->inputLength)
+		return MODBUS_OK;
+
+	// Incomplete header - carry over
+	if (stream->inputLength < 6)
+	{
+		modbusTCPStreamTake(stream, 6);
+		return MODBUS_OK;
+	}
+
+	if ((err = modbusTCPStreamCheckHeader(stream->input, &length)) != MODBUS_OK)
+	{
+		modbusTCPStreamReset(stream);
+		stream->errors++;
+		return err;
+	}
+
+	// Incomplete frame - carry over
+	if (stream->inputLength < length)
+	{
+		modbusTCPStreamTake(stream, length);
+		return MODBUS_OK;
+	}
+
+	// Complete frame in the chunk - return in place
+	*frame = stream->input;
+	*frameLength = length;
+	stream->input += length;
+	stream->inputLength -= length;
+	stream->frames++;
+	return MODBUS_OK;
+}
+
+/**
+	\brief Initializes a ModbusRTUStream struct
+	\param type Kind of frames to look for - requests on the slave side,
+		responses on the master side
+*/
+void modbusRTUStreamInit(ModbusRTUStream *stream, ModbusRTUStreamType type)
+{
+	modbusRTUStreamReset(stream);
+	stream->type = type;
+	stream->frames = 0;
+	stream->errors = 0;
+	stream->discarded = 0;
+}
+
+/**
+	\brief Discards all buffered data (e.g. after a response timeout)
+*/
+void modbusRTUStreamReset(ModbusRTUStream *stream)
+{
+	stream->length = 0;
+	stream->frameLength = 0;
+	stream->input = NULL;
+	stream->inputLength = 0;
+}
+
+/**
+	\brief Provides the stream with the next chunk of received data
+	\param data Received data. It must remain valid until modbusRTUStreamNext()
+		stops returning frames.
+	\param length Length of the data (may be a single byte)
+
+	All frames from the previous chunk must be retrieved before the next one is fed.
+*/
+void modbusRTUStreamFeed(ModbusRTUStream *stream, const uint8_t *data, size_t length)
+{
+	stream->input = data;
+	stream->inputLength = length;
+}
+
+/**
+	\brief Predicts length of a Modbus RTU frame from its beginning
+	\param type Kind of the frame
+	\param frame Beginning of the frame
+	\param length Number of bytes available
+	\returns 0 if the frame is invalid (unsupported function code or bad byte count)
+	\returns Total length of the frame, if it can be determined from the available bytes
+	\returns Number of bytes required to make a better prediction (greater than `length`) otherwise
+
+	Supported functions are 01-06, 15, 16 and 22. Exception responses are
+	supported as well.
+*/
+uint16_t modbusRTUStreamPredictLength(ModbusRTUStreamType type, const uint8_t *frame, uint16_t length)
+{
+	// Address and function code
+	if (length < 2)
+		return 2;
+
+	uint8_t function = frame[1];
+	if (type == MODBUS_RTU_STREAM_REQUESTS)
+	{
+		switch (function)
+		{
+			case 1:
+			case 2:
+			case 3:
+			case 4:
+			case 5:
+			case 6:
+				return 8;
+
+			// Address, function, index, count, byte count, data, CRC
+			case 15:
+			case 16:
+				if (length < 7)
+					return 7;
+				if (frame[6] > MODBUS_RTU_ADU_MAX - 9)
+					return 0;
+				return 9 + frame[6];
+
+			case 22:
+				return 10;
+
+			default:
+				return 0;
+		}
+	}
+	else
+	{
+		// Address, function, exception code, CRC
+		if (function & 0x80)
+			return 5;
+
+		switch (function)
+		{
+			// Address, function, byte count, data, CRC
+			case 1:
+			case 2:
+			case 3:
+			case 4:
+				if (length < 3)
+					return 3;
+				if (frame[2] > MODBUS_RTU_ADU_MAX - 5)
+					return 0;
+				return 5 + frame[2];
+
+			case 5:
+			case 6:
+			case 15:
+			case 16:
+				return 8;
+
+			case 22:
+				return 10;
+
+			default:
+				return 0;
+		}
+	}
+}
+
+/**
+	\brief Drops `count` bytes from the beginning of the internal buffer
+*/
+static inline void modbusRTUStreamDrop(ModbusRTUStream *stream, uint16_t count)
+{
+	for (uint16_t i = count; i < stream->length; i++)
+		stream->buffer[i - count] = stream->buffer[i];
+	stream->length -= count;
+}
+
+/**
+	\brief Retrieves the next complete frame from the stream
+	\param frame Output: pointer to the frame or NULL if more data is needed. The frame
+		remains valid until the next call to modbusRTUStreamNext().
+	\param frameLength Output: length of the frame
+	\returns 1 if a frame has been found, 0 if more data is needed
+
+	The returned frame has a valid CRC and can be passed directly to
+	modbusParseRequestRTU() or modbusParseResponseRTU(). This function should be
+	called repeatedly after each modbusRTUStreamFeed() until it returns 0.
+
+	Garbage resembling a long frame may delay detection of the following frame
+	until enough bytes arrive to rule it out. Callers should still reset
+	the stream when the response timeout expires.
+*/
+LIGHTMODBUS_WARN_UNUSED uint8_t modbusRTUStreamNext(
+	ModbusRTUStream *stream,
+	const uint8_t **frame,
+	uint16_t *frameLength)
+{
+	*frame = NULL;
+	*frameLength = 0;
+
+	// Discard the previously returned frame
+	modbusRTUStreamDrop(stream, stream->frameLength);
+	stream->frameLength = 0;
+
+	while (1)
+	{
+		uint16_t length = modbusRTUStreamPredictLength(stream->type, stream->buffer, stream->length);
+
+		// Unsupported function code or bad byte count - resynchronize
+		if (length == 0)
+		{
+			modbusRTUStreamDrop(stream, 1);
+			stream->discarded++;
+			continue;
+		}
+
+		// More data needed
+		if (length > stream->length)
+		{
+			if (!stream->inputLength)
+				return 0;
+
+			uint16_t count = length - stream->length;
+			if (count > stream->inputLength)
+				count = (uint16_t) stream->inputLength;
+
+			for (uint16_t i = 0; i < count; i++)
+				stream->buffer[stream->length++] = stream->input[i];
+
+			stream->input += count;
+			stream->inputLength -= count;
+			continue;
+		}
+
+		// Confirm the boundary with the CRC
+		if (modbusCRC(stream->buffer, length - 2) != modbusRLE(&stream->buffer[length - 2]))
+		{
+			modbusRTUStreamDrop(stream, 1);
+			stream->errors++;
+			stream->discarded++;
+			continue;
+		}
+
+		*frame = stream->buffer;
+		*frameLength = length;
+		stream->frameLength = length;
+		stream->frames++;
+		return 1;
+	}
+}
+
+#if defined(LIGHTMODBUS_SLAVE) || defined(LIGHTMODBUS_SLAVE_FULL) || defined(LIGHTMODBUS_FULL)
+/**
+	\brief Parses the next request received over a stream carrying Modbus RTU frames (e.g. RTU over TCP)
+	\param slaveAddress ID of the slave
+	\param stream ModbusRTUStream of type MODBUS_RTU_STREAM_REQUESTS
+	\param parsed Output: 1 if a request has been taken from the stream, 0 if more data is needed
+	\returns Any errors from modbusParseRequestRTU()
+	\returns MODBUS_NO_ERROR() if no complete request is available
+
+	Responses are Modbus RTU frames and should be sent back over the same connection.
+	This function should be called repeatedly after each modbusRTUStreamFeed() until
+	`parsed` is 0, regardless of the returned errors. Requests addressed to other
+	slaves result in MODBUS_REQUEST_ERROR(ADDRESS) and can be ignored.
+*/
+LIGHTMODBUS_RET_ERROR modbusParseRequestRTUStream(
+	ModbusSlave *status,
+	uint8_t slaveAddress,
+	ModbusRTUStream *stream,
+	uint8_t *parsed)
+{
+	const uint8_t *frame;
+	uint16_t frameLength;
+
+	*parsed = modbusRTUStreamNext(stream, &frame, &frameLength);
+	if (!*parsed)
+	{
+		modbusSlaveFreeResponse(status);
+		return MODBUS_NO_ERROR();
+	}
+
+	return modbusParseRequestRTU(status, slaveAddress, frame, frameLength);
+}
+#endif
+
+#if defined(LIGHTMODBUS_MASTER) || defined(LIGHTMODBUS_MASTER_FULL) || defined(LIGHTMODBUS_FULL)
+/**
+	\brief Parses the next response received over a stream carrying Modbus RTU frames (e.g. RTU over TCP)
+	\param request The request frame sent over the stream
+	\param requestLength Length of the request frame
+	\param stream ModbusRTUStream of type MODBUS_RTU_STREAM_RESPONSES
+	\param parsed Output: 1 if a response has been taken from the stream, 0 if more data is needed
+	\returns Any errors from modbusParseResponseRTU()
+	\returns MODBUS_NO_ERROR() if no complete response is available
+
+	Stale responses (e.g. arriving after a timeout) are reported with
+	MODBUS_RESPONSE_ERROR(ADDRESS) or MODBUS_RESPONSE_ERROR(FUNCTION) and
+	should be skipped by calling this function again.
+*/
+LIGHTMODBUS_RET_ERROR modbusParseResponseRTUStream(
+	ModbusMaster *status,
+	const uint8_t *request,
+	uint16_t requestLength,
+	ModbusRTUStream *stream,
+	uint8_t *parsed)
+{
+	const uint8_t *frame;
+	uint16_t frameLength;
+
+	*parsed = modbusRTUStreamNext(stream, &frame, &frameLength);
+	if (!*parsed)
+		return MODBUS_NO_ERROR();
+
+	return modbusParseResponseRTU(status, request, requestLength, frame, frameLength);
+}
+#endif
+
+#endif
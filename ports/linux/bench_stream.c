@@ -0,0 +1,85 @@
+/*
+	Throughput benchmark of ModbusTCPStream.
+
+	Builds a buffer of Modbus TCP frames of random lengths and pushes it
+	through the stream in chunks of the given size (1460 bytes by default,
+	a typical TCP segment payload). Reports frames and megabytes per second.
+
+	Usage: ./bench_stream [chunk size] [megabytes]
+*/
+#include "modbus_port.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static double now_s(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv)
+{
+	size_t chunk = argc > 1 ? (size_t) atol(argv[1]) : 1460;
+	size_t megabytes = argc > 2 ? (size_t) atol(argv[2]) : 256;
+	if (chunk < 1)
+	{
+		fprintf(stderr, "usage: %s [chunk size] [megabytes]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	// 1 MiB of frames, ending on a frame boundary
+	size_t size = 1 << 20;
+	uint8_t *data = malloc(size);
+	size_t length = 0;
+	size_t frames_per_pass = 0;
+	srand(1);
+	for (;;)
+	{
+		uint16_t pdu = 1 + rand() % MODBUS_PDU_MAX;
+		if (length + MODBUS_TCP_PDU_OFFSET + pdu > size)
+			break;
+
+		modbusWBE(&data[length], (uint16_t) frames_per_pass);
+		modbusWBE(&data[length + 2], 0);
+		modbusWBE(&data[length + 4], pdu + 1);
+		for (uint16_t i = 6; i < MODBUS_TCP_PDU_OFFSET + pdu; i++)
+			data[length + i] = (uint8_t) rand();
+
+		length += MODBUS_TCP_PDU_OFFSET + pdu;
+		frames_per_pass++;
+	}
+
+	ModbusTCPStream stream;
+	modbusTCPStreamInit(&stream);
+
+	uint64_t checksum = 0;
+	double start = now_s();
+	for (size_t pass = 0; pass < megabytes; pass++)
+	{
+		for (size_t offset = 0; offset < length; offset += chunk)
+		{
+			size_t n = length - offset < chunk ? length - offset : chunk;
+			modbusTCPStreamFeed(&stream, data + offset, n);
+
+			const uint8_t *frame;
+			uint16_t frame_length;
+			while (modbusTCPStreamNext(&stream, &frame, &frame_length) == MODBUS_OK && frame)
+				checksum += frame[frame_length - 1];
+		}
+	}
+	double elapsed = now_s() - start;
+
+	if (stream.frames != frames_per_pass * megabytes || stream.errors)
+	{
+		fprintf(stderr, "framing error: %u frames, %u errors\n", stream.frames, stream.errors);
+		return EXIT_FAILURE;
+	}
+
+	printf("chunk %zu B, %zu MiB, %.3f s (checksum %llu)\n", chunk, megabytes, elapsed, (unsigned long long) checksum);
+	printf("%.1f Mframes/s, %.0f MiB/s\n", stream.frames / elapsed / 1e6, megabytes / elapsed);
+	free(data);
+	return EXIT_SUCCESS;
+}
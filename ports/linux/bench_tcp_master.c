@@ -0,0 +1,244 @@
+/*
+	Loopback benchmark of the epoll TCP master engine.
+
+	Spawns a simple epoll-based Modbus TCP slave on 127.0.0.1 and keeps
+	every connection saturated with pipelined FC03 requests for the given
+	duration. Reports aggregate requests per second.
+
+	Usage: ./bench_tcp_master [connections] [depth] [seconds] [port]
+*/
+#define _GNU_SOURCE
+#include "tcp_master.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/tcp.h>
+
+#define BENCH_REGISTERS 10
+
+typedef struct
+{
+	modbus_handle_t handle;
+	uint8_t rx[4 * MODBUS_TCP_ADU_MAX];
+	uint16_t rx_len;
+} bench_client_t;
+
+static volatile int server_running = 1;
+static uint64_t registers_received = 0;
+static int depth = 8;
+
+static ModbusError bench_register_callback(
+	const ModbusSlave *slave,
+	const ModbusRegisterCallbackArgs *args,
+	ModbusRegisterCallbackResult *result)
+{
+	result->exceptionCode = MODBUS_EXCEP_NONE;
+	result->value = args->index;
+	return MODBUS_OK;
+}
+
+static void server_client_data(ModbusSlave *slave, bench_client_t *client)
+{
+	for (;;)
+	{
+		ssize_t n = recv(client->handle.fd, client->rx + client->rx_len, sizeof(client->rx) - client->rx_len, 0);
+		if (n <= 0)
+		{
+			if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+			{
+				close(client->handle.fd);
+				free(client);
+			}
+			return;
+		}
+		client->rx_len += n;
+
+		// Parse all complete requests and send all responses at once
+		size_t consumed;
+		do
+		{
+			uint8_t tx[4 * MODBUS_TCP_ADU_MAX];
+			size_t tx_len;
+			uint16_t count;
+			ModbusErrorInfo err = modbusParseRequestTCPBatch(slave, client->rx, client->rx_len, tx, sizeof(tx), &consumed, &tx_len, &count);
+			if (!modbusIsOk(err))
+				fprintf(stderr, "server: invalid request\n");
+
+			memmove(client->rx, client->rx + consumed, client->rx_len - consumed);
+			client->rx_len -= consumed;
+
+			if (tx_len && send(client->handle.fd, tx, tx_len, MSG_NOSIGNAL) != (ssize_t) tx_len)
+				fprintf(stderr, "server: short send\n");
+		} while (consumed);
+	}
+}
+
+static void *server_thread(void *arg)
+{
+	int listen_fd = *(int*) arg;
+	int epoll_fd = epoll_create1(0);
+	modbus_handle_t listener = {.fd = listen_fd, .type = MODBUS_HANDLE_LISTENER, .owner = NULL};
+	modbus_epoll_add(epoll_fd, &listener, EPOLLIN);
+
+	ModbusSlave slave;
+	ModbusErrorInfo err = modbusSlaveInit(
+		&slave,
+		bench_register_callback,
+		NULL,
+		modbusDefaultAllocator,
+		modbusSlaveDefaultFunctions,
+		modbusSlaveDefaultFunctionCount);
+	if (!modbusIsOk(err))
+		return NULL;
+
+	while (server_running)
+	{
+		struct epoll_event events[64];
+		int n = epoll_wait(epoll_fd, events, 64, 100);
+		for (int i = 0; i < n; i++)
+		{
+			modbus_handle_t *handle = events[i].data.ptr;
+			if (handle->type == MODBUS_HANDLE_LISTENER)
+			{
+				int fd;
+				while ((fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+				{
+					int one = 1;
+					setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+					bench_client_t *client = calloc(1, sizeof(bench_client_t));
+					client->handle.fd = fd;
+					client->handle.type = MODBUS_HANDLE_SOCKET;
+					client->handle.owner = client;
+					modbus_epoll_add(epoll_fd, &client->handle, EPOLLIN);
+				}
+			}
+			else
+				server_client_data(&slave, handle->owner);
+		}
+	}
+
+	modbusSlaveDestroy(&slave);
+	close(epoll_fd);
+	return NULL;
+}
+
+static ModbusError bench_data_callback(const ModbusMaster *master, const ModbusDataCallbackArgs *args)
+{
+	registers_received++;
+	return MODBUS_OK;
+}
+
+static void bench_fill(modbus_tcp_conn_t *conn)
+{
+	while (conn->state == MODBUS_TCP_CONNECTED && modbusTransactionTableGetCount(&conn->table) < depth)
+	{
+		ModbusErrorInfo err = modbusBuildRequest03TCP(modbus_tcp_conn_master(conn), 0, 1, 0, BENCH_REGISTERS);
+		if (!modbusIsOk(err) || modbus_tcp_conn_submit(conn, 1000, NULL))
+			return;
+	}
+}
+
+static void bench_complete(modbus_tcp_conn_t *conn, modbus_tcp_result result, const ModbusTransaction *t, ModbusErrorInfo err)
+{
+	bench_fill(conn);
+}
+
+int main(int argc, char **argv)
+{
+	int connections = argc > 1 ? atoi(argv[1]) : 100;
+	depth = argc > 2 ? atoi(argv[2]) : 8;
+	double seconds = argc > 3 ? atof(argv[3]) : 3;
+	int port = argc > 4 ? atoi(argv[4]) : 15020;
+
+	if (connections < 1 || depth < 1 || depth > MODBUS_TCP_MASTER_DEPTH)
+	{
+		fprintf(stderr, "usage: %s [connections] [depth (1-%d)] [seconds] [port]\n", argv[0], MODBUS_TCP_MASTER_DEPTH);
+		return EXIT_FAILURE;
+	}
+
+	struct sockaddr_in addr = {0};
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	int listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	int one = 1;
+	setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	if (bind(listen_fd, (struct sockaddr*) &addr, sizeof(addr)) || listen(listen_fd, 1024))
+	{
+		perror("bind");
+		return EXIT_FAILURE;
+	}
+
+	pthread_t server;
+	pthread_create(&server, NULL, server_thread, &listen_fd);
+
+	modbus_tcp_master_t engine;
+	if (modbus_tcp_master_init(&engine))
+	{
+		perror("epoll");
+		return EXIT_FAILURE;
+	}
+
+	modbus_tcp_conn_t *conns = calloc(connections, sizeof(modbus_tcp_conn_t));
+	for (int i = 0; i < connections; i++)
+	{
+		if (modbus_tcp_conn_init(&engine, &conns[i], &addr, bench_data_callback, NULL, bench_complete))
+		{
+			perror("connection");
+			return EXIT_FAILURE;
+		}
+	}
+
+	// Wait for all connections
+	uint32_t start = modbus_now_ms();
+	int connected = 0;
+	while (connected < connections && modbusTimeDiff(modbus_now_ms(), start) < 5000)
+	{
+		modbus_tcp_master_poll(&engine, 10);
+		connected = 0;
+		for (int i = 0; i < connections; i++)
+			connected += conns[i].state == MODBUS_TCP_CONNECTED;
+	}
+
+	start = modbus_now_ms();
+	for (int i = 0; i < connections; i++)
+		bench_fill(&conns[i]);
+
+	uint32_t duration = (uint32_t)(seconds * 1000);
+	while (modbusTimeDiff(modbus_now_ms(), start) < (int32_t) duration)
+		modbus_tcp_master_poll(&engine, 10);
+	uint32_t elapsed = modbus_now_ms() - start;
+
+	modbus_tcp_stats_t total = {0};
+	for (int i = 0; i < connections; i++)
+	{
+		total.requests += conns[i].stats.requests;
+		total.responses += conns[i].stats.responses;
+		total.errors += conns[i].stats.errors;
+		total.timeouts += conns[i].stats.timeouts;
+		modbus_tcp_conn_destroy(&conns[i]);
+	}
+
+	printf("%d/%d connections, depth %d, %.2f s\n", connected, connections, depth, elapsed / 1000.0);
+	printf("%llu responses (%llu registers), %llu errors, %llu timeouts\n",
+		(unsigned long long) total.responses,
+		(unsigned long long) registers_received,
+		(unsigned long long) total.errors,
+		(unsigned long long) total.timeouts);
+	printf("%.0f requests/s\n", total.responses * 1000.0 / (elapsed ? elapsed : 1));
+
+	server_running = 0;
+	pthread_join(server, NULL);
+	modbus_tcp_master_destroy(&engine);
+	close(listen_fd);
+	free(conns);
+	return total.responses && !total.errors ? EXIT_SUCCESS : EXIT_FAILURE;
+}
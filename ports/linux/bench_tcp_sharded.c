@@ -0,0 +1,235 @@
+/*
+	Loopback benchmark of the sharded Modbus TCP server.
+
+	Starts a number of server workers sharing one register bank and
+	a number of load generator threads, each driving its share of the
+	connections with its own TCP master engine. Connections are kept
+	saturated with pipelined FC03 requests, a given percentage of which
+	are replaced with FC16 writes. Reports aggregate requests per second
+	and requests per second of CPU time used by the workers (i.e. per core).
+
+	For meaningful scaling figures, there should be enough cores
+	for both the workers and the load generators.
+
+	Usage: ./bench_tcp_sharded [workers] [loaders] [connections] [depth] [seconds] [write %] [port]
+*/
+#define _GNU_SOURCE
+#include "tcp_master.h"
+#include "tcp_sharded.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <sys/resource.h>
+
+#define BENCH_REGISTERS 10
+
+static volatile int running = 1;
+static int depth = 8;
+static int write_percent = 0;
+static pthread_barrier_t barrier;
+static __thread uint64_t writes_sent;
+
+typedef struct
+{
+	pthread_t thread;
+	struct sockaddr_in addr;
+	int connections;
+	double seconds;
+
+	// Results
+	int connected;
+	uint32_t elapsed;
+	uint64_t writes;
+	modbus_tcp_stats_t stats;
+} loader_t;
+
+static ModbusError bench_data_callback(const ModbusMaster *master, const ModbusDataCallbackArgs *args)
+{
+	return MODBUS_OK;
+}
+
+static void bench_fill(modbus_tcp_conn_t *conn)
+{
+	static __thread unsigned sequence;
+
+	while (running && conn->state == MODBUS_TCP_CONNECTED && modbusTransactionTableGetCount(&conn->table) < depth)
+	{
+		ModbusErrorInfo err;
+		if ((sequence++ % 100) < (unsigned) write_percent)
+		{
+			uint16_t values[BENCH_REGISTERS];
+			for (int i = 0; i < BENCH_REGISTERS; i++)
+				values[i] = sequence + i;
+			err = modbusBuildRequest16TCP(modbus_tcp_conn_master(conn), 0, 1, 0, BENCH_REGISTERS, values);
+			writes_sent++;
+		}
+		else
+			err = modbusBuildRequest03TCP(modbus_tcp_conn_master(conn), 0, 1, 0, BENCH_REGISTERS);
+
+		if (!modbusIsOk(err) || modbus_tcp_conn_submit(conn, 1000, NULL))
+			return;
+	}
+}
+
+static void bench_complete(modbus_tcp_conn_t *conn, modbus_tcp_result result, const ModbusTransaction *t, ModbusErrorInfo err)
+{
+	bench_fill(conn);
+}
+
+static void *loader_thread(void *arg)
+{
+	loader_t *loader = arg;
+	modbus_tcp_master_t engine;
+	modbus_tcp_conn_t *conns = calloc(loader->connections, sizeof(modbus_tcp_conn_t));
+	int ok = conns && !modbus_tcp_master_init(&engine);
+
+	for (int i = 0; ok && i < loader->connections; i++)
+		ok = !modbus_tcp_conn_init(&engine, &conns[i], &loader->addr, bench_data_callback, NULL, bench_complete);
+
+	// Wait for all connections
+	uint32_t start = modbus_now_ms();
+	while (ok && loader->connected < loader->connections && modbusTimeDiff(modbus_now_ms(), start) < 5000)
+	{
+		modbus_tcp_master_poll(&engine, 10);
+		loader->connected = 0;
+		for (int i = 0; i < loader->connections; i++)
+			loader->connected += conns[i].state == MODBUS_TCP_CONNECTED;
+	}
+
+	pthread_barrier_wait(&barrier);
+
+	start = modbus_now_ms();
+	for (int i = 0; ok && i < loader->connections; i++)
+		bench_fill(&conns[i]);
+
+	uint32_t duration = (uint32_t)(loader->seconds * 1000);
+	while (ok && modbusTimeDiff(modbus_now_ms(), start) < (int32_t) duration)
+		modbus_tcp_master_poll(&engine, 10);
+	loader->elapsed = modbus_now_ms() - start;
+	loader->writes = writes_sent;
+
+	for (int i = 0; ok && i < loader->connections; i++)
+	{
+		loader->stats.responses += conns[i].stats.responses;
+		loader->stats.errors += conns[i].stats.errors;
+		loader->stats.timeouts += conns[i].stats.timeouts;
+		modbus_tcp_conn_destroy(&conns[i]);
+	}
+
+	if (ok)
+		modbus_tcp_master_destroy(&engine);
+	free(conns);
+	return NULL;
+}
+
+static double workers_cpu_seconds(const modbus_sharded_server_t *server)
+{
+	double total = 0;
+	for (int i = 0; i < server->shard_count; i++)
+	{
+		clockid_t clock;
+		struct timespec ts;
+		if (!pthread_getcpuclockid(server->shards[i].thread, &clock) && !clock_gettime(clock, &ts))
+			total += ts.tv_sec + ts.tv_nsec / 1e9;
+	}
+	return total;
+}
+
+int main(int argc, char **argv)
+{
+	int workers = argc > 1 ? atoi(argv[1]) : 4;
+	int loaders = argc > 2 ? atoi(argv[2]) : 4;
+	int connections = argc > 3 ? atoi(argv[3]) : 64;
+	depth = argc > 4 ? atoi(argv[4]) : 8;
+	double seconds = argc > 5 ? atof(argv[5]) : 3;
+	write_percent = argc > 6 ? atoi(argv[6]) : 0;
+	int port = argc > 7 ? atoi(argv[7]) : 15023;
+
+	if (workers < 1 || loaders < 1 || connections < loaders || depth < 1 || depth > MODBUS_TCP_MASTER_DEPTH
+		|| write_percent < 0 || write_percent > 100)
+	{
+		fprintf(stderr, "usage: %s [workers] [loaders] [connections (>= loaders)] [depth (1-%d)] [seconds] [write %%] [port]\n",
+			argv[0], MODBUS_TCP_MASTER_DEPTH);
+		return EXIT_FAILURE;
+	}
+
+	// Both ends of every connection are open in this process
+	struct rlimit limit;
+	getrlimit(RLIMIT_NOFILE, &limit);
+	limit.rlim_cur = limit.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &limit);
+
+	struct sockaddr_in addr = {0};
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	modbus_register_bank_t *bank = malloc(sizeof(modbus_register_bank_t));
+	modbus_sharded_server_t server;
+	if (!bank || modbus_register_bank_init(bank) || modbus_sharded_server_start(&server, &addr, workers, bank, NULL))
+	{
+		perror("server");
+		return EXIT_FAILURE;
+	}
+
+	addr.sin_port = htons(server.port);
+	loader_t *load = calloc(loaders, sizeof(loader_t));
+	pthread_barrier_init(&barrier, NULL, loaders + 1);
+	for (int i = 0; i < loaders; i++)
+	{
+		load[i].addr = addr;
+		load[i].connections = connections / loaders + (i < connections % loaders);
+		load[i].seconds = seconds;
+		pthread_create(&load[i].thread, NULL, loader_thread, &load[i]);
+	}
+
+	// CPU time is measured once all connections are open
+	pthread_barrier_wait(&barrier);
+	double cpu = workers_cpu_seconds(&server);
+
+	modbus_tcp_stats_t total = {0};
+	uint32_t elapsed = 0;
+	uint64_t writes = 0;
+	int connected = 0;
+	for (int i = 0; i < loaders; i++)
+	{
+		pthread_join(load[i].thread, NULL);
+		total.responses += load[i].stats.responses;
+		total.errors += load[i].stats.errors;
+		total.timeouts += load[i].stats.timeouts;
+		writes += load[i].writes;
+		connected += load[i].connected;
+		if (load[i].elapsed > elapsed)
+			elapsed = load[i].elapsed;
+	}
+
+	// No requests are sent before all connections are open
+	cpu = workers_cpu_seconds(&server) - cpu;
+	running = 0;
+	modbus_sharded_server_stop(&server);
+	uint64_t requests = server.stats.requests;
+
+	printf("%d workers, %d load generators: %d connections (depth %d), %d%% writes, %.2f s\n",
+		workers, loaders, connected, depth, write_percent, elapsed / 1000.0);
+	printf("%llu responses, %llu errors, %llu timeouts, %llu write requests applied\n",
+		(unsigned long long) total.responses,
+		(unsigned long long) total.errors,
+		(unsigned long long) total.timeouts,
+		(unsigned long long) bank->writes);
+	printf("%.0f requests/s, %.0f requests/s per core (%.2f s CPU)\n",
+		total.responses * 1000.0 / (elapsed ? elapsed : 1),
+		cpu > 0 ? requests / cpu : 0.0,
+		cpu);
+
+	// Write requests still in flight at the end may not have been applied
+	int ok = total.responses && !total.errors && bank->writes <= writes;
+	modbus_register_bank_destroy(bank);
+	free(bank);
+	free(load);
+	pthread_barrier_destroy(&barrier);
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
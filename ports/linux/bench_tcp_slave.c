@@ -0,0 +1,268 @@
+/*
+	Loopback benchmark of the epoll Modbus TCP server.
+
+	Runs the server in its own thread, opens a number of idle connections
+	and keeps a number of active connections saturated with pipelined FC03
+	requests using the TCP master engine. Reports requests per second,
+	requests per second of CPU time used by the server thread (i.e. per core)
+	and system calls made by the server per request.
+
+	The backend is either epoll, io_uring or auto (io_uring if supported).
+
+	Usage: ./bench_tcp_slave [active] [depth] [idle] [seconds] [epoll|uring|auto] [port]
+*/
+#define _GNU_SOURCE
+#include "tcp_master.h"
+#include "tcp_slave.h"
+#include "tcp_uring.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#define BENCH_REGISTERS 10
+
+static volatile int running = 1;
+static int depth = 8;
+static int use_uring = 0;
+static modbus_tcp_server_t *epoll_server;
+static modbus_uring_server_t *uring_server;
+
+static ModbusError bench_register_callback(
+	const ModbusSlave *slave,
+	const ModbusRegisterCallbackArgs *args,
+	ModbusRegisterCallbackResult *result)
+{
+	result->exceptionCode = MODBUS_EXCEP_NONE;
+	result->value = args->index;
+	return MODBUS_OK;
+}
+
+static double thread_cpu_seconds(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t server_requests(void)
+{
+	return use_uring ? uring_server->stats.requests : epoll_server->stats.requests;
+}
+
+static void *server_thread(void *arg)
+{
+	double *cpu = calloc(1, sizeof(double));
+	double start = 0;
+	int measuring = 0;
+
+	while (running)
+	{
+		if (use_uring)
+			modbus_uring_server_poll(uring_server, 10);
+		else
+			modbus_tcp_server_poll(epoll_server, 10);
+
+		// CPU time is measured once the load starts
+		if (!measuring && server_requests())
+		{
+			start = thread_cpu_seconds();
+			measuring = 1;
+		}
+	}
+
+	*cpu = measuring ? thread_cpu_seconds() - start : 0;
+	return cpu;
+}
+
+static ModbusError bench_data_callback(const ModbusMaster *master, const ModbusDataCallbackArgs *args)
+{
+	return MODBUS_OK;
+}
+
+static void bench_fill(modbus_tcp_conn_t *conn)
+{
+	while (running && conn->state == MODBUS_TCP_CONNECTED && modbusTransactionTableGetCount(&conn->table) < depth)
+	{
+		ModbusErrorInfo err = modbusBuildRequest03TCP(modbus_tcp_conn_master(conn), 0, 1, 0, BENCH_REGISTERS);
+		if (!modbusIsOk(err) || modbus_tcp_conn_submit(conn, 1000, NULL))
+			return;
+	}
+}
+
+static void bench_complete(modbus_tcp_conn_t *conn, modbus_tcp_result result, const ModbusTransaction *t, ModbusErrorInfo err)
+{
+	bench_fill(conn);
+}
+
+int main(int argc, char **argv)
+{
+	int active = argc > 1 ? atoi(argv[1]) : 16;
+	depth = argc > 2 ? atoi(argv[2]) : 8;
+	int idle = argc > 3 ? atoi(argv[3]) : 1000;
+	double seconds = argc > 4 ? atof(argv[4]) : 3;
+	const char *backend = argc > 5 ? argv[5] : "auto";
+	int port = argc > 6 ? atoi(argv[6]) : 15022;
+
+	if (active < 1 || idle < 0 || depth < 1 || depth > MODBUS_TCP_MASTER_DEPTH
+		|| (strcmp(backend, "epoll") && strcmp(backend, "uring") && strcmp(backend, "auto")))
+	{
+		fprintf(stderr, "usage: %s [active] [depth (1-%d)] [idle] [seconds] [epoll|uring|auto] [port]\n", argv[0], MODBUS_TCP_MASTER_DEPTH);
+		return EXIT_FAILURE;
+	}
+
+	use_uring = !strcmp(backend, "uring") || (!strcmp(backend, "auto") && modbus_uring_supported());
+
+	// Both ends of every connection are open in this process
+	struct rlimit limit;
+	getrlimit(RLIMIT_NOFILE, &limit);
+	limit.rlim_cur = limit.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &limit);
+	if ((rlim_t)(2 * (active + idle) + 16) > limit.rlim_cur)
+	{
+		fprintf(stderr, "%d connections need %d file descriptors, the limit is %llu\n",
+			active + idle, 2 * (active + idle) + 16, (unsigned long long) limit.rlim_cur);
+		return EXIT_FAILURE;
+	}
+
+	struct sockaddr_in addr = {0};
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	int err;
+	if (use_uring)
+	{
+		uring_server = malloc(sizeof(modbus_uring_server_t));
+		err = !uring_server || modbus_uring_server_init(uring_server, &addr, bench_register_callback, NULL);
+	}
+	else
+	{
+		epoll_server = malloc(sizeof(modbus_tcp_server_t));
+		err = !epoll_server || modbus_tcp_server_init(epoll_server, &addr, bench_register_callback, NULL);
+	}
+
+	if (err)
+	{
+		perror("server");
+		return EXIT_FAILURE;
+	}
+
+	pthread_t server_tid;
+	pthread_create(&server_tid, NULL, server_thread, NULL);
+
+	// Idle connections
+	int *idle_fds = calloc(idle ? idle : 1, sizeof(int));
+	for (int i = 0; i < idle; i++)
+	{
+		idle_fds[i] = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (idle_fds[i] < 0 || connect(idle_fds[i], (struct sockaddr*) &addr, sizeof(addr)))
+		{
+			perror("idle connection");
+			return EXIT_FAILURE;
+		}
+	}
+
+	modbus_tcp_master_t engine;
+	if (modbus_tcp_master_init(&engine))
+	{
+		perror("epoll");
+		return EXIT_FAILURE;
+	}
+
+	modbus_tcp_conn_t *conns = calloc(active, sizeof(modbus_tcp_conn_t));
+	for (int i = 0; i < active; i++)
+	{
+		if (modbus_tcp_conn_init(&engine, &conns[i], &addr, bench_data_callback, NULL, bench_complete))
+		{
+			perror("connection");
+			return EXIT_FAILURE;
+		}
+	}
+
+	// Wait for all connections
+	uint32_t start = modbus_now_ms();
+	int connected = 0;
+	while (connected < active && modbusTimeDiff(modbus_now_ms(), start) < 5000)
+	{
+		modbus_tcp_master_poll(&engine, 10);
+		connected = 0;
+		for (int i = 0; i < active; i++)
+			connected += conns[i].state == MODBUS_TCP_CONNECTED;
+	}
+
+	start = modbus_now_ms();
+	for (int i = 0; i < active; i++)
+		bench_fill(&conns[i]);
+
+	uint32_t duration = (uint32_t)(seconds * 1000);
+	while (modbusTimeDiff(modbus_now_ms(), start) < (int32_t) duration)
+		modbus_tcp_master_poll(&engine, 10);
+	uint32_t elapsed = modbus_now_ms() - start;
+
+	running = 0;
+	double *cpu;
+	pthread_join(server_tid, (void**) &cpu);
+
+	modbus_tcp_stats_t total = {0};
+	for (int i = 0; i < active; i++)
+	{
+		total.responses += conns[i].stats.responses;
+		total.errors += conns[i].stats.errors;
+		total.timeouts += conns[i].stats.timeouts;
+		modbus_tcp_conn_destroy(&conns[i]);
+	}
+
+	uint64_t requests, errors, syscalls;
+	uint32_t clients;
+	if (use_uring)
+	{
+		modbus_uring_stats_t *stats = &uring_server->stats;
+		requests = stats->requests;
+		errors = stats->errors;
+		syscalls = stats->enter_calls;
+		clients = stats->clients;
+	}
+	else
+	{
+		modbus_tcp_server_stats_t *stats = &epoll_server->stats;
+		requests = stats->requests;
+		errors = stats->errors;
+		syscalls = stats->poll_calls + stats->recv_calls + stats->send_calls;
+		clients = stats->clients;
+	}
+
+	printf("%s: %d active connections (depth %d), %u open on the server, %.2f s\n",
+		use_uring ? "io_uring" : "epoll", connected, depth, clients, elapsed / 1000.0);
+	printf("%llu responses, %llu errors, %llu timeouts\n",
+		(unsigned long long) total.responses,
+		(unsigned long long) total.errors,
+		(unsigned long long) total.timeouts);
+	printf("%.3f system calls per request\n", requests ? (double) syscalls / requests : 0.0);
+	printf("%.0f requests/s, %.0f requests/s per core (%.2f s CPU)\n",
+		total.responses * 1000.0 / (elapsed ? elapsed : 1),
+		*cpu > 0 ? requests / *cpu : 0.0,
+		*cpu);
+
+	int ok = total.responses && !total.errors && !errors;
+	for (int i = 0; i < idle; i++)
+		close(idle_fds[i]);
+	modbus_tcp_master_destroy(&engine);
+	if (use_uring)
+		modbus_uring_server_destroy(uring_server);
+	else
+		modbus_tcp_server_destroy(epoll_server);
+	free(uring_server);
+	free(epoll_server);
+	free(idle_fds);
+	free(conns);
+	free(cpu);
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,210 @@
+/*
+	Loopback benchmark of the recvmmsg/sendmmsg Modbus UDP slave.
+
+	Runs the slave in its own thread and floods it with FC03 requests from
+	a number of client threads, each keeping a window of requests in flight.
+	Reports datagrams per second and datagrams per second of CPU time
+	used by the slave thread (i.e. per core).
+
+	Usage: ./bench_udp_slave [clients] [window] [seconds] [port]
+*/
+#define _GNU_SOURCE
+#include "udp_slave.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#define BENCH_REGISTERS 10
+
+typedef struct
+{
+	pthread_t thread;
+	struct sockaddr_in addr;
+	uint64_t responses;
+	uint64_t timeouts;
+} bench_client_t;
+
+static volatile int running = 1;
+static int window = 32;
+
+static ModbusError bench_register_callback(
+	const ModbusSlave *slave,
+	const ModbusRegisterCallbackArgs *args,
+	ModbusRegisterCallbackResult *result)
+{
+	result->exceptionCode = MODBUS_EXCEP_NONE;
+	result->value = args->index;
+	return MODBUS_OK;
+}
+
+static double thread_cpu_seconds(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *server_thread(void *arg)
+{
+	modbus_udp_slave_t *server = arg;
+	double start = thread_cpu_seconds();
+	while (running)
+		modbus_udp_slave_poll(server, 100);
+
+	double *cpu = malloc(sizeof(double));
+	*cpu = thread_cpu_seconds() - start;
+	return cpu;
+}
+
+/*
+	Sends a window of requests and sends a new one for every response.
+	The whole window is resent if nothing arrives for 100 ms.
+*/
+static void *client_thread(void *arg)
+{
+	bench_client_t *client = arg;
+
+	ModbusMaster master;
+	ModbusErrorInfo err = modbusMasterInit(&master, NULL, NULL, modbusDefaultAllocator, modbusMasterDefaultFunctions, modbusMasterDefaultFunctionCount);
+	if (!modbusIsOk(err) || !modbusIsOk(modbusBuildRequest03TCP(&master, 1, 1, 0, BENCH_REGISTERS)))
+		return NULL;
+
+	int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	struct timeval tv = {.tv_sec = 0, .tv_usec = 100000};
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	if (connect(fd, (struct sockaddr*) &client->addr, sizeof(client->addr)))
+	{
+		close(fd);
+		return NULL;
+	}
+
+	struct mmsghdr *tx = calloc(window, sizeof(struct mmsghdr));
+	struct mmsghdr *rx = calloc(window, sizeof(struct mmsghdr));
+	struct iovec *tx_iov = calloc(window, sizeof(struct iovec));
+	struct iovec *rx_iov = calloc(window, sizeof(struct iovec));
+	uint8_t (*rx_data)[MODBUS_TCP_ADU_MAX] = calloc(window, MODBUS_TCP_ADU_MAX);
+	for (int i = 0; i < window; i++)
+	{
+		tx_iov[i].iov_base = (void*) modbusMasterGetRequest(&master);
+		tx_iov[i].iov_len = modbusMasterGetRequestLength(&master);
+		tx[i].msg_hdr.msg_iov = &tx_iov[i];
+		tx[i].msg_hdr.msg_iovlen = 1;
+
+		rx_iov[i].iov_base = rx_data[i];
+		rx_iov[i].iov_len = MODBUS_TCP_ADU_MAX;
+		rx[i].msg_hdr.msg_iov = &rx_iov[i];
+		rx[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	int to_send = window;
+	while (running)
+	{
+		if (to_send > 0 && sendmmsg(fd, tx, to_send, 0) < 0)
+			break;
+
+		int n = recvmmsg(fd, rx, window, MSG_WAITFORONE, NULL);
+		if (n < 0)
+		{
+			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+				break;
+
+			client->timeouts++;
+			to_send = window;
+			continue;
+		}
+
+		client->responses += n;
+		to_send = n;
+	}
+
+	close(fd);
+	free(tx);
+	free(rx);
+	free(tx_iov);
+	free(rx_iov);
+	free(rx_data);
+	modbusMasterDestroy(&master);
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	int clients = argc > 1 ? atoi(argv[1]) : 4;
+	window = argc > 2 ? atoi(argv[2]) : 32;
+	double seconds = argc > 3 ? atof(argv[3]) : 3;
+	int port = argc > 4 ? atoi(argv[4]) : 15021;
+
+	if (clients < 1 || window < 1)
+	{
+		fprintf(stderr, "usage: %s [clients] [window] [seconds] [port]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	struct sockaddr_in addr = {0};
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	modbus_udp_slave_t *server = malloc(sizeof(modbus_udp_slave_t));
+	if (modbus_udp_slave_init(server, &addr, bench_register_callback, NULL))
+	{
+		perror("bind");
+		return EXIT_FAILURE;
+	}
+
+	pthread_t server_tid;
+	pthread_create(&server_tid, NULL, server_thread, server);
+
+	bench_client_t *threads = calloc(clients, sizeof(bench_client_t));
+	uint32_t start = modbus_now_ms();
+	for (int i = 0; i < clients; i++)
+	{
+		threads[i].addr = addr;
+		pthread_create(&threads[i].thread, NULL, client_thread, &threads[i]);
+	}
+
+	usleep((useconds_t)(seconds * 1e6));
+	running = 0;
+
+	uint64_t responses = 0, timeouts = 0;
+	for (int i = 0; i < clients; i++)
+	{
+		pthread_join(threads[i].thread, NULL);
+		responses += threads[i].responses;
+		timeouts += threads[i].timeouts;
+	}
+	uint32_t elapsed = modbus_now_ms() - start;
+
+	double *cpu;
+	pthread_join(server_tid, (void**) &cpu);
+
+	modbus_udp_stats_t *stats = &server->stats;
+	printf("%d clients, window %d, %.2f s\n", clients, window, elapsed / 1000.0);
+	printf("%llu datagrams, %llu responses received, %llu errors, %llu dropped, %llu timeouts\n",
+		(unsigned long long) stats->datagrams,
+		(unsigned long long) responses,
+		(unsigned long long) stats->errors,
+		(unsigned long long) stats->dropped,
+		(unsigned long long) timeouts);
+	printf("%.1f datagrams per recvmmsg(), %.1f per sendmmsg()\n",
+		stats->recv_calls ? (double) stats->datagrams / stats->recv_calls : 0.0,
+		stats->send_calls ? (double) stats->responses / stats->send_calls : 0.0);
+	printf("%.0f datagrams/s, %.0f datagrams/s per core (%.2f s CPU)\n",
+		stats->datagrams * 1000.0 / (elapsed ? elapsed : 1),
+		*cpu > 0 ? stats->datagrams / *cpu : 0.0,
+		*cpu);
+
+	int ok = responses && !stats->errors;
+	modbus_udp_slave_destroy(server);
+	free(server);
+	free(threads);
+	free(cpu);
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,864 @@
+#define _GNU_SOURCE
+#include "gateway.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/tcp.h>
+
+#define MODBUS_GATEWAY_MAX_EVENTS 64
+#define MODBUS_GATEWAY_CLIENT_EVENTS (EPOLLIN | EPOLLRDHUP | EPOLLET)
+
+static int client_receive(modbus_gateway_client_t *client);
+
+static void client_close(modbus_gateway_client_t *client)
+{
+	modbus_gateway_t *gateway = client->gateway;
+
+	// Responses to queued requests are dropped
+	for (modbus_gateway_line_t *line = gateway->lines; line; line = line->next)
+		for (uint16_t i = 0; i < line->count; i++)
+		{
+			modbus_gateway_request_t *request = &line->queue[(line->head + i) % line->capacity];
+			for (uint8_t j = 0; j < request->waiter_count; j++)
+				if (request->waiters[j].client == client)
+					request->waiters[j].client = NULL;
+		}
+
+	close(client->socket.fd);
+	free(client->pending);
+
+	if (client->prev)
+		client->prev->next = client->next;
+	else
+		gateway->clients = client->next;
+	if (client->next)
+		client->next->prev = client->prev;
+
+	gateway->stats.closed++;
+	gateway->stats.clients--;
+	free(client);
+}
+
+/*
+	Sends a response or, if there are pending ones or the socket
+	is full, appends it to the pending buffer.
+	Returns -1 if the connection has to be closed.
+*/
+static int client_send(modbus_gateway_client_t *client, const uint8_t *data, uint16_t length)
+{
+	ssize_t n = 0;
+	if (!client->pending_len)
+	{
+		n = send(client->socket.fd, data, length, MSG_NOSIGNAL);
+		if (n < 0)
+		{
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				return -1;
+			n = 0;
+		}
+
+		if (n == length)
+			return 0;
+	}
+
+	uint8_t *pending = realloc(client->pending, client->pending_len + length - n);
+	if (!pending)
+		return -1;
+
+	memcpy(pending + client->pending_len, data + n, length - n);
+	client->pending = pending;
+	client->pending_len += length - n;
+	return modbus_epoll_mod(client->gateway->epoll_fd, &client->socket, MODBUS_GATEWAY_CLIENT_EVENTS | EPOLLOUT);
+}
+
+/*
+	Sends the pending responses. Returns 1 if all of them have been sent,
+	0 if the socket is full again or -1 on error.
+*/
+static int client_send_pending(modbus_gateway_client_t *client)
+{
+	while (client->pending_offset < client->pending_len)
+	{
+		ssize_t n = send(
+			client->socket.fd,
+			client->pending + client->pending_offset,
+			client->pending_len - client->pending_offset,
+			MSG_NOSIGNAL);
+
+		if (n < 0)
+			return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+		client->pending_offset += n;
+	}
+
+	free(client->pending);
+	client->pending = NULL;
+	client->pending_len = 0;
+	client->pending_offset = 0;
+	return modbus_epoll_mod(client->gateway->epoll_fd, &client->socket, MODBUS_GATEWAY_CLIENT_EVENTS) ? -1 : 1;
+}
+
+/*
+	Sends an exception response built by the gateway itself
+*/
+static int client_send_exception(
+	modbus_gateway_client_t *client,
+	uint16_t transaction_id,
+	uint8_t unit,
+	uint8_t function,
+	ModbusExceptionCode code)
+{
+	uint8_t frame[9];
+	modbusWBE(&frame[0], transaction_id);
+	modbusWBE(&frame[2], 0);
+	modbusWBE(&frame[4], 3);
+	frame[6] = unit;
+	frame[7] = function | 0x80;
+	frame[8] = code;
+	return client_send(client, frame, sizeof(frame));
+}
+
+/*
+	Removes the request at the head of the queue
+*/
+static void line_pop(modbus_gateway_line_t *line)
+{
+	line->head = (line->head + 1) % line->capacity;
+	line->count--;
+}
+
+/*
+	Returns 1 if a request other than a read of the slave (or a broadcast)
+	is queued behind the request at the head of the queue
+*/
+static int line_write_queued(const modbus_gateway_line_t *line, uint8_t unit)
+{
+	for (uint16_t i = 1; i < line->count; i++)
+	{
+		const modbus_gateway_request_t *request = &line->queue[(line->head + i) % line->capacity];
+		if ((request->frame[0] == unit || !request->frame[0]) && (request->frame[1] < 1 || request->frame[1] > 4))
+			return 1;
+	}
+
+	return 0;
+}
+
+/*
+	Stores the response to the request at the head of the queue, if it's
+	a read, or invalidates the responses it may have made stale. A response
+	to a read isn't stored while a write to the slave is queued - it may
+	hold values from before the write, and a client that has sent the write
+	could get them back from the cache for a read sent after the write.
+*/
+static void line_update_cache(modbus_gateway_line_t *line, const uint8_t *response, uint16_t length)
+{
+	ModbusResponseCache *cache = line->gateway->cache;
+	const modbus_gateway_request_t *request = &line->queue[line->head];
+	if (!cache)
+		return;
+
+	uint8_t pdu_length = (uint8_t)(request->length - 3);
+	modbusResponseCacheInvalidate(cache, request->frame[0], &request->frame[1], pdu_length);
+	if (response && !line_write_queued(line, request->frame[0]))
+		modbusResponseCacheStore(cache, request->frame[0], &request->frame[1], pdu_length, &response[1], (uint8_t)(length - 3), modbus_now_ms());
+}
+
+/*
+	Builds the response to a part of a merged read out of the response
+	to the whole read. Returns length of the MBAP frame or 0 if the
+	response doesn't match the request.
+*/
+static uint16_t waiter_carve(
+	const modbus_gateway_request_t *request,
+	const modbus_gateway_waiter_t *waiter,
+	const uint8_t *response,
+	uint16_t length,
+	uint8_t *frame)
+{
+	uint8_t function = request->frame[1];
+	uint16_t first = modbusRBE(&request->frame[2]);
+	uint16_t total = modbusRBE(&request->frame[4]);
+	uint16_t offset = waiter->index - first;
+	uint16_t bytes = function <= 2 ? modbusBitsToBytes(total) : total * 2;
+	if (response[2] != bytes || length != bytes + 5)
+		return 0;
+
+	const uint8_t *data = &response[3];
+	if (function <= 2)
+	{
+		bytes = modbusBitsToBytes(waiter->count);
+		memset(&frame[9], 0, bytes);
+		for (uint16_t i = 0; i < waiter->count; i++)
+			modbusMaskWrite(&frame[9], i, modbusMaskRead(data, offset + i));
+	}
+	else
+	{
+		bytes = waiter->count * 2;
+		memcpy(&frame[9], &data[offset * 2], bytes);
+	}
+
+	modbusWBE(&frame[0], waiter->transaction_id);
+	modbusWBE(&frame[2], 0);
+	modbusWBE(&frame[4], bytes + 3);
+	frame[6] = request->frame[0];
+	frame[7] = function;
+	frame[8] = bytes;
+	return bytes + 9;
+}
+
+/*
+	Passes the result of a request to a client. `response` is an RTU frame
+	(with CRC) or NULL if the slave hasn't responded.
+*/
+static void waiter_complete(
+	const modbus_gateway_request_t *request,
+	const modbus_gateway_waiter_t *waiter,
+	const uint8_t *response,
+	uint16_t length)
+{
+	modbus_gateway_client_t *client = waiter->client;
+	uint8_t frame[MODBUS_TCP_ADU_MAX];
+	int err;
+	if (!client)
+		return;
+
+	if (!response)
+		err = client_send_exception(client, waiter->transaction_id, request->frame[0], request->frame[1], MODBUS_EXCEP_GATEWAY_TARGET);
+	else if (waiter->count
+		&& !(response[1] & 0x80)
+		&& (waiter->index != modbusRBE(&request->frame[2]) || waiter->count != modbusRBE(&request->frame[4])))
+	{
+		// Only a part of a merged read
+		uint16_t frame_length = waiter_carve(request, waiter, response, length, frame);
+		if (frame_length)
+			err = client_send(client, frame, frame_length);
+		else
+			err = client_send_exception(client, waiter->transaction_id, request->frame[0], request->frame[1], MODBUS_EXCEP_SLAVE_FAILURE);
+	}
+	else
+	{
+		// MBAP header in front of the unit ID and PDU. The CRC is dropped.
+		// Exceptions only get here for reads of the whole range (see line_split()).
+		modbusWBE(&frame[0], waiter->transaction_id);
+		modbusWBE(&frame[2], 0);
+		modbusWBE(&frame[4], length - 2);
+		memcpy(&frame[6], response, length - 2);
+		err = client_send(client, frame, length + 4);
+	}
+
+	// The client may have events waiting in the current batch, so it's
+	// only shut down here and closed once the hangup is reported
+	if (err)
+		shutdown(client->socket.fd, SHUT_RDWR);
+}
+
+/*
+	Handles an exception to a merged read at the head of the queue. The
+	exception may be caused by coils/registers only some of the clients
+	asked for, so the clients that didn't ask for the whole range have their
+	own reads re-sent ahead of the rest of the queue. Returns 0 if all clients
+	asked for the whole range and the exception applies to all of them.
+*/
+static int line_split(modbus_gateway_line_t *line, const uint8_t *response, uint16_t length)
+{
+	// The slot of the popped request is reused below
+	modbus_gateway_request_t request = line->queue[line->head];
+	uint16_t first = modbusRBE(&request.frame[2]);
+	uint16_t total = modbusRBE(&request.frame[4]);
+	uint8_t partial = 0;
+	for (uint8_t i = 0; i < request.waiter_count; i++)
+		partial |= request.waiters[i].count && (request.waiters[i].index != first || request.waiters[i].count != total);
+
+	if (!partial)
+		return 0;
+
+	line_pop(line);
+	line->stats.split++;
+
+	// Newest first, so that the oldest read ends up at the head of the queue
+	for (uint8_t i = request.waiter_count; i-- > 0;)
+	{
+		const modbus_gateway_waiter_t *waiter = &request.waiters[i];
+		if (!waiter->client)
+			continue;
+
+		if (waiter->index == first && waiter->count == total)
+		{
+			waiter_complete(&request, waiter, response, length);
+			continue;
+		}
+
+		if (line->count == line->capacity)
+		{
+			line->stats.rejected++;
+			if (client_send_exception(waiter->client, waiter->transaction_id, request.frame[0], request.frame[1], MODBUS_EXCEP_SLAVE_BUSY))
+				shutdown(waiter->client->socket.fd, SHUT_RDWR);
+			continue;
+		}
+
+		line->head = (line->head + line->capacity - 1) % line->capacity;
+		line->count++;
+		modbus_gateway_request_t *single = &line->queue[line->head];
+		single->waiters[0] = *waiter;
+		single->waiter_count = 1;
+		single->exact = 1;
+		single->length = 8;
+		single->frame[0] = request.frame[0];
+		single->frame[1] = request.frame[1];
+		modbusWBE(&single->frame[2], waiter->index);
+		modbusWBE(&single->frame[4], waiter->count);
+		modbusWLE(&single->frame[6], modbusCRC(single->frame, 6));
+	}
+
+	return 1;
+}
+
+/*
+	Passes the result of the request at the head of the queue to the clients
+	and removes the request from the queue. `response` is an RTU frame
+	(with CRC) or NULL if the slave hasn't responded.
+*/
+static void line_complete(modbus_gateway_line_t *line, const uint8_t *response, uint16_t length)
+{
+	modbus_gateway_request_t *request = &line->queue[line->head];
+	if (response && (response[1] & 0x80) && line_split(line, response, length))
+		return;
+
+	line_update_cache(line, response, length);
+	line_pop(line);
+
+	// The popped slot isn't reused until the next request is queued
+	for (uint8_t i = 0; i < request->waiter_count; i++)
+		waiter_complete(request, &request->waiters[i], response, length);
+}
+
+/*
+	Keeps the line silent for the inter-frame delay (plus `extra_ms`)
+	before the next request is sent
+*/
+static void line_silence(modbus_gateway_line_t *line, uint32_t extra_ms)
+{
+	line->state = MODBUS_LINE_SILENCE;
+	modbus_timer_arm(&line->timer, line->silence_ms + extra_ms);
+}
+
+/*
+	Called once the whole request has been written to the serial port
+*/
+static void line_sent(modbus_gateway_line_t *line)
+{
+	modbus_gateway_request_t *request = &line->queue[line->head];
+	uint32_t air_time_ms = (modbusRTUFrameTime(line->baudrate, request->length) + 999) / 1000;
+	line->stats.requests++;
+
+	// Nobody responds to a broadcast
+	if (request->frame[0] == 0)
+	{
+		line_update_cache(line, NULL, 0);
+		line_pop(line);
+		line_silence(line, air_time_ms + line->broadcast_delay_ms);
+		return;
+	}
+
+	line->state = MODBUS_LINE_WAITING;
+	modbus_timer_arm(&line->timer, air_time_ms + line->response_timeout_ms);
+}
+
+/*
+	Writes (the rest of) the request at the head of the queue
+*/
+static void line_write(modbus_gateway_line_t *line)
+{
+	modbus_gateway_request_t *request = &line->queue[line->head];
+	ssize_t n = write(line->serial.fd, request->frame + line->sent, request->length - line->sent);
+	if (n > 0)
+		line->sent += n;
+
+	if (line->sent == request->length)
+	{
+		if (line->state == MODBUS_LINE_SENDING)
+			modbus_epoll_mod(line->gateway->epoll_fd, &line->serial, EPOLLIN);
+		line_sent(line);
+		return;
+	}
+
+	if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+	{
+		// The port is unusable - the request fails like an unanswered one
+		line_complete(line, NULL, 0);
+		line_silence(line, 0);
+		return;
+	}
+
+	if (line->state != MODBUS_LINE_SENDING)
+		modbus_epoll_mod(line->gateway->epoll_fd, &line->serial, EPOLLIN | EPOLLOUT);
+	line->state = MODBUS_LINE_SENDING;
+}
+
+/*
+	Starts the next request, if the line is idle
+*/
+static void line_kick(modbus_gateway_line_t *line)
+{
+	while (line->state == MODBUS_LINE_IDLE && line->count)
+	{
+		// Requests of disconnected clients aren't sent at all
+		const modbus_gateway_request_t *request = &line->queue[line->head];
+		uint8_t connected = 0;
+		for (uint8_t i = 0; i < request->waiter_count; i++)
+			connected |= request->waiters[i].client != NULL;
+
+		if (!connected)
+		{
+			line_pop(line);
+			continue;
+		}
+
+		// Anything received so far can't be a response to this request
+		tcflush(line->serial.fd, TCIFLUSH);
+		modbusRTUStreamReset(&line->stream);
+		line->sent = 0;
+		line_write(line);
+	}
+}
+
+static void line_on_timer(modbus_gateway_line_t *line)
+{
+	modbus_timer_ack(&line->timer);
+	if (line->state == MODBUS_LINE_WAITING)
+	{
+		line->stats.timeouts++;
+		line_complete(line, NULL, 0);
+		line_silence(line, 0);
+	}
+	else if (line->state == MODBUS_LINE_SILENCE)
+	{
+		line->state = MODBUS_LINE_IDLE;
+		line_kick(line);
+	}
+}
+
+static void line_on_serial(modbus_gateway_line_t *line, uint32_t events)
+{
+	if ((events & EPOLLOUT) && line->state == MODBUS_LINE_SENDING)
+		line_write(line);
+
+	if (!(events & EPOLLIN))
+		return;
+
+	uint8_t rx[MODBUS_RTU_ADU_MAX];
+	ssize_t n;
+	while ((n = read(line->serial.fd, rx, sizeof(rx))) > 0)
+	{
+		modbusRTUStreamFeed(&line->stream, rx, n);
+
+		const uint8_t *frame;
+		uint16_t length;
+		while (modbusRTUStreamNext(&line->stream, &frame, &length))
+		{
+			const modbus_gateway_request_t *request = &line->queue[line->head];
+			if (line->state != MODBUS_LINE_WAITING
+				|| frame[0] != request->frame[0]
+				|| (frame[1] & 0x7f) != request->frame[1])
+			{
+				line->stats.unexpected++;
+				continue;
+			}
+
+			line->stats.responses++;
+			line_complete(line, frame, length);
+			line_silence(line, 0);
+		}
+	}
+}
+
+/*
+	Folds a read into a read of the same coils/registers of the same slave.
+	A queued read is widened to cover both, if they overlap or adjoin and the
+	result doesn't exceed the limit of the function (125 registers or 2000 coils).
+	A read in flight, or one re-sent after an exception, can only take reads it
+	already covers. Reads aren't moved
+	ahead of other requests to the same slave (or broadcasts), as these may
+	be writes. Returns 1 if the read has been merged.
+*/
+static int line_merge(modbus_gateway_line_t *line, modbus_gateway_client_t *client, const uint8_t *frame)
+{
+	uint8_t unit = frame[6];
+	uint8_t function = frame[7];
+	uint16_t index = modbusRBE(&frame[8]);
+	uint16_t count = modbusRBE(&frame[10]);
+	uint16_t limit = function <= 2 ? 2000 : 125;
+
+	// The slave responds with an exception to anything else
+	if (!unit || function < 1 || function > 4 || !count || count > limit || (uint32_t) index + count > 0x10000)
+		return 0;
+
+	// Newest first
+	for (uint16_t i = line->count; i-- > 0;)
+	{
+		modbus_gateway_request_t *request = &line->queue[(line->head + i) % line->capacity];
+		if (request->frame[0] && request->frame[0] != unit)
+			continue;
+		if (!request->frame[0] || request->frame[1] < 1 || request->frame[1] > 4)
+			break;
+		if (request->frame[1] != function || request->waiter_count == MODBUS_GATEWAY_MAX_MERGED)
+			continue;
+
+		uint32_t first = modbusRBE(&request->frame[2]);
+		uint32_t end = first + modbusRBE(&request->frame[4]);
+		if (index > end || (uint32_t) index + count < first)
+			continue;
+
+		uint32_t merged_first = index < first ? index : first;
+		uint32_t merged_end = (uint32_t) index + count > end ? (uint32_t) index + count : end;
+		if (merged_first != first || merged_end != end)
+		{
+			uint8_t in_flight = i == 0 && (line->state == MODBUS_LINE_SENDING || line->state == MODBUS_LINE_WAITING);
+			if (in_flight || request->exact || merged_end - merged_first > limit)
+				continue;
+
+			modbusWBE(&request->frame[2], merged_first);
+			modbusWBE(&request->frame[4], merged_end - merged_first);
+			modbusWLE(&request->frame[6], modbusCRC(request->frame, 6));
+		}
+
+		modbus_gateway_waiter_t *waiter = &request->waiters[request->waiter_count++];
+		waiter->client = client;
+		waiter->transaction_id = modbusRBE(&frame[0]);
+		waiter->index = index;
+		waiter->count = count;
+		line->stats.merged++;
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+	Routes a request to its line. Unit ID and PDU are copied
+	to the queue as they are, only the CRC is appended.
+*/
+static int client_on_request(modbus_gateway_client_t *client, const uint8_t *frame, uint16_t length)
+{
+	modbus_gateway_t *gateway = client->gateway;
+	uint16_t transaction_id = modbusRBE(&frame[0]);
+	uint8_t unit = frame[6];
+	uint8_t function = frame[7];
+	gateway->stats.requests++;
+
+	modbus_gateway_line_t *line = NULL;
+	for (uint8_t i = 0; i < gateway->route_count && !line; i++)
+		if (unit >= gateway->routes[i].first && unit <= gateway->routes[i].last)
+			line = gateway->routes[i].line;
+
+	if (!line)
+	{
+		gateway->stats.unrouted++;
+		return client_send_exception(client, transaction_id, unit, function, MODBUS_EXCEP_GATEWAY_PATH);
+	}
+
+	// Responses can only be framed for functions known to the RTU stream,
+	// and a request of wrong length would be misframed by the slaves
+	uint16_t predicted = modbusRTUStreamPredictLength(MODBUS_RTU_STREAM_REQUESTS, &frame[6], length - 6);
+	if (predicted != length - 6 + 2)
+	{
+		gateway->stats.unsupported++;
+		return client_send_exception(client, transaction_id, unit, function,
+			predicted ? MODBUS_EXCEP_ILLEGAL_VALUE : MODBUS_EXCEP_ILLEGAL_FUNCTION);
+	}
+
+	// Repeated reads are answered from the cache, writes invalidate it
+	if (gateway->cache)
+	{
+		uint8_t response[MODBUS_TCP_ADU_MAX];
+		uint16_t response_length;
+		if (modbusResponseCacheLookupTCP(gateway->cache, frame, length, modbus_now_ms(), response, &response_length))
+			return client_send(client, response, response_length);
+	}
+
+	if (line->merge_reads && line_merge(line, client, frame))
+		return 0;
+
+	if (line->count == line->capacity)
+	{
+		line->stats.rejected++;
+		return client_send_exception(client, transaction_id, unit, function, MODBUS_EXCEP_SLAVE_BUSY);
+	}
+
+	modbus_gateway_request_t *request = &line->queue[(line->head + line->count) % line->capacity];
+	request->waiters[0].client = client;
+	request->waiters[0].transaction_id = transaction_id;
+	request->waiters[0].index = function >= 1 && function <= 4 ? modbusRBE(&frame[8]) : 0;
+	request->waiters[0].count = function >= 1 && function <= 4 ? modbusRBE(&frame[10]) : 0;
+	request->waiter_count = 1;
+	request->exact = 0;
+	request->length = length - 6 + 2;
+	memcpy(request->frame, &frame[6], length - 6);
+	modbusWLE(&request->frame[length - 6], modbusCRC(request->frame, length - 6));
+	line->count++;
+
+	line_kick(line);
+	return 0;
+}
+
+/*
+	Reads until the socket is drained (the socket is edge-triggered).
+	Reading stops while there are pending responses.
+	Returns -1 if the connection has to be closed.
+*/
+static int client_receive(modbus_gateway_client_t *client)
+{
+	modbus_gateway_t *gateway = client->gateway;
+	while (!client->pending_len)
+	{
+		ssize_t n = recv(client->socket.fd, gateway->rx, sizeof(gateway->rx), 0);
+		if (n == 0)
+			return -1;
+		if (n < 0)
+			return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+
+		modbusTCPStreamFeed(&client->stream, gateway->rx, n);
+
+		const uint8_t *frame;
+		uint16_t length;
+		ModbusError err;
+		while ((err = modbusTCPStreamNext(&client->stream, &frame, &length)) == MODBUS_OK && frame)
+			if (client_on_request(client, frame, length))
+				return -1;
+
+		// Invalid MBAP header - the stream cannot be resynchronized
+		if (err != MODBUS_OK)
+			return -1;
+	}
+
+	return 0;
+}
+
+static void client_on_socket(modbus_gateway_client_t *client, uint32_t events)
+{
+	if (events & EPOLLERR)
+	{
+		client_close(client);
+		return;
+	}
+
+	if (events & EPOLLOUT)
+	{
+		int r = client_send_pending(client);
+		if (r < 0)
+		{
+			client_close(client);
+			return;
+		}
+
+		// Resume reading - data may have been left in the socket
+		if (r > 0)
+			events |= EPOLLIN;
+	}
+
+	if ((events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) && client_receive(client))
+		client_close(client);
+}
+
+static void gateway_accept(modbus_gateway_t *gateway)
+{
+	int fd;
+	while ((fd = accept4(gateway->listener.fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+	{
+		modbus_gateway_client_t *client = calloc(1, sizeof(modbus_gateway_client_t));
+		if (!client)
+		{
+			close(fd);
+			continue;
+		}
+
+		int one = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+		client->gateway = gateway;
+		client->socket.fd = fd;
+		client->socket.type = MODBUS_HANDLE_SOCKET;
+		client->socket.owner = client;
+		modbusTCPStreamInit(&client->stream);
+
+		if (modbus_epoll_add(gateway->epoll_fd, &client->socket, MODBUS_GATEWAY_CLIENT_EVENTS))
+		{
+			close(fd);
+			free(client);
+			continue;
+		}
+
+		client->next = gateway->clients;
+		if (gateway->clients)
+			gateway->clients->prev = client;
+		gateway->clients = client;
+
+		gateway->stats.accepted++;
+		gateway->stats.clients++;
+
+		// Data might have arrived before the socket was registered
+		if (client_receive(client))
+			client_close(client);
+	}
+}
+
+/*
+	Starts listening on the given address. The gateway struct
+	must stay in place until modbus_gateway_destroy() is called.
+*/
+int modbus_gateway_init(modbus_gateway_t *gateway, const struct sockaddr_in *addr)
+{
+	memset(gateway, 0, sizeof(*gateway));
+	gateway->listener.type = MODBUS_HANDLE_LISTENER;
+	gateway->listener.owner = gateway;
+
+	gateway->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	gateway->listener.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (gateway->epoll_fd < 0 || gateway->listener.fd < 0)
+	{
+		modbus_gateway_destroy(gateway);
+		return -1;
+	}
+
+	int one = 1;
+	setsockopt(gateway->listener.fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	if (bind(gateway->listener.fd, (const struct sockaddr*) addr, sizeof(*addr))
+		|| listen(gateway->listener.fd, SOMAXCONN)
+		|| modbus_epoll_add(gateway->epoll_fd, &gateway->listener, EPOLLIN))
+	{
+		modbus_gateway_destroy(gateway);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+	Closes all connections, the listening socket and serial ports of all lines
+*/
+void modbus_gateway_destroy(modbus_gateway_t *gateway)
+{
+	while (gateway->clients)
+		client_close(gateway->clients);
+
+	for (modbus_gateway_line_t *line = gateway->lines; line; line = line->next)
+	{
+		close(line->serial.fd);
+		close(line->timer.fd);
+		free(line->queue);
+	}
+
+	if (gateway->listener.fd >= 0)
+		close(gateway->listener.fd);
+	if (gateway->epoll_fd >= 0)
+		close(gateway->epoll_fd);
+
+	gateway->lines = NULL;
+	gateway->listener.fd = -1;
+	gateway->epoll_fd = -1;
+}
+
+/*
+	Adds a serial line with a queue for up to `queue_length` requests.
+	The gateway takes ownership of `fd` (see modbus_serial_open()),
+	also when adding the line fails. Timeouts can be adjusted
+	in the line struct afterwards.
+*/
+int modbus_gateway_add_line(
+	modbus_gateway_t *gateway,
+	modbus_gateway_line_t *line,
+	int fd,
+	uint32_t baudrate,
+	uint16_t queue_length)
+{
+	memset(line, 0, sizeof(*line));
+	line->gateway = gateway;
+	line->serial.fd = fd;
+	line->serial.type = MODBUS_HANDLE_SERIAL;
+	line->serial.owner = line;
+	line->baudrate = baudrate;
+	line->response_timeout_ms = MODBUS_GATEWAY_RESPONSE_TIMEOUT;
+	line->broadcast_delay_ms = MODBUS_GATEWAY_BROADCAST_DELAY;
+	line->silence_ms = (modbusRTUSilence(baudrate) + 999) / 1000;
+	line->capacity = queue_length;
+	modbusRTUStreamInit(&line->stream, MODBUS_RTU_STREAM_RESPONSES);
+
+	line->queue = calloc(queue_length, sizeof(modbus_gateway_request_t));
+	if (fd < 0 || !baudrate || !line->queue || modbus_timer_create(&line->timer, line))
+	{
+		if (fd >= 0)
+			close(fd);
+		free(line->queue);
+		return -1;
+	}
+
+	if (modbus_set_nonblocking(fd) || modbus_epoll_add(gateway->epoll_fd, &line->serial, EPOLLIN)
+		|| modbus_epoll_add(gateway->epoll_fd, &line->timer, EPOLLIN))
+	{
+		close(fd);
+		close(line->timer.fd);
+		free(line->queue);
+		return -1;
+	}
+
+	line->next = gateway->lines;
+	gateway->lines = line;
+	return 0;
+}
+
+/*
+	Routes requests for unit IDs from `first` to `last` (inclusive) to the line.
+	Routes are checked in the order they were added.
+*/
+int modbus_gateway_route(modbus_gateway_t *gateway, uint8_t first, uint8_t last, modbus_gateway_line_t *line)
+{
+	if (first > last || gateway->route_count == MODBUS_GATEWAY_MAX_ROUTES)
+		return -1;
+
+	modbus_gateway_route_t *route = &gateway->routes[gateway->route_count++];
+	route->first = first;
+	route->last = last;
+	route->line = line;
+	return 0;
+}
+
+/*
+	Waits for events and dispatches them.
+	Returns number of processed events or -1 on error.
+*/
+int modbus_gateway_poll(modbus_gateway_t *gateway, int timeout_ms)
+{
+	struct epoll_event events[MODBUS_GATEWAY_MAX_EVENTS];
+	int n = epoll_wait(gateway->epoll_fd, events, MODBUS_GATEWAY_MAX_EVENTS, timeout_ms);
+	if (n < 0)
+		return errno == EINTR ? 0 : -1;
+
+	for (int i = 0; i < n; i++)
+	{
+		modbus_handle_t *handle = events[i].data.ptr;
+		switch (handle->type)
+		{
+			case MODBUS_HANDLE_LISTENER:
+				gateway_accept(gateway);
+				break;
+
+			case MODBUS_HANDLE_SOCKET:
+				client_on_socket(handle->owner, events[i].events);
+				break;
+
+			case MODBUS_HANDLE_SERIAL:
+				line_on_serial(handle->owner, events[i].events);
+				break;
+
+			case MODBUS_HANDLE_TIMER:
+				line_on_timer(handle->owner);
+				break;
+		}
+	}
+
+	return n;
+}
@@ -0,0 +1,165 @@
+#ifndef _GATEWAY_H
+#define _GATEWAY_H
+
+#include "modbus_port.h"
+#include <netinet/in.h>
+
+/*
+	Maximum number of unit ID ranges in the routing table
+*/
+#ifndef MODBUS_GATEWAY_MAX_ROUTES
+#define MODBUS_GATEWAY_MAX_ROUTES 32
+#endif
+
+/*
+	Maximum number of client requests answered by a single merged read
+*/
+#ifndef MODBUS_GATEWAY_MAX_MERGED
+#define MODBUS_GATEWAY_MAX_MERGED 8
+#endif
+
+#define MODBUS_GATEWAY_RESPONSE_TIMEOUT 1000 // ms
+#define MODBUS_GATEWAY_BROADCAST_DELAY 100   // ms
+
+typedef struct modbus_gateway modbus_gateway_t;
+typedef struct modbus_gateway_line modbus_gateway_line_t;
+typedef struct modbus_gateway_client modbus_gateway_client_t;
+
+typedef enum
+{
+	MODBUS_LINE_IDLE,
+	MODBUS_LINE_SENDING, // Request not fully written to the serial port yet
+	MODBUS_LINE_WAITING, // Waiting for the response
+	MODBUS_LINE_SILENCE, // Waiting before the next request can be sent
+} modbus_line_state;
+
+typedef struct
+{
+	uint64_t requests;   // Requests sent on the line
+	uint64_t responses;  // Responses passed back to clients
+	uint64_t timeouts;   // Requests answered with exception 0B
+	uint64_t rejected;   // Requests answered with exception 06 (queue full)
+	uint64_t unexpected; // Frames received while not waiting or from the wrong slave
+	uint64_t merged;     // Reads folded into another queued or in-flight read
+	uint64_t split;      // Merged reads re-sent one by one after an exception
+} modbus_gateway_line_stats_t;
+
+typedef struct
+{
+	uint64_t requests;
+	uint64_t unrouted;    // Requests answered with exception 0A
+	uint64_t unsupported; // Requests answered with exception 01 or 03 (function can't be framed or bad length)
+	uint32_t accepted;
+	uint32_t closed;
+	uint32_t clients;     // Currently open connections
+} modbus_gateway_stats_t;
+
+/*
+	A client request waiting for the response. For reads, `index` and `count`
+	are the coils/registers the client asked for, which may be only a part
+	of a merged read.
+*/
+typedef struct
+{
+	modbus_gateway_client_t *client; // NULL if the client has disconnected
+	uint16_t transaction_id;
+	uint16_t index;
+	uint16_t count; // 0 if the request isn't a read
+} modbus_gateway_waiter_t;
+
+/*
+	A queued request - the RTU frame (unit ID, PDU copied as-is from the
+	MBAP frame and CRC) and where the response should go
+*/
+typedef struct
+{
+	modbus_gateway_waiter_t waiters[MODBUS_GATEWAY_MAX_MERGED];
+	uint8_t waiter_count;
+	uint8_t exact; // Read re-sent after an exception to a merged read, mustn't be widened
+	uint16_t length;
+	uint8_t frame[MODBUS_RTU_ADU_MAX];
+} modbus_gateway_request_t;
+
+/*
+	A serial line with a bounded queue of requests. Lines work
+	independently of each other, so a slow slave only holds up
+	requests routed to the same line.
+*/
+struct modbus_gateway_line
+{
+	modbus_gateway_t *gateway;
+	modbus_handle_t serial;
+	modbus_handle_t timer;
+	modbus_line_state state;
+
+	uint32_t response_timeout_ms; // Time allowed for the response (after the request air time)
+	uint32_t broadcast_delay_ms;  // Time given to slaves to process a broadcast
+	uint32_t baudrate;
+	uint32_t silence_ms;          // Silent interval between frames
+	uint8_t merge_reads;          // Fold overlapping reads of the same slave into one request
+
+	modbus_gateway_request_t *queue; // queue[head] is the request in progress
+	uint16_t capacity;
+	uint16_t head;
+	uint16_t count;
+	uint16_t sent; // Bytes of the current request written to the port
+
+	ModbusRTUStream stream;
+	modbus_gateway_line_stats_t stats;
+	modbus_gateway_line_t *next;
+};
+
+/*
+	TCP connection. Reading stops while responses the socket
+	didn't accept are pending.
+*/
+struct modbus_gateway_client
+{
+	modbus_gateway_t *gateway;
+	modbus_handle_t socket;
+	ModbusTCPStream stream;
+
+	uint8_t *pending;
+	uint32_t pending_len;
+	uint32_t pending_offset;
+
+	modbus_gateway_client_t *prev;
+	modbus_gateway_client_t *next;
+};
+
+typedef struct
+{
+	uint8_t first;
+	uint8_t last;
+	modbus_gateway_line_t *line;
+} modbus_gateway_route_t;
+
+struct modbus_gateway
+{
+	int epoll_fd;
+	modbus_handle_t listener;
+
+	modbus_gateway_route_t routes[MODBUS_GATEWAY_MAX_ROUTES];
+	uint8_t route_count;
+
+	modbus_gateway_line_t *lines;
+	modbus_gateway_client_t *clients;
+	uint8_t rx[4096];
+
+	ModbusResponseCache *cache; // Optional cache of read responses
+	modbus_gateway_stats_t stats;
+};
+
+int modbus_gateway_init(modbus_gateway_t *gateway, const struct sockaddr_in *addr);
+void modbus_gateway_destroy(modbus_gateway_t *gateway);
+int modbus_gateway_poll(modbus_gateway_t *gateway, int timeout_ms);
+
+int modbus_gateway_add_line(
+	modbus_gateway_t *gateway,
+	modbus_gateway_line_t *line,
+	int fd,
+	uint32_t baudrate,
+	uint16_t queue_length);
+int modbus_gateway_route(modbus_gateway_t *gateway, uint8_t first, uint8_t last, modbus_gateway_line_t *line);
+
+#endif
@@ -0,0 +1,180 @@
+#include "modbus_port.h"
+#define LIGHTMODBUS_IMPL
+#include <lightmodbus/lightmodbus.h>
+
+#include <fcntl.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/timerfd.h>
+#include <linux/serial.h>
+
+/*
+	Monotonic time in milliseconds. Wraps around every ~49 days,
+	which is handled by modbusTimeDiff().
+*/
+uint32_t modbus_now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint32_t)ts.tv_sec * 1000u + (uint32_t)(ts.tv_nsec / 1000000);
+}
+
+/*
+	Monotonic time in microseconds
+*/
+uint64_t modbus_now_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)(ts.tv_nsec / 1000);
+}
+
+int modbus_set_nonblocking(int fd)
+{
+	int flags = fcntl(fd, F_GETFL, 0);
+	if (flags < 0)
+		return -1;
+	return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+int modbus_epoll_add(int epoll_fd, modbus_handle_t *handle, uint32_t events)
+{
+	struct epoll_event ev = {.events = events, .data.ptr = handle};
+	return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, handle->fd, &ev);
+}
+
+int modbus_epoll_mod(int epoll_fd, modbus_handle_t *handle, uint32_t events)
+{
+	struct epoll_event ev = {.events = events, .data.ptr = handle};
+	return epoll_ctl(epoll_fd, EPOLL_CTL_MOD, handle->fd, &ev);
+}
+
+int modbus_timer_create(modbus_handle_t *handle, void *owner)
+{
+	handle->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	handle->type = MODBUS_HANDLE_TIMER;
+	handle->owner = owner;
+	return handle->fd < 0 ? -1 : 0;
+}
+
+/*
+	Arms the timer to fire once after delay_ms. A zero delay disarms
+	the timer, so it's rounded up to 1 ns.
+*/
+int modbus_timer_arm(modbus_handle_t *handle, uint32_t delay_ms)
+{
+	struct itimerspec its = {0};
+	its.it_value.tv_sec = delay_ms / 1000;
+	its.it_value.tv_nsec = (long)(delay_ms % 1000) * 1000000L;
+	if (!delay_ms)
+		its.it_value.tv_nsec = 1;
+	return timerfd_settime(handle->fd, 0, &its, NULL);
+}
+
+/*
+	Same as modbus_timer_arm(), with microsecond resolution
+	for the inter-frame delays of serial lines
+*/
+int modbus_timer_arm_us(modbus_handle_t *handle, uint32_t delay_us)
+{
+	struct itimerspec its = {0};
+	its.it_value.tv_sec = delay_us / 1000000;
+	its.it_value.tv_nsec = (long)(delay_us % 1000000) * 1000L;
+	if (!delay_us)
+		its.it_value.tv_nsec = 1;
+	return timerfd_settime(handle->fd, 0, &its, NULL);
+}
+
+void modbus_timer_ack(modbus_handle_t *handle)
+{
+	uint64_t expirations;
+	while (read(handle->fd, &expirations, sizeof(expirations)) > 0);
+}
+
+/*
+	Opens a serial port in raw, non-blocking mode with 8 data bits and
+	the given parity ('N', 'E' or 'O'). Modbus RTU requires two stop bits
+	when there's no parity. Returns the file descriptor or -1 on error.
+*/
+int modbus_serial_open(const char *path, uint32_t baudrate, char parity)
+{
+	static const struct { uint32_t baudrate; speed_t speed; } speeds[] =
+	{
+		{1200, B1200}, {2400, B2400}, {4800, B4800}, {9600, B9600}, {19200, B19200},
+		{38400, B38400}, {57600, B57600}, {115200, B115200}, {230400, B230400},
+	};
+
+	speed_t speed = 0;
+	for (size_t i = 0; i < sizeof(speeds) / sizeof(speeds[0]); i++)
+		if (speeds[i].baudrate == baudrate)
+			speed = speeds[i].speed;
+
+	if (!speed || (parity != 'N' && parity != 'E' && parity != 'O'))
+		return -1;
+
+	int fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	struct termios tio;
+	if (tcgetattr(fd, &tio))
+	{
+		close(fd);
+		return -1;
+	}
+
+	cfmakeraw(&tio);
+	tio.c_cflag |= CLOCAL | CREAD;
+	tio.c_cflag &= ~(PARENB | PARODD | CSTOPB);
+	if (parity == 'E')
+		tio.c_cflag |= PARENB;
+	else if (parity == 'O')
+		tio.c_cflag |= PARENB | PARODD;
+	else
+		tio.c_cflag |= CSTOPB;
+
+	cfsetispeed(&tio, speed);
+	cfsetospeed(&tio, speed);
+	if (tcsetattr(fd, TCSANOW, &tio))
+	{
+		close(fd);
+		return -1;
+	}
+
+	tcflush(fd, TCIOFLUSH);
+	return fd;
+}
+
+/*
+	Lets the kernel drive the RS-485 transceiver - RTS is asserted while
+	sending and released `rts_after_ms` after the last byte. The receiver
+	is disabled while sending, so the port doesn't hear its own frames.
+	Returns -1 if the driver doesn't support RS-485 mode.
+*/
+int modbus_serial_rs485(int fd, uint32_t rts_before_ms, uint32_t rts_after_ms)
+{
+	struct serial_rs485 rs485 = {0};
+	rs485.flags = SER_RS485_ENABLED | SER_RS485_RTS_ON_SEND;
+	rs485.delay_rts_before_send = rts_before_ms;
+	rs485.delay_rts_after_send = rts_after_ms;
+	return ioctl(fd, TIOCSRS485, &rs485);
+}
+
+/*
+	Asks the driver to pass received bytes on immediately rather than
+	batching them (e.g. FTDI adapters wait up to 16 ms by default), so
+	that gaps between frames can be measured. Returns -1 if the driver
+	doesn't support the serial_struct ioctls.
+*/
+int modbus_serial_low_latency(int fd)
+{
+	struct serial_struct serial;
+	if (ioctl(fd, TIOCGSERIAL, &serial))
+		return -1;
+
+	serial.flags |= ASYNC_LOW_LATENCY;
+	return ioctl(fd, TIOCSSERIAL, &serial);
+}
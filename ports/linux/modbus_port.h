@@ -0,0 +1,44 @@
+#ifndef _MODBUS_PORT_H
+#define _MODBUS_PORT_H
+
+#define LIGHTMODBUS_FULL
+#define LIGHTMODBUS_PIPELINE
+#define LIGHTMODBUS_STREAM
+#define LIGHTMODBUS_CACHE
+#define LIGHTMODBUS_RTU_BUS
+#include <lightmodbus/lightmodbus.h>
+#include <stdint.h>
+
+/*
+	Each file descriptor registered with epoll is wrapped in a handle,
+	so that the event loop knows what it belongs to.
+*/
+typedef enum
+{
+	MODBUS_HANDLE_SOCKET,
+	MODBUS_HANDLE_TIMER,
+	MODBUS_HANDLE_LISTENER,
+	MODBUS_HANDLE_SERIAL,
+} modbus_handle_type;
+
+typedef struct
+{
+	int fd;
+	modbus_handle_type type;
+	void *owner;
+} modbus_handle_t;
+
+uint32_t modbus_now_ms(void);
+uint64_t modbus_now_us(void);
+int modbus_set_nonblocking(int fd);
+int modbus_epoll_add(int epoll_fd, modbus_handle_t *handle, uint32_t events);
+int modbus_epoll_mod(int epoll_fd, modbus_handle_t *handle, uint32_t events);
+int modbus_timer_create(modbus_handle_t *handle, void *owner);
+int modbus_timer_arm(modbus_handle_t *handle, uint32_t delay_ms);
+int modbus_timer_arm_us(modbus_handle_t *handle, uint32_t delay_us);
+void modbus_timer_ack(modbus_handle_t *handle);
+int modbus_serial_open(const char *path, uint32_t baudrate, char parity);
+int modbus_serial_rs485(int fd, uint32_t rts_before_ms, uint32_t rts_after_ms);
+int modbus_serial_low_latency(int fd);
+
+#endif
@@ -0,0 +1,238 @@
+#define _GNU_SOURCE
+#include "rtu_port.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+/*
+	Maximum gap between characters of a frame in microseconds.
+	Fixed above 19200 baud, like t3.5.
+*/
+static uint32_t rtu_t15(uint32_t baudrate)
+{
+	if (baudrate > 19200)
+		return 750;
+	return (3 * MODBUS_RTU_CHAR_BITS * 1000000ul / 2 + baudrate - 1) / baudrate;
+}
+
+/*
+	Writes (the rest of) the frame being sent. Once all of it is in the
+	driver, the line stays busy for its air time and t3.5 after it.
+*/
+static void port_write(modbus_rtu_port_t *port)
+{
+	ssize_t n = write(port->serial.fd, port->tx + port->tx_sent, port->tx_length - port->tx_sent);
+	if (n > 0)
+		port->tx_sent += n;
+
+	if (port->tx_sent == port->tx_length || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+	{
+		if (port->tx_blocked)
+			modbus_epoll_mod(port->epoll_fd, &port->serial, EPOLLIN);
+
+		// A frame the port refused is dropped
+		if (port->tx_sent == port->tx_length)
+			port->stats.frames_sent++;
+
+		port->tx_blocked = 0;
+		port->state = MODBUS_RTU_PORT_DRAINING;
+		modbus_timer_arm_us(&port->timer, modbusRTUFrameTime(port->baudrate, port->tx_sent) + port->silence_us);
+		port->tx_length = 0;
+		return;
+	}
+
+	if (!port->tx_blocked)
+		modbus_epoll_mod(port->epoll_fd, &port->serial, EPOLLIN | EPOLLOUT);
+	port->tx_blocked = 1;
+}
+
+/*
+	Starts sending the queued frame, if the line is idle
+*/
+static void port_kick(modbus_rtu_port_t *port)
+{
+	if (port->state != MODBUS_RTU_PORT_IDLE || !port->tx_length)
+		return;
+
+	port->state = MODBUS_RTU_PORT_SENDING;
+	port->tx_sent = 0;
+	port_write(port);
+}
+
+static void port_on_timer(modbus_rtu_port_t *port)
+{
+	modbus_timer_ack(&port->timer);
+	if (port->state == MODBUS_RTU_PORT_RECEIVING)
+	{
+		// The timer may have expired before it was re-armed by the last read
+		uint64_t silent = modbus_now_us() - port->rx_last_us;
+		if (silent < port->silence_us)
+		{
+			modbus_timer_arm_us(&port->timer, port->silence_us - silent);
+			return;
+		}
+
+		port->state = MODBUS_RTU_PORT_IDLE;
+		if (!port->rx_broken)
+		{
+			uint16_t length = port->rx_length;
+			if (length < 4 || modbusCRC(port->rx, length - 2) != modbusRLE(&port->rx[length - 2]))
+				port->stats.crc_errors++;
+			else
+			{
+				port->stats.frames_received++;
+				port->on_frame(port, port->rx, length);
+			}
+		}
+	}
+	else if (port->state == MODBUS_RTU_PORT_DRAINING)
+		port->state = MODBUS_RTU_PORT_IDLE;
+
+	port_kick(port);
+}
+
+static void port_on_serial(modbus_rtu_port_t *port, uint32_t events)
+{
+	if ((events & EPOLLOUT) && port->state == MODBUS_RTU_PORT_SENDING)
+		port_write(port);
+
+	if (!(events & EPOLLIN))
+		return;
+
+	uint8_t rx[MODBUS_RTU_ADU_MAX];
+	ssize_t n;
+	while ((n = read(port->serial.fd, rx, sizeof(rx))) > 0)
+	{
+		uint64_t now = modbus_now_us();
+		if (port->state == MODBUS_RTU_PORT_SENDING)
+		{
+			port->stats.collisions += n;
+			continue;
+		}
+
+		if (port->state == MODBUS_RTU_PORT_RECEIVING)
+		{
+			// The first byte of the chunk arrived n - 1 characters before the last one
+			uint64_t first = now - (uint64_t)(n - 1) * modbusRTUCharTime(port->baudrate);
+			if (first > port->rx_last_us + port->t15_us)
+			{
+				port->stats.t15_violations++;
+				if (port->strict_t15)
+					port->rx_broken = 1;
+			}
+		}
+		else
+		{
+			// A response may start while our request is still draining
+			port->state = MODBUS_RTU_PORT_RECEIVING;
+			port->rx_length = 0;
+			port->rx_broken = 0;
+		}
+
+		if (port->rx_length + n > (ssize_t) sizeof(port->rx))
+		{
+			if (!port->rx_broken)
+				port->stats.overruns++;
+			port->rx_broken = 1;
+		}
+		else
+		{
+			memcpy(port->rx + port->rx_length, rx, n);
+			port->rx_length += n;
+		}
+
+		port->rx_last_us = now;
+		modbus_timer_arm_us(&port->timer, port->silence_us);
+	}
+}
+
+/*
+	Sets up a port on an open serial port (see modbus_serial_open()) and
+	registers it with `epoll_fd`. The port takes ownership of `fd`, also
+	when the setup fails. Timing can be adjusted in the port struct
+	afterwards, e.g. `silence_us` raised for USB adapters that deliver
+	received data in chunks.
+*/
+int modbus_rtu_port_init(
+	modbus_rtu_port_t *port,
+	int epoll_fd,
+	int fd,
+	uint32_t baudrate,
+	modbus_rtu_frame_callback on_frame,
+	void *context)
+{
+	memset(port, 0, sizeof(*port));
+	port->epoll_fd = epoll_fd;
+	port->serial.fd = fd;
+	port->serial.type = MODBUS_HANDLE_SERIAL;
+	port->serial.owner = port;
+	port->timer.fd = -1;
+	port->baudrate = baudrate;
+	port->on_frame = on_frame;
+	port->context = context;
+
+	if (fd < 0 || !baudrate || modbus_timer_create(&port->timer, port))
+	{
+		if (fd >= 0)
+			close(fd);
+		return -1;
+	}
+
+	port->t15_us = rtu_t15(baudrate);
+	port->silence_us = modbusRTUSilence(baudrate);
+
+	// Not supported by all drivers (e.g. pseudo-terminals)
+	modbus_serial_low_latency(fd);
+
+	if (modbus_set_nonblocking(fd)
+		|| modbus_epoll_add(epoll_fd, &port->serial, EPOLLIN)
+		|| modbus_epoll_add(epoll_fd, &port->timer, EPOLLIN))
+	{
+		close(fd);
+		close(port->timer.fd);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+	Closes the serial port and the timer
+*/
+void modbus_rtu_port_destroy(modbus_rtu_port_t *port)
+{
+	close(port->serial.fd);
+	close(port->timer.fd);
+	port->serial.fd = -1;
+	port->timer.fd = -1;
+}
+
+/*
+	Sends a frame (with CRC) once the line has been silent for t3.5.
+	Only one frame can wait at a time - returns -1 if there already
+	is one or the length is invalid.
+*/
+int modbus_rtu_port_send(modbus_rtu_port_t *port, const uint8_t *frame, uint16_t length)
+{
+	if (port->tx_length || length < 4 || length > sizeof(port->tx))
+		return -1;
+
+	memcpy(port->tx, frame, length);
+	port->tx_length = length;
+	port_kick(port);
+	return 0;
+}
+
+/*
+	Handles an event reported by epoll for one of the port's handles
+	(`handle->owner` is the port)
+*/
+void modbus_rtu_port_on_event(modbus_rtu_port_t *port, const modbus_handle_t *handle, uint32_t events)
+{
+	if (handle == &port->timer)
+		port_on_timer(port);
+	else
+		port_on_serial(port, events);
+}
@@ -0,0 +1,75 @@
+#ifndef _RTU_PORT_H
+#define _RTU_PORT_H
+
+#include "modbus_port.h"
+
+typedef struct modbus_rtu_port modbus_rtu_port_t;
+
+/*
+	Called with every frame received with a valid CRC
+*/
+typedef void (*modbus_rtu_frame_callback)(modbus_rtu_port_t *port, const uint8_t *frame, uint16_t length);
+
+typedef enum
+{
+	MODBUS_RTU_PORT_IDLE,      // The line has been silent for t3.5
+	MODBUS_RTU_PORT_RECEIVING, // Receiving a frame, which ends after t3.5 of silence
+	MODBUS_RTU_PORT_SENDING,   // Frame not fully written to the port yet
+	MODBUS_RTU_PORT_DRAINING,  // Waiting for the frame to go out and for t3.5 after it
+} modbus_rtu_port_state;
+
+typedef struct
+{
+	uint64_t frames_received;
+	uint64_t frames_sent;
+	uint64_t crc_errors;     // Frames with a bad CRC or shorter than 4 bytes
+	uint64_t overruns;       // Frames longer than MODBUS_RTU_ADU_MAX
+	uint64_t t15_violations; // Gaps longer than t1.5 within a frame
+	uint64_t collisions;     // Bytes received while sending
+} modbus_rtu_port_stats_t;
+
+/*
+	A serial port carrying Modbus RTU frames, for both masters and slaves.
+	Frames are delimited by silence - a timerfd fires t3.5 after the last
+	received byte. The port is driven by the caller's epoll loop, so one
+	thread can serve any number of ports without polling.
+*/
+struct modbus_rtu_port
+{
+	int epoll_fd;
+	modbus_handle_t serial;
+	modbus_handle_t timer;
+	modbus_rtu_port_state state;
+
+	uint32_t baudrate;
+	uint32_t t15_us;     // Maximum gap between characters of a frame
+	uint32_t silence_us; // Gap ending a frame, t3.5 by default
+	uint8_t strict_t15;  // Drop frames with gaps longer than t1.5
+
+	uint8_t rx[MODBUS_RTU_ADU_MAX];
+	uint16_t rx_length;
+	uint8_t rx_broken; // The frame being received is going to be dropped
+	uint64_t rx_last_us;
+
+	uint8_t tx[MODBUS_RTU_ADU_MAX];
+	uint16_t tx_length; // 0 if there's no frame to send
+	uint16_t tx_sent;
+	uint8_t tx_blocked; // Waiting for the port to accept more data
+
+	modbus_rtu_frame_callback on_frame;
+	void *context;
+	modbus_rtu_port_stats_t stats;
+};
+
+int modbus_rtu_port_init(
+	modbus_rtu_port_t *port,
+	int epoll_fd,
+	int fd,
+	uint32_t baudrate,
+	modbus_rtu_frame_callback on_frame,
+	void *context);
+void modbus_rtu_port_destroy(modbus_rtu_port_t *port);
+int modbus_rtu_port_send(modbus_rtu_port_t *port, const uint8_t *frame, uint16_t length);
+void modbus_rtu_port_on_event(modbus_rtu_port_t *port, const modbus_handle_t *handle, uint32_t events);
+
+#endif
@@ -0,0 +1,521 @@
+#define _GNU_SOURCE
+#include "rtu_sim.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/prctl.h>
+#include <sys/timerfd.h>
+
+static uint8_t sim_random_byte(modbus_sim_bus_t *bus)
+{
+	bus->seed ^= bus->seed << 13;
+	bus->seed ^= bus->seed >> 17;
+	bus->seed ^= bus->seed << 5;
+	return bus->seed >> 24;
+}
+
+/*
+	Queues bytes for transmission starting with a character ending
+	at `first_us`. Returns -1 if the source is still sending.
+*/
+static int tx_start(modbus_sim_tx_t *tx, const uint8_t *data, uint16_t length, uint64_t first_us)
+{
+	if (tx->sent < tx->length || length > sizeof(tx->data))
+		return -1;
+
+	memcpy(tx->data, data, length);
+	tx->length = length;
+	tx->sent = 0;
+	tx->next_us = first_us;
+	tx->prev_us = 0;
+	tx->gap_after = 0;
+	tx->gap_us = 0;
+	tx->corrupted = 0;
+	tx->record = -1;
+	return 0;
+}
+
+static int tx_active(const modbus_sim_tx_t *tx)
+{
+	return tx->sent < tx->length;
+}
+
+/*
+	Returns the transmission with the earliest pending character
+*/
+static modbus_sim_tx_t *sim_next_tx(modbus_sim_bus_t *bus)
+{
+	modbus_sim_tx_t *next = tx_active(&bus->injected_tx) ? &bus->injected_tx : NULL;
+	for (int i = 0; i < bus->port_count; i++)
+		if (tx_active(&bus->port_tx[i]) && (!next || bus->port_tx[i].next_us < next->next_us))
+			next = &bus->port_tx[i];
+	for (int i = 0; i < bus->device_count; i++)
+		if (tx_active(&bus->device_tx[i]) && (!next || bus->device_tx[i].next_us < next->next_us))
+			next = &bus->device_tx[i];
+	return next;
+}
+
+/*
+	Returns the device whose received frame ends the earliest
+	(after t3.5 of silence)
+*/
+static modbus_sim_device_t *sim_next_frame_end(modbus_sim_bus_t *bus)
+{
+	modbus_sim_device_t *next = NULL;
+	for (int i = 0; i < bus->device_count; i++)
+	{
+		modbus_sim_device_t *device = bus->devices[i];
+		if (device->rx_length && (!next || device->rx_last_us < next->rx_last_us))
+			next = device;
+	}
+	return next;
+}
+
+static void device_on_frame(modbus_sim_bus_t *bus, int index)
+{
+	modbus_sim_device_t *device = bus->devices[index];
+	uint16_t length = device->rx_length;
+	uint64_t end_us = device->rx_last_us;
+	device->rx_length = 0;
+
+	if (device->rx_broken || length < 4 || modbusCRC(device->rx, length - 2) != modbusRLE(&device->rx[length - 2]))
+		return;
+	if (device->rx[0] && device->rx[0] != device->address)
+		return;
+
+	device->requests++;
+	modbusSlaveSetUserPointer(device->slave, device);
+	if (!modbusIsOk(modbusParseRequestRTU(device->slave, device->address, device->rx, length)))
+		return;
+
+	uint16_t response_length = modbusSlaveGetResponseLength(device->slave);
+	if (!response_length || device->faults.drop)
+		return;
+
+	// Noise goes out right before the response, as a part of the same transmission
+	uint8_t frame[2 * MODBUS_RTU_ADU_MAX];
+	uint8_t noise = device->faults.noise;
+	for (int i = 0; i < noise; i++)
+		frame[i] = sim_random_byte(bus);
+	memcpy(frame + noise, modbusSlaveGetResponse(device->slave), response_length);
+	response_length += noise;
+	if (device->faults.corrupt_crc)
+		frame[response_length - 1] ^= 0x01;
+
+	uint32_t turnaround = device->turnaround_us > bus->silence_us ? device->turnaround_us : bus->silence_us;
+	modbus_sim_tx_t *tx = &bus->device_tx[index];
+	if (tx_start(tx, frame, response_length, end_us + turnaround + bus->char_us))
+		return;
+
+	tx->gap_after = device->faults.gap_after;
+	tx->gap_us = device->faults.gap_us;
+	tx->corrupted = device->faults.corrupt_crc;
+	device->responses++;
+}
+
+static void device_on_byte(modbus_sim_device_t *device, uint8_t byte, uint64_t end_us)
+{
+	if (!device->rx_length)
+		device->rx_broken = 0;
+
+	if (device->rx_length < sizeof(device->rx))
+		device->rx[device->rx_length++] = byte;
+	else
+		device->rx_broken = 1;
+
+	device->rx_last_us = end_us;
+}
+
+/*
+	Puts the next character of `tx` on the wire and delivers it to
+	everyone else on the bus
+*/
+static void sim_send_char(
+	modbus_sim_bus_t *bus,
+	modbus_sim_tx_t *tx,
+	modbus_sim_source_type source_type,
+	int source,
+	uint64_t now)
+{
+	uint64_t end = tx->next_us;
+	uint64_t start = end - bus->char_us;
+	uint8_t byte = tx->data[tx->sent];
+
+	if (tx->record < 0 && bus->trace_length < bus->trace_capacity)
+	{
+		tx->record = bus->trace_length++;
+		modbus_sim_record_t *record = &bus->trace[tx->record];
+		memset(record, 0, sizeof(*record));
+		record->start_us = start;
+		record->source_type = source_type;
+		record->source = source;
+		if (tx->corrupted)
+			record->flags |= MODBUS_SIM_CORRUPTED;
+	}
+
+	// Overlapping with the current or the previous character of another transmission
+	modbus_sim_tx_t *all[MODBUS_SIM_MAX_PORTS + MODBUS_SIM_MAX_DEVICES + 1];
+	int count = 0;
+	all[count++] = &bus->injected_tx;
+	for (int i = 0; i < bus->port_count; i++)
+		all[count++] = &bus->port_tx[i];
+	for (int i = 0; i < bus->device_count; i++)
+		all[count++] = &bus->device_tx[i];
+
+	for (int i = 0; i < count; i++)
+	{
+		modbus_sim_tx_t *other = all[i];
+		if (other == tx)
+			continue;
+
+		int current = tx_active(other) && other->next_us - bus->char_us < end && other->next_us > start;
+		if (!current && other->prev_us <= start)
+			continue;
+
+		byte ^= sim_random_byte(bus) | 0x01;
+		bus->stats.collisions++;
+		if (tx->record >= 0)
+			bus->trace[tx->record].flags |= MODBUS_SIM_COLLISION;
+		if (other->record >= 0)
+			bus->trace[other->record].flags |= MODBUS_SIM_COLLISION;
+		break;
+	}
+
+	if (tx->record >= 0)
+	{
+		modbus_sim_record_t *record = &bus->trace[tx->record];
+		if (record->length < 2)
+			record->head[record->length] = byte;
+		record->length++;
+		record->end_us = end;
+	}
+
+	for (int i = 0; i < bus->port_count; i++)
+		if (source_type != MODBUS_SIM_SOURCE_PORT || i != source)
+			if (write(bus->ports[i].fd, &byte, 1) != 1)
+				bus->stats.overruns++;
+
+	for (int i = 0; i < bus->device_count; i++)
+		if (source_type != MODBUS_SIM_SOURCE_DEVICE || i != source)
+			device_on_byte(bus->devices[i], byte, end);
+
+	if (now - end > bus->stats.max_late_us)
+		bus->stats.max_late_us = now - end;
+
+	bus->stats.bytes++;
+	tx->sent++;
+	tx->prev_us = end;
+	tx->next_us = end + bus->char_us;
+	if (tx->gap_after && tx->sent == tx->gap_after)
+	{
+		tx->next_us += tx->gap_us;
+		if (tx->record >= 0)
+			bus->trace[tx->record].flags |= MODBUS_SIM_GAP;
+	}
+
+	// A gap ends the trace record, as it does the frame
+	if (tx->gap_after && tx->sent == tx->gap_after && tx->gap_us >= bus->silence_us)
+		tx->record = -1;
+}
+
+/*
+	Runs the bus up to `now`. Returns the time of the next event,
+	or 0 if there's nothing to do.
+*/
+static uint64_t sim_process(modbus_sim_bus_t *bus, uint64_t now)
+{
+	for (;;)
+	{
+		modbus_sim_tx_t *tx = sim_next_tx(bus);
+		modbus_sim_device_t *device = sim_next_frame_end(bus);
+		uint64_t frame_end = device ? device->rx_last_us + bus->silence_us : 0;
+
+		// A frame ends before the next character starts
+		if (device && frame_end <= now && (!tx || frame_end <= tx->next_us - bus->char_us))
+		{
+			int index = 0;
+			while (bus->devices[index] != device)
+				index++;
+			device_on_frame(bus, index);
+			continue;
+		}
+
+		if (tx && tx->next_us <= now)
+		{
+			if (tx == &bus->injected_tx)
+				sim_send_char(bus, tx, MODBUS_SIM_SOURCE_INJECTED, 0, now);
+			else if (tx >= bus->port_tx && tx < bus->port_tx + MODBUS_SIM_MAX_PORTS)
+				sim_send_char(bus, tx, MODBUS_SIM_SOURCE_PORT, tx - bus->port_tx, now);
+			else
+				sim_send_char(bus, tx, MODBUS_SIM_SOURCE_DEVICE, tx - bus->device_tx, now);
+			continue;
+		}
+
+		if (!tx)
+			return frame_end;
+		if (!device)
+			return tx->next_us;
+		return frame_end < tx->next_us ? frame_end : tx->next_us;
+	}
+}
+
+/*
+	Reads what the code under test wrote to a port. Bytes written while
+	the port is sending are appended to the same transmission.
+*/
+static void sim_read_port(modbus_sim_bus_t *bus, int index, uint64_t now)
+{
+	modbus_sim_tx_t *tx = &bus->port_tx[index];
+	uint8_t buf[MODBUS_RTU_ADU_MAX];
+	ssize_t n;
+	while ((n = read(bus->ports[index].fd, buf, sizeof(buf))) > 0)
+	{
+		if (!tx_active(tx))
+		{
+			tx_start(tx, buf, n, now + bus->char_us);
+			continue;
+		}
+
+		// Move what's been sent out of the way
+		memmove(tx->data, tx->data + tx->sent, tx->length - tx->sent);
+		tx->length -= tx->sent;
+		tx->sent = 0;
+		if (tx->length + n > (ssize_t) sizeof(tx->data))
+			n = sizeof(tx->data) - tx->length;
+		memcpy(tx->data + tx->length, buf, n);
+		tx->length += n;
+	}
+}
+
+static void sim_arm(modbus_sim_bus_t *bus, uint64_t at_us)
+{
+	struct itimerspec its = {0};
+	its.it_value.tv_sec = at_us / 1000000;
+	its.it_value.tv_nsec = (at_us % 1000000) * 1000;
+	timerfd_settime(bus->timer.fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+static void *sim_thread(void *arg)
+{
+	modbus_sim_bus_t *bus = arg;
+
+	// Characters should go out on time, even with the code under test
+	// keeping the CPU busy. Both only work with enough privileges.
+	struct sched_param param = {.sched_priority = 1};
+	pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+	prctl(PR_SET_TIMERSLACK, 1);
+
+	for (;;)
+	{
+		struct epoll_event events[MODBUS_SIM_MAX_PORTS + 1];
+		int n = epoll_wait(bus->epoll_fd, events, MODBUS_SIM_MAX_PORTS + 1, -1);
+		if (n < 0 && errno != EINTR)
+			break;
+
+		pthread_mutex_lock(&bus->lock);
+		if (!bus->running)
+		{
+			pthread_mutex_unlock(&bus->lock);
+			break;
+		}
+
+		uint64_t now = modbus_now_us();
+		for (int i = 0; i < n; i++)
+		{
+			modbus_handle_t *handle = events[i].data.ptr;
+			if (handle == &bus->timer)
+				modbus_timer_ack(&bus->timer);
+			else
+				sim_read_port(bus, handle - bus->ports, now);
+		}
+
+		sim_arm(bus, sim_process(bus, now));
+		pthread_mutex_unlock(&bus->lock);
+	}
+
+	return NULL;
+}
+
+/*
+	Sets up a bus with no ports and devices. Transmissions are recorded
+	in `trace` until it's full (it can be NULL).
+*/
+int modbus_sim_init(modbus_sim_bus_t *bus, uint32_t baudrate, modbus_sim_record_t *trace, size_t trace_capacity)
+{
+	memset(bus, 0, sizeof(*bus));
+	if (!baudrate)
+		return -1;
+
+	bus->baudrate = baudrate;
+	bus->char_us = modbusRTUCharTime(baudrate);
+	bus->silence_us = modbusRTUSilence(baudrate);
+	bus->trace = trace;
+	bus->trace_capacity = trace ? trace_capacity : 0;
+	bus->seed = 0x2545f491;
+	bus->injected_tx.record = -1;
+	pthread_mutex_init(&bus->lock, NULL);
+
+	bus->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (bus->epoll_fd < 0)
+		return -1;
+
+	if (modbus_timer_create(&bus->timer, bus) || modbus_epoll_add(bus->epoll_fd, &bus->timer, EPOLLIN))
+	{
+		close(bus->epoll_fd);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+	Closes all ports. The bus must be stopped.
+*/
+void modbus_sim_destroy(modbus_sim_bus_t *bus)
+{
+	for (int i = 0; i < bus->port_count; i++)
+	{
+		close(bus->ports[i].fd);
+		close(bus->port_hold_fds[i]);
+	}
+	close(bus->timer.fd);
+	close(bus->epoll_fd);
+	pthread_mutex_destroy(&bus->lock);
+}
+
+/*
+	Creates a pseudo-terminal connected to the bus and returns the path
+	to be opened by the code under test (e.g. with modbus_serial_open()).
+	Returns NULL on failure. Ports can only be added while the bus is stopped.
+*/
+const char *modbus_sim_add_port(modbus_sim_bus_t *bus)
+{
+	if (bus->running || bus->port_count == MODBUS_SIM_MAX_PORTS)
+		return NULL;
+
+	int index = bus->port_count;
+	char *path = bus->port_paths[index];
+	int fd = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+
+	struct termios tio;
+	int hold = -1;
+	if (grantpt(fd) || unlockpt(fd) || ptsname_r(fd, path, sizeof(bus->port_paths[0]))
+		|| tcgetattr(fd, &tio) || modbus_set_nonblocking(fd))
+		goto fail;
+
+	cfmakeraw(&tio);
+	if (tcsetattr(fd, TCSANOW, &tio))
+		goto fail;
+
+	// Without the other side open, the pseudo-terminal would report a hangup all the time
+	hold = open(path, O_RDWR | O_NOCTTY | O_CLOEXEC);
+	if (hold < 0)
+		goto fail;
+
+	bus->ports[index].fd = fd;
+	bus->ports[index].type = MODBUS_HANDLE_SERIAL;
+	bus->ports[index].owner = bus;
+	if (modbus_epoll_add(bus->epoll_fd, &bus->ports[index], EPOLLIN))
+		goto fail;
+
+	bus->port_hold_fds[index] = hold;
+	bus->port_tx[index].record = -1;
+	bus->port_count++;
+	return path;
+
+fail:
+	if (hold >= 0)
+		close(hold);
+	close(fd);
+	return NULL;
+}
+
+/*
+	Attaches a simulated slave at `address`. Several devices can share
+	an address, in which case their responses collide on the bus.
+*/
+int modbus_sim_add_device(modbus_sim_bus_t *bus, modbus_sim_device_t *device, uint8_t address, ModbusSlave *slave, void *context)
+{
+	if (bus->running || bus->device_count == MODBUS_SIM_MAX_DEVICES || !address || address > 247)
+		return -1;
+
+	memset(device, 0, sizeof(*device));
+	device->address = address;
+	device->slave = slave;
+	device->context = context;
+	bus->device_tx[bus->device_count].record = -1;
+	bus->devices[bus->device_count++] = device;
+	return 0;
+}
+
+int modbus_sim_start(modbus_sim_bus_t *bus)
+{
+	if (bus->running)
+		return -1;
+
+	bus->running = 1;
+	if (pthread_create(&bus->thread, NULL, sim_thread, bus))
+	{
+		bus->running = 0;
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+	Stops the bus thread. Transmissions in progress are cut short.
+*/
+void modbus_sim_stop(modbus_sim_bus_t *bus)
+{
+	if (!bus->running)
+		return;
+
+	pthread_mutex_lock(&bus->lock);
+	bus->running = 0;
+	modbus_timer_arm(&bus->timer, 0);
+	pthread_mutex_unlock(&bus->lock);
+	pthread_join(bus->thread, NULL);
+}
+
+/*
+	Sends raw bytes on the bus right away - noise, or frames for a slave
+	under test. Bytes after the first `gap_after` ones are held back for
+	`gap_us` (gap_after = 0 - no gap). Returns -1 if the previous
+	injected bytes are still being sent.
+*/
+int modbus_sim_inject(modbus_sim_bus_t *bus, const uint8_t *data, uint16_t length, uint16_t gap_after, uint32_t gap_us)
+{
+	pthread_mutex_lock(&bus->lock);
+	int err = tx_start(&bus->injected_tx, data, length, modbus_now_us() + bus->char_us);
+	if (!err)
+	{
+		bus->injected_tx.gap_after = gap_after;
+		bus->injected_tx.gap_us = gap_us;
+		modbus_timer_arm(&bus->timer, 0);
+	}
+	pthread_mutex_unlock(&bus->lock);
+	return err;
+}
+
+/*
+	Stops the bus from running while the trace, statistics
+	or device settings are accessed
+*/
+void modbus_sim_lock(modbus_sim_bus_t *bus)
+{
+	pthread_mutex_lock(&bus->lock);
+}
+
+void modbus_sim_unlock(modbus_sim_bus_t *bus)
+{
+	pthread_mutex_unlock(&bus->lock);
+}
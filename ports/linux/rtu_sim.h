@@ -0,0 +1,146 @@
+#ifndef _RTU_SIM_H
+#define _RTU_SIM_H
+
+#include "modbus_port.h"
+#include <pthread.h>
+
+#define MODBUS_SIM_MAX_PORTS 8
+#define MODBUS_SIM_MAX_DEVICES 16
+
+typedef enum
+{
+	MODBUS_SIM_SOURCE_PORT,     // Code under test writing to a pseudo-terminal
+	MODBUS_SIM_SOURCE_DEVICE,   // Simulated slave
+	MODBUS_SIM_SOURCE_INJECTED, // Sent with modbus_sim_inject()
+} modbus_sim_source_type;
+
+// Trace record flags
+#define MODBUS_SIM_COLLISION 1 // Overlapped with another transmission
+#define MODBUS_SIM_CORRUPTED 2 // CRC damaged on purpose
+#define MODBUS_SIM_GAP       4 // Interrupted by an injected gap
+
+/*
+	One transmission on the bus - bytes sent back to back by one source.
+	Times are CLOCK_MONOTONIC microseconds (see modbus_now_us()) of the
+	start of the first and the end of the last character on the wire.
+*/
+typedef struct
+{
+	uint64_t start_us;
+	uint64_t end_us;
+	modbus_sim_source_type source_type;
+	uint8_t source;   // Port or device index
+	uint8_t flags;
+	uint16_t length;
+	uint8_t head[2];  // Address and function code as seen on the wire
+} modbus_sim_record_t;
+
+/*
+	Faults applied to the responses of a simulated slave
+*/
+typedef struct
+{
+	uint8_t drop;        // Don't respond at all
+	uint8_t corrupt_crc; // Flip a bit of the CRC
+	uint8_t noise;       // Random bytes sent right before the response
+	uint16_t gap_after;  // Pause for gap_us after this many bytes (0 - no gap)
+	uint32_t gap_us;
+} modbus_sim_faults_t;
+
+/*
+	Simulated slave on the bus. Requests are parsed with the slave
+	passed to modbus_sim_add_device(), whose user pointer is set to
+	the device beforehand - callbacks can use `context` for their data.
+*/
+typedef struct
+{
+	uint8_t address;
+	ModbusSlave *slave;
+	void *context;
+	uint32_t turnaround_us; // Delay between the end of a request and the response
+	modbus_sim_faults_t faults;
+
+	uint8_t rx[MODBUS_RTU_ADU_MAX];
+	uint16_t rx_length;
+	uint8_t rx_broken;
+	uint64_t rx_last_us;
+
+	uint64_t requests;  // Valid frames addressed to the device
+	uint64_t responses;
+} modbus_sim_device_t;
+
+/*
+	A source of bytes on the bus. Bytes are sent at the baud rate
+	of the bus, one character after another.
+*/
+typedef struct
+{
+	uint8_t data[2 * MODBUS_RTU_ADU_MAX];
+	uint16_t length;
+	uint16_t sent;
+	uint64_t next_us;   // End of the character being sent
+	uint64_t prev_us;   // End of the previous character
+	uint16_t gap_after; // Pause for gap_us after this many bytes (0 - no gap)
+	uint32_t gap_us;
+	uint8_t corrupted;
+	int record;         // Trace record index, -1 if not recorded
+} modbus_sim_tx_t;
+
+typedef struct
+{
+	uint64_t bytes;       // Characters put on the wire
+	uint64_t collisions;  // Characters damaged by overlapping transmissions
+	uint64_t overruns;    // Characters the code under test didn't read in time
+	uint32_t max_late_us; // Longest delay of a character behind its time on the wire
+} modbus_sim_stats_t;
+
+/*
+	A multi-drop RTU bus connecting pseudo-terminals opened by the code
+	under test with simulated slaves. All parties hear each other and
+	transmissions are paced at the baud rate of the bus, so framing,
+	turnaround and scheduling behave like on a real line. The bus runs
+	in its own thread - configuration should only be changed while it's
+	stopped or with the lock held (modbus_sim_lock()).
+*/
+typedef struct
+{
+	uint32_t baudrate;
+	uint32_t char_us;
+	uint32_t silence_us;
+
+	int port_count;
+	modbus_handle_t ports[MODBUS_SIM_MAX_PORTS];
+	int port_hold_fds[MODBUS_SIM_MAX_PORTS]; // Keep the pseudo-terminals from hanging up
+	char port_paths[MODBUS_SIM_MAX_PORTS][64];
+	modbus_sim_tx_t port_tx[MODBUS_SIM_MAX_PORTS];
+
+	int device_count;
+	modbus_sim_device_t *devices[MODBUS_SIM_MAX_DEVICES];
+	modbus_sim_tx_t device_tx[MODBUS_SIM_MAX_DEVICES];
+	modbus_sim_tx_t injected_tx;
+
+	modbus_sim_record_t *trace;
+	size_t trace_capacity;
+	size_t trace_length;
+
+	modbus_sim_stats_t stats;
+	uint32_t seed;
+
+	int epoll_fd;
+	modbus_handle_t timer;
+	int running;
+	pthread_t thread;
+	pthread_mutex_t lock;
+} modbus_sim_bus_t;
+
+int modbus_sim_init(modbus_sim_bus_t *bus, uint32_t baudrate, modbus_sim_record_t *trace, size_t trace_capacity);
+void modbus_sim_destroy(modbus_sim_bus_t *bus);
+const char *modbus_sim_add_port(modbus_sim_bus_t *bus);
+int modbus_sim_add_device(modbus_sim_bus_t *bus, modbus_sim_device_t *device, uint8_t address, ModbusSlave *slave, void *context);
+int modbus_sim_start(modbus_sim_bus_t *bus);
+void modbus_sim_stop(modbus_sim_bus_t *bus);
+int modbus_sim_inject(modbus_sim_bus_t *bus, const uint8_t *data, uint16_t length, uint16_t gap_after, uint32_t gap_us);
+void modbus_sim_lock(modbus_sim_bus_t *bus);
+void modbus_sim_unlock(modbus_sim_bus_t *bus);
+
+#endif
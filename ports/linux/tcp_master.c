@@ -0,0 +1,483 @@
+#include "tcp_master.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/tcp.h>
+
+#define MODBUS_TCP_MASTER_CONNECT_TIMEOUT 3000 // ms
+#define MODBUS_TCP_MASTER_MAX_EVENTS 64
+
+static void conn_close(modbus_tcp_conn_t *conn, uint32_t now);
+
+/*
+	Requests are built in a buffer embedded in the connection
+	and copied to the transmit buffer once submitted.
+*/
+static ModbusError conn_allocator(ModbusBuffer *buffer, uint16_t size, void *context)
+{
+	modbus_tcp_conn_t *conn = context;
+	if (size > sizeof(conn->request))
+	{
+		buffer->data = NULL;
+		return MODBUS_ERROR_ALLOC;
+	}
+
+	buffer->data = size ? conn->request : NULL;
+	return MODBUS_OK;
+}
+
+/*
+	Makes sure the timer fires no later than at the deadline. Timers
+	firing early are harmless - they are simply rearmed.
+*/
+static void conn_arm(modbus_tcp_conn_t *conn, uint32_t deadline, uint32_t now)
+{
+	if (conn->timer_armed && modbusTimeDiff(deadline, conn->timer_deadline) >= 0)
+		return;
+
+	int32_t delay = modbusTimeDiff(deadline, now);
+	modbus_timer_arm(&conn->timer, delay > 0 ? (uint32_t) delay : 0);
+	conn->timer_armed = 1;
+	conn->timer_deadline = deadline;
+}
+
+static void conn_set_events(modbus_tcp_conn_t *conn, uint32_t events)
+{
+	if (conn->events == events)
+		return;
+
+	if (!modbus_epoll_mod(conn->engine->epoll_fd, &conn->socket, events))
+		conn->events = events;
+}
+
+static void conn_mark_dirty(modbus_tcp_conn_t *conn)
+{
+	if (conn->is_dirty)
+		return;
+
+	conn->is_dirty = 1;
+	conn->next_dirty = conn->engine->dirty;
+	conn->engine->dirty = conn;
+}
+
+static void conn_schedule_reconnect(modbus_tcp_conn_t *conn, uint32_t now)
+{
+	// Spread reconnects of many devices behind the same failed link
+	uint32_t jitter = conn->backoff / 4 ? (uint32_t) rand() % (conn->backoff / 4) : 0;
+
+	conn->state = MODBUS_TCP_DISCONNECTED;
+	conn->reconnect_at = now + conn->backoff + jitter;
+	conn->backoff *= 2;
+	if (conn->backoff > conn->engine->backoff_max)
+		conn->backoff = conn->engine->backoff_max;
+
+	conn_arm(conn, conn->reconnect_at, now);
+}
+
+static void conn_connect(modbus_tcp_conn_t *conn, uint32_t now)
+{
+	int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+	{
+		conn_schedule_reconnect(conn, now);
+		return;
+	}
+
+	int one = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	if (connect(fd, (const struct sockaddr*) &conn->addr, sizeof(conn->addr)) < 0 && errno != EINPROGRESS)
+	{
+		close(fd);
+		conn_schedule_reconnect(conn, now);
+		return;
+	}
+
+	// Connection is completed when the socket becomes writable
+	conn->socket.fd = fd;
+	conn->events = EPOLLOUT;
+	if (modbus_epoll_add(conn->engine->epoll_fd, &conn->socket, conn->events))
+	{
+		close(fd);
+		conn->socket.fd = -1;
+		conn_schedule_reconnect(conn, now);
+		return;
+	}
+
+	conn->state = MODBUS_TCP_CONNECTING;
+	conn->reconnect_at = now + MODBUS_TCP_MASTER_CONNECT_TIMEOUT;
+	conn_arm(conn, conn->reconnect_at, now);
+}
+
+/*
+	Closes the socket, fails all pending transactions and schedules a reconnect
+*/
+static void conn_close(modbus_tcp_conn_t *conn, uint32_t now)
+{
+	if (conn->socket.fd >= 0)
+	{
+		close(conn->socket.fd);
+		conn->socket.fd = -1;
+	}
+
+	if (conn->state == MODBUS_TCP_CONNECTED)
+		conn->stats.disconnects++;
+
+	modbusTCPStreamReset(&conn->stream);
+	conn->tx_len = 0;
+	conn_schedule_reconnect(conn, now);
+
+	for (uint16_t i = 0; i < conn->table.capacity; i++)
+	{
+		ModbusTransaction t = conn->transactions[i];
+		if (modbusTransactionTableCancel(&conn->table, t.transactionID) && conn->on_complete)
+			conn->on_complete(conn, MODBUS_TCP_CLOSED, &t, MODBUS_GENERAL_ERROR(OTHER));
+	}
+}
+
+static void conn_send(modbus_tcp_conn_t *conn, uint32_t now)
+{
+	uint32_t sent = 0;
+	while (sent < conn->tx_len)
+	{
+		ssize_t n = send(conn->socket.fd, conn->tx + sent, conn->tx_len - sent, MSG_NOSIGNAL);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+
+			conn_close(conn, now);
+			return;
+		}
+
+		sent += n;
+	}
+
+	if (sent)
+	{
+		memmove(conn->tx, conn->tx + sent, conn->tx_len - sent);
+		conn->tx_len -= sent;
+	}
+
+	conn_set_events(conn, EPOLLIN | (conn->tx_len ? EPOLLOUT : 0));
+}
+
+static void conn_handle_response(modbus_tcp_conn_t *conn, const uint8_t *frame, uint16_t length)
+{
+	ModbusTransaction t;
+	ModbusErrorInfo err = modbusTransactionTableParseResponseTCP(
+		&conn->table,
+		&conn->master,
+		frame,
+		length,
+		&t);
+
+	// Late response to a timed out request or garbage
+	if (!t.active)
+	{
+		conn->stats.errors++;
+		return;
+	}
+
+	if (modbusIsOk(err))
+		conn->stats.responses++;
+	else
+		conn->stats.errors++;
+
+	if (conn->on_complete)
+		conn->on_complete(conn, MODBUS_TCP_DONE, &t, err);
+}
+
+static void conn_receive(modbus_tcp_conn_t *conn, uint32_t now)
+{
+	while (conn->state == MODBUS_TCP_CONNECTED)
+	{
+		ssize_t n = recv(conn->socket.fd, conn->rx, sizeof(conn->rx), 0);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return;
+		if (n <= 0)
+		{
+			conn_close(conn, now);
+			return;
+		}
+
+		// Extract all complete frames
+		modbusTCPStreamFeed(&conn->stream, conn->rx, n);
+		while (conn->state == MODBUS_TCP_CONNECTED)
+		{
+			const uint8_t *frame;
+			uint16_t length;
+			if (modbusTCPStreamNext(&conn->stream, &frame, &length) != MODBUS_OK)
+			{
+				// Framing is lost
+				conn->stats.errors++;
+				conn_close(conn, now);
+				return;
+			}
+
+			if (!frame)
+				break;
+
+			conn_handle_response(conn, frame, length);
+		}
+	}
+}
+
+static void conn_on_socket(modbus_tcp_conn_t *conn, uint32_t events)
+{
+	uint32_t now = modbus_now_ms();
+
+	// Stale event for an already closed socket
+	if (conn->state == MODBUS_TCP_DISCONNECTED)
+		return;
+
+	if (conn->state == MODBUS_TCP_CONNECTING)
+	{
+		int err = 0;
+		socklen_t len = sizeof(err);
+		if (getsockopt(conn->socket.fd, SOL_SOCKET, SO_ERROR, &err, &len) || err || (events & (EPOLLERR | EPOLLHUP)))
+		{
+			conn_close(conn, now);
+			return;
+		}
+
+		conn->state = MODBUS_TCP_CONNECTED;
+		conn->backoff = conn->engine->backoff_min;
+		conn->stats.connects++;
+		conn_set_events(conn, EPOLLIN);
+		return;
+	}
+
+	if (events & EPOLLERR)
+	{
+		conn_close(conn, now);
+		return;
+	}
+
+	if (events & (EPOLLIN | EPOLLHUP))
+		conn_receive(conn, now);
+
+	if ((events & EPOLLOUT) && conn->state == MODBUS_TCP_CONNECTED)
+		conn_send(conn, now);
+}
+
+static void conn_on_timer(modbus_tcp_conn_t *conn)
+{
+	uint32_t now = modbus_now_ms();
+	modbus_timer_ack(&conn->timer);
+	conn->timer_armed = 0;
+
+	switch (conn->state)
+	{
+		case MODBUS_TCP_DISCONNECTED:
+			if (modbusTimeDiff(now, conn->reconnect_at) >= 0)
+				conn_connect(conn, now);
+			else
+				conn_arm(conn, conn->reconnect_at, now);
+			return;
+
+		case MODBUS_TCP_CONNECTING:
+			if (modbusTimeDiff(now, conn->reconnect_at) >= 0)
+				conn_close(conn, now);
+			else
+				conn_arm(conn, conn->reconnect_at, now);
+			return;
+
+		case MODBUS_TCP_CONNECTED:
+			break;
+	}
+
+	ModbusTransaction t;
+	while (modbusTransactionTablePopExpired(&conn->table, now, &t))
+	{
+		conn->stats.timeouts++;
+		if (conn->on_complete)
+			conn->on_complete(conn, MODBUS_TCP_TIMEOUT, &t, MODBUS_NO_ERROR());
+	}
+
+	uint32_t deadline;
+	if (conn->state == MODBUS_TCP_CONNECTED && modbusTransactionTableNextDeadline(&conn->table, &deadline))
+		conn_arm(conn, deadline, now);
+}
+
+int modbus_tcp_master_init(modbus_tcp_master_t *engine)
+{
+	engine->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	engine->backoff_min = MODBUS_TCP_MASTER_BACKOFF_MIN;
+	engine->backoff_max = MODBUS_TCP_MASTER_BACKOFF_MAX;
+	engine->dirty = NULL;
+	return engine->epoll_fd < 0 ? -1 : 0;
+}
+
+void modbus_tcp_master_destroy(modbus_tcp_master_t *engine)
+{
+	close(engine->epoll_fd);
+	engine->epoll_fd = -1;
+}
+
+/*
+	Sends requests submitted since the last flush. Submitting only
+	appends to the transmit buffer, so that requests to the same device
+	are coalesced into a single send().
+*/
+void modbus_tcp_master_flush(modbus_tcp_master_t *engine)
+{
+	uint32_t now = modbus_now_ms();
+	while (engine->dirty)
+	{
+		modbus_tcp_conn_t *conn = engine->dirty;
+		engine->dirty = conn->next_dirty;
+		conn->is_dirty = 0;
+
+		if (conn->state == MODBUS_TCP_CONNECTED && conn->tx_len)
+			conn_send(conn, now);
+	}
+}
+
+/*
+	Flushes pending requests, waits for events and dispatches them.
+	Returns number of processed events or -1 on error.
+*/
+int modbus_tcp_master_poll(modbus_tcp_master_t *engine, int timeout_ms)
+{
+	struct epoll_event events[MODBUS_TCP_MASTER_MAX_EVENTS];
+
+	modbus_tcp_master_flush(engine);
+	int n = epoll_wait(engine->epoll_fd, events, MODBUS_TCP_MASTER_MAX_EVENTS, timeout_ms);
+	if (n < 0)
+		return errno == EINTR ? 0 : -1;
+
+	for (int i = 0; i < n; i++)
+	{
+		modbus_handle_t *handle = events[i].data.ptr;
+		if (handle->type == MODBUS_HANDLE_TIMER)
+			conn_on_timer(handle->owner);
+		else
+			conn_on_socket(handle->owner, events[i].events);
+	}
+
+	modbus_tcp_master_flush(engine);
+	return n;
+}
+
+/*
+	Sets up a connection and starts connecting. The connection struct
+	must stay in place until modbus_tcp_conn_destroy() is called.
+*/
+int modbus_tcp_conn_init(
+	modbus_tcp_master_t *engine,
+	modbus_tcp_conn_t *conn,
+	const struct sockaddr_in *addr,
+	ModbusDataCallback data_callback,
+	ModbusMasterExceptionCallback exception_callback,
+	modbus_tcp_completion_handler on_complete)
+{
+	memset(conn, 0, sizeof(*conn));
+	modbusTCPStreamInit(&conn->stream);
+	conn->engine = engine;
+	conn->addr = *addr;
+	conn->on_complete = on_complete;
+	conn->backoff = engine->backoff_min;
+	conn->state = MODBUS_TCP_DISCONNECTED;
+	conn->socket.fd = -1;
+	conn->socket.type = MODBUS_HANDLE_SOCKET;
+	conn->socket.owner = conn;
+
+	ModbusErrorInfo err = modbusMasterInit(
+		&conn->master,
+		data_callback,
+		exception_callback,
+		conn_allocator,
+		modbusMasterDefaultFunctions,
+		modbusMasterDefaultFunctionCount);
+	if (!modbusIsOk(err))
+		return -1;
+	modbusMasterSetUserPointer(&conn->master, conn);
+
+	err = modbusTransactionTableInit(&conn->table, conn->transactions, MODBUS_TCP_MASTER_DEPTH);
+	if (!modbusIsOk(err))
+		return -1;
+
+	if (modbus_timer_create(&conn->timer, conn))
+		return -1;
+
+	if (modbus_epoll_add(engine->epoll_fd, &conn->timer, EPOLLIN))
+	{
+		close(conn->timer.fd);
+		return -1;
+	}
+
+	conn_connect(conn, modbus_now_ms());
+	return 0;
+}
+
+void modbus_tcp_conn_destroy(modbus_tcp_conn_t *conn)
+{
+	modbus_tcp_conn_t **p = &conn->engine->dirty;
+	while (*p && *p != conn)
+		p = &(*p)->next_dirty;
+	if (*p)
+		*p = conn->next_dirty;
+
+	if (conn->socket.fd >= 0)
+		close(conn->socket.fd);
+	close(conn->timer.fd);
+	modbusMasterDestroy(&conn->master);
+}
+
+/*
+	Queues the request currently built in the connection's master. The
+	transaction ID is assigned automatically. The context pointer is passed
+	back to the completion handler in the transaction struct.
+
+	Returns 0 on success or -1 with errno set to:
+	 - ENOTCONN if the connection is not established
+	 - EAGAIN if MODBUS_TCP_MASTER_DEPTH requests are already in flight
+	 - EINVAL if the master doesn't hold a valid Modbus TCP request
+*/
+int modbus_tcp_conn_submit(modbus_tcp_conn_t *conn, uint32_t timeout_ms, void *context)
+{
+	if (conn->state != MODBUS_TCP_CONNECTED)
+	{
+		errno = ENOTCONN;
+		return -1;
+	}
+
+	uint16_t length = modbusMasterGetRequestLength(&conn->master);
+	if (conn->tx_len + length > sizeof(conn->tx))
+	{
+		errno = EAGAIN;
+		return -1;
+	}
+
+	uint32_t now = modbus_now_ms();
+	ModbusErrorInfo err = modbusTransactionTableAddRequest(
+		&conn->table,
+		&conn->master,
+		now + timeout_ms,
+		context,
+		NULL);
+
+	if (!modbusIsOk(err))
+	{
+		errno = modbusGetGeneralError(err) == MODBUS_ERROR_ALLOC ? EAGAIN : EINVAL;
+		return -1;
+	}
+
+	memcpy(conn->tx + conn->tx_len, modbusMasterGetRequest(&conn->master), length);
+	conn->tx_len += length;
+	modbusMasterFreeRequest(&conn->master);
+
+	conn->stats.requests++;
+	conn_mark_dirty(conn);
+	conn_arm(conn, now + timeout_ms, now);
+	return 0;
+}
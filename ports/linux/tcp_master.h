@@ -0,0 +1,119 @@
+#ifndef _TCP_MASTER_H
+#define _TCP_MASTER_H
+
+#include "modbus_port.h"
+#include <netinet/in.h>
+
+/*
+	Maximum number of requests in flight on one connection.
+	Should be a power of two, so transaction IDs are allocated sequentially.
+*/
+#ifndef MODBUS_TCP_MASTER_DEPTH
+#define MODBUS_TCP_MASTER_DEPTH 16
+#endif
+
+#define MODBUS_TCP_MASTER_BACKOFF_MIN 100   // ms
+#define MODBUS_TCP_MASTER_BACKOFF_MAX 30000 // ms
+
+typedef enum
+{
+	MODBUS_TCP_DISCONNECTED,
+	MODBUS_TCP_CONNECTING,
+	MODBUS_TCP_CONNECTED,
+} modbus_tcp_state;
+
+typedef enum
+{
+	MODBUS_TCP_DONE,    // Response received - see the error info for parsing result
+	MODBUS_TCP_TIMEOUT, // No response before the deadline
+	MODBUS_TCP_CLOSED,  // Connection lost before the response arrived
+} modbus_tcp_result;
+
+typedef struct modbus_tcp_master modbus_tcp_master_t;
+typedef struct modbus_tcp_conn modbus_tcp_conn_t;
+
+typedef void (*modbus_tcp_completion_handler)(
+	modbus_tcp_conn_t *conn,
+	modbus_tcp_result result,
+	const ModbusTransaction *transaction,
+	ModbusErrorInfo err);
+
+typedef struct
+{
+	uint64_t requests;
+	uint64_t responses;
+	uint64_t errors;
+	uint64_t timeouts;
+	uint32_t connects;
+	uint32_t disconnects;
+} modbus_tcp_stats_t;
+
+struct modbus_tcp_master
+{
+	int epoll_fd;
+	uint32_t backoff_min;
+	uint32_t backoff_max;
+	modbus_tcp_conn_t *dirty; // Connections with unsent data
+};
+
+struct modbus_tcp_conn
+{
+	modbus_tcp_master_t *engine;
+	modbus_handle_t socket;
+	modbus_handle_t timer;
+	struct sockaddr_in addr;
+	modbus_tcp_state state;
+	uint32_t events;
+
+	uint32_t backoff;
+	uint32_t reconnect_at;
+	uint32_t timer_deadline;
+	uint8_t timer_armed;
+
+	ModbusMaster master;
+	ModbusTransactionTable table;
+	ModbusTransaction transactions[MODBUS_TCP_MASTER_DEPTH];
+	uint8_t request[MODBUS_TCP_ADU_MAX];
+
+	ModbusTCPStream stream;
+	uint8_t rx[MODBUS_TCP_MASTER_DEPTH * MODBUS_TCP_ADU_MAX];
+	uint8_t tx[MODBUS_TCP_MASTER_DEPTH * MODBUS_TCP_ADU_MAX];
+	uint32_t tx_len;
+	modbus_tcp_conn_t *next_dirty;
+	uint8_t is_dirty;
+
+	modbus_tcp_completion_handler on_complete;
+	modbus_tcp_stats_t stats;
+	void *context;
+};
+
+int modbus_tcp_master_init(modbus_tcp_master_t *engine);
+void modbus_tcp_master_destroy(modbus_tcp_master_t *engine);
+int modbus_tcp_master_poll(modbus_tcp_master_t *engine, int timeout_ms);
+void modbus_tcp_master_flush(modbus_tcp_master_t *engine);
+
+int modbus_tcp_conn_init(
+	modbus_tcp_master_t *engine,
+	modbus_tcp_conn_t *conn,
+	const struct sockaddr_in *addr,
+	ModbusDataCallback data_callback,
+	ModbusMasterExceptionCallback exception_callback,
+	modbus_tcp_completion_handler on_complete);
+void modbus_tcp_conn_destroy(modbus_tcp_conn_t *conn);
+int modbus_tcp_conn_submit(modbus_tcp_conn_t *conn, uint32_t timeout_ms, void *context);
+
+/*
+	Returns the master used to build requests for this connection.
+	Its user pointer is set to the connection and must not be changed.
+*/
+static inline ModbusMaster *modbus_tcp_conn_master(modbus_tcp_conn_t *conn)
+{
+	return &conn->master;
+}
+
+static inline modbus_tcp_conn_t *modbus_tcp_conn_from_master(const ModbusMaster *master)
+{
+	return (modbus_tcp_conn_t*) modbusMasterGetUserPointer(master);
+}
+
+#endif
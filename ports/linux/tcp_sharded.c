@@ -0,0 +1,260 @@
+#define _GNU_SOURCE
+#include "tcp_sharded.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#define MODBUS_SHARD_POLL_MS 50
+
+static modbus_register_bank_t *bank_from_slave(const ModbusSlave *slave)
+{
+	return modbus_tcp_client_from_slave(slave)->server->context;
+}
+
+static uint16_t bank_read_bit(const uint8_t *bits, uint16_t index)
+{
+	return (__atomic_load_n(&bits[index >> 3], __ATOMIC_RELAXED) >> (index & 7)) & 1;
+}
+
+/*
+	Only called with the write lock held, so the read-modify-write
+	can't race with other writers. The store is atomic for the readers.
+*/
+static void bank_write_bit(uint8_t *bits, uint16_t index, uint16_t value)
+{
+	uint8_t byte = __atomic_load_n(&bits[index >> 3], __ATOMIC_RELAXED);
+	if (value)
+		byte |= 1 << (index & 7);
+	else
+		byte &= ~(1 << (index & 7));
+	__atomic_store_n(&bits[index >> 3], byte, __ATOMIC_RELAXED);
+}
+
+/*
+	Register callback of the workers. All 65536 registers of every
+	type exist, so it never reports an exception.
+*/
+static ModbusError bank_register_callback(
+	const ModbusSlave *slave,
+	const ModbusRegisterCallbackArgs *args,
+	ModbusRegisterCallbackResult *result)
+{
+	modbus_register_bank_t *bank = bank_from_slave(slave);
+	result->exceptionCode = MODBUS_EXCEP_NONE;
+
+	if (args->query == MODBUS_REGQ_R)
+	{
+		switch (args->type)
+		{
+			case MODBUS_HOLDING_REGISTER:
+				result->value = __atomic_load_n(&bank->holding_registers[args->index], __ATOMIC_RELAXED);
+				break;
+
+			case MODBUS_INPUT_REGISTER:
+				result->value = __atomic_load_n(&bank->input_registers[args->index], __ATOMIC_RELAXED);
+				break;
+
+			case MODBUS_COIL:
+				result->value = bank_read_bit(bank->coils, args->index);
+				break;
+
+			case MODBUS_DISCRETE_INPUT:
+				result->value = bank_read_bit(bank->discrete_inputs, args->index);
+				break;
+		}
+	}
+	else if (args->query == MODBUS_REGQ_W)
+	{
+		// Only holding registers and coils are ever written
+		if (args->type == MODBUS_HOLDING_REGISTER)
+			__atomic_store_n(&bank->holding_registers[args->index], args->value, __ATOMIC_RELAXED);
+		else
+			bank_write_bit(bank->coils, args->index, args->value);
+	}
+
+	return MODBUS_OK;
+}
+
+/*
+	Write requests are parsed with the bank's write lock held,
+	so they never interleave with each other. Reads don't lock.
+*/
+static ModbusErrorInfo locked_write(
+	ModbusRequestParsingFunction parse,
+	ModbusSlave *status,
+	uint8_t function,
+	const uint8_t *requestPDU,
+	uint8_t requestLength)
+{
+	modbus_register_bank_t *bank = bank_from_slave(status);
+	pthread_mutex_lock(&bank->write_lock);
+	ModbusErrorInfo err = parse(status, function, requestPDU, requestLength);
+	bank->writes++;
+	pthread_mutex_unlock(&bank->write_lock);
+	return err;
+}
+
+static ModbusErrorInfo locked_0506(ModbusSlave *status, uint8_t function, const uint8_t *requestPDU, uint8_t requestLength)
+{
+	return locked_write(modbusParseRequest0506, status, function, requestPDU, requestLength);
+}
+
+static ModbusErrorInfo locked_1516(ModbusSlave *status, uint8_t function, const uint8_t *requestPDU, uint8_t requestLength)
+{
+	return locked_write(modbusParseRequest1516, status, function, requestPDU, requestLength);
+}
+
+static ModbusErrorInfo locked_22(ModbusSlave *status, uint8_t function, const uint8_t *requestPDU, uint8_t requestLength)
+{
+	return locked_write(modbusParseRequest22, status, function, requestPDU, requestLength);
+}
+
+static const ModbusSlaveFunctionHandler shard_functions[] =
+{
+	{1, modbusParseRequest01020304},
+	{2, modbusParseRequest01020304},
+	{3, modbusParseRequest01020304},
+	{4, modbusParseRequest01020304},
+	{5, locked_0506},
+	{6, locked_0506},
+	{15, locked_1516},
+	{16, locked_1516},
+	{22, locked_22},
+};
+
+int modbus_register_bank_init(modbus_register_bank_t *bank)
+{
+	memset(bank, 0, sizeof(*bank));
+	return pthread_mutex_init(&bank->write_lock, NULL) ? -1 : 0;
+}
+
+void modbus_register_bank_destroy(modbus_register_bank_t *bank)
+{
+	pthread_mutex_destroy(&bank->write_lock);
+}
+
+static void *shard_thread(void *arg)
+{
+	modbus_shard_t *shard = arg;
+	while (__atomic_load_n(&shard->parent->running, __ATOMIC_RELAXED))
+		modbus_tcp_server_poll(&shard->server, MODBUS_SHARD_POLL_MS);
+	return NULL;
+}
+
+/*
+	Every worker gets its own listening socket bound to the same
+	port with SO_REUSEPORT, so the kernel spreads new connections
+	between them. Port 0 picks a free port for all workers.
+*/
+static int shard_listen(struct sockaddr_in *addr)
+{
+	int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+
+	int one = 1;
+	socklen_t len = sizeof(*addr);
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one))
+		|| bind(fd, (const struct sockaddr*) addr, sizeof(*addr))
+		|| listen(fd, SOMAXCONN)
+		|| getsockname(fd, (struct sockaddr*) addr, &len))
+	{
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/*
+	Starts the given number of worker threads serving the register bank.
+	The bank must stay in place until modbus_sharded_server_stop() is called.
+*/
+int modbus_sharded_server_start(
+	modbus_sharded_server_t *server,
+	const struct sockaddr_in *addr,
+	int threads,
+	modbus_register_bank_t *bank,
+	ModbusSlaveExceptionCallback exception_callback)
+{
+	memset(server, 0, sizeof(*server));
+	if (threads < 1)
+		return -1;
+
+	server->bank = bank;
+	server->shards = calloc(threads, sizeof(modbus_shard_t));
+	if (!server->shards)
+		return -1;
+
+	// All listeners are created before any worker starts accepting
+	struct sockaddr_in shard_addr = *addr;
+	for (int i = 0; i < threads; i++)
+	{
+		modbus_shard_t *shard = &server->shards[i];
+		shard->parent = server;
+
+		int fd = shard_listen(&shard_addr);
+		if (fd < 0 || modbus_tcp_server_init_socket(&shard->server, fd, bank_register_callback, exception_callback))
+		{
+			modbus_sharded_server_stop(server);
+			return -1;
+		}
+
+		shard->server.functions = shard_functions;
+		shard->server.function_count = sizeof(shard_functions) / sizeof(shard_functions[0]);
+		shard->server.context = bank;
+		server->shard_count++;
+	}
+
+	server->port = ntohs(shard_addr.sin_port);
+	server->running = 1;
+	for (int i = 0; i < threads; i++)
+	{
+		modbus_shard_t *shard = &server->shards[i];
+		if (pthread_create(&shard->thread, NULL, shard_thread, shard))
+		{
+			modbus_sharded_server_stop(server);
+			return -1;
+		}
+		shard->started = 1;
+	}
+
+	return 0;
+}
+
+static void stats_add(modbus_tcp_server_stats_t *total, const modbus_tcp_server_stats_t *s)
+{
+	total->requests += s->requests;
+	total->responses += s->responses;
+	total->errors += s->errors;
+	total->poll_calls += s->poll_calls;
+	total->recv_calls += s->recv_calls;
+	total->send_calls += s->send_calls;
+	total->accepted += s->accepted;
+	total->closed += s->closed;
+}
+
+/*
+	Stops the workers, closes all connections and
+	sums up statistics of all workers in server->stats
+*/
+void modbus_sharded_server_stop(modbus_sharded_server_t *server)
+{
+	__atomic_store_n(&server->running, 0, __ATOMIC_RELAXED);
+
+	for (int i = 0; i < server->shard_count; i++)
+	{
+		modbus_shard_t *shard = &server->shards[i];
+		if (shard->started)
+			pthread_join(shard->thread, NULL);
+		modbus_tcp_server_destroy(&shard->server);
+		stats_add(&server->stats, &shard->server.stats);
+	}
+
+	free(server->shards);
+	server->shards = NULL;
+	server->shard_count = 0;
+}
@@ -0,0 +1,56 @@
+#ifndef _TCP_SHARDED_H
+#define _TCP_SHARDED_H
+
+#include "tcp_slave.h"
+#include <pthread.h>
+
+/*
+	Register bank shared by all workers of a sharded server.
+	Every register is read with a single atomic load, so reads never
+	block. Write requests are applied one at a time under write_lock.
+*/
+typedef struct
+{
+	uint8_t coils[65536 / 8];
+	uint8_t discrete_inputs[65536 / 8];
+	uint16_t holding_registers[65536];
+	uint16_t input_registers[65536];
+
+	pthread_mutex_t write_lock;
+	uint64_t writes; // Number of applied write requests
+} modbus_register_bank_t;
+
+/*
+	One worker thread with its own listening socket and TCP server
+	(and so its own slaves and transmit buffers)
+*/
+typedef struct
+{
+	struct modbus_sharded_server *parent;
+	pthread_t thread;
+	int started;
+	modbus_tcp_server_t server;
+} modbus_shard_t;
+
+typedef struct modbus_sharded_server
+{
+	modbus_register_bank_t *bank;
+	modbus_shard_t *shards;
+	int shard_count;
+	int running;
+	uint16_t port; // Port the workers listen on
+	modbus_tcp_server_stats_t stats; // Totals, filled in by modbus_sharded_server_stop()
+} modbus_sharded_server_t;
+
+int modbus_register_bank_init(modbus_register_bank_t *bank);
+void modbus_register_bank_destroy(modbus_register_bank_t *bank);
+
+int modbus_sharded_server_start(
+	modbus_sharded_server_t *server,
+	const struct sockaddr_in *addr,
+	int threads,
+	modbus_register_bank_t *bank,
+	ModbusSlaveExceptionCallback exception_callback);
+void modbus_sharded_server_stop(modbus_sharded_server_t *server);
+
+#endif
@@ -0,0 +1,396 @@
+#define _GNU_SOURCE
+#include "tcp_slave.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/tcp.h>
+
+#define MODBUS_TCP_SLAVE_MAX_EVENTS 256
+#define MODBUS_TCP_SLAVE_EVENTS (EPOLLIN | EPOLLRDHUP | EPOLLET)
+
+/*
+	Responses are built directly in the next free transmit
+	buffer of the server and sent from there with one gathered write.
+*/
+static ModbusError client_allocator(ModbusBuffer *buffer, uint16_t size, void *context)
+{
+	modbus_tcp_client_t *client = context;
+	modbus_tcp_server_t *server = client->server;
+	if (size > sizeof(server->tx[0]))
+	{
+		buffer->data = NULL;
+		return MODBUS_ERROR_ALLOC;
+	}
+
+	buffer->data = size ? server->tx[server->tx_count] : NULL;
+	return MODBUS_OK;
+}
+
+static void client_close(modbus_tcp_client_t *client)
+{
+	modbus_tcp_server_t *server = client->server;
+
+	// Closing the socket removes it from the epoll set
+	close(client->socket.fd);
+	free(client->pending);
+	modbusSlaveDestroy(&client->slave);
+
+	if (client->prev)
+		client->prev->next = client->next;
+	else
+		server->clients = client->next;
+	if (client->next)
+		client->next->prev = client->prev;
+
+	server->stats.closed++;
+	server->stats.clients--;
+	free(client);
+}
+
+/*
+	Appends data the socket didn't accept to the pending buffer
+	and starts waiting for the socket to become writable.
+*/
+static int client_defer(modbus_tcp_client_t *client, const struct iovec *iov, int count, size_t skip)
+{
+	size_t length = 0;
+	for (int i = 0; i < count; i++)
+		length += iov[i].iov_len;
+	length -= skip;
+
+	// Compact the buffer first
+	if (client->pending_offset)
+	{
+		memmove(client->pending, client->pending + client->pending_offset, client->pending_len - client->pending_offset);
+		client->pending_len -= client->pending_offset;
+		client->pending_offset = 0;
+	}
+
+	uint8_t *pending = realloc(client->pending, client->pending_len + length);
+	if (!pending)
+		return -1;
+	client->pending = pending;
+
+	for (int i = 0; i < count; i++)
+	{
+		size_t n = iov[i].iov_len;
+		const uint8_t *data = iov[i].iov_base;
+		if (skip >= n)
+		{
+			skip -= n;
+			continue;
+		}
+
+		memcpy(client->pending + client->pending_len, data + skip, n - skip);
+		client->pending_len += n - skip;
+		skip = 0;
+	}
+
+	return modbus_epoll_mod(client->server->epoll_fd, &client->socket, MODBUS_TCP_SLAVE_EVENTS | EPOLLOUT);
+}
+
+/*
+	Sends all responses collected in the transmit buffers with a single call.
+	Returns -1 if the connection has to be closed.
+*/
+static int client_flush(modbus_tcp_client_t *client)
+{
+	modbus_tcp_server_t *server = client->server;
+	int count = server->tx_count;
+	server->tx_count = 0;
+	if (!count)
+		return 0;
+
+	// Responses must not overtake the pending ones
+	if (client->pending_len)
+		return client_defer(client, server->tx_iov, count, 0);
+
+	size_t length = 0;
+	for (int i = 0; i < count; i++)
+		length += server->tx_iov[i].iov_len;
+
+	// sendmsg() is writev() with MSG_NOSIGNAL
+	struct msghdr msg = {.msg_iov = server->tx_iov, .msg_iovlen = count};
+	ssize_t n = sendmsg(client->socket.fd, &msg, MSG_NOSIGNAL);
+	server->stats.send_calls++;
+	if (n < 0)
+	{
+		if (errno != EAGAIN && errno != EWOULDBLOCK)
+			return -1;
+		n = 0;
+	}
+
+	if ((size_t) n == length)
+		return 0;
+
+	return client_defer(client, server->tx_iov, count, n);
+}
+
+/*
+	Sends the pending responses. Returns 1 if all of them have been sent,
+	0 if the socket is full again or -1 on error.
+*/
+static int client_send_pending(modbus_tcp_client_t *client)
+{
+	while (client->pending_offset < client->pending_len)
+	{
+		ssize_t n = send(
+			client->socket.fd,
+			client->pending + client->pending_offset,
+			client->pending_len - client->pending_offset,
+			MSG_NOSIGNAL);
+		client->server->stats.send_calls++;
+
+		if (n < 0)
+			return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+		client->pending_offset += n;
+	}
+
+	free(client->pending);
+	client->pending = NULL;
+	client->pending_len = 0;
+	client->pending_offset = 0;
+	return modbus_epoll_mod(client->server->epoll_fd, &client->socket, MODBUS_TCP_SLAVE_EVENTS) ? -1 : 1;
+}
+
+/*
+	Reads until the socket is drained (the socket is edge-triggered).
+	Reading stops while there are pending responses, so that a client
+	which doesn't read responses is throttled by TCP flow control.
+	Returns -1 if the connection has to be closed.
+*/
+static int client_receive(modbus_tcp_client_t *client)
+{
+	modbus_tcp_server_t *server = client->server;
+	while (!client->pending_len)
+	{
+		ssize_t n = recv(client->socket.fd, server->rx, sizeof(server->rx), 0);
+		server->stats.recv_calls++;
+		if (n == 0)
+			return -1;
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+		}
+
+		// The receive buffer is shared - the whole chunk is processed right away
+		modbusTCPStreamFeed(&client->stream, server->rx, n);
+
+		const uint8_t *frame;
+		uint16_t length;
+		ModbusError err;
+		while ((err = modbusTCPStreamNext(&client->stream, &frame, &length)) == MODBUS_OK && frame)
+		{
+			server->stats.requests++;
+			ModbusErrorInfo perr = modbusParseRequestTCP(&client->slave, frame, length);
+			if (!modbusIsOk(perr))
+			{
+				server->stats.errors++;
+				continue;
+			}
+
+			uint16_t response_length = modbusSlaveGetResponseLength(&client->slave);
+			if (!response_length)
+				continue;
+
+			server->tx_iov[server->tx_count].iov_base = server->tx[server->tx_count];
+			server->tx_iov[server->tx_count].iov_len = response_length;
+			server->tx_count++;
+			server->stats.responses++;
+
+			if (server->tx_count == MODBUS_TCP_SLAVE_BATCH && client_flush(client))
+				return -1;
+		}
+
+		if (client_flush(client))
+			return -1;
+
+		// Invalid MBAP header - the stream cannot be resynchronized
+		if (err != MODBUS_OK)
+			return -1;
+	}
+
+	return 0;
+}
+
+static void client_on_socket(modbus_tcp_client_t *client, uint32_t events)
+{
+	if (events & EPOLLERR)
+	{
+		client_close(client);
+		return;
+	}
+
+	if ((events & EPOLLOUT) && client->pending_len)
+	{
+		int r = client_send_pending(client);
+		if (r < 0)
+		{
+			client_close(client);
+			return;
+		}
+
+		// Resume reading - data may have been left in the socket
+		if (r > 0)
+			events |= EPOLLIN;
+	}
+
+	if ((events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) && client_receive(client))
+		client_close(client);
+}
+
+static void server_accept(modbus_tcp_server_t *server)
+{
+	int fd;
+	while ((fd = accept4(server->listener.fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+	{
+		modbus_tcp_client_t *client = calloc(1, sizeof(modbus_tcp_client_t));
+		if (!client)
+		{
+			close(fd);
+			continue;
+		}
+
+		int one = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+		client->server = server;
+		client->socket.fd = fd;
+		client->socket.type = MODBUS_HANDLE_SOCKET;
+		client->socket.owner = client;
+		modbusTCPStreamInit(&client->stream);
+
+		ModbusErrorInfo err = modbusSlaveInit(
+			&client->slave,
+			server->register_callback,
+			server->exception_callback,
+			client_allocator,
+			server->functions,
+			server->function_count);
+		modbusSlaveSetUserPointer(&client->slave, client);
+
+		if (!modbusIsOk(err) || modbus_epoll_add(server->epoll_fd, &client->socket, MODBUS_TCP_SLAVE_EVENTS))
+		{
+			close(fd);
+			free(client);
+			continue;
+		}
+
+		client->next = server->clients;
+		if (server->clients)
+			server->clients->prev = client;
+		server->clients = client;
+
+		server->stats.accepted++;
+		server->stats.clients++;
+
+		// Data might have arrived before the socket was registered
+		if (client_receive(client))
+			client_close(client);
+	}
+}
+
+/*
+	Starts serving connections from a listening socket, which is
+	made non-blocking and closed by modbus_tcp_server_destroy().
+	The server struct must stay in place until then.
+*/
+int modbus_tcp_server_init_socket(
+	modbus_tcp_server_t *server,
+	int listen_fd,
+	ModbusRegisterCallback register_callback,
+	ModbusSlaveExceptionCallback exception_callback)
+{
+	memset(server, 0, sizeof(*server));
+	server->register_callback = register_callback;
+	server->exception_callback = exception_callback;
+	server->functions = modbusSlaveDefaultFunctions;
+	server->function_count = modbusSlaveDefaultFunctionCount;
+	server->listener.type = MODBUS_HANDLE_LISTENER;
+	server->listener.owner = server;
+	server->listener.fd = listen_fd;
+
+	server->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (server->epoll_fd < 0
+		|| fcntl(listen_fd, F_SETFL, fcntl(listen_fd, F_GETFL) | O_NONBLOCK)
+		|| modbus_epoll_add(server->epoll_fd, &server->listener, EPOLLIN))
+	{
+		modbus_tcp_server_destroy(server);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+	Starts listening on the given address. The server struct
+	must stay in place until modbus_tcp_server_destroy() is called.
+*/
+int modbus_tcp_server_init(
+	modbus_tcp_server_t *server,
+	const struct sockaddr_in *addr,
+	ModbusRegisterCallback register_callback,
+	ModbusSlaveExceptionCallback exception_callback)
+{
+	int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+
+	int one = 1;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	if (bind(fd, (const struct sockaddr*) addr, sizeof(*addr)) || listen(fd, SOMAXCONN))
+	{
+		close(fd);
+		return -1;
+	}
+
+	return modbus_tcp_server_init_socket(server, fd, register_callback, exception_callback);
+}
+
+/*
+	Closes all connections and the listening socket
+*/
+void modbus_tcp_server_destroy(modbus_tcp_server_t *server)
+{
+	while (server->clients)
+		client_close(server->clients);
+
+	if (server->listener.fd >= 0)
+		close(server->listener.fd);
+	if (server->epoll_fd >= 0)
+		close(server->epoll_fd);
+
+	server->listener.fd = -1;
+	server->epoll_fd = -1;
+}
+
+/*
+	Waits for events and dispatches them.
+	Returns number of processed events or -1 on error.
+*/
+int modbus_tcp_server_poll(modbus_tcp_server_t *server, int timeout_ms)
+{
+	struct epoll_event events[MODBUS_TCP_SLAVE_MAX_EVENTS];
+	int n = epoll_wait(server->epoll_fd, events, MODBUS_TCP_SLAVE_MAX_EVENTS, timeout_ms);
+	server->stats.poll_calls++;
+	if (n < 0)
+		return errno == EINTR ? 0 : -1;
+
+	for (int i = 0; i < n; i++)
+	{
+		modbus_handle_t *handle = events[i].data.ptr;
+		if (handle->type == MODBUS_HANDLE_LISTENER)
+			server_accept(server);
+		else
+			client_on_socket(handle->owner, events[i].events);
+	}
+
+	return n;
+}
@@ -0,0 +1,102 @@
+#ifndef _TCP_SLAVE_H
+#define _TCP_SLAVE_H
+
+#include "modbus_port.h"
+#include <netinet/in.h>
+#include <sys/uio.h>
+
+/*
+	Maximum number of responses sent with a single writev().
+*/
+#ifndef MODBUS_TCP_SLAVE_BATCH
+#define MODBUS_TCP_SLAVE_BATCH 64
+#endif
+
+/*
+	Size of the receive buffer shared by all connections
+*/
+#ifndef MODBUS_TCP_SLAVE_RX_SIZE
+#define MODBUS_TCP_SLAVE_RX_SIZE 65536
+#endif
+
+typedef struct modbus_tcp_server modbus_tcp_server_t;
+typedef struct modbus_tcp_client modbus_tcp_client_t;
+
+typedef struct
+{
+	uint64_t requests;
+	uint64_t responses;
+	uint64_t errors;     // Requests which could not be parsed
+	uint64_t poll_calls;
+	uint64_t recv_calls;
+	uint64_t send_calls;
+	uint32_t accepted;
+	uint32_t closed;
+	uint32_t clients;    // Currently open connections
+} modbus_tcp_server_stats_t;
+
+/*
+	Per-connection state is kept small, so that many idle connections
+	are cheap. Responses are built in the server's transmit buffers and
+	only copied to the connection when the socket can't take them.
+*/
+struct modbus_tcp_client
+{
+	modbus_tcp_server_t *server;
+	modbus_handle_t socket;
+	ModbusSlave slave;
+	ModbusTCPStream stream;
+
+	uint8_t *pending;        // Responses not accepted by the socket yet
+	uint32_t pending_len;
+	uint32_t pending_offset; // Number of pending bytes already sent
+
+	modbus_tcp_client_t *prev;
+	modbus_tcp_client_t *next;
+};
+
+struct modbus_tcp_server
+{
+	int epoll_fd;
+	modbus_handle_t listener;
+	ModbusRegisterCallback register_callback;
+	ModbusSlaveExceptionCallback exception_callback;
+
+	// Function handlers given to new connections (library defaults after init)
+	const ModbusSlaveFunctionHandler *functions;
+	uint8_t function_count;
+
+	uint8_t rx[MODBUS_TCP_SLAVE_RX_SIZE];
+	uint8_t tx[MODBUS_TCP_SLAVE_BATCH][MODBUS_TCP_ADU_MAX];
+	struct iovec tx_iov[MODBUS_TCP_SLAVE_BATCH];
+	uint16_t tx_count; // Number of responses in tx
+
+	modbus_tcp_client_t *clients;
+
+	modbus_tcp_server_stats_t stats;
+	void *context;
+};
+
+int modbus_tcp_server_init(
+	modbus_tcp_server_t *server,
+	const struct sockaddr_in *addr,
+	ModbusRegisterCallback register_callback,
+	ModbusSlaveExceptionCallback exception_callback);
+int modbus_tcp_server_init_socket(
+	modbus_tcp_server_t *server,
+	int listen_fd,
+	ModbusRegisterCallback register_callback,
+	ModbusSlaveExceptionCallback exception_callback);
+void modbus_tcp_server_destroy(modbus_tcp_server_t *server);
+int modbus_tcp_server_poll(modbus_tcp_server_t *server, int timeout_ms);
+
+/*
+	Returns the connection a request is being parsed for,
+	e.g. from within the register callback.
+*/
+static inline modbus_tcp_client_t *modbus_tcp_client_from_slave(const ModbusSlave *slave)
+{
+	return (modbus_tcp_client_t*) modbusSlaveGetUserPointer(slave);
+}
+
+#endif
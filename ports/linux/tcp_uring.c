@@ -0,0 +1,823 @@
+#define _GNU_SOURCE
+#include "tcp_uring.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <netinet/tcp.h>
+
+#define MODBUS_URING_BUF_GROUP 0
+
+/*
+	Completions are dispatched using tags stored in the lowest
+	bits of user_data, next to the pointer to the owner.
+*/
+#define URING_TAG_ACCEPT 0u
+#define URING_TAG_RECV   1u
+#define URING_TAG_SEND   2u
+#define URING_TAG_CANCEL 3u
+#define URING_TAG_MASK   3u
+
+static void client_close(modbus_uring_client_t *client);
+static void client_update(modbus_uring_client_t *client);
+static void client_drain(modbus_uring_client_t *client);
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *params)
+{
+	return (int) syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, void *arg, size_t size)
+{
+	return (int) syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, size);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, void *arg, unsigned count)
+{
+	return (int) syscall(__NR_io_uring_register, fd, opcode, arg, count);
+}
+
+static inline uint64_t uring_data(const void *owner, unsigned tag)
+{
+	return (uint64_t)(uintptr_t) owner | tag;
+}
+
+static inline void *uring_owner(uint64_t data)
+{
+	return (void*)(uintptr_t)(data & ~(uint64_t) URING_TAG_MASK);
+}
+
+/*
+	Creates the ring and maps its queues. Multishot receives with provided
+	buffers and waiting with a timeout require Linux 6.0.
+*/
+static int ring_init(modbus_uring_server_t *server)
+{
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN;
+	params.cq_entries = 4 * MODBUS_URING_ENTRIES;
+
+	int fd = sys_io_uring_setup(MODBUS_URING_ENTRIES, &params);
+	if (fd < 0 && errno == EINVAL)
+	{
+		memset(&params, 0, sizeof(params));
+		params.flags = IORING_SETUP_CQSIZE;
+		params.cq_entries = 4 * MODBUS_URING_ENTRIES;
+		fd = sys_io_uring_setup(MODBUS_URING_ENTRIES, &params);
+	}
+	if (fd < 0)
+		return -1;
+
+	server->ring_fd = fd;
+	if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_EXT_ARG))
+	{
+		errno = ENOSYS;
+		return -1;
+	}
+
+	// Both queues share one mapping
+	size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	server->sq_size = sq_size > cq_size ? sq_size : cq_size;
+	server->sq_ptr = mmap(NULL, server->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (server->sq_ptr == MAP_FAILED)
+	{
+		server->sq_ptr = NULL;
+		return -1;
+	}
+	server->cq_ptr = server->sq_ptr;
+
+	server->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+	server->sqes_ptr = mmap(NULL, server->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (server->sqes_ptr == MAP_FAILED)
+	{
+		server->sqes_ptr = NULL;
+		return -1;
+	}
+
+	uint8_t *sq = server->sq_ptr;
+	uint8_t *cq = server->cq_ptr;
+	server->sq_head = (unsigned*)(sq + params.sq_off.head);
+	server->sq_tail = (unsigned*)(sq + params.sq_off.tail);
+	server->sq_mask = (unsigned*)(sq + params.sq_off.ring_mask);
+	server->sq_array = (unsigned*)(sq + params.sq_off.array);
+	server->cq_head = (unsigned*)(cq + params.cq_off.head);
+	server->cq_tail = (unsigned*)(cq + params.cq_off.tail);
+	server->cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+	server->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+	server->sqes = server->sqes_ptr;
+	server->sq_entries = params.sq_entries;
+	server->sq_local_tail = *server->sq_tail;
+	return 0;
+}
+
+/*
+	Submits queued entries and optionally waits for completions.
+	This is the only system call made by the server loop.
+*/
+static int ring_enter(modbus_uring_server_t *server, unsigned min_complete, int timeout_ms)
+{
+	unsigned to_submit = server->sq_local_tail - *server->sq_tail;
+	__atomic_store_n(server->sq_tail, server->sq_local_tail, __ATOMIC_RELEASE);
+	if (!to_submit && !min_complete)
+		return 0;
+
+	struct __kernel_timespec ts;
+	struct io_uring_getevents_arg arg;
+	memset(&arg, 0, sizeof(arg));
+	unsigned flags = 0;
+	if (min_complete)
+	{
+		flags |= IORING_ENTER_GETEVENTS;
+		if (timeout_ms >= 0)
+		{
+			ts.tv_sec = timeout_ms / 1000;
+			ts.tv_nsec = (long long)(timeout_ms % 1000) * 1000000LL;
+			arg.ts = (uint64_t)(uintptr_t) &ts;
+			arg.sigmask_sz = _NSIG / 8;
+			flags |= IORING_ENTER_EXT_ARG;
+		}
+	}
+
+	int r = sys_io_uring_enter(
+		server->ring_fd,
+		to_submit,
+		min_complete,
+		flags,
+		(flags & IORING_ENTER_EXT_ARG) ? &arg : NULL,
+		(flags & IORING_ENTER_EXT_ARG) ? sizeof(arg) : 0);
+	server->stats.enter_calls++;
+
+	if (r < 0 && (errno == ETIME || errno == EINTR || errno == EBUSY || errno == EAGAIN))
+		return 0;
+	return r;
+}
+
+/*
+	Returns a zeroed submission queue entry. When the queue is
+	full, the queued entries are submitted first.
+*/
+static struct io_uring_sqe *ring_get_sqe(modbus_uring_server_t *server)
+{
+	unsigned head = __atomic_load_n(server->sq_head, __ATOMIC_ACQUIRE);
+	if (server->sq_local_tail - head >= server->sq_entries)
+	{
+		if (ring_enter(server, 0, 0) < 0)
+			return NULL;
+
+		head = __atomic_load_n(server->sq_head, __ATOMIC_ACQUIRE);
+		if (server->sq_local_tail - head >= server->sq_entries)
+			return NULL;
+	}
+
+	unsigned index = server->sq_local_tail & *server->sq_mask;
+	struct io_uring_sqe *sqe = &server->sqes[index];
+	memset(sqe, 0, sizeof(*sqe));
+	server->sq_array[index] = index;
+	server->sq_local_tail++;
+	return sqe;
+}
+
+/*
+	Gives a receive buffer back to the kernel
+*/
+static void buf_recycle(modbus_uring_server_t *server, uint16_t bid)
+{
+	struct io_uring_buf_ring *ring = server->buf_ring;
+	uint16_t tail = ring->tail;
+	struct io_uring_buf *buf = &ring->bufs[tail & (MODBUS_URING_RX_BUFFERS - 1)];
+	buf->addr = (uint64_t)(uintptr_t)(server->rx + (size_t) bid * MODBUS_URING_RX_SIZE);
+	buf->len = MODBUS_URING_RX_SIZE;
+	buf->bid = bid;
+	__atomic_store_n(&ring->tail, (uint16_t)(tail + 1), __ATOMIC_RELEASE);
+}
+
+static int buf_ring_init(modbus_uring_server_t *server)
+{
+	server->buf_ring_size = MODBUS_URING_RX_BUFFERS * sizeof(struct io_uring_buf);
+	void *ring = mmap(NULL, server->buf_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ring == MAP_FAILED)
+		return -1;
+	server->buf_ring = ring;
+
+	server->rx = malloc((size_t) MODBUS_URING_RX_BUFFERS * MODBUS_URING_RX_SIZE);
+	if (!server->rx)
+		return -1;
+
+	struct io_uring_buf_reg reg;
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (uint64_t)(uintptr_t) ring;
+	reg.ring_entries = MODBUS_URING_RX_BUFFERS;
+	reg.bgid = MODBUS_URING_BUF_GROUP;
+	if (sys_io_uring_register(server->ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1))
+		return -1;
+
+	for (uint16_t i = 0; i < MODBUS_URING_RX_BUFFERS; i++)
+		buf_recycle(server, i);
+	return 0;
+}
+
+static void arm_accept(modbus_uring_server_t *server)
+{
+	struct io_uring_sqe *sqe = ring_get_sqe(server);
+	if (!sqe)
+		return;
+
+	sqe->opcode = IORING_OP_ACCEPT;
+	sqe->fd = server->listen_fd;
+	sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+	sqe->accept_flags = SOCK_CLOEXEC;
+	sqe->user_data = uring_data(server, URING_TAG_ACCEPT);
+	server->accept_armed = 1;
+}
+
+static void arm_recv(modbus_uring_client_t *client)
+{
+	struct io_uring_sqe *sqe = ring_get_sqe(client->server);
+	if (!sqe)
+		return;
+
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = client->fd;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = MODBUS_URING_BUF_GROUP;
+	sqe->user_data = uring_data(client, URING_TAG_RECV);
+	client->recv_armed = 1;
+}
+
+static void ring_cancel(modbus_uring_server_t *server, uint64_t data)
+{
+	struct io_uring_sqe *sqe = ring_get_sqe(server);
+	if (!sqe)
+		return;
+
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = data;
+	sqe->user_data = uring_data(server, URING_TAG_CANCEL);
+}
+
+static void cancel_recv(modbus_uring_client_t *client)
+{
+	ring_cancel(client->server, uring_data(client, URING_TAG_RECV));
+}
+
+static modbus_uring_tx_t *tx_get(modbus_uring_server_t *server)
+{
+	modbus_uring_tx_t *tx = server->tx_free;
+	if (tx)
+		server->tx_free = tx->next;
+	else if (!(tx = malloc(sizeof(modbus_uring_tx_t))))
+		return NULL;
+
+	tx->next = NULL;
+	tx->length = 0;
+	return tx;
+}
+
+static void tx_put(modbus_uring_server_t *server, modbus_uring_tx_t *tx)
+{
+	tx->next = server->tx_free;
+	server->tx_free = tx;
+}
+
+/*
+	Responses are built directly in the connection's current send buffer
+*/
+static ModbusError client_allocator(ModbusBuffer *buffer, uint16_t size, void *context)
+{
+	modbus_uring_client_t *client = context;
+	modbus_uring_tx_t *tx = client->tx_tail;
+	if (size && (!tx || size > MODBUS_URING_TX_SIZE - tx->length))
+	{
+		buffer->data = NULL;
+		return MODBUS_ERROR_ALLOC;
+	}
+
+	buffer->data = size ? tx->data + tx->length : NULL;
+	return MODBUS_OK;
+}
+
+static void client_mark_dirty(modbus_uring_client_t *client)
+{
+	if (client->is_dirty)
+		return;
+
+	client->is_dirty = 1;
+	client->next_dirty = client->server->dirty;
+	client->server->dirty = client;
+}
+
+/*
+	Makes sure the current send buffer can take the longest possible response
+*/
+static int client_reserve(modbus_uring_client_t *client)
+{
+	if (client->tx_tail && client->tx_tail->length <= MODBUS_URING_TX_SIZE - MODBUS_TCP_ADU_MAX)
+		return 0;
+
+	modbus_uring_tx_t *tx = tx_get(client->server);
+	if (!tx)
+		return -1;
+
+	tx->client = client;
+	client->tx_count++;
+	if (client->tx_tail)
+		client->tx_tail->next = tx;
+	else
+		client->tx_head = tx;
+	client->tx_tail = tx;
+	client_mark_dirty(client);
+	return 0;
+}
+
+static void client_accept(modbus_uring_server_t *server, int fd)
+{
+	modbus_uring_client_t *client = calloc(1, sizeof(modbus_uring_client_t));
+	if (!client)
+	{
+		close(fd);
+		return;
+	}
+
+	int one = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	client->server = server;
+	client->fd = fd;
+	client->held_head = -1;
+	client->held_tail = -1;
+	modbusTCPStreamInit(&client->stream);
+
+	ModbusErrorInfo err = modbusSlaveInit(
+		&client->slave,
+		server->register_callback,
+		server->exception_callback,
+		client_allocator,
+		modbusSlaveDefaultFunctions,
+		modbusSlaveDefaultFunctionCount);
+	if (!modbusIsOk(err))
+	{
+		close(fd);
+		free(client);
+		return;
+	}
+	modbusSlaveSetUserPointer(&client->slave, client);
+
+	client->next = server->clients;
+	if (server->clients)
+		server->clients->prev = client;
+	server->clients = client;
+
+	server->stats.accepted++;
+	server->stats.clients++;
+	arm_recv(client);
+}
+
+static void client_free(modbus_uring_client_t *client)
+{
+	modbus_uring_server_t *server = client->server;
+	close(client->fd);
+	modbusSlaveDestroy(&client->slave);
+
+	while (client->held_head >= 0)
+	{
+		int32_t bid = client->held_head;
+		client->held_head = server->held_next[bid];
+		if (server->buf_ring)
+			buf_recycle(server, (uint16_t) bid);
+	}
+
+	while (client->tx_head)
+	{
+		modbus_uring_tx_t *tx = client->tx_head;
+		client->tx_head = tx->next;
+		tx_put(server, tx);
+	}
+
+	if (client->prev)
+		client->prev->next = client->next;
+	else
+		server->clients = client->next;
+	if (client->next)
+		client->next->prev = client->prev;
+
+	server->stats.clients--;
+	free(client);
+}
+
+/*
+	Stops receiving. The connection is freed once the kernel
+	no longer uses it (see client_update()).
+*/
+static void client_close(modbus_uring_client_t *client)
+{
+	if (client->closing)
+		return;
+
+	client->closing = 1;
+	client->server->stats.closed++;
+	shutdown(client->fd, SHUT_RDWR);
+	if (client->recv_armed)
+		cancel_recv(client);
+}
+
+/*
+	Re-arms the receive or frees a closed connection. Must be called
+	after each completion, the connection may not be accessed afterwards.
+*/
+static void client_update(modbus_uring_client_t *client)
+{
+	if (client->paused && !client->closing && client->tx_count <= MODBUS_URING_MAX_INFLIGHT / 2)
+	{
+		client->paused = 0;
+		client_drain(client);
+	}
+
+	if (client->closing)
+	{
+		if (!client->recv_armed && !client->inflight && !client->is_dirty)
+			client_free(client);
+		return;
+	}
+
+	if (!client->recv_armed && !client->paused)
+		arm_recv(client);
+}
+
+/*
+	Parses requests from the stream until it needs more data. Stops early
+	when the connection holds too many send buffers and pauses receiving.
+	Returns 1 if the stream is drained, 0 if parsing has been paused or -1 on error.
+*/
+static int client_parse(modbus_uring_client_t *client)
+{
+	modbus_uring_server_t *server = client->server;
+	const uint8_t *frame;
+	uint16_t frame_length;
+
+	while (1)
+	{
+		if (client->tx_count >= MODBUS_URING_MAX_INFLIGHT && !client->closing)
+		{
+			if (!client->paused && client->recv_armed)
+				cancel_recv(client);
+			client->paused = 1;
+			return 0;
+		}
+
+		ModbusError err = modbusTCPStreamNext(&client->stream, &frame, &frame_length);
+		if (err != MODBUS_OK)
+			return -1;
+		if (!frame)
+			return 1;
+
+		server->stats.requests++;
+		if (client_reserve(client))
+			return -1;
+
+		ModbusErrorInfo perr = modbusParseRequestTCP(&client->slave, frame, frame_length);
+		if (!modbusIsOk(perr))
+		{
+			server->stats.errors++;
+			continue;
+		}
+
+		uint16_t response_length = modbusSlaveGetResponseLength(&client->slave);
+		if (!response_length)
+			continue;
+
+		client->tx_tail->length += response_length;
+		server->stats.responses++;
+		client_mark_dirty(client);
+	}
+}
+
+/*
+	Parses the held receive buffers in order. Requests are parsed straight
+	from the buffers - only frames split between them are copied (into the stream).
+	A buffer is given back to the kernel once it's fully parsed.
+*/
+static void client_drain(modbus_uring_client_t *client)
+{
+	modbus_uring_server_t *server = client->server;
+	while (client->held_head >= 0 && !client->closing)
+	{
+		int32_t bid = client->held_head;
+		if (!client->held_fed)
+		{
+			modbusTCPStreamFeed(&client->stream, server->rx + (size_t) bid * MODBUS_URING_RX_SIZE, server->held_length[bid]);
+			client->held_fed = 1;
+		}
+
+		int r = client_parse(client);
+		if (r < 0)
+		{
+			// Invalid MBAP header - the stream cannot be resynchronized
+			client_close(client);
+			return;
+		}
+		if (!r)
+			return;
+
+		client->held_head = server->held_next[bid];
+		if (client->held_head < 0)
+			client->held_tail = -1;
+		client->held_fed = 0;
+		buf_recycle(server, (uint16_t) bid);
+	}
+}
+
+static void client_hold(modbus_uring_client_t *client, uint16_t bid, uint32_t length)
+{
+	modbus_uring_server_t *server = client->server;
+	server->held_next[bid] = -1;
+	server->held_length[bid] = length;
+	if (client->held_tail >= 0)
+		server->held_next[client->held_tail] = bid;
+	else
+		client->held_head = bid;
+	client->held_tail = bid;
+}
+
+/*
+	Submits all filled send buffers of the connection as a chain of linked
+	sends, so they're sent in order.
+*/
+static void client_flush(modbus_uring_client_t *client)
+{
+	modbus_uring_server_t *server = client->server;
+	modbus_uring_tx_t *tx = client->tx_head;
+	client->tx_head = NULL;
+	client->tx_tail = NULL;
+
+	while (tx)
+	{
+		modbus_uring_tx_t *next = tx->next;
+		tx->next = NULL;
+
+		struct io_uring_sqe *sqe = tx->length && !client->closing ? ring_get_sqe(server) : NULL;
+		if (!sqe)
+		{
+			if (tx->length && !client->closing)
+				client_close(client);
+			client->tx_count--;
+			tx_put(server, tx);
+			tx = next;
+			continue;
+		}
+
+		sqe->opcode = IORING_OP_SEND;
+		sqe->fd = client->fd;
+		sqe->addr = (uint64_t)(uintptr_t) tx->data;
+		sqe->len = tx->length;
+		sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+		sqe->user_data = uring_data(tx, URING_TAG_SEND);
+		if (next && next->length)
+			sqe->flags = IOSQE_IO_LINK;
+
+		client->inflight++;
+		tx = next;
+	}
+}
+
+static void on_recv(modbus_uring_client_t *client, const struct io_uring_cqe *cqe)
+{
+	modbus_uring_server_t *server = client->server;
+	server->stats.recv_completions++;
+	if (!(cqe->flags & IORING_CQE_F_MORE))
+		client->recv_armed = 0;
+
+	if (cqe->res > 0 && (cqe->flags & IORING_CQE_F_BUFFER))
+	{
+		uint16_t bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+		if (client->closing)
+			buf_recycle(server, bid);
+		else
+		{
+			client_hold(client, bid, cqe->res);
+			client_drain(client);
+		}
+	}
+	else if (cqe->res == 0 || (cqe->res != -ENOBUFS && cqe->res != -ECANCELED))
+	{
+		// End of stream or an error
+		client_close(client);
+	}
+
+	client_update(client);
+}
+
+static void on_send(modbus_uring_tx_t *tx, const struct io_uring_cqe *cqe)
+{
+	modbus_uring_client_t *client = tx->client;
+	modbus_uring_server_t *server = client->server;
+	server->stats.send_completions++;
+	client->inflight--;
+	client->tx_count--;
+
+	if (cqe->res != (int32_t) tx->length)
+		client_close(client);
+	tx_put(server, tx);
+
+	client_update(client);
+}
+
+static void on_accept(modbus_uring_server_t *server, const struct io_uring_cqe *cqe)
+{
+	if (!(cqe->flags & IORING_CQE_F_MORE))
+		server->accept_armed = 0;
+
+	if (cqe->res >= 0)
+		client_accept(server, cqe->res);
+}
+
+static int ring_reap(modbus_uring_server_t *server)
+{
+	unsigned head = *server->cq_head;
+	unsigned tail = __atomic_load_n(server->cq_tail, __ATOMIC_ACQUIRE);
+	int count = 0;
+
+	for (; head != tail; head++, count++)
+	{
+		const struct io_uring_cqe *cqe = &server->cqes[head & *server->cq_mask];
+		void *owner = uring_owner(cqe->user_data);
+		switch (cqe->user_data & URING_TAG_MASK)
+		{
+			case URING_TAG_ACCEPT:
+				on_accept(owner, cqe);
+				break;
+
+			case URING_TAG_RECV:
+				on_recv(owner, cqe);
+				break;
+
+			case URING_TAG_SEND:
+				on_send(owner, cqe);
+				break;
+
+			default:
+				break;
+		}
+	}
+
+	__atomic_store_n(server->cq_head, head, __ATOMIC_RELEASE);
+	return count;
+}
+
+static void server_flush(modbus_uring_server_t *server)
+{
+	while (server->dirty)
+	{
+		modbus_uring_client_t *client = server->dirty;
+		server->dirty = client->next_dirty;
+		client->is_dirty = 0;
+
+		client_flush(client);
+		client_update(client);
+	}
+}
+
+/*
+	Checks if the running kernel supports everything the server needs
+*/
+int modbus_uring_supported(void)
+{
+	modbus_uring_server_t *server = calloc(1, sizeof(modbus_uring_server_t));
+	if (!server)
+		return 0;
+
+	server->ring_fd = -1;
+	int ok = !ring_init(server) && !buf_ring_init(server);
+
+	if (server->sqes_ptr)
+		munmap(server->sqes_ptr, server->sqes_size);
+	if (server->sq_ptr)
+		munmap(server->sq_ptr, server->sq_size);
+	if (server->buf_ring)
+		munmap(server->buf_ring, server->buf_ring_size);
+	if (server->ring_fd >= 0)
+		close(server->ring_fd);
+	free(server->rx);
+	free(server);
+	return ok;
+}
+
+/*
+	Starts listening on the given address. Fails if io_uring is not
+	supported - modbus_tcp_server_t should be used instead then.
+	The server struct must stay in place until modbus_uring_server_destroy() is called.
+*/
+int modbus_uring_server_init(
+	modbus_uring_server_t *server,
+	const struct sockaddr_in *addr,
+	ModbusRegisterCallback register_callback,
+	ModbusSlaveExceptionCallback exception_callback)
+{
+	memset(server, 0, sizeof(*server));
+	server->ring_fd = -1;
+	server->listen_fd = -1;
+	server->register_callback = register_callback;
+	server->exception_callback = exception_callback;
+
+	if (ring_init(server) || buf_ring_init(server))
+	{
+		modbus_uring_server_destroy(server);
+		return -1;
+	}
+
+	server->listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	int one = 1;
+	if (server->listen_fd < 0
+		|| setsockopt(server->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one))
+		|| bind(server->listen_fd, (const struct sockaddr*) addr, sizeof(*addr))
+		|| listen(server->listen_fd, SOMAXCONN))
+	{
+		modbus_uring_server_destroy(server);
+		return -1;
+	}
+
+	arm_accept(server);
+	return 0;
+}
+
+/*
+	Closes all connections and waits (up to a second) until
+	the kernel is done with them before tearing down the ring.
+*/
+void modbus_uring_server_destroy(modbus_uring_server_t *server)
+{
+	server->stopping = 1;
+	if (server->sq_ptr)
+	{
+		if (server->accept_armed)
+			ring_cancel(server, uring_data(server, URING_TAG_ACCEPT));
+
+		for (modbus_uring_client_t *client = server->clients; client; client = client->next)
+			client_close(client);
+
+		for (int i = 0; i < 100 && (server->clients || server->accept_armed); i++)
+			modbus_uring_server_poll(server, 10);
+	}
+
+	if (server->sqes_ptr)
+		munmap(server->sqes_ptr, server->sqes_size);
+	if (server->sq_ptr)
+		munmap(server->sq_ptr, server->sq_size);
+	if (server->ring_fd >= 0)
+		close(server->ring_fd);
+	if (server->listen_fd >= 0)
+		close(server->listen_fd);
+
+	// Connections still alive give their held buffers back to the
+	// buffer ring, so it has to be unmapped only afterwards
+	while (server->clients)
+	{
+		server->clients->is_dirty = 0;
+		client_free(server->clients);
+	}
+
+	if (server->buf_ring)
+		munmap(server->buf_ring, server->buf_ring_size);
+
+	while (server->tx_free)
+	{
+		modbus_uring_tx_t *tx = server->tx_free;
+		server->tx_free = tx->next;
+		free(tx);
+	}
+
+	free(server->rx);
+	server->sq_ptr = NULL;
+	server->sqes_ptr = NULL;
+	server->buf_ring = NULL;
+	server->rx = NULL;
+	server->ring_fd = -1;
+	server->listen_fd = -1;
+}
+
+/*
+	Submits queued requests, waits for completions and dispatches them.
+	Responses are submitted with the next call, so each iteration of the
+	server loop takes a single system call.
+	Returns number of processed completions or -1 on error.
+*/
+int modbus_uring_server_poll(modbus_uring_server_t *server, int timeout_ms)
+{
+	if (!server->accept_armed && !server->stopping)
+		arm_accept(server);
+
+	if (ring_enter(server, 1, timeout_ms) < 0)
+		return -1;
+
+	int count = ring_reap(server);
+	server_flush(server);
+	return count;
+}
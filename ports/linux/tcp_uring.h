@@ -0,0 +1,153 @@
+#ifndef _TCP_URING_H
+#define _TCP_URING_H
+
+#include "modbus_port.h"
+#include <netinet/in.h>
+#include <linux/io_uring.h>
+
+/*
+	Number of submission queue entries. The completion queue is four times larger,
+	because multishot receives produce many completions per submission.
+*/
+#ifndef MODBUS_URING_ENTRIES
+#define MODBUS_URING_ENTRIES 1024
+#endif
+
+/*
+	Number and size of receive buffers provided to the kernel. They are shared
+	by all connections and returned to the ring as soon as they are parsed.
+	The number must be a power of two.
+*/
+#ifndef MODBUS_URING_RX_BUFFERS
+#define MODBUS_URING_RX_BUFFERS 512
+#endif
+
+#ifndef MODBUS_URING_RX_SIZE
+#define MODBUS_URING_RX_SIZE 4096
+#endif
+
+/*
+	Size of a send buffer. Responses are appended to the current send buffer of
+	the connection until it's submitted.
+*/
+#ifndef MODBUS_URING_TX_SIZE
+#define MODBUS_URING_TX_SIZE 8192
+#endif
+
+/*
+	Maximum number of send buffers per connection. When a client doesn't read
+	its responses, parsing stops and receiving is paused until half of them are sent.
+	Receive buffers which arrive in the meantime are held by the connection.
+*/
+#ifndef MODBUS_URING_MAX_INFLIGHT
+#define MODBUS_URING_MAX_INFLIGHT 8
+#endif
+
+typedef struct modbus_uring_server modbus_uring_server_t;
+typedef struct modbus_uring_client modbus_uring_client_t;
+typedef struct modbus_uring_tx modbus_uring_tx_t;
+
+typedef struct
+{
+	uint64_t requests;
+	uint64_t responses;
+	uint64_t errors;      // Requests which could not be parsed
+	uint64_t enter_calls; // io_uring_enter() system calls
+	uint64_t recv_completions;
+	uint64_t send_completions;
+	uint32_t accepted;
+	uint32_t closed;
+	uint32_t clients;     // Currently open connections
+} modbus_uring_stats_t;
+
+struct modbus_uring_tx
+{
+	modbus_uring_client_t *client;
+	modbus_uring_tx_t *next;
+	uint32_t length;
+	uint8_t data[MODBUS_URING_TX_SIZE];
+};
+
+struct modbus_uring_client
+{
+	modbus_uring_server_t *server;
+	int fd;
+	ModbusSlave slave;
+	ModbusTCPStream stream;
+
+	modbus_uring_tx_t *tx_head;   // Send buffers not submitted yet
+	modbus_uring_tx_t *tx_tail;   // Send buffer responses are appended to
+	uint16_t tx_count;            // Send buffers owned by the connection
+	uint16_t inflight;            // Send buffers submitted, but not completed
+	uint8_t recv_armed;           // Multishot receive is active
+	uint8_t paused;               // Receiving is paused until responses are sent
+	uint8_t closing;
+
+	int32_t held_head;            // Receive buffers waiting to be parsed (-1 if none)
+	int32_t held_tail;
+	uint8_t held_fed;             // The first held buffer has been fed to the stream
+
+	modbus_uring_client_t *next_dirty;
+	uint8_t is_dirty;
+	modbus_uring_client_t *prev;
+	modbus_uring_client_t *next;
+};
+
+struct modbus_uring_server
+{
+	int ring_fd;
+	int listen_fd;
+	uint8_t accept_armed;
+	uint8_t stopping;
+
+	// Submission and completion queues mapped from the kernel
+	void *sq_ptr;
+	void *cq_ptr;
+	void *sqes_ptr;
+	size_t sq_size;
+	size_t cq_size;
+	size_t sqes_size;
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned *sq_mask;
+	unsigned *sq_array;
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	unsigned sq_entries;
+	unsigned sq_local_tail;
+
+	// Provided receive buffers
+	struct io_uring_buf_ring *buf_ring;
+	size_t buf_ring_size;
+	uint8_t *rx;
+	int32_t held_next[MODBUS_URING_RX_BUFFERS];  // Held buffer queues
+	uint32_t held_length[MODBUS_URING_RX_BUFFERS];
+
+	ModbusRegisterCallback register_callback;
+	ModbusSlaveExceptionCallback exception_callback;
+	modbus_uring_tx_t *tx_free;
+	modbus_uring_client_t *dirty;
+	modbus_uring_client_t *clients;
+
+	modbus_uring_stats_t stats;
+	void *context;
+};
+
+int modbus_uring_supported(void);
+int modbus_uring_server_init(
+	modbus_uring_server_t *server,
+	const struct sockaddr_in *addr,
+	ModbusRegisterCallback register_callback,
+	ModbusSlaveExceptionCallback exception_callback);
+void modbus_uring_server_destroy(modbus_uring_server_t *server);
+int modbus_uring_server_poll(modbus_uring_server_t *server, int timeout_ms);
+
+static inline modbus_uring_client_t *modbus_uring_client_from_slave(const ModbusSlave *slave)
+{
+	return (modbus_uring_client_t*) modbusSlaveGetUserPointer(slave);
+}
+
+#endif
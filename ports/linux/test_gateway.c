@@ -0,0 +1,680 @@
+/*
+	Test harness of the TCP to RTU gateway.
+
+	Serial lines are pseudo-terminal pairs - the gateway opens the slave
+	side like a serial port, and a thread on the master side simulates
+	a number of RTU slaves sharing the line. The gateway runs in its own
+	thread and is tested over TCP with blocking sockets.
+
+	Usage: ./test_gateway [port]
+*/
+#define _GNU_SOURCE
+#include "gateway.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#define SIM_REGISTERS 16
+#define SIM_COILS 64
+
+/*
+	Simulated multi-drop line with slaves at addresses first-last.
+	Holding register i of slave a initially holds a * 100 + i.
+	Coils are read-only, every third one is set.
+*/
+typedef struct
+{
+	int fd;
+	char path[64];
+	uint8_t first;
+	uint8_t last;
+	int delay_ms; // Response delay, changed by the tests
+	uint16_t registers[256][SIM_REGISTERS];
+	uint8_t current; // Address the request is parsed for
+	int requests;    // Requests received
+	pthread_t thread;
+} sim_line_t;
+
+static int running = 1;
+static int failures = 0;
+static struct sockaddr_in gateway_addr;
+
+static ModbusError sim_register_callback(
+	const ModbusSlave *slave,
+	const ModbusRegisterCallbackArgs *args,
+	ModbusRegisterCallbackResult *result)
+{
+	sim_line_t *sim = modbusSlaveGetUserPointer(slave);
+	if (args->type == MODBUS_COIL && args->index < SIM_COILS && args->query != MODBUS_REGQ_W_CHECK)
+	{
+		result->exceptionCode = MODBUS_EXCEP_NONE;
+		result->value = args->index % 3 == 0;
+		return MODBUS_OK;
+	}
+
+	if (args->type != MODBUS_HOLDING_REGISTER || args->index >= SIM_REGISTERS)
+	{
+		result->exceptionCode = MODBUS_EXCEP_ILLEGAL_ADDRESS;
+		return MODBUS_OK;
+	}
+
+	result->exceptionCode = MODBUS_EXCEP_NONE;
+	if (args->query == MODBUS_REGQ_R)
+		result->value = sim->registers[sim->current][args->index];
+	else if (args->query == MODBUS_REGQ_W)
+		sim->registers[sim->current][args->index] = args->value;
+	return MODBUS_OK;
+}
+
+static void *sim_thread(void *arg)
+{
+	sim_line_t *sim = arg;
+	ModbusSlave slave;
+	ModbusRTUStream stream;
+	modbusRTUStreamInit(&stream, MODBUS_RTU_STREAM_REQUESTS);
+	if (!modbusIsOk(modbusSlaveInit(&slave, sim_register_callback, NULL, modbusDefaultAllocator,
+		modbusSlaveDefaultFunctions, modbusSlaveDefaultFunctionCount)))
+		return NULL;
+	modbusSlaveSetUserPointer(&slave, sim);
+
+	uint8_t rx[256];
+	while (__atomic_load_n(&running, __ATOMIC_RELAXED))
+	{
+		struct pollfd pfd = {.fd = sim->fd, .events = POLLIN};
+		if (poll(&pfd, 1, 20) <= 0)
+			continue;
+
+		ssize_t n = read(sim->fd, rx, sizeof(rx));
+		if (n <= 0)
+			continue;
+
+		modbusRTUStreamFeed(&stream, rx, n);
+		const uint8_t *frame;
+		uint16_t length;
+		while (modbusRTUStreamNext(&stream, &frame, &length))
+		{
+			uint8_t address = frame[0];
+			if (address && (address < sim->first || address > sim->last))
+				continue;
+
+			__atomic_add_fetch(&sim->requests, 1, __ATOMIC_RELAXED);
+
+			// Broadcasts are applied to the first slave only
+			sim->current = address ? address : sim->first;
+			if (!modbusIsOk(modbusParseRequestRTU(&slave, sim->current, frame, length)))
+				continue;
+
+			uint16_t response_length = modbusSlaveGetResponseLength(&slave);
+			if (!response_length)
+				continue;
+
+			int delay = __atomic_load_n(&sim->delay_ms, __ATOMIC_RELAXED);
+			if (delay)
+				usleep(delay * 1000);
+			if (write(sim->fd, modbusSlaveGetResponse(&slave), response_length) != response_length)
+				perror("sim write");
+		}
+	}
+
+	modbusSlaveDestroy(&slave);
+	return NULL;
+}
+
+static int sim_open(sim_line_t *sim, uint8_t first, uint8_t last)
+{
+	memset(sim, 0, sizeof(*sim));
+	sim->first = first;
+	sim->last = last;
+	for (int a = 0; a < 256; a++)
+		for (int i = 0; i < SIM_REGISTERS; i++)
+			sim->registers[a][i] = a * 100 + i;
+
+	sim->fd = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+	if (sim->fd < 0 || grantpt(sim->fd) || unlockpt(sim->fd) || ptsname_r(sim->fd, sim->path, sizeof(sim->path)))
+		return -1;
+
+	struct termios tio;
+	tcgetattr(sim->fd, &tio);
+	cfmakeraw(&tio);
+	tcsetattr(sim->fd, TCSANOW, &tio);
+	return pthread_create(&sim->thread, NULL, sim_thread, sim) ? -1 : 0;
+}
+
+static void *gateway_thread(void *arg)
+{
+	modbus_gateway_t *gateway = arg;
+	while (__atomic_load_n(&running, __ATOMIC_RELAXED))
+		modbus_gateway_poll(gateway, 20);
+	return NULL;
+}
+
+static int client_connect(void)
+{
+	int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	struct timeval tv = {.tv_sec = 2};
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	if (connect(fd, (struct sockaddr*) &gateway_addr, sizeof(gateway_addr)))
+	{
+		perror("connect");
+		exit(EXIT_FAILURE);
+	}
+	return fd;
+}
+
+static void send_frame(int fd, const uint8_t *frame, size_t length)
+{
+	if (send(fd, frame, length, MSG_NOSIGNAL) != (ssize_t) length)
+		perror("send");
+}
+
+/*
+	Builds a MBAP frame from transaction ID, unit ID and PDU
+*/
+static size_t build_frame(uint8_t *frame, uint16_t tid, uint8_t unit, const uint8_t *pdu, uint8_t pdu_length)
+{
+	modbusWBE(&frame[0], tid);
+	modbusWBE(&frame[2], 0);
+	modbusWBE(&frame[4], pdu_length + 1);
+	frame[6] = unit;
+	memcpy(&frame[7], pdu, pdu_length);
+	return pdu_length + 7;
+}
+
+static void send_read_function(int fd, uint16_t tid, uint8_t unit, uint8_t function, uint16_t index, uint16_t count)
+{
+	uint8_t pdu[5] = {function}, frame[16];
+	modbusWBE(&pdu[1], index);
+	modbusWBE(&pdu[3], count);
+	send_frame(fd, frame, build_frame(frame, tid, unit, pdu, sizeof(pdu)));
+}
+
+static void send_read(int fd, uint16_t tid, uint8_t unit, uint16_t index, uint16_t count)
+{
+	send_read_function(fd, tid, unit, 3, index, count);
+}
+
+/*
+	Receives a whole frame. Returns its length or 0 on timeout.
+*/
+static size_t recv_frame(int fd, uint8_t *frame)
+{
+	size_t length = 0, expected = 6;
+	while (length < expected)
+	{
+		ssize_t n = recv(fd, frame + length, expected - length, 0);
+		if (n <= 0)
+			return 0;
+		length += n;
+		if (length == 6)
+			expected = 6 + modbusRBE(&frame[4]);
+	}
+	return length;
+}
+
+#define check(expr) do { if (!(expr)) { printf("  %s:%d: %s failed\n", __FILE__, __LINE__, #expr); return 1; } } while (0)
+
+/*
+	Checks that the frame is an exception response with the given code
+*/
+static int check_exception(const uint8_t *frame, size_t length, uint16_t tid, uint8_t unit, uint8_t function, uint8_t code)
+{
+	check(length == 9);
+	check(modbusRBE(&frame[0]) == tid);
+	check(frame[6] == unit);
+	check(frame[7] == (function | 0x80));
+	check(frame[8] == code);
+	return 0;
+}
+
+static sim_line_t sim_a, sim_b;
+static modbus_gateway_line_t line_a, line_b;
+
+static int test_read(void)
+{
+	uint8_t frame[MODBUS_TCP_ADU_MAX];
+	int fd = client_connect();
+	send_read(fd, 0x1234, 5, 2, 3);
+	size_t length = recv_frame(fd, frame);
+	close(fd);
+
+	check(length == 6 + 3 + 6);
+	check(modbusRBE(&frame[0]) == 0x1234);
+	check(frame[6] == 5 && frame[7] == 3 && frame[8] == 6);
+	check(modbusRBE(&frame[9]) == 502 && modbusRBE(&frame[11]) == 503 && modbusRBE(&frame[13]) == 504);
+	return 0;
+}
+
+static int test_second_line(void)
+{
+	uint8_t frame[MODBUS_TCP_ADU_MAX];
+	int fd = client_connect();
+	send_read(fd, 7, 25, 0, 1);
+	size_t length = recv_frame(fd, frame);
+	close(fd);
+
+	check(length == 11);
+	check(frame[6] == 25 && modbusRBE(&frame[9]) == 2500);
+	return 0;
+}
+
+static int test_write(void)
+{
+	uint8_t frame[MODBUS_TCP_ADU_MAX];
+	uint8_t pdu[] = {16, 0, 4, 0, 2, 4, 0xab, 0xcd, 0x12, 0x34};
+	int fd = client_connect();
+	send_frame(fd, frame, build_frame(frame, 1, 3, pdu, sizeof(pdu)));
+	size_t length = recv_frame(fd, frame);
+	check(length == 12 && frame[7] == 16);
+
+	send_read(fd, 2, 3, 4, 2);
+	length = recv_frame(fd, frame);
+	close(fd);
+	check(length == 13);
+	check(modbusRBE(&frame[9]) == 0xabcd && modbusRBE(&frame[11]) == 0x1234);
+	return 0;
+}
+
+static int test_slave_exception(void)
+{
+	uint8_t frame[MODBUS_TCP_ADU_MAX];
+	int fd = client_connect();
+	send_read(fd, 9, 5, SIM_REGISTERS, 1);
+	size_t length = recv_frame(fd, frame);
+	close(fd);
+	return check_exception(frame, length, 9, 5, 3, MODBUS_EXCEP_ILLEGAL_ADDRESS);
+}
+
+static int test_unrouted(void)
+{
+	uint8_t frame[MODBUS_TCP_ADU_MAX];
+	int fd = client_connect();
+	send_read(fd, 10, 50, 0, 1);
+	size_t length = recv_frame(fd, frame);
+	close(fd);
+	return check_exception(frame, length, 10, 50, 3, MODBUS_EXCEP_GATEWAY_PATH);
+}
+
+static int test_unsupported(void)
+{
+	uint8_t frame[MODBUS_TCP_ADU_MAX];
+	uint8_t pdu[] = {0x2b, 0x0e, 0x01, 0x00};
+	int fd = client_connect();
+	send_frame(fd, frame, build_frame(frame, 11, 5, pdu, sizeof(pdu)));
+	size_t length = recv_frame(fd, frame);
+	int r = check_exception(frame, length, 11, 5, 0x2b, MODBUS_EXCEP_ILLEGAL_FUNCTION);
+
+	// FC03 with a trailing byte
+	uint8_t bad[] = {3, 0, 0, 0, 1, 0};
+	send_frame(fd, frame, build_frame(frame, 12, 5, bad, sizeof(bad)));
+	length = recv_frame(fd, frame);
+	close(fd);
+	return r || check_exception(frame, length, 12, 5, 3, MODBUS_EXCEP_ILLEGAL_VALUE);
+}
+
+static int test_timeout(void)
+{
+	uint8_t frame[MODBUS_TCP_ADU_MAX];
+	int fd = client_connect();
+	send_read(fd, 13, 15, 0, 1);
+	size_t length = recv_frame(fd, frame);
+	close(fd);
+	check(line_a.stats.timeouts == 1);
+	return check_exception(frame, length, 13, 15, 3, MODBUS_EXCEP_GATEWAY_TARGET);
+}
+
+/*
+	A slow slave on one line doesn't hold up requests to the other one
+*/
+static int test_parallel(void)
+{
+	uint8_t frame[MODBUS_TCP_ADU_MAX];
+	int fd = client_connect();
+	__atomic_store_n(&sim_a.delay_ms, 300, __ATOMIC_RELAXED);
+	uint32_t start = modbus_now_ms();
+	send_read(fd, 100, 7, 0, 1);
+	send_read(fd, 200, 21, 0, 1);
+
+	size_t length = recv_frame(fd, frame);
+	uint32_t first = modbus_now_ms() - start;
+	check(length == 11 && modbusRBE(&frame[0]) == 200 && modbusRBE(&frame[9]) == 2100);
+	check(first < 200);
+
+	length = recv_frame(fd, frame);
+	__atomic_store_n(&sim_a.delay_ms, 0, __ATOMIC_RELAXED);
+	close(fd);
+	check(length == 11 && modbusRBE(&frame[0]) == 100 && modbusRBE(&frame[9]) == 700);
+	return 0;
+}
+
+/*
+	Requests over the queue capacity are rejected with exception 06
+*/
+static int test_queue_full(void)
+{
+	uint8_t frame[MODBUS_TCP_ADU_MAX];
+	int fd = client_connect();
+	__atomic_store_n(&sim_a.delay_ms, 50, __ATOMIC_RELAXED);
+	for (int i = 0; i < 7; i++)
+		send_read(fd, 300 + i, 1, i, 1);
+
+	int ok = 0, busy = 0;
+	for (int i = 0; i < 7; i++)
+	{
+		size_t length = recv_frame(fd, frame);
+		uint16_t tid = modbusRBE(&frame[0]);
+		if (length == 11 && modbusRBE(&frame[9]) == 100 + (tid - 300))
+			ok++;
+		else if (!check_exception(frame, length, tid, 1, 3, MODBUS_EXCEP_SLAVE_BUSY))
+			busy++;
+	}
+
+	__atomic_store_n(&sim_a.delay_ms, 0, __ATOMIC_RELAXED);
+	close(fd);
+	check(ok == 4 && busy == 3);
+	check(line_a.stats.rejected == 3);
+	return 0;
+}
+
+/*
+	Requests of a client that has disconnected are dropped
+*/
+static int test_disconnect(void)
+{
+	uint8_t frame[MODBUS_TCP_ADU_MAX];
+	int fd = client_connect();
+	__atomic_store_n(&sim_a.delay_ms, 50, __ATOMIC_RELAXED);
+	for (int i = 0; i < 4; i++)
+		send_read(fd, i, 2, 0, 1);
+	usleep(20000);
+	close(fd);
+	usleep(100000);
+	__atomic_store_n(&sim_a.delay_ms, 0, __ATOMIC_RELAXED);
+
+	fd = client_connect();
+	send_read(fd, 400, 2, 1, 1);
+	size_t length = recv_frame(fd, frame);
+	close(fd);
+	check(length == 11 && modbusRBE(&frame[0]) == 400 && modbusRBE(&frame[9]) == 201);
+	return 0;
+}
+
+/*
+	Repeated reads of unit 9 are served from the cache until a write
+*/
+static ModbusCacheRange cache_ranges[] = {{9, 3, 0, SIM_REGISTERS, 60000}};
+static ModbusCacheEntry cache_entries[4];
+static ModbusResponseCache cache;
+
+static int test_cache(void)
+{
+	uint8_t frame[MODBUS_TCP_ADU_MAX];
+	int fd = client_connect();
+	int requests = __atomic_load_n(&sim_a.requests, __ATOMIC_RELAXED);
+	send_read(fd, 600, 9, 0, 2);
+	size_t length = recv_frame(fd, frame);
+	check(length == 13 && modbusRBE(&frame[9]) == 900);
+
+	send_read(fd, 601, 9, 0, 2);
+	length = recv_frame(fd, frame);
+	check(length == 13 && modbusRBE(&frame[0]) == 601 && modbusRBE(&frame[11]) == 901);
+	check(__atomic_load_n(&sim_a.requests, __ATOMIC_RELAXED) == requests + 1);
+
+	uint8_t pdu[] = {6, 0, 1, 0x12, 0x34};
+	send_frame(fd, frame, build_frame(frame, 602, 9, pdu, sizeof(pdu)));
+	length = recv_frame(fd, frame);
+	check(length == 12);
+
+	send_read(fd, 603, 9, 0, 2);
+	length = recv_frame(fd, frame);
+	close(fd);
+	check(length == 13 && modbusRBE(&frame[0]) == 603 && modbusRBE(&frame[11]) == 0x1234);
+	check(__atomic_load_n(&sim_a.requests, __ATOMIC_RELAXED) == requests + 3);
+	check(cache.hits == 1 && cache.misses == 2);
+	return 0;
+}
+
+/*
+	A read in flight when a write to the same slave is queued isn't cached,
+	so a read sent after the write can't get the values from before it
+*/
+static int test_cache_write_queued(void)
+{
+	uint8_t frame[MODBUS_TCP_ADU_MAX];
+	int fd_a = client_connect();
+	int fd_b = client_connect();
+	__atomic_store_n(&sim_a.delay_ms, 100, __ATOMIC_RELAXED);
+	int requests = __atomic_load_n(&sim_a.requests, __ATOMIC_RELAXED);
+
+	// B's read in flight, A's write queued behind it
+	send_read(fd_b, 610, 9, 0, 10);
+	usleep(20000);
+	uint8_t pdu[] = {6, 0, 5, 0x55, 0x55};
+	send_frame(fd_a, frame, build_frame(frame, 611, 9, pdu, sizeof(pdu)));
+
+	size_t length = recv_frame(fd_b, frame);
+	check(length == 29 && modbusRBE(&frame[0]) == 610 && modbusRBE(&frame[19]) == 905);
+
+	// A's read right after B's one completes, with the write still in flight
+	send_read(fd_a, 612, 9, 0, 10);
+	length = recv_frame(fd_a, frame);
+	check(length == 12 && modbusRBE(&frame[0]) == 611);
+	length = recv_frame(fd_a, frame);
+	check(length == 29 && modbusRBE(&frame[0]) == 612 && modbusRBE(&frame[19]) == 0x5555);
+
+	__atomic_store_n(&sim_a.delay_ms, 0, __ATOMIC_RELAXED);
+	close(fd_a);
+	close(fd_b);
+	check(__atomic_load_n(&sim_a.requests, __ATOMIC_RELAXED) == requests + 3);
+	return 0;
+}
+
+/*
+	Checks that the frame is a response to a read of `count` registers of
+	slave 22 starting at `index`
+*/
+static int check_registers(const uint8_t *frame, size_t length, uint16_t tid, uint16_t index, uint16_t count)
+{
+	check(length == 9 + count * 2u);
+	check(modbusRBE(&frame[0]) == tid && frame[6] == 22 && frame[7] == 3 && frame[8] == count * 2);
+	for (uint16_t i = 0; i < count; i++)
+		check(modbusRBE(&frame[9 + i * 2]) == 2200 + index + i);
+	return 0;
+}
+
+/*
+	Overlapping reads of different clients are sent as one (line B merges reads)
+*/
+static int test_merge(void)
+{
+	uint8_t frame[MODBUS_TCP_ADU_MAX];
+	int fd[4];
+	for (int i = 0; i < 4; i++)
+		fd[i] = client_connect();
+
+	__atomic_store_n(&sim_b.delay_ms, 100, __ATOMIC_RELAXED);
+	int requests = __atomic_load_n(&sim_b.requests, __ATOMIC_RELAXED);
+	uint64_t merged = line_b.stats.merged;
+
+	// 0-5 in flight, 4-9 can't be added to it, so it's queued,
+	// 10-11 widens the queued read to 4-11 and 1-2 is covered by the one in flight
+	send_read(fd[0], 700, 22, 0, 6);
+	usleep(20000);
+	send_read(fd[1], 701, 22, 4, 6);
+	usleep(5000);
+	send_read(fd[2], 702, 22, 10, 2);
+	usleep(5000);
+	send_read(fd[3], 703, 22, 1, 2);
+
+	int r = 0;
+	size_t length = recv_frame(fd[0], frame);
+	r |= check_registers(frame, length, 700, 0, 6);
+	length = recv_frame(fd[3], frame);
+	r |= check_registers(frame, length, 703, 1, 2);
+	length = recv_frame(fd[1], frame);
+	r |= check_registers(frame, length, 701, 4, 6);
+	length = recv_frame(fd[2], frame);
+	r |= check_registers(frame, length, 702, 10, 2);
+	check(!r);
+	check(__atomic_load_n(&sim_b.requests, __ATOMIC_RELAXED) == requests + 2);
+
+	// Coils are carved out bit by bit
+	send_read_function(fd[0], 710, 23, 1, 40, 1);
+	usleep(20000);
+	send_read_function(fd[1], 711, 23, 1, 3, 10);
+	usleep(5000);
+	send_read_function(fd[2], 712, 23, 1, 9, 12);
+	recv_frame(fd[0], frame);
+	length = recv_frame(fd[1], frame);
+	check(length == 11 && modbusRBE(&frame[0]) == 711 && frame[8] == 2);
+	for (int i = 0; i < 10; i++)
+		check(modbusMaskRead(&frame[9], i) == ((3 + i) % 3 == 0));
+	length = recv_frame(fd[2], frame);
+	check(length == 11 && modbusRBE(&frame[0]) == 712 && frame[8] == 2);
+	for (int i = 0; i < 12; i++)
+		check(modbusMaskRead(&frame[9], i) == ((9 + i) % 3 == 0));
+
+	__atomic_store_n(&sim_b.delay_ms, 0, __ATOMIC_RELAXED);
+	for (int i = 0; i < 4; i++)
+		close(fd[i]);
+	check(__atomic_load_n(&sim_b.requests, __ATOMIC_RELAXED) == requests + 4);
+	check(line_b.stats.merged == merged + 3);
+	return 0;
+}
+
+/*
+	An exception to a merged read isn't passed to clients whose own
+	reads are valid - their reads are re-sent one by one
+*/
+static int test_merge_exception(void)
+{
+	uint8_t frame[MODBUS_TCP_ADU_MAX];
+	int fd[4];
+	for (int i = 0; i < 4; i++)
+		fd[i] = client_connect();
+
+	__atomic_store_n(&sim_b.delay_ms, 100, __ATOMIC_RELAXED);
+	int requests = __atomic_load_n(&sim_b.requests, __ATOMIC_RELAXED);
+	uint64_t merged = line_b.stats.merged;
+	uint64_t split = line_b.stats.split;
+
+	// 0-5 in flight, 4-9 queued, 10-19 (past the last register) widens it
+	// to 4-19 and 12-15 is covered by it
+	send_read(fd[0], 720, 22, 0, 6);
+	usleep(20000);
+	send_read(fd[1], 721, 22, 4, 6);
+	usleep(5000);
+	send_read(fd[2], 722, 22, 10, SIM_REGISTERS - 6);
+	usleep(5000);
+	send_read(fd[3], 723, 22, 12, 4);
+
+	int r = 0;
+	size_t length = recv_frame(fd[0], frame);
+	r |= check_registers(frame, length, 720, 0, 6);
+	length = recv_frame(fd[1], frame);
+	r |= check_registers(frame, length, 721, 4, 6);
+	length = recv_frame(fd[2], frame);
+	r |= check_exception(frame, length, 722, 22, 3, MODBUS_EXCEP_ILLEGAL_ADDRESS);
+	length = recv_frame(fd[3], frame);
+	r |= check_registers(frame, length, 723, 12, 4);
+	check(!r);
+
+	__atomic_store_n(&sim_b.delay_ms, 0, __ATOMIC_RELAXED);
+	for (int i = 0; i < 4; i++)
+		close(fd[i]);
+	check(__atomic_load_n(&sim_b.requests, __ATOMIC_RELAXED) == requests + 5);
+	check(line_b.stats.merged == merged + 2);
+	check(line_b.stats.split == split + 1);
+	return 0;
+}
+
+static int test_broadcast(void)
+{
+	uint8_t frame[MODBUS_TCP_ADU_MAX];
+	uint8_t pdu[] = {6, 0, 9, 0x55, 0xaa};
+	int fd = client_connect();
+	send_frame(fd, frame, build_frame(frame, 500, 0, pdu, sizeof(pdu)));
+
+	// No response to a broadcast, so the next response is for the read
+	send_read(fd, 501, 1, 9, 1);
+	size_t length = recv_frame(fd, frame);
+	close(fd);
+	check(length == 11 && modbusRBE(&frame[0]) == 501 && modbusRBE(&frame[9]) == 0x55aa);
+	return 0;
+}
+
+static void run(const char *name, int (*test)(void))
+{
+	int r = test();
+	printf("[GW] %s: %s\n", name, r ? "FAILED" : "OK");
+	failures += r;
+}
+
+int main(int argc, char **argv)
+{
+	int port = argc > 1 ? atoi(argv[1]) : 15024;
+	gateway_addr.sin_family = AF_INET;
+	gateway_addr.sin_port = htons(port);
+	gateway_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	modbus_gateway_t gateway;
+	if (sim_open(&sim_a, 1, 10) || sim_open(&sim_b, 20, 30) || modbus_gateway_init(&gateway, &gateway_addr))
+	{
+		perror("setup");
+		return EXIT_FAILURE;
+	}
+
+	// Units 1-19 and 0 (broadcast) on line A, only 1-10 exist
+	if (modbus_gateway_add_line(&gateway, &line_a, modbus_serial_open(sim_a.path, 115200, 'E'), 115200, 4)
+		|| modbus_gateway_add_line(&gateway, &line_b, modbus_serial_open(sim_b.path, 19200, 'E'), 19200, 4)
+		|| modbus_gateway_route(&gateway, 0, 19, &line_a)
+		|| modbus_gateway_route(&gateway, 20, 30, &line_b))
+	{
+		perror("line");
+		return EXIT_FAILURE;
+	}
+	line_a.response_timeout_ms = 500;
+	line_b.merge_reads = 1;
+
+	if (!modbusIsOk(modbusResponseCacheInit(&cache, cache_ranges, 1, cache_entries, 4)))
+		return EXIT_FAILURE;
+	gateway.cache = &cache;
+
+	pthread_t gateway_tid;
+	pthread_create(&gateway_tid, NULL, gateway_thread, &gateway);
+
+	run("Read over a line", test_read);
+	run("Read over another line", test_second_line);
+	run("Write and read back", test_write);
+	run("Exception from a slave", test_slave_exception);
+	run("Unrouted unit ID", test_unrouted);
+	run("Unsupported and malformed requests", test_unsupported);
+	run("Response timeout", test_timeout);
+	run("Lines work in parallel", test_parallel);
+	run("Queue full", test_queue_full);
+	run("Client disconnects with queued requests", test_disconnect);
+	run("Read cache", test_cache);
+	run("Read cache with a write queued", test_cache_write_queued);
+	run("Merged reads", test_merge);
+	run("Exception to a merged read", test_merge_exception);
+	run("Broadcast", test_broadcast);
+
+	__atomic_store_n(&running, 0, __ATOMIC_RELAXED);
+	pthread_join(gateway_tid, NULL);
+	pthread_join(sim_a.thread, NULL);
+	pthread_join(sim_b.thread, NULL);
+	modbus_gateway_destroy(&gateway);
+	close(sim_a.fd);
+	close(sim_b.fd);
+
+	printf("%s\n", failures ? "FAILED" : "All gateway tests passed");
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
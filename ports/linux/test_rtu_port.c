@@ -0,0 +1,323 @@
+/*
+	Test harness of the RTU serial port transport.
+
+	Each serial line is a pseudo-terminal pair. The slave side is opened
+	like a serial port and served by a Modbus slave, the master side is
+	driven by a Modbus master. All ports of both sides run in a single
+	epoll loop in the main thread.
+
+	Usage: ./test_rtu_port [ports]
+*/
+#define _GNU_SOURCE
+#include "rtu_port.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+
+#define MAX_LINES 64
+#define READS_PER_LINE 20
+
+/*
+	A pseudo-terminal pair with a master port and a slave port.
+	Holding register i of the slave on line n holds n * 100 + i.
+*/
+typedef struct
+{
+	int number;
+	modbus_rtu_port_t master_port;
+	modbus_rtu_port_t slave_port;
+	ModbusMaster master;
+	uint16_t index;    // First register of the pending read
+	int reads;         // Reads completed
+	int bad_values;
+} test_line_t;
+
+static int epoll_fd;
+static int line_count;
+static test_line_t lines[MAX_LINES];
+static ModbusSlave slave;
+static int failures = 0;
+
+static ModbusError register_callback(
+	const ModbusSlave *s,
+	const ModbusRegisterCallbackArgs *args,
+	ModbusRegisterCallbackResult *result)
+{
+	const test_line_t *line = modbusSlaveGetUserPointer(s);
+	result->exceptionCode = MODBUS_EXCEP_NONE;
+	if (args->query == MODBUS_REGQ_R)
+		result->value = line->number * 100 + args->index;
+	return MODBUS_OK;
+}
+
+static ModbusError data_callback(const ModbusMaster *master, const ModbusDataCallbackArgs *args)
+{
+	test_line_t *line = modbusMasterGetUserPointer(master);
+	if (args->value != line->number * 100 + args->index)
+		line->bad_values++;
+	return MODBUS_OK;
+}
+
+static void slave_on_frame(modbus_rtu_port_t *port, const uint8_t *frame, uint16_t length)
+{
+	modbusSlaveSetUserPointer(&slave, port->context);
+	if (!modbusIsOk(modbusParseRequestRTU(&slave, 1, frame, length)))
+		return;
+
+	uint16_t response_length = modbusSlaveGetResponseLength(&slave);
+	if (response_length)
+		modbus_rtu_port_send(port, modbusSlaveGetResponse(&slave), response_length);
+}
+
+static void send_read(test_line_t *line)
+{
+	line->index = line->reads % 10;
+	if (modbusIsOk(modbusBuildRequest03RTU(&line->master, 1, line->index, 4)))
+		modbus_rtu_port_send(
+			&line->master_port,
+			modbusMasterGetRequest(&line->master),
+			modbusMasterGetRequestLength(&line->master));
+}
+
+static void master_on_frame(modbus_rtu_port_t *port, const uint8_t *frame, uint16_t length)
+{
+	test_line_t *line = port->context;
+	ModbusErrorInfo err = modbusParseResponseRTU(
+		&line->master,
+		modbusMasterGetRequest(&line->master),
+		modbusMasterGetRequestLength(&line->master),
+		frame,
+		length);
+
+	if (!modbusIsOk(err))
+		line->bad_values++;
+	if (++line->reads < READS_PER_LINE)
+		send_read(line);
+}
+
+/*
+	Dispatches events until `done` returns nonzero or the time runs out.
+	Returns the number of epoll wakeups.
+*/
+static int run_loop(uint32_t timeout_ms, int (*done)(void))
+{
+	uint32_t start = modbus_now_ms();
+	int wakeups = 0;
+	while (!(done && done()))
+	{
+		int32_t left = timeout_ms - (modbus_now_ms() - start);
+		if (left <= 0)
+			break;
+
+		struct epoll_event events[64];
+		int n = epoll_wait(epoll_fd, events, 64, left);
+		if (n > 0)
+			wakeups++;
+
+		for (int i = 0; i < n; i++)
+		{
+			modbus_handle_t *handle = events[i].data.ptr;
+			modbus_rtu_port_on_event(handle->owner, handle, events[i].events);
+		}
+	}
+
+	return wakeups;
+}
+
+static int line_open(test_line_t *line, int number)
+{
+	char path[64];
+	line->number = number;
+	int fd = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+	if (fd < 0 || grantpt(fd) || unlockpt(fd) || ptsname_r(fd, path, sizeof(path)))
+		return -1;
+
+	struct termios tio;
+	tcgetattr(fd, &tio);
+	cfmakeraw(&tio);
+	tcsetattr(fd, TCSANOW, &tio);
+
+	if (modbus_rtu_port_init(&line->master_port, epoll_fd, fd, 115200, master_on_frame, line)
+		|| modbus_rtu_port_init(&line->slave_port, epoll_fd, modbus_serial_open(path, 115200, 'E'), 115200, slave_on_frame, line))
+		return -1;
+
+	if (!modbusIsOk(modbusMasterInit(&line->master, data_callback, NULL, modbusDefaultAllocator,
+		modbusMasterDefaultFunctions, modbusMasterDefaultFunctionCount)))
+		return -1;
+	modbusMasterSetUserPointer(&line->master, line);
+	return 0;
+}
+
+#define check(expr) do { if (!(expr)) { printf("  %s:%d: %s failed\n", __FILE__, __LINE__, #expr); return 1; } } while (0)
+
+static int all_lines_done(void)
+{
+	for (int i = 0; i < line_count; i++)
+		if (lines[i].reads < READS_PER_LINE)
+			return 0;
+	return 1;
+}
+
+static int test_requests(void)
+{
+	for (int i = 0; i < line_count; i++)
+		send_read(&lines[i]);
+
+	run_loop(10000, all_lines_done);
+	check(all_lines_done());
+	for (int i = 0; i < line_count; i++)
+	{
+		check(lines[i].bad_values == 0);
+		check(lines[i].master_port.stats.frames_received == READS_PER_LINE);
+		check(lines[i].slave_port.stats.frames_sent == READS_PER_LINE);
+		check(lines[i].slave_port.stats.crc_errors == 0);
+	}
+	return 0;
+}
+
+/*
+	Nothing wakes the loop up while the lines are quiet
+*/
+static int test_idle(void)
+{
+	struct rusage before, after;
+	// Let the lines settle after the last responses
+	run_loop(20, NULL);
+
+	getrusage(RUSAGE_SELF, &before);
+	int wakeups = run_loop(500, NULL);
+	getrusage(RUSAGE_SELF, &after);
+
+	long cpu_us = (after.ru_utime.tv_sec - before.ru_utime.tv_sec) * 1000000L
+		+ (after.ru_utime.tv_usec - before.ru_utime.tv_usec)
+		+ (after.ru_stime.tv_sec - before.ru_stime.tv_sec) * 1000000L
+		+ (after.ru_stime.tv_usec - before.ru_stime.tv_usec);
+
+	printf("  %d ports idle for 500 ms: %d wakeups, %ld us of CPU time\n", line_count * 2, wakeups, cpu_us);
+	check(wakeups == 0);
+	check(cpu_us < 20000);
+	return 0;
+}
+
+/*
+	Noise with a bad CRC is dropped without a response
+*/
+static int test_bad_crc(void)
+{
+	test_line_t *line = &lines[0];
+	uint64_t errors = line->slave_port.stats.crc_errors;
+	uint64_t sent = line->slave_port.stats.frames_sent;
+	static const uint8_t noise[] = {1, 3, 0, 0, 0, 1, 0x12, 0x34};
+	check(write(line->master_port.serial.fd, noise, sizeof(noise)) == sizeof(noise));
+
+	run_loop(50, NULL);
+	check(line->slave_port.stats.crc_errors == errors + 1);
+	check(line->slave_port.stats.frames_sent == sent);
+	return 0;
+}
+
+/*
+	A frame interrupted by more than t3.5 of silence falls apart
+	into two frames with bad CRCs
+*/
+static int test_split_frame(void)
+{
+	test_line_t *line = &lines[1];
+	uint64_t errors = line->slave_port.stats.crc_errors;
+	uint64_t sent = line->slave_port.stats.frames_sent;
+	check(modbusIsOk(modbusBuildRequest03RTU(&line->master, 1, 0, 1)));
+	const uint8_t *frame = modbusMasterGetRequest(&line->master);
+	uint16_t length = modbusMasterGetRequestLength(&line->master);
+
+	check(write(line->master_port.serial.fd, frame, 3) == 3);
+	run_loop(10, NULL);
+	check(write(line->master_port.serial.fd, frame + 3, length - 3) == length - 3);
+	run_loop(50, NULL);
+	check(line->slave_port.stats.crc_errors == errors + 2);
+	check(line->slave_port.stats.frames_sent == sent);
+
+	// The same frame sent in one go is answered
+	check(write(line->master_port.serial.fd, frame, length) == length);
+	run_loop(50, NULL);
+	check(line->slave_port.stats.frames_sent == sent + 1);
+	return 0;
+}
+
+/*
+	Only one frame can wait for the line
+*/
+static int test_send_queue(void)
+{
+	test_line_t *line = &lines[2];
+	uint64_t received = line->master_port.stats.frames_received;
+	check(modbusIsOk(modbusBuildRequest03RTU(&line->master, 1, 0, 1)));
+	const uint8_t *frame = modbusMasterGetRequest(&line->master);
+	uint16_t length = modbusMasterGetRequestLength(&line->master);
+
+	check(modbus_rtu_port_send(&line->master_port, frame, length) == 0);
+	check(line->master_port.state == MODBUS_RTU_PORT_DRAINING);
+	check(modbus_rtu_port_send(&line->master_port, frame, length) == 0);
+	check(modbus_rtu_port_send(&line->master_port, frame, length) == -1);
+	check(modbus_rtu_port_send(&line->master_port, frame, 3) == -1);
+
+	// Both requests are answered, as the second one waits for t3.5
+	// after the response to the first one
+	line->reads = READS_PER_LINE;
+	run_loop(100, NULL);
+	check(line->master_port.stats.frames_received == received + 2);
+	check(line->master_port.stats.collisions == 0);
+	return 0;
+}
+
+static void run(const char *name, int (*test)(void))
+{
+	int r = test();
+	printf("[RTU] %s: %s\n", name, r ? "FAILED" : "OK");
+	failures += r;
+}
+
+int main(int argc, char **argv)
+{
+	line_count = argc > 1 ? atoi(argv[1]) : 16;
+	if (line_count < 3 || line_count > MAX_LINES)
+	{
+		fprintf(stderr, "Number of ports must be between 3 and %d\n", MAX_LINES);
+		return EXIT_FAILURE;
+	}
+
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (epoll_fd < 0 || !modbusIsOk(modbusSlaveInit(&slave, register_callback, NULL, modbusDefaultAllocator,
+		modbusSlaveDefaultFunctions, modbusSlaveDefaultFunctionCount)))
+		return EXIT_FAILURE;
+
+	for (int i = 0; i < line_count; i++)
+		if (line_open(&lines[i], i))
+		{
+			perror("line");
+			return EXIT_FAILURE;
+		}
+
+	run("Reads over all ports", test_requests);
+	run("Idle ports", test_idle);
+	run("Bad CRC", test_bad_crc);
+	run("Frame split by silence", test_split_frame);
+	run("Send queue", test_send_queue);
+
+	for (int i = 0; i < line_count; i++)
+	{
+		modbus_rtu_port_destroy(&lines[i].master_port);
+		modbus_rtu_port_destroy(&lines[i].slave_port);
+		modbusMasterDestroy(&lines[i].master);
+	}
+	modbusSlaveDestroy(&slave);
+	close(epoll_fd);
+
+	printf("%s\n", failures ? "FAILED" : "All RTU port tests passed");
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
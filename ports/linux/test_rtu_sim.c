@@ -0,0 +1,387 @@
+/*
+	Test harness of the virtual RTU bus, which doubles as a timing
+	benchmark of the RTU serial port.
+
+	A master port (rtu_port.c) runs in the main thread on one of the
+	pseudo-terminals of a simulated bus with a few slaves. Faults are
+	injected into the responses and the bus trace is used to check
+	what happened on the wire and when.
+
+	The bus thread can be woken up late on a busy or virtualized machine,
+	which shows as gaps in frames. The master port therefore waits for
+	t3.5 plus a margin before it considers a frame complete - set it
+	to 0 for exact turnaround measurements on an idle machine.
+
+	Usage: ./test_rtu_sim [baudrate] [margin_us]
+*/
+#define _GNU_SOURCE
+#include "rtu_port.h"
+#include "rtu_sim.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+#define TRACE_LENGTH 1024
+#define BENCH_READS 50
+#define DEFAULT_MARGIN_US 20000
+
+static int epoll_fd;
+static modbus_sim_bus_t bus;
+static modbus_sim_record_t trace[TRACE_LENGTH];
+static modbus_sim_device_t devices[4];
+static ModbusSlave slave;
+
+static modbus_rtu_port_t port;
+static ModbusMaster master;
+static int responses;      // Valid responses received by the master
+static int unsolicited;    // Other frames received by the master
+static uint64_t response_us;
+
+static int failures = 0;
+
+/*
+	Holding register i of the slave at address a holds a * 100 + i
+*/
+static ModbusError register_callback(
+	const ModbusSlave *s,
+	const ModbusRegisterCallbackArgs *args,
+	ModbusRegisterCallbackResult *result)
+{
+	const modbus_sim_device_t *device = modbusSlaveGetUserPointer(s);
+	result->exceptionCode = MODBUS_EXCEP_NONE;
+	if (args->query == MODBUS_REGQ_R)
+		result->value = device->address * 100 + args->index;
+	return MODBUS_OK;
+}
+
+static ModbusError data_callback(const ModbusMaster *m, const ModbusDataCallbackArgs *args)
+{
+	if (args->value != args->address * 100 + args->index)
+		unsolicited++;
+	return MODBUS_OK;
+}
+
+static void on_frame(modbus_rtu_port_t *p, const uint8_t *frame, uint16_t length)
+{
+	ModbusErrorInfo err = modbusParseResponseRTU(
+		&master,
+		modbusMasterGetRequest(&master),
+		modbusMasterGetRequestLength(&master),
+		frame,
+		length);
+
+	if (modbusIsOk(err))
+	{
+		responses++;
+		response_us = modbus_now_us();
+	}
+	else
+		unsolicited++;
+}
+
+/*
+	Dispatches events of the master port for `timeout_ms`, or until
+	a response is received when `until_response` is set
+*/
+static void run_loop(uint32_t timeout_ms, int until_response)
+{
+	uint32_t start = modbus_now_ms();
+	int initial = responses;
+	while (!(until_response && responses != initial))
+	{
+		int32_t left = timeout_ms - (modbus_now_ms() - start);
+		if (left <= 0)
+			break;
+
+		struct epoll_event events[4];
+		int n = epoll_wait(epoll_fd, events, 4, left);
+		for (int i = 0; i < n; i++)
+		{
+			modbus_handle_t *handle = events[i].data.ptr;
+			modbus_rtu_port_on_event(handle->owner, handle, events[i].events);
+		}
+	}
+}
+
+/*
+	Sends a read request and waits for the response.
+	Returns the time of the request in microseconds.
+*/
+static uint64_t read_registers(uint8_t address, uint16_t index, uint16_t count, uint32_t timeout_ms)
+{
+	if (!modbusIsOk(modbusBuildRequest03RTU(&master, address, index, count)))
+		return 0;
+
+	uint64_t start = modbus_now_us();
+	modbus_rtu_port_send(&port, modbusMasterGetRequest(&master), modbusMasterGetRequestLength(&master));
+	run_loop(timeout_ms, 1);
+	return start;
+}
+
+/*
+	Returns the last trace record, with the bus locked
+*/
+static modbus_sim_record_t last_record(size_t back)
+{
+	modbus_sim_record_t record = {0};
+	modbus_sim_lock(&bus);
+	if (bus.trace_length > back)
+		record = trace[bus.trace_length - 1 - back];
+	modbus_sim_unlock(&bus);
+	return record;
+}
+
+static uint64_t device_requests(int device)
+{
+	modbus_sim_lock(&bus);
+	uint64_t requests = devices[device].requests;
+	modbus_sim_unlock(&bus);
+	return requests;
+}
+
+static void set_faults(int device, modbus_sim_faults_t faults)
+{
+	modbus_sim_lock(&bus);
+	devices[device].faults = faults;
+	modbus_sim_unlock(&bus);
+}
+
+#define check(expr) do { if (!(expr)) { printf("  %s:%d: %s failed\n", __FILE__, __LINE__, #expr); return 1; } } while (0)
+
+/*
+	Request and response take exactly their air time on the wire,
+	and the slave answers after its turnaround time
+*/
+static int test_timing(void)
+{
+	int initial = responses;
+	uint64_t start = read_registers(1, 0, 10, 500);
+	check(responses == initial + 1);
+
+	modbus_sim_record_t request = last_record(1);
+	modbus_sim_record_t response = last_record(0);
+	check(request.source_type == MODBUS_SIM_SOURCE_PORT);
+	check(request.length == 8 && request.head[0] == 1 && request.head[1] == 3);
+	check(request.end_us - request.start_us == 8 * bus.char_us);
+	check(response.source_type == MODBUS_SIM_SOURCE_DEVICE && response.source == 0);
+	check(response.length == 25 && !response.flags);
+	check(response.end_us - response.start_us == 25 * bus.char_us);
+	check(response.start_us - request.end_us == devices[0].turnaround_us);
+
+	// The master sees the response t3.5 after its end, give or take scheduling
+	uint64_t ideal = response.end_us + port.silence_us;
+	printf("  request written to end of request on the wire: %llu us\n",
+		(unsigned long long)(request.end_us - start));
+	printf("  end of response on the wire to frame delivered: %llu us (port silence: %u us)\n",
+		(unsigned long long)(response_us - response.end_us), port.silence_us);
+	check(response_us >= ideal);
+	check(response_us < ideal + 20000);
+	return 0;
+}
+
+/*
+	Back-to-back reads - the master keeps t3.5 of silence between
+	a response and its next request
+*/
+static int test_turnaround(void)
+{
+	int initial = responses;
+	modbus_sim_lock(&bus);
+	size_t first = bus.trace_length;
+	modbus_sim_unlock(&bus);
+	uint64_t start = modbus_now_us();
+	for (int i = 0; i < BENCH_READS; i++)
+		read_registers(2, i % 10, 4, 500);
+	uint64_t elapsed = modbus_now_us() - start;
+	check(responses == initial + BENCH_READS);
+
+	uint64_t min_gap = UINT64_MAX, max_gap = 0, total_gap = 0;
+	int gaps = 0;
+	modbus_sim_lock(&bus);
+	for (size_t i = first + 2; i + 1 < bus.trace_length; i += 2)
+	{
+		uint64_t gap = trace[i].start_us - trace[i - 1].end_us;
+		min_gap = gap < min_gap ? gap : min_gap;
+		max_gap = gap > max_gap ? gap : max_gap;
+		total_gap += gap;
+		gaps++;
+	}
+	modbus_sim_unlock(&bus);
+
+	check(gaps == BENCH_READS - 1);
+	printf("  %d reads in %llu ms, master turnaround min/avg/max: %llu/%llu/%llu us\n",
+		BENCH_READS, (unsigned long long)(elapsed / 1000),
+		(unsigned long long)min_gap, (unsigned long long)(total_gap / gaps), (unsigned long long)max_gap);
+	check(min_gap >= bus.silence_us);
+	return 0;
+}
+
+static int test_crc_error(void)
+{
+	int initial = responses;
+	uint64_t errors = port.stats.crc_errors;
+	set_faults(0, (modbus_sim_faults_t){.corrupt_crc = 1});
+	read_registers(1, 0, 2, 200);
+	set_faults(0, (modbus_sim_faults_t){0});
+
+	check(responses == initial);
+	check(port.stats.crc_errors == errors + 1);
+	check(last_record(0).flags == MODBUS_SIM_CORRUPTED);
+	return 0;
+}
+
+/*
+	A gap longer than t3.5 splits the response into two bad frames,
+	a shorter one doesn't (t1.5 violations are only estimated by the
+	port, so they aren't checked here)
+*/
+static int test_gap(void)
+{
+	int initial = responses;
+	uint64_t errors = port.stats.crc_errors;
+	set_faults(0, (modbus_sim_faults_t){.gap_after = 4, .gap_us = 2 * port.silence_us});
+	read_registers(1, 0, 2, 200);
+	check(responses == initial);
+	check(port.stats.crc_errors == errors + 2);
+	check(last_record(1).flags == MODBUS_SIM_GAP);
+	check(last_record(1).length == 4 && last_record(0).length == 5);
+
+	set_faults(0, (modbus_sim_faults_t){.gap_after = 4, .gap_us = bus.silence_us / 2});
+	read_registers(1, 0, 2, 200);
+	set_faults(0, (modbus_sim_faults_t){0});
+	check(responses == initial + 1);
+	check(last_record(0).flags == MODBUS_SIM_GAP && last_record(0).length == 9);
+	return 0;
+}
+
+static int test_noise(void)
+{
+	int initial = responses;
+	uint64_t errors = port.stats.crc_errors;
+	set_faults(0, (modbus_sim_faults_t){.noise = 3});
+	read_registers(1, 0, 2, 200);
+	set_faults(0, (modbus_sim_faults_t){0});
+
+	check(responses == initial);
+	check(port.stats.crc_errors == errors + 1);
+	check(last_record(0).length == 12);
+	return 0;
+}
+
+/*
+	Two slaves with the same address answer at the same time
+*/
+static int test_collision(void)
+{
+	int initial = responses;
+	modbus_sim_lock(&bus);
+	uint64_t collisions = bus.stats.collisions;
+	modbus_sim_unlock(&bus);
+	read_registers(3, 0, 2, 200);
+
+	check(responses == initial);
+	modbus_sim_lock(&bus);
+	collisions = bus.stats.collisions - collisions;
+	modbus_sim_unlock(&bus);
+	check(collisions > 0);
+	modbus_sim_record_t a = last_record(1), b = last_record(0);
+	check(a.source_type == MODBUS_SIM_SOURCE_DEVICE && b.source_type == MODBUS_SIM_SOURCE_DEVICE);
+	check(a.source != b.source);
+	check((a.flags & MODBUS_SIM_COLLISION) && (b.flags & MODBUS_SIM_COLLISION));
+	return 0;
+}
+
+/*
+	Injected requests reach the slaves, unless they're split by a gap
+*/
+static int test_inject(void)
+{
+	uint8_t frame[8] = {2, 3, 0, 0, 0, 1};
+	uint16_t crc = modbusCRC(frame, 6);
+	frame[6] = crc & 0xff;
+	frame[7] = crc >> 8;
+
+	uint64_t requests = device_requests(1);
+	int frames = unsolicited;
+	check(modbus_sim_inject(&bus, frame, 8, 3, 3 * bus.silence_us) == 0);
+	check(modbus_sim_inject(&bus, frame, 8, 0, 0) == -1);
+	run_loop(150, 0);
+	check(device_requests(1) == requests);
+	check(last_record(1).flags == MODBUS_SIM_GAP && last_record(1).length == 3);
+	check(last_record(0).source_type == MODBUS_SIM_SOURCE_INJECTED && last_record(0).length == 5);
+
+	check(modbus_sim_inject(&bus, frame, 8, 0, 0) == 0);
+	run_loop(150, 0);
+	check(device_requests(1) == requests + 1);
+	check(last_record(1).source_type == MODBUS_SIM_SOURCE_INJECTED && last_record(1).length == 8);
+	check(last_record(0).source_type == MODBUS_SIM_SOURCE_DEVICE && last_record(0).source == 1);
+	check(unsolicited > frames);
+	return 0;
+}
+
+static void run(const char *name, int (*test)(void))
+{
+	int r = test();
+	printf("[SIM] %s: %s\n", name, r ? "FAILED" : "OK");
+	failures += r;
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t baudrate = argc > 1 ? atoi(argv[1]) : 19200;
+	uint32_t margin = argc > 2 ? atoi(argv[2]) : DEFAULT_MARGIN_US;
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (epoll_fd < 0 || modbus_sim_init(&bus, baudrate, trace, TRACE_LENGTH))
+		return EXIT_FAILURE;
+
+	if (!modbusIsOk(modbusSlaveInit(&slave, register_callback, NULL, modbusDefaultAllocator,
+		modbusSlaveDefaultFunctions, modbusSlaveDefaultFunctionCount))
+		|| !modbusIsOk(modbusMasterInit(&master, data_callback, NULL, modbusDefaultAllocator,
+		modbusMasterDefaultFunctions, modbusMasterDefaultFunctionCount)))
+		return EXIT_FAILURE;
+
+	// Slave 3 is there twice
+	const char *path = modbus_sim_add_port(&bus);
+	if (!path
+		|| modbus_sim_add_device(&bus, &devices[0], 1, &slave, NULL)
+		|| modbus_sim_add_device(&bus, &devices[1], 2, &slave, NULL)
+		|| modbus_sim_add_device(&bus, &devices[2], 3, &slave, NULL)
+		|| modbus_sim_add_device(&bus, &devices[3], 3, &slave, NULL))
+		return EXIT_FAILURE;
+	devices[0].turnaround_us = bus.silence_us + 3000;
+
+	if (modbus_rtu_port_init(&port, epoll_fd, modbus_serial_open(path, baudrate, 'E'), baudrate, on_frame, NULL)
+		|| modbus_sim_start(&bus))
+	{
+		perror("setup");
+		return EXIT_FAILURE;
+	}
+	port.silence_us += margin;
+
+	run("Timing", test_timing);
+	run("Master turnaround", test_turnaround);
+	run("CRC error", test_crc_error);
+	run("Gap in response", test_gap);
+	run("Noise", test_noise);
+	run("Collision", test_collision);
+	run("Injected frames", test_inject);
+
+	modbus_sim_stop(&bus);
+	printf("  bus: %llu bytes, %llu collisions, %llu overruns, up to %u us late\n",
+		(unsigned long long)bus.stats.bytes,
+		(unsigned long long)bus.stats.collisions,
+		(unsigned long long)bus.stats.overruns,
+		bus.stats.max_late_us);
+
+	modbus_rtu_port_destroy(&port);
+	modbus_sim_destroy(&bus);
+	modbusMasterDestroy(&master);
+	modbusSlaveDestroy(&slave);
+	close(epoll_fd);
+
+	printf("%s\n", failures ? "FAILED" : "All RTU simulator tests passed");
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,182 @@
+#define _GNU_SOURCE
+#include "udp_slave.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+/*
+	Responses are built directly in the transmit buffer
+	of the datagram being parsed, so they're never copied.
+*/
+static ModbusError udp_allocator(ModbusBuffer *buffer, uint16_t size, void *context)
+{
+	modbus_udp_slave_t *server = context;
+	if (size > sizeof(server->tx[0]))
+	{
+		buffer->data = NULL;
+		return MODBUS_ERROR_ALLOC;
+	}
+
+	buffer->data = size ? server->tx[server->current] : NULL;
+	return MODBUS_OK;
+}
+
+/*
+	Creates a non-blocking UDP socket bound to the given address.
+	The server struct must stay in place until modbus_udp_slave_destroy() is called.
+*/
+int modbus_udp_slave_init(
+	modbus_udp_slave_t *server,
+	const struct sockaddr_in *addr,
+	ModbusRegisterCallback register_callback,
+	ModbusSlaveExceptionCallback exception_callback)
+{
+	memset(server, 0, sizeof(*server));
+	server->epoll_fd = -1;
+	server->socket.fd = -1;
+	server->socket.type = MODBUS_HANDLE_SOCKET;
+	server->socket.owner = server;
+
+	ModbusErrorInfo err = modbusSlaveInit(
+		&server->slave,
+		register_callback,
+		exception_callback,
+		udp_allocator,
+		modbusSlaveDefaultFunctions,
+		modbusSlaveDefaultFunctionCount);
+	if (!modbusIsOk(err))
+		return -1;
+	modbusSlaveSetUserPointer(&server->slave, server);
+
+	for (int i = 0; i < MODBUS_UDP_SLAVE_BATCH; i++)
+	{
+		server->rx_iov[i].iov_base = server->rx[i];
+		server->rx_iov[i].iov_len = sizeof(server->rx[i]);
+		server->rx_msgs[i].msg_hdr.msg_iov = &server->rx_iov[i];
+		server->rx_msgs[i].msg_hdr.msg_iovlen = 1;
+		server->rx_msgs[i].msg_hdr.msg_name = &server->rx_addr[i];
+
+		server->tx_msgs[i].msg_hdr.msg_iov = &server->tx_iov[i];
+		server->tx_msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	server->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	server->socket.fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (server->epoll_fd < 0 || server->socket.fd < 0)
+	{
+		modbus_udp_slave_destroy(server);
+		return -1;
+	}
+
+	if (bind(server->socket.fd, (const struct sockaddr*) addr, sizeof(*addr))
+		|| modbus_epoll_add(server->epoll_fd, &server->socket, EPOLLIN))
+	{
+		modbus_udp_slave_destroy(server);
+		return -1;
+	}
+
+	return 0;
+}
+
+void modbus_udp_slave_destroy(modbus_udp_slave_t *server)
+{
+	if (server->socket.fd >= 0)
+		close(server->socket.fd);
+	if (server->epoll_fd >= 0)
+		close(server->epoll_fd);
+
+	server->socket.fd = -1;
+	server->epoll_fd = -1;
+	modbusSlaveDestroy(&server->slave);
+}
+
+/*
+	Receives up to MODBUS_UDP_SLAVE_BATCH datagrams with one recvmmsg(), parses them
+	(MBAP framing is the same as in Modbus TCP) and sends all responses with sendmmsg().
+	Returns number of received datagrams, 0 if there were none or -1 on error.
+*/
+int modbus_udp_slave_process(modbus_udp_slave_t *server)
+{
+	for (int i = 0; i < MODBUS_UDP_SLAVE_BATCH; i++)
+		server->rx_msgs[i].msg_hdr.msg_namelen = sizeof(server->rx_addr[i]);
+
+	int n = recvmmsg(server->socket.fd, server->rx_msgs, MODBUS_UDP_SLAVE_BATCH, MSG_DONTWAIT, NULL);
+	if (n < 0)
+		return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1;
+
+	server->stats.recv_calls++;
+	server->stats.datagrams += n;
+
+	int count = 0;
+	for (int i = 0; i < n; i++)
+	{
+		server->current = i;
+		ModbusErrorInfo err = modbusParseRequestTCP(&server->slave, server->rx[i], server->rx_msgs[i].msg_len);
+		if (!modbusIsOk(err))
+		{
+			server->stats.errors++;
+			continue;
+		}
+
+		uint16_t length = modbusSlaveGetResponseLength(&server->slave);
+		if (!length)
+			continue;
+
+		server->tx_iov[count].iov_base = (void*) modbusSlaveGetResponse(&server->slave);
+		server->tx_iov[count].iov_len = length;
+		server->tx_msgs[count].msg_hdr.msg_name = &server->rx_addr[i];
+		server->tx_msgs[count].msg_hdr.msg_namelen = server->rx_msgs[i].msg_hdr.msg_namelen;
+		count++;
+	}
+
+	// Responses are released right away - their data stays in tx[]
+	modbusSlaveFreeResponse(&server->slave);
+
+	int sent = 0;
+	while (sent < count)
+	{
+		int r = sendmmsg(server->socket.fd, server->tx_msgs + sent, count - sent, MSG_DONTWAIT);
+		server->stats.send_calls++;
+		if (r <= 0)
+		{
+			if (r < 0 && errno == EINTR)
+				continue;
+
+			// UDP gives no delivery guarantees anyway - the client will retry
+			server->stats.dropped += count - sent;
+			break;
+		}
+		sent += r;
+	}
+
+	server->stats.responses += sent;
+	return n;
+}
+
+/*
+	Waits for datagrams and processes them until the socket is drained.
+	Returns number of processed datagrams or -1 on error.
+*/
+int modbus_udp_slave_poll(modbus_udp_slave_t *server, int timeout_ms)
+{
+	struct epoll_event event;
+	int n = epoll_wait(server->epoll_fd, &event, 1, timeout_ms);
+	if (n < 0)
+		return errno == EINTR ? 0 : -1;
+	if (!n)
+		return 0;
+
+	int total = 0;
+	for (;;)
+	{
+		int count = modbus_udp_slave_process(server);
+		if (count < 0)
+			return -1;
+
+		total += count;
+		if (count < MODBUS_UDP_SLAVE_BATCH)
+			return total;
+	}
+}
@@ -0,0 +1,69 @@
+#ifndef _UDP_SLAVE_H
+#define _UDP_SLAVE_H
+
+#include "modbus_port.h"
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+/*
+	Maximum number of datagrams received or sent with a single system call.
+	Each of them has its own request and response buffer.
+*/
+#ifndef MODBUS_UDP_SLAVE_BATCH
+#define MODBUS_UDP_SLAVE_BATCH 64
+#endif
+
+typedef struct
+{
+	uint64_t datagrams; // Requests received
+	uint64_t responses; // Responses sent
+	uint64_t errors;    // Requests which could not be parsed
+	uint64_t dropped;   // Responses which could not be sent
+	uint64_t recv_calls;
+	uint64_t send_calls;
+} modbus_udp_stats_t;
+
+typedef struct
+{
+	int epoll_fd;
+	modbus_handle_t socket;
+	ModbusSlave slave;
+	uint16_t current; // Datagram being parsed - the response is placed in tx[current]
+
+	struct mmsghdr rx_msgs[MODBUS_UDP_SLAVE_BATCH];
+	struct iovec rx_iov[MODBUS_UDP_SLAVE_BATCH];
+	struct sockaddr_in rx_addr[MODBUS_UDP_SLAVE_BATCH];
+	uint8_t rx[MODBUS_UDP_SLAVE_BATCH][MODBUS_TCP_ADU_MAX];
+
+	struct mmsghdr tx_msgs[MODBUS_UDP_SLAVE_BATCH];
+	struct iovec tx_iov[MODBUS_UDP_SLAVE_BATCH];
+	uint8_t tx[MODBUS_UDP_SLAVE_BATCH][MODBUS_TCP_ADU_MAX];
+
+	modbus_udp_stats_t stats;
+	void *context;
+} modbus_udp_slave_t;
+
+int modbus_udp_slave_init(
+	modbus_udp_slave_t *server,
+	const struct sockaddr_in *addr,
+	ModbusRegisterCallback register_callback,
+	ModbusSlaveExceptionCallback exception_callback);
+void modbus_udp_slave_destroy(modbus_udp_slave_t *server);
+int modbus_udp_slave_process(modbus_udp_slave_t *server);
+int modbus_udp_slave_poll(modbus_udp_slave_t *server, int timeout_ms);
+
+/*
+	Returns the slave parsing the requests. Its user pointer is set to
+	the server and must not be changed - use server->context instead.
+*/
+static inline ModbusSlave *modbus_udp_slave_get(modbus_udp_slave_t *server)
+{
+	return &server->slave;
+}
+
+static inline modbus_udp_slave_t *modbus_udp_slave_from_slave(const ModbusSlave *slave)
+{
+	return (modbus_udp_slave_t*) modbusSlaveGetUserPointer(slave);
+}
+
+#endif
@@ -13,7 +13,7 @@ static uint32_t buffer_size = 0;
 
 static uint8_t modbus_tcp_socket_init(modbus_tcp_t *const modbus_tcp)
 {
-    modbus_tcp->receive_buffer_len = 0;
+    modbusTCPStreamInit(&(modbus_tcp->stream));
     modbus_tcp->send_buffer_len = 0;
     memset(modbus_tcp->receive_buffer, 0, sizeof(modbus_tcp->receive_buffer));
     memset(modbus_tcp->send_buffer, 0, sizeof(modbus_tcp->send_buffer));
@@ -75,25 +75,6 @@ static uint8_t modbus_tcp_on_disconnect(modbus_tcp_t *const modbus_tcp)
     return 0;
 }
 
-static uint16_t modbus_tcp_buffer_find_data(modbus_tcp_t *const modbus_tcp)
-{
-    if (!(modbus_tcp->receive_buffer_len))
-    {
-        return 0;
-    }
-    if (modbus_tcp->send_buffer_len != 0)
-    {
-        return 0;
-    }
-    if (modbus_tcp->receive_buffer[2] != 0 || modbus_tcp->receive_buffer[3] != 0 || modbus_tcp->receive_buffer[4] != 0 || modbus_tcp->receive_buffer[5] > 254)
-    {
-        memset(modbus_tcp->receive_buffer, 0, sizeof(modbus_tcp->receive_buffer));
-        modbus_tcp->receive_buffer_len = 0;
-        return 0;
-    }
-    return (uint16_t)((modbus_tcp->receive_buffer[5]) + 6);
-}
-
 static uint8_t modbus_tcp_on_timeout(modbus_tcp_t *const modbus_tcp)
 {
 #ifdef MY_DEBUG
@@ -115,15 +96,21 @@ static void modbus_tcp_on_sent(modbus_tcp_t *const modbus_tcp)
 {
     if (modbus_tcp->send_buffer_len == 0)
     {
-        uint16_t data_len = modbus_tcp_buffer_find_data(modbus_tcp);
+        // An invalid header makes the stream drop all received data
+        const uint8_t *frame = NULL;
+        uint16_t data_len = 0;
+        if (modbusTCPStreamNext(&(modbus_tcp->stream), &frame, &data_len) != MODBUS_OK)
+        {
+            frame = NULL;
+        }
 
-        if (data_len)
+        if (frame)
         {
 #ifdef MY_DEBUG
             buffer_size = sprintf(print_poll_buffer, "MB-TCP Received: ");
             for (uint8_t i = 0; i < data_len; i++)
             {
-                buffer_size += sprintf(print_poll_buffer + buffer_size, "%.02X", modbus_tcp->receive_buffer[i]);
+                buffer_size += sprintf(print_poll_buffer + buffer_size, "%.02X", frame[i]);
                 if (i == 6)
                 {
                     buffer_size += sprintf(print_poll_buffer + buffer_size, " : ");
@@ -137,29 +124,13 @@ static void modbus_tcp_on_sent(modbus_tcp_t *const modbus_tcp)
             modbus_tcp->modbus_debug(print_poll_buffer, buffer_size);
             memset(print_poll_buffer, 0, buffer_size);
 #endif
-            modbus_tcp->modbus.err = modbusParseRequestTCP(&(modbus_tcp->modbus.slave), modbus_tcp->receive_buffer, data_len);
+            modbus_tcp->modbus.err = modbusParseRequestTCP(&(modbus_tcp->modbus.slave), frame, data_len);
             if (modbusIsOk(modbus_tcp->modbus.err))
             {
                 const uint8_t *send_buffer_pointer = modbusSlaveGetResponse(&(modbus_tcp->modbus.slave));
                 modbus_tcp->send_buffer_len = modbusSlaveGetResponseLength(&(modbus_tcp->modbus.slave));
                 memcpy(modbus_tcp->send_buffer, send_buffer_pointer, modbus_tcp->send_buffer_len);
                 modbusSlaveFreeResponse(&(modbus_tcp->modbus.slave));
-                if (data_len > modbus_tcp->receive_buffer_len)
-                {
-                    // we should never reach here
-                    memset(modbus_tcp->receive_buffer, 0, sizeof(modbus_tcp->receive_buffer));
-                    modbus_tcp->receive_buffer_len = 0;
-                }
-                else
-                {
-                    memmove(modbus_tcp->receive_buffer, &(modbus_tcp->receive_buffer[data_len]), modbus_tcp->receive_buffer_len - data_len);
-                    modbus_tcp->receive_buffer_len -= data_len;
-                }
-            }
-            else
-            {
-                memset(modbus_tcp->receive_buffer, 0, sizeof(modbus_tcp->receive_buffer));
-                modbus_tcp->receive_buffer_len = 0;
             }
         }
     }
@@ -200,44 +171,38 @@ static void modbus_tcp_on_sent(modbus_tcp_t *const modbus_tcp)
 
 static uint8_t modbus_tcp_on_receive(modbus_tcp_t *const modbus_tcp)
 {
-    if (modbus_tcp->receive_buffer_len > sizeof(modbus_tcp->receive_buffer))
-    {
-        // we should never reach here
-        memset(modbus_tcp->receive_buffer, 0, sizeof(modbus_tcp->receive_buffer));
-        modbus_tcp->receive_buffer_len = 0;
-        modbus_tcp->send_buffer_len = 0;
-        memset(modbus_tcp->send_buffer, 0, sizeof(modbus_tcp->send_buffer));
-        return 1;
-    }
-    else if (modbus_tcp->receive_buffer_len == sizeof(modbus_tcp->receive_buffer))
+    // Requests of the previous chunk are still being answered - the stream
+    // refers to the receive buffer until all of them are retrieved
+    if (modbus_tcp->stream.inputLength)
     {
+        if (modbus_tcp->send_buffer_len == 0)
+        {
+            modbus_tcp_on_sent(modbus_tcp);
+        }
         return 1;
     }
-    else
+
+    uint16_t receive_len = 0;
+    getsockopt(modbus_tcp->socket, SO_RECVBUF, &receive_len);
+    if (receive_len > 0)
     {
-        uint16_t receive_len = 0;
-        uint16_t available_space = sizeof(modbus_tcp->receive_buffer) - modbus_tcp->receive_buffer_len;
-        getsockopt(modbus_tcp->socket, SO_RECVBUF, &receive_len);
-        if (receive_len > 0)
+        if (receive_len > sizeof(modbus_tcp->receive_buffer))
         {
-            if (receive_len > available_space)
-            {
-                receive_len = available_space;
-            }
-            int32_t real_len = recv(modbus_tcp->socket, &(modbus_tcp->receive_buffer[modbus_tcp->receive_buffer_len]), receive_len);
+            receive_len = sizeof(modbus_tcp->receive_buffer);
+        }
+        int32_t real_len = recv(modbus_tcp->socket, modbus_tcp->receive_buffer, receive_len);
 
-            if (real_len > 0)
+        if (real_len > 0)
+        {
+            modbusTCPStreamFeed(&(modbus_tcp->stream), modbus_tcp->receive_buffer, real_len);
+            if (modbus_tcp->send_buffer_len == 0)
             {
-                modbus_tcp->receive_buffer_len += real_len;
-                if (modbus_tcp->send_buffer_len == 0)
-                {
-                    modbus_tcp_on_sent(modbus_tcp);
-                }
+                modbus_tcp_on_sent(modbus_tcp);
             }
         }
-
-        return 0;
     }
+
+    return 0;
 }
 
 void modbus_tcp_poll(modbus_tcp_t *const modbus_tcp)
@@ -15,7 +15,7 @@ typedef struct
     uint8_t interrupts;
     uint8_t clear_interrupts;
     uint8_t receive_buffer[MODBUS_TCP_REC_MESSAGE_MAX_SIZE * 4];
-    uint16_t receive_buffer_len;
+    ModbusTCPStream stream;
     uint8_t send_buffer[MODBUS_TCP_REC_MESSAGE_MAX_SIZE];
     uint16_t send_buffer_len;
     modbus_debug_handler modbus_debug;
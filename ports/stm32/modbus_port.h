@@ -11,6 +11,7 @@
 #define LIGHTMODBUS_F03S
 #define LIGHTMODBUS_F06S
 #define LIGHTMODBUS_F16S
+#define LIGHTMODBUS_STREAM
 
 #include "lightmodbus.h"
 #include <stdbool.h>
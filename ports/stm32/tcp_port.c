@@ -15,26 +15,19 @@
 #include "modbus_callbacks.h"
 #include "lwrb.h"
 
-#define MODBUS_TCP_REC_MESSAGE_MAX_SIZE 260 // 7+1+252
-#define MODBUS_TCP_REC_MESSAGE_MIN_SIZE 8
 #define MODBUS_TCP_SEND_MESSAGE_MAX_SIZE 260
 #define MODBUS_TCP_REC_MULT 4
 #define MODBUS_TCP_MAX_IDLE_SEC	3
-#define MODBUS_TCP_LEN_HIGHER_BYTE	4
-#define MODBUS_TCP_LEN_LOWER_BYTE	5
-#define MODBUS_TCP_HEADER_LEN		6
 #define MODBUS_TCP_RING_BUFFER_SIZE	((uint32_t)(3 * 1024)) // you can tweak this value till have messages_ring_buffer_full
 
 typedef struct {
 	modbus_t modbus;
 	struct tcp_pcb *client_pcb;
 	uint8_t idle_cnt;
-	uint8_t buff[MODBUS_TCP_REC_MESSAGE_MAX_SIZE];
-	uint32_t buff_len;
+	ModbusTCPStream stream;
 	uint8_t ring_buff[MODBUS_TCP_RING_BUFFER_SIZE];
 	lwrb_t lwrb;
 	bool response_sent;
-	bool is_ok;
 } modbus_tcp_client_t;
 
 typedef struct {
@@ -114,78 +107,67 @@ static bool handle_modbus_data(modbus_tcp_client_t *const client, struct tcp_pcb
 			lwrb_write(&(client->lwrb), send_buffer_pointer, send_buffer_len);
 			modbus_tcp.stats.messages_sent++;
 			modbusSlaveFreeResponse(&(client->modbus.slave));
-			client->is_ok = true;
 			return true;
 		}
 	} else {
-		client->is_ok = false;
-		client->buff_len = 0;
 		modbus_tcp.stats.messages_received++;
 		modbus_tcp.stats.messages_nok++;
 		return false;
 	}
 }
 
-static bool handle_normal_data(modbus_tcp_client_t *const client, struct tcp_pcb *tpcb, uint8_t **const payload, uint16_t *const len) {
-	uint16_t id_and_pdu_len = (((uint16_t) (*payload)[MODBUS_TCP_LEN_HIGHER_BYTE]) << 8) | ((uint16_t) (*payload)[MODBUS_TCP_LEN_LOWER_BYTE]);
-	uint16_t real_len = MODBUS_TCP_HEADER_LEN + id_and_pdu_len;
-	if (real_len > MODBUS_TCP_REC_MESSAGE_MAX_SIZE) {
-		client->is_ok = false;
-		client->buff_len = 0;
+/**
+ * Parses all complete requests in the payload at once. Responses are written
+ * directly to the linear part of the ring buffer, so that a burst of pipelined
+ * requests is answered with a single tcp_write().
+ *
+ * @return false if a request could not be parsed
+ */
+static bool handle_batch_data(modbus_tcp_client_t *const client, uint8_t **const payload, uint16_t *const len) {
+	size_t consumed = 0;
+	size_t produced = 0;
+	uint16_t count = 0;
+	client->modbus.err = modbusParseRequestTCPBatch(&(client->modbus.slave), *payload, *len,
+			(uint8_t*) lwrb_get_linear_block_write_address(&(client->lwrb)),
+			lwrb_get_linear_block_write_length(&(client->lwrb)),
+			&consumed, &produced, &count);
+
+	lwrb_advance(&(client->lwrb), produced);
+	modbus_tcp.stats.messages_received += count;
+	modbus_tcp.stats.messages_ok += count;
+	modbus_tcp.stats.messages_sent += count;
+	*len -= consumed;
+	*payload += consumed;
+
+	if (!modbusIsOk(client->modbus.err)) {
 		modbus_tcp.stats.messages_received++;
 		modbus_tcp.stats.messages_nok++;
 		return false;
 	}
-	if (real_len > *len) {
-		if (client->is_ok && client->buff_len == 0) {
-			memcpy(client->buff, *payload, *len);
-			client->buff_len = *len;
-		} else {
-			client->is_ok = false;
-			client->buff_len = 0;
-			modbus_tcp.stats.messages_received++;
-			modbus_tcp.stats.messages_nok++;
-		}
-		return false;
-	}
-	if (!handle_modbus_data(client, tpcb, *payload, real_len)) {
-		return false;
-	}
-	*len -= real_len;
-	*payload += real_len;
 	return true;
 }
 
-static bool handle_prev_data(modbus_tcp_client_t *client, struct tcp_pcb *tpcb, uint8_t **const payload, uint16_t *const len) {
-	uint16_t to_copy_bytes = MODBUS_TCP_REC_MESSAGE_MAX_SIZE - client->buff_len;
-	if (to_copy_bytes > *len) {
-		to_copy_bytes = *len;
-	}
-	memcpy(client->buff + client->buff_len, *payload, to_copy_bytes);
-	uint16_t id_and_pdu_len = (((uint16_t) client->buff[MODBUS_TCP_LEN_HIGHER_BYTE]) << 8) | ((uint16_t) client->buff[MODBUS_TCP_LEN_LOWER_BYTE]);
-	uint16_t real_len = MODBUS_TCP_HEADER_LEN + id_and_pdu_len;
-	if (real_len > MODBUS_TCP_REC_MESSAGE_MAX_SIZE) {
-		client->is_ok = false;
-		client->buff_len = 0;
-		modbus_tcp.stats.messages_received++;
-		modbus_tcp.stats.messages_nok++;
-		return false;
-	}
-	if (real_len > client->buff_len + *len) {
-		client->is_ok = false;
-		client->buff_len = 0;
-		modbus_tcp.stats.messages_received++;
-		modbus_tcp.stats.messages_nok++;
-		return false;
-	}
-	if (!handle_modbus_data(client, tpcb, client->buff, real_len)) {
-		return false;
+/**
+ * Parses requests reassembled by the stream - the ones split between
+ * segments and the ones the batch parser left for lack of linear space.
+ *
+ * @return false if the stream has to be dropped
+ */
+static bool handle_stream_data(modbus_tcp_client_t *const client, struct tcp_pcb *tpcb, const uint8_t *payload, uint16_t len) {
+	modbusTCPStreamFeed(&(client->stream), payload, len);
+	for (;;) {
+		const uint8_t *frame;
+		uint16_t frame_len;
+		if (modbusTCPStreamNext(&(client->stream), &frame, &frame_len) != MODBUS_OK) {
+			modbus_tcp.stats.messages_received++;
+			modbus_tcp.stats.messages_nok++;
+			return false;
+		}
+		if (frame == NULL) {
+			return true;
+		}
+		handle_modbus_data(client, tpcb, frame, frame_len);
 	}
-	uint16_t bytes_to_remove = real_len - client->buff_len;
-	*len -= bytes_to_remove;
-	*payload += bytes_to_remove;
-	client->buff_len = 0;
-	return true;
 }
 
 static void send_data_from_ring_buffer(modbus_tcp_client_t *client, struct tcp_pcb *tpcb) {
@@ -242,30 +224,13 @@ static err_t modbus_tcp_on_receive(void *arg, struct tcp_pcb *tpcb, struct pbuf
 	for (struct pbuf *p_temp = p; p_temp != NULL; p_temp = p_temp->next) {
 		uint8_t *payload = (uint8_t*) p_temp->payload;
 		uint16_t len = p_temp->len;
-		while (len) {
-			if (client->buff_len + len < MODBUS_TCP_REC_MESSAGE_MIN_SIZE) {
-				if (client->is_ok && client->buff_len == 0) {
-					memcpy(client->buff, payload, len);
-					client->buff_len = len;
-				} else {
-					client->is_ok = false;
-					client->buff_len = 0;
-					modbus_tcp.stats.messages_received++;
-					modbus_tcp.stats.messages_nok++;
-				}
-				break;
-			}
-			if (client->buff_len) {
-				if (!handle_prev_data(client, tpcb, &payload, &len)) {
-					if (!handle_normal_data(client, tpcb, &payload, &len)) {
-						break;
-					}
-				}
-			} else {
-				if (!handle_normal_data(client, tpcb, &payload, &len)) {
-					break;
-				}
-			}
+		// Complete requests at the beginning of the segment are answered in one go
+		if (client->stream.length == 0 && !handle_batch_data(client, &payload, &len)) {
+			modbusTCPStreamReset(&(client->stream));
+			break;
+		}
+		if (!handle_stream_data(client, tpcb, payload, len)) {
+			break;
 		}
 	}
 	if (!client->response_sent) {
@@ -346,8 +311,7 @@ static err_t modbus_tcp_on_accept(void *arg, struct tcp_pcb *newpcb, err_t err)
 				tcp_nagle_disable(newpcb);
 				modbus_tcp.clients[i].client_pcb = newpcb;
 				modbus_tcp.clients[i].idle_cnt = 0;
-				modbus_tcp.clients[i].is_ok = false;
-				modbus_tcp.clients[i].buff_len = 0;
+				modbusTCPStreamInit(&(modbus_tcp.clients[i].stream));
 				modbus_tcp.clients[i].response_sent = false;
 				lwrb_init(&(modbus_tcp.clients[i].lwrb), modbus_tcp.clients[i].ring_buff, MODBUS_TCP_RING_BUFFER_SIZE);
 				tcp_arg(modbus_tcp.clients[i].client_pcb, &modbus_tcp.clients[i]);
@@ -1,4 +1,12 @@
 #define LIGHTMODBUS_FULL
 #define LIGHTMODBUS_DEBUG
+#define LIGHTMODBUS_STREAM
+#define LIGHTMODBUS_CACHE
+#define LIGHTMODBUS_PIPELINE
+#define LIGHTMODBUS_RTT
+#define LIGHTMODBUS_SHADOW
+#define LIGHTMODBUS_SCHEDULER
+#define LIGHTMODBUS_RTU_BUS
+#define LIGHTMODBUS_COALESCE
 #define LIGHTMODBUS_IMPL
 #include <lightmodbus/lightmodbus.h>
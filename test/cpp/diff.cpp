@@ -0,0 +1,342 @@
+/*
+	Differential test of llm::StaticSlave and llm::StaticMaster.
+
+	Random (valid, invalid and malformed) requests and responses for all
+	default functions are parsed both by the templated classes and by
+	llm::Slave/llm::Master using the C parsing functions. Both must produce
+	the same errors, responses, exceptions and callback calls.
+
+	Usage: ./diff [iterations] [seed]
+*/
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <typeinfo>
+#include <vector>
+#define LIGHTMODBUS_FULL
+#define LIGHTMODBUS_IMPL
+#include <lightmodbus/lightmodbus.hpp>
+
+/*
+	Everything observable about parsing a single frame
+*/
+struct Outcome
+{
+	std::string error;
+	std::vector<uint8_t> response;
+	std::vector<std::vector<int>> calls;
+
+	bool operator==(const Outcome &other) const
+	{
+		return error == other.error && response == other.response && calls == other.calls;
+	}
+};
+
+// Callbacks of the current parse are logged here
+static Outcome *outcome;
+
+enum Fault
+{
+	NO_FAULT,
+	CALLBACK_ERROR,  // The callback returns an error
+	ADDRESS_FAULT,   // Checks fail with exception 02
+	WRITE_FAULT,     // Write checks fail with exception 03
+};
+
+// Register the handler fails on in the current iteration
+static Fault fault;
+static uint16_t faultIndex;
+
+/*
+	Register handler shared by all slaves. Values depend only on the
+	register, except for the faulty one.
+*/
+static ModbusError handleRegister(const ModbusRegisterCallbackArgs &args, ModbusRegisterCallbackResult &result)
+{
+	outcome->calls.push_back({'R', args.type, args.query, args.index, args.value, args.function});
+	bool faulty = args.index == faultIndex;
+	if (faulty && fault == CALLBACK_ERROR)
+		return MODBUS_ERROR_OTHER;
+
+	result.exceptionCode = MODBUS_EXCEP_NONE;
+	if (faulty && fault == ADDRESS_FAULT)
+		result.exceptionCode = MODBUS_EXCEP_ILLEGAL_ADDRESS;
+	else if (faulty && fault == WRITE_FAULT && args.query == MODBUS_REGQ_W_CHECK)
+		result.exceptionCode = MODBUS_EXCEP_ILLEGAL_VALUE;
+
+	if (args.query == MODBUS_REGQ_R)
+		result.value = args.type <= MODBUS_DISCRETE_INPUT ? args.index % 3 == 0 : args.index * 31 + args.type;
+	return MODBUS_OK;
+}
+
+static ModbusError registerCallback(
+	const ModbusSlave *slave,
+	const ModbusRegisterCallbackArgs *args,
+	ModbusRegisterCallbackResult *result)
+{
+	return handleRegister(*args, *result);
+}
+
+static ModbusError slaveExceptionCallback(const ModbusSlave *slave, uint8_t function, ModbusExceptionCode code)
+{
+	outcome->calls.push_back({'E', function, code});
+	return MODBUS_OK;
+}
+
+static void handleData(const ModbusDataCallbackArgs &args)
+{
+	outcome->calls.push_back({'D', args.type, args.index, args.value, args.function, args.address});
+}
+
+static ModbusError dataCallback(const ModbusMaster *master, const ModbusDataCallbackArgs *args)
+{
+	handleData(*args);
+	return MODBUS_OK;
+}
+
+static ModbusError masterExceptionCallback(const ModbusMaster *master, uint8_t address, uint8_t function, ModbusExceptionCode code)
+{
+	outcome->calls.push_back({'E', address, function, code});
+	return MODBUS_OK;
+}
+
+/*
+	Runs `parse` and records the exception it throws, if any
+*/
+template <typename Parse>
+static Outcome run(Parse parse)
+{
+	Outcome result;
+	outcome = &result;
+	try
+	{
+		parse(result);
+	}
+	catch (const std::exception &e)
+	{
+		result.error = std::string(typeid(e).name()) + ": " + e.what();
+	}
+	outcome = nullptr;
+	return result;
+}
+
+template <typename Slave>
+static Outcome parseRequest(Slave &slave, const std::vector<uint8_t> &request)
+{
+	return run([&](Outcome &result)
+	{
+		slave.parseRequestPDU(request.data(), request.size());
+		const uint8_t *response = slave.getResponse();
+		result.response.assign(response, response + slave.getResponseLength());
+	});
+}
+
+template <typename Master>
+static Outcome parseResponse(Master &master, const std::vector<uint8_t> &request, const std::vector<uint8_t> &response)
+{
+	return run([&](Outcome &)
+	{
+		master.parseResponsePDU(1, request.data(), request.size(), response.data(), response.size());
+	});
+}
+
+static std::mt19937 rng;
+
+static unsigned randomInt(unsigned max)
+{
+	return std::uniform_int_distribution<unsigned>(0, max)(rng);
+}
+
+static void push16(std::vector<uint8_t> &frame, uint16_t value)
+{
+	frame.push_back(value >> 8);
+	frame.push_back(value & 0xff);
+}
+
+/*
+	Index and count of a read or write, mostly valid,
+	sometimes past the last register or over the limit
+*/
+static void randomRange(std::vector<uint8_t> &frame, uint16_t limit)
+{
+	uint16_t count;
+	switch (randomInt(7))
+	{
+		case 0: count = 0; break;
+		case 1: count = limit + 1 + randomInt(20); break;
+		case 2: count = limit; break;
+		default: count = 1 + randomInt(limit - 1); break;
+	}
+
+	uint16_t index = randomInt(3) ? randomInt(400) : 0xffff - randomInt(count + 2);
+	push16(frame, index);
+	push16(frame, count);
+}
+
+static const uint8_t functions[] = {1, 2, 3, 4, 5, 6, 15, 16, 22};
+
+/*
+	Random request PDU for one of the default functions
+	(or an unsupported one), possibly of wrong length
+*/
+static std::vector<uint8_t> randomRequest()
+{
+	std::vector<uint8_t> frame;
+	uint8_t function = randomInt(15) ? functions[randomInt(sizeof(functions) - 1)] : randomInt(255);
+	frame.push_back(function);
+
+	switch (function)
+	{
+		case 1:
+		case 2:
+			randomRange(frame, 2000);
+			break;
+
+		case 3:
+		case 4:
+			randomRange(frame, 125);
+			break;
+
+		case 5:
+		case 6:
+			push16(frame, randomInt(400));
+			push16(frame, function == 5 && randomInt(3) ? (randomInt(1) ? 0xff00 : 0) : randomInt(0xffff));
+			break;
+
+		case 15:
+		case 16:
+		{
+			randomRange(frame, function == 15 ? 1968 : 123);
+			uint16_t count = modbusRBE(&frame[3]);
+			unsigned bytes = function == 15 ? modbusBitsToBytes(count) : count * 2;
+			if (!randomInt(7))
+				bytes = randomInt(255);
+			frame.push_back(bytes);
+			for (unsigned i = 0; i < bytes && frame.size() < MODBUS_PDU_MAX; i++)
+				frame.push_back(randomInt(255));
+			break;
+		}
+
+		case 22:
+			push16(frame, randomInt(400));
+			push16(frame, randomInt(0xffff));
+			push16(frame, randomInt(0xffff));
+			break;
+	}
+
+	// Malformed length
+	if (!randomInt(5))
+	{
+		if (randomInt(1) || frame.size() >= MODBUS_PDU_MAX)
+			frame.resize(1 + randomInt(frame.size() - 1));
+		else
+			for (unsigned i = 1 + randomInt(3); i > 0 && frame.size() < MODBUS_PDU_MAX; i--)
+				frame.push_back(randomInt(255));
+	}
+
+	return frame;
+}
+
+/*
+	Damages a response - wrong length, wrong byte count, an exception
+	or random data
+*/
+static void damageResponse(std::vector<uint8_t> &response, uint8_t function)
+{
+	switch (randomInt(4))
+	{
+		case 0:
+			response.resize(randomInt(response.size()));
+			break;
+
+		case 1:
+			response.push_back(randomInt(255));
+			break;
+
+		case 2:
+			if (response.size() > 1)
+				response[1] += randomInt(1) ? 1 : -1;
+			break;
+
+		case 3:
+			response = {uint8_t(function | 0x80), uint8_t(randomInt(12))};
+			break;
+
+		case 4:
+			for (auto &byte : response)
+				if (!randomInt(3))
+					byte = randomInt(255);
+			break;
+	}
+}
+
+static void dump(const char *name, const std::vector<uint8_t> &frame)
+{
+	printf("  %s:", name);
+	for (uint8_t byte : frame)
+		printf(" %02x", byte);
+	printf("\n");
+}
+
+static void dump(const char *name, const Outcome &result)
+{
+	printf("  %s: %s\n", name, result.error.empty() ? "OK" : result.error.c_str());
+	dump("    response", result.response);
+	printf("    %zu callback calls\n", result.calls.size());
+}
+
+int main(int argc, char **argv)
+{
+	unsigned iterations = argc > 1 ? atoi(argv[1]) : 100000;
+	rng.seed(argc > 2 ? atoi(argv[2]) : 1);
+
+	llm::Slave slave(registerCallback, slaveExceptionCallback);
+	llm::StaticSlave staticSlave(handleRegister, slaveExceptionCallback);
+	llm::Master master(dataCallback, masterExceptionCallback);
+	llm::StaticMaster staticMaster(handleData, masterExceptionCallback);
+
+	unsigned parsed = 0, exceptions = 0, errors = 0, mismatches = 0;
+	for (; parsed < iterations && mismatches < 10; parsed++)
+	{
+		fault = randomInt(1) ? NO_FAULT : Fault(randomInt(WRITE_FAULT));
+		faultIndex = randomInt(500);
+
+		// Request parsed by both slaves
+		std::vector<uint8_t> request = randomRequest();
+		Outcome expected = parseRequest(slave, request);
+		Outcome actual = parseRequest(staticSlave, request);
+		if (!(actual == expected))
+		{
+			printf("[DIFF] Slave mismatch\n");
+			dump("request", request);
+			dump("llm::Slave", expected);
+			dump("llm::StaticSlave", actual);
+			mismatches++;
+		}
+
+		exceptions += expected.response.size() && (expected.response[0] & 0x80);
+
+		// Response of the slave (or a damaged one) parsed by both masters
+		std::vector<uint8_t> response = expected.response;
+		if (response.empty() || !randomInt(3))
+			damageResponse(response, request[0]);
+
+		expected = parseResponse(master, request, response);
+		actual = parseResponse(staticMaster, request, response);
+		errors += !expected.error.empty();
+		if (!(actual == expected))
+		{
+			printf("[DIFF] Master mismatch\n");
+			dump("request", request);
+			dump("response", response);
+			dump("llm::Master", expected);
+			dump("llm::StaticMaster", actual);
+			mismatches++;
+		}
+	}
+
+	printf("[DIFF] %u requests: %u exception responses, %u responses rejected by the master\n", parsed, exceptions, errors);
+	printf("%s\n", mismatches ? "FAILED" : "Static and dynamic slave/master match");
+	return mismatches ? EXIT_FAILURE : EXIT_SUCCESS;
+}
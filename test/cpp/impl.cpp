@@ -4,5 +4,14 @@
 
 int main()
 {
+	// Instantiate the templated classes
+	llm::StaticSlave slave([](const ModbusRegisterCallbackArgs &args, ModbusRegisterCallbackResult &result)
+	{
+		result.exceptionCode = MODBUS_EXCEP_NONE;
+		result.value = args.index;
+		return MODBUS_OK;
+	});
+	llm::StaticMaster master([](const ModbusDataCallbackArgs &args) {});
+
 	return 0;
-}
\ No newline at end of file
+}
@@ -1,5 +1,24 @@
 #!/bin/sh
+# Usage: ./run-fuzz.sh [slave|stream]
 cd "$(dirname "$0")"
-tar xvf slave_samples.tar
-AFL_USE_ASAN=1 afl-clang++ -Wall -I../../include slavefuzz.cpp -m32 -g -O3 -DFUZZ -o slavefuzz
-AFL_SKIP_CPUFREQ=1 afl-fuzz -i slave_samples -o out -M master -m 1024 ./slavefuzz
\ No newline at end of file
+target=${1:-slave}
+
+case "$target" in
+	slave)
+		tar xvf slave_samples.tar
+		samples=slave_samples
+		;;
+	stream)
+		# Seed byte followed by two Modbus TCP frames
+		mkdir -p stream_samples
+		printf '\007\000\001\000\000\000\006\001\003\000\000\000\002\000\002\000\000\000\006\001\004\000\000\000\001' > stream_samples/two_frames
+		samples=stream_samples
+		;;
+	*)
+		echo "unknown target: $target" >&2
+		exit 1
+		;;
+esac
+
+AFL_USE_ASAN=1 afl-clang++ -Wall -I../../include ${target}fuzz.cpp -m32 -g -O3 -DFUZZ -o ${target}fuzz
+AFL_SKIP_CPUFREQ=1 afl-fuzz -i $samples -o out-$target -M master -m 1024 ./${target}fuzz
@@ -0,0 +1,100 @@
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#define LIGHTMODBUS_STREAM
+#define LIGHTMODBUS_IMPL
+#include <lightmodbus/lightmodbus.h>
+
+using Frames = std::vector<std::vector<uint8_t>>;
+
+/*
+	Reference implementation - parses the whole stream at once.
+	Returns frames preceding the first invalid header.
+*/
+Frames reference(const std::vector<uint8_t> &data, bool &error)
+{
+	Frames frames;
+	size_t offset = 0;
+	error = false;
+	while (data.size() - offset >= 6)
+	{
+		const uint8_t *p = &data[offset];
+		uint16_t length = modbusRBE(&p[4]) + 6;
+		if (modbusRBE(&p[2]) != 0 || length < MODBUS_TCP_ADU_MIN || length > MODBUS_TCP_ADU_MAX)
+		{
+			error = true;
+			break;
+		}
+
+		if (data.size() - offset < length)
+			break;
+
+		frames.emplace_back(p, p + length);
+		offset += length;
+	}
+
+	return frames;
+}
+
+/*
+	Feeds the stream with chunks of pseudo-random sizes derived from the seed
+*/
+Frames stream(const std::vector<uint8_t> &data, uint8_t seed, bool &error)
+{
+	ModbusTCPStream s;
+	modbusTCPStreamInit(&s);
+
+	Frames frames;
+	size_t offset = 0;
+	uint32_t state = seed | 1;
+	error = false;
+	while (offset < data.size() && !error)
+	{
+		state = state * 1103515245 + 12345;
+		size_t chunk = 1 + (state >> 16) % 600;
+		if (chunk > data.size() - offset)
+			chunk = data.size() - offset;
+
+		// Chunk is copied so that stale pointers are caught by ASan
+		std::vector<uint8_t> buffer(data.begin() + offset, data.begin() + offset + chunk);
+		modbusTCPStreamFeed(&s, buffer.data(), buffer.size());
+		offset += chunk;
+
+		const uint8_t *frame;
+		uint16_t length;
+		ModbusError err;
+		while ((err = modbusTCPStreamNext(&s, &frame, &length)) == MODBUS_OK && frame)
+		{
+			assert(length >= MODBUS_TCP_ADU_MIN && length <= MODBUS_TCP_ADU_MAX);
+			frames.emplace_back(frame, frame + length);
+		}
+
+		if (err != MODBUS_OK)
+			error = true;
+		else
+			assert(s.inputLength == 0 && s.length < MODBUS_TCP_ADU_MAX);
+	}
+
+	return frames;
+}
+
+int main()
+{
+	std::vector<uint8_t> data(65536);
+	data.resize(std::fread(data.data(), 1, data.size(), stdin));
+	if (data.empty())
+		return 0;
+
+	uint8_t seed = data[0];
+	data.erase(data.begin());
+
+	bool refError, streamError;
+	Frames expected = reference(data, refError);
+	Frames actual = stream(data, seed, streamError);
+	assert(expected == actual);
+	assert(refError == streamError);
+	std::printf("%zu frames%s\n", actual.size(), streamError ? ", invalid header" : "");
+	return 0;
+}
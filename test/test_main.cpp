@@ -146,14 +146,17 @@ void short_frames_tests()
 	short_slave_request_test("pdu");
 	short_slave_request_test("rtu");
 	short_slave_request_test("tcp");
+	short_slave_request_test("ascii");
 
 	short_master_request_test("pdu");
 	short_master_request_test("rtu");
 	short_master_request_test("tcp");
+	short_master_request_test("ascii");
 
 	short_master_response_test("pdu");
 	short_master_response_test("rtu");
 	short_master_response_test("tcp");
+	short_master_response_test("ascii");
 }
 
 void modbus_pdu_tests()
@@ -442,6 +445,195 @@ void modbus_tcp_tests()
 		parse_response();
 		assert_master_err(MODBUS_RESPONSE_ERROR(ADDRESS));
 	});
+
+	run_test("[TCP] Batch of pipelined requests", [](){
+		set_mode("tcp");
+		std::vector<uint8_t> input, expected;
+		for (int i = 0; i < 5; i++)
+		{
+			build_request({1, 6, 100 + i, i});
+			assert_master_ok();
+			request_data[1] = i;
+			parse_request();
+			assert_slave_ok();
+			input.insert(input.end(), request_data.begin(), request_data.end());
+			expected.insert(expected.end(), response_data.begin(), response_data.end());
+		}
+
+		// Incomplete frame at the end
+		input.insert(input.end(), request_data.begin(), request_data.begin() + 7);
+
+		std::vector<uint8_t> output(5 * MODBUS_TCP_ADU_MAX);
+		size_t consumed, produced;
+		uint16_t count;
+		ModbusErrorInfo err = modbusParseRequestTCPBatch(&slave, input.data(), input.size(), output.data(), output.size(), &consumed, &produced, &count);
+		assert_expr("batch ok", modbusIsOk(err) && count == 5);
+		assert_expr("incomplete frame left", consumed == input.size() - 7);
+		assert_expr("responses appended", produced == expected.size() && std::equal(expected.begin(), expected.end(), output.begin()));
+		assert_expr("response freed", !modbusSlaveGetResponseLength(&slave));
+		assert_reg(104, 4);
+
+		// Space for the longest possible response is required for each request
+		err = modbusParseRequestTCPBatch(&slave, input.data(), input.size(), output.data(), expected.size() / 5 * 3 + MODBUS_TCP_ADU_MAX, &consumed, &produced, &count);
+		assert_expr("output full", modbusIsOk(err) && count == 4 && produced == expected.size() / 5 * 4);
+
+		// Invalid frame in the middle
+		input[request_data.size() * 2 + 2] = 1;
+		err = modbusParseRequestTCPBatch(&slave, input.data(), input.size(), output.data(), output.size(), &consumed, &produced, &count);
+		assert_expr("bad protocol", modbusGetRequestError(err) == MODBUS_ERROR_BAD_PROTOCOL && count == 2);
+		assert_expr("stops at invalid frame", consumed == request_data.size() * 2 && produced == expected.size() / 5 * 2);
+
+		input[request_data.size() * 2 + 2] = 0;
+		input[request_data.size() * 2 + 4] = 0xff;
+		err = modbusParseRequestTCPBatch(&slave, input.data(), input.size(), output.data(), output.size(), &consumed, &produced, &count);
+		assert_expr("bad length", modbusGetRequestError(err) == MODBUS_ERROR_LENGTH && count == 2);
+	});
+}
+
+// Converts a string to a frame usable with set_request() and set_response()
+static std::vector<int> ascii_frame(const std::string &str)
+{
+	return std::vector<int>(str.begin(), str.end());
+}
+
+void modbus_ascii_tests()
+{
+	run_test("[ASCII] Build a request", [](){
+		set_mode("ascii");
+		ModbusErrorInfo err = modbusBuildRequest03ASCII(&master, 0x11, 0x6b, 3);
+		assert_expr("request built", modbusIsOk(err));
+		std::string frame(modbusMasterGetRequest(&master), modbusMasterGetRequest(&master) + modbusMasterGetRequestLength(&master));
+		assert_expr("frame", frame == ":1103006B00037E\r\n");
+
+		ModbusRequestDescriptor desc;
+		err = modbusDescribeRequest(&desc, &master);
+		assert_expr("descriptor", modbusIsOk(err) && desc.address == 0x11 && modbusRequestDescriptorGetCount(&desc) == 3);
+		modbusMasterFreeRequest(&master);
+	});
+
+	run_test("[ASCII] Parse a raw request (write register)", [](){
+		set_mode("ascii");
+		set_request(ascii_frame(":010600010003F5\r\n"));
+		parse_request();
+		assert_slave_ok();
+		assert_reg(1, 3);
+		assert_expr("response", std::string(response_data.begin(), response_data.end()) == ":010600010003F5\r\n");
+
+		// Lowercase hex digits are accepted too
+		set_request(ascii_frame(":01060001000af5\r\n"));
+		parse_request();
+		assert_slave_err(MODBUS_REQUEST_ERROR(CRC));
+		set_request(ascii_frame(":01060001000aee\r\n"));
+		parse_request();
+		assert_slave_ok();
+		assert_reg(1, 10);
+	});
+
+	run_test("[ASCII] Malformed frames", [](){
+		set_mode("ascii");
+		set_request(ascii_frame("010600010003F5\r\n"));
+		parse_request();
+		assert_slave_err(MODBUS_REQUEST_ERROR(LENGTH));
+
+		set_request(ascii_frame(";010600010003F5\r\n"));
+		parse_request();
+		assert_slave_err(MODBUS_REQUEST_ERROR(BAD_PROTOCOL));
+
+		set_request(ascii_frame(":010600010003F5\n\r"));
+		parse_request();
+		assert_slave_err(MODBUS_REQUEST_ERROR(BAD_PROTOCOL));
+
+		set_request(ascii_frame(":01060001000GF5\r\n"));
+		parse_request();
+		assert_slave_err(MODBUS_REQUEST_ERROR(BAD_PROTOCOL));
+
+		set_request(ascii_frame(":010600010003F\r\n"));
+		parse_request();
+		assert_slave_err(MODBUS_REQUEST_ERROR(LENGTH));
+
+		set_request(ascii_frame(":020600010003F4\r\n"));
+		parse_request();
+		assert_slave_err(MODBUS_REQUEST_ERROR(ADDRESS));
+	});
+
+	run_test("[ASCII] Valid requests/responses", [](){
+		set_mode("ascii");
+		std::vector<std::vector<int>> requests = {
+			{1, 16, 0, 8, 1, 2, 3, 4, 5, 6, 7, 8},
+			{1, 3, 0, 8},
+			{1, 15, 0, 8, 1, 0, 1, 0, 1, 0, 1, 0},
+			{1, 1, 0, 8},
+			{1, 22, 2, 0xff00, 0x00ff},
+		};
+
+		for (const auto &r : requests)
+		{
+			build_request(r);
+			assert_master_ok();
+			parse_request();
+			assert_slave_ok();
+			assert_slave_ex(MODBUS_EXCEP_NONE);
+			parse_response();
+			assert_master_ok();
+		}
+	});
+
+	run_test("[ASCII] Exceptions", [](){
+		set_mode("ascii");
+		build_request({1, 3, 0, 0});
+		assert_master_err(MODBUS_GENERAL_ERROR(COUNT));
+
+		build_request({1, 1, 0, 1});
+		build_exception(1, 1, MODBUS_EXCEP_ILLEGAL_ADDRESS);
+		assert_expr("exception frame", std::string(response_data.begin(), response_data.end()) == ":0181027C\r\n");
+		parse_response();
+		assert_master_ok();
+		assert_master_ex(MODBUS_EXCEP_ILLEGAL_ADDRESS);
+
+		set_response(ascii_frame(":018102FF\r\n"));
+		parse_response();
+		assert_master_err(MODBUS_RESPONSE_ERROR(CRC));
+	});
+
+	run_test("[ASCII] Hex codec", [](){
+		std::vector<uint8_t> data(64), hex(128), decoded(64);
+		for (size_t i = 0; i < data.size(); i++)
+			data[i] = i * 37 + 11;
+
+		for (uint16_t length = 0; length <= data.size(); length++)
+		{
+			modbusHexEncode(hex.data(), data.data(), length);
+			for (uint16_t i = 0; i < length; i++)
+			{
+				char expected[3];
+				std::snprintf(expected, sizeof(expected), "%02X", data[i]);
+				assert_expr("encoded", hex[2 * i] == expected[0] && hex[2 * i + 1] == expected[1]);
+			}
+
+			std::fill(decoded.begin(), decoded.end(), 0);
+			assert_expr("decoded", modbusHexDecode(decoded.data(), hex.data(), length));
+			assert_expr("round trip", std::equal(data.begin(), data.begin() + length, decoded.begin()));
+
+			// Invalid character at any position is detected
+			for (uint16_t i = 0; i < 2 * length; i++)
+			{
+				std::vector<uint8_t> bad(hex.begin(), hex.begin() + 2 * length);
+				for (uint8_t c : std::vector<uint8_t>{'/', ':', '@', 'G', '`', 'g', 0x80, 0xc1})
+				{
+					bad[i] = c;
+					assert_expr("invalid digit", !modbusHexDecode(decoded.data(), bad.data(), length));
+				}
+			}
+		}
+
+		// All byte values
+		for (int i = 0; i < 256; i++)
+		{
+			uint8_t b = i, h[2], d;
+			modbusHexEncode(h, &b, 1);
+			assert_expr("all bytes", modbusHexDecode(&d, h, 1) && d == b);
+		}
+	});
 }
 
 void single_write_tests()
@@ -861,11 +1053,1513 @@ void invalid_response_tests()
 	});
 }
 
+void frozen_request_tests()
+{
+	run_test("[TCP] Reuse a frozen request with different transaction IDs", [](){
+		set_mode("tcp");
+		ModbusFrozenRequest frozen;
+		ModbusErrorInfo err = modbusBuildRequest03TCP(&master, 0, 1, 5, 3);
+		assert_expr("request built", modbusIsOk(err));
+		err = modbusFreezeRequest(&frozen, &master);
+		assert_expr("request frozen", modbusIsOk(err));
+		modbusMasterFreeRequest(&master);
+		regs.at(6) = 0x1234;
+
+		for (int tid = 0xfffe; tid <= 0x10001; tid++)
+		{
+			modbusFrozenRequestSetTransactionID(&frozen, tid);
+			const uint8_t *ptr = modbusFrozenRequestGet(&frozen);
+			request_data.assign(ptr, ptr + modbusFrozenRequestGetLength(&frozen));
+			dump_request();
+			parse_request();
+			assert_slave_ok();
+			assert_expr("transaction ID echoed", modbusRBE(&response_data.at(0)) == (tid & 0xffff));
+			parse_response();
+			assert_master_ok();
+			assert_expr("3 registers received", received_data.size() == 3);
+			assert_expr("register value", received_data.at(1).index == 6 && received_data.at(1).value == 0x1234);
+		}
+	});
+
+	run_test("[RTU] Frozen request is identical to a freshly built one", [](){
+		set_mode("rtu");
+		ModbusFrozenRequest frozen;
+		ModbusErrorInfo err = modbusBuildRequest01RTU(&master, 1, 10, 12);
+		assert_expr("request built", modbusIsOk(err));
+		err = modbusFreezeRequest(&frozen, &master);
+		assert_expr("request frozen", modbusIsOk(err));
+		modbusMasterFreeRequest(&master);
+
+		build_request({1, 1, 10, 12});
+		assert_master_ok();
+		assert_expr("same frame", std::equal(
+			request_data.begin(),
+			request_data.end(),
+			modbusFrozenRequestGet(&frozen),
+			modbusFrozenRequestGet(&frozen) + modbusFrozenRequestGetLength(&frozen)));
+
+		const uint8_t *ptr = modbusFrozenRequestGet(&frozen);
+		request_data.assign(ptr, ptr + modbusFrozenRequestGetLength(&frozen));
+		parse_request();
+		assert_slave_ok();
+		parse_response();
+		assert_master_ok();
+		assert_expr("12 coils received", received_data.size() == 12);
+	});
+
+	run_test("Freeze without a request", [](){
+		ModbusFrozenRequest frozen;
+		modbusMasterFreeRequest(&master);
+		ModbusErrorInfo err = modbusFreezeRequest(&frozen, &master);
+		assert_expr("freezing fails", modbusGetGeneralError(err) == MODBUS_ERROR_LENGTH);
+	});
+}
+
+void request_coalesce_tests()
+{
+	run_test("[TCP] Requests built into a batch", [](){
+		set_mode("tcp");
+		uint8_t buffer[40];
+		ModbusRequestBatch batch;
+		ModbusErrorInfo err = modbusRequestBatchInit(&batch, buffer, sizeof(buffer));
+		assert_expr("batch initialized", modbusIsOk(err));
+
+		ModbusMaster builder;
+		err = modbusMasterInit(
+			&builder,
+			master.dataCallback,
+			master.exceptionCallback,
+			modbusRequestBatchAllocator,
+			modbusMasterDefaultFunctions,
+			modbusMasterDefaultFunctionCount);
+		assert_expr("builder initialized", modbusIsOk(err));
+		modbusMasterSetUserPointer(&builder, &batch);
+
+		for (int i = 0; i < 3; i++)
+		{
+			err = modbusBuildRequest03TCP(&builder, 100 + i, 1, i, 2);
+			assert_expr("request built", modbusIsOk(err));
+			err = modbusRequestBatchCommit(&batch, &builder);
+			assert_expr("request committed", modbusIsOk(err) && !modbusMasterGetRequest(&builder));
+		}
+
+		assert_expr("batch length", batch.count == 3 && modbusRequestBatchGetLength(&batch) == 36);
+		err = modbusBuildRequest03TCP(&builder, 103, 1, 3, 2);
+		assert_expr("batch full", modbusGetGeneralError(err) == MODBUS_ERROR_ALLOC);
+		err = modbusRequestBatchCommit(&batch, &builder);
+		assert_expr("nothing to commit", modbusGetGeneralError(err) == MODBUS_ERROR_LENGTH);
+
+		// Each frame in the batch is a valid request
+		for (int i = 0; i < 3; i++)
+		{
+			request_data = std::vector<uint8_t>(buffer + 12 * i, buffer + 12 * (i + 1));
+			parse_request();
+			assert_slave_ok();
+			assert_expr("transaction ID", modbusRBE(&response_data[0]) == 100 + i);
+			received_data.clear();
+			err = modbusParseResponseTCP(&master, request_data.data(), request_data.size(), response_data.data(), response_data.size());
+			assert_expr("response parsed", modbusIsOk(err) && received_data.size() == 2 && received_data[0].index == i);
+		}
+
+		modbusRequestBatchClear(&batch);
+		err = modbusBuildRequest03TCP(&builder, 0, 1, 0, 1);
+		assert_expr("batch reused", modbusIsOk(err) && modbusMasterGetRequest(&builder) == buffer);
+		modbusMasterDestroy(&builder);
+
+		err = modbusRequestBatchInit(&batch, buffer, 0);
+		assert_expr("zero capacity", modbusGetGeneralError(err) == MODBUS_ERROR_LENGTH);
+	});
+}
+
+// Feeds the stream with chunks of given size and returns all frames
+static std::vector<std::vector<uint8_t>> stream_frames(ModbusTCPStream *stream, const std::vector<uint8_t> &data, size_t chunk)
+{
+	std::vector<std::vector<uint8_t>> frames;
+	for (size_t offset = 0; offset < data.size(); offset += chunk)
+	{
+		std::vector<uint8_t> buffer(data.begin() + offset, data.begin() + std::min(offset + chunk, data.size()));
+		modbusTCPStreamFeed(stream, buffer.data(), buffer.size());
+
+		const uint8_t *frame;
+		uint16_t length;
+		while (modbusTCPStreamNext(stream, &frame, &length) == MODBUS_OK && frame)
+			frames.emplace_back(frame, frame + length);
+		assert_expr("chunk consumed", stream->inputLength == 0);
+	}
+	return frames;
+}
+
+void stream_tests()
+{
+	run_test("[TCP] Stream reassembly", [](){
+		set_mode("tcp");
+		std::vector<std::vector<uint8_t>> requests;
+		std::vector<uint8_t> data;
+		for (int i = 0; i < 5; i++)
+		{
+			build_request({1, 16, 0, i + 1, 1, 2, 3, 4, 5});
+			assert_master_ok();
+			requests.push_back(request_data);
+			data.insert(data.end(), request_data.begin(), request_data.end());
+		}
+
+		for (size_t chunk = 1; chunk <= data.size(); chunk++)
+		{
+			ModbusTCPStream stream;
+			modbusTCPStreamInit(&stream);
+			assert_expr("frames reassembled", stream_frames(&stream, data, chunk) == requests);
+			assert_expr("frame count", stream.frames == 5 && stream.errors == 0 && stream.length == 0);
+		}
+
+		// Frames contained in a single chunk are not copied
+		ModbusTCPStream stream;
+		modbusTCPStreamInit(&stream);
+		modbusTCPStreamFeed(&stream, data.data(), data.size());
+		const uint8_t *frame;
+		uint16_t length;
+		size_t offset = 0;
+		while (modbusTCPStreamNext(&stream, &frame, &length) == MODBUS_OK && frame)
+		{
+			assert_expr("zero copy", frame == data.data() + offset);
+			offset += length;
+		}
+		assert_expr("all frames", offset == data.size());
+	});
+
+	run_test("[TCP] Invalid stream headers", [](){
+		ModbusTCPStream stream;
+		modbusTCPStreamInit(&stream);
+		const uint8_t *frame;
+		uint16_t length;
+
+		std::vector<uint8_t> badProtocol = {0, 1, 0, 1, 0, 6, 1, 3, 0, 0, 0, 1};
+		modbusTCPStreamFeed(&stream, badProtocol.data(), 3);
+		assert_expr("partial header", modbusTCPStreamNext(&stream, &frame, &length) == MODBUS_OK && !frame);
+		modbusTCPStreamFeed(&stream, badProtocol.data() + 3, badProtocol.size() - 3);
+		assert_expr("bad protocol", modbusTCPStreamNext(&stream, &frame, &length) == MODBUS_ERROR_BAD_PROTOCOL);
+		assert_expr("data discarded", stream.length == 0 && stream.inputLength == 0 && stream.errors == 1);
+
+		std::vector<uint8_t> badLength = {0, 1, 0, 0, 1, 6, 1, 3, 0, 0, 0, 1};
+		modbusTCPStreamFeed(&stream, badLength.data(), badLength.size());
+		assert_expr("bad length", modbusTCPStreamNext(&stream, &frame, &length) == MODBUS_ERROR_LENGTH);
+
+		badLength[4] = 0;
+		badLength[5] = 1;
+		modbusTCPStreamFeed(&stream, badLength.data(), badLength.size());
+		assert_expr("too short", modbusTCPStreamNext(&stream, &frame, &length) == MODBUS_ERROR_LENGTH);
+
+		modbusTCPStreamReset(&stream);
+		badLength[5] = 6;
+		modbusTCPStreamFeed(&stream, badLength.data(), badLength.size());
+		assert_expr("valid after reset", modbusTCPStreamNext(&stream, &frame, &length) == MODBUS_OK && length == 12);
+	});
+
+	run_test("[RTU] Stream framing", [](){
+		set_mode("rtu");
+		std::vector<std::vector<int>> args = {
+			{1, 1, 0, 9},
+			{1, 3, 0, 4},
+			{1, 5, 2, 1},
+			{1, 6, 2, 0x1234},
+			{1, 15, 0, 3, 1, 0, 1},
+			{1, 16, 0, 3, 1, 2, 3},
+			{1, 22, 2, 0xff00, 0x00ff},
+		};
+
+		std::vector<std::vector<uint8_t>> requests, responses;
+		std::vector<uint8_t> requestStream, responseStream;
+		for (const auto &a : args)
+		{
+			build_request(a);
+			assert_master_ok();
+			parse_request();
+			assert_slave_ok();
+			requests.push_back(request_data);
+			responses.push_back(response_data);
+		}
+
+		// Exception response
+		std::vector<uint8_t> exception = {1, 0x83, 2, 0, 0};
+		modbusWLE(&exception[3], modbusCRC(exception.data(), 3));
+		responses.push_back(exception);
+
+		// Garbage before, between and after frames
+		std::vector<uint8_t> garbage = {0x00, 0x11, 0x03, 0x7f};
+		for (const auto &f : requests)
+		{
+			requestStream.insert(requestStream.end(), garbage.begin(), garbage.end());
+			requestStream.insert(requestStream.end(), f.begin(), f.end());
+		}
+		for (const auto &f : responses)
+		{
+			responseStream.insert(responseStream.end(), garbage.begin(), garbage.end());
+			responseStream.insert(responseStream.end(), f.begin(), f.end());
+		}
+
+		// Garbage resembling a long frame is ruled out only when enough bytes arrive
+		requestStream.insert(requestStream.end(), MODBUS_RTU_ADU_MAX, 0);
+		responseStream.insert(responseStream.end(), MODBUS_RTU_ADU_MAX, 0);
+
+		auto split = [](ModbusRTUStream *stream, const std::vector<uint8_t> &data, size_t chunk)
+		{
+			std::vector<std::vector<uint8_t>> frames;
+			for (size_t offset = 0; offset < data.size(); offset += chunk)
+			{
+				std::vector<uint8_t> buffer(data.begin() + offset, data.begin() + std::min(offset + chunk, data.size()));
+				modbusRTUStreamFeed(stream, buffer.data(), buffer.size());
+
+				const uint8_t *frame;
+				uint16_t length;
+				while (modbusRTUStreamNext(stream, &frame, &length))
+					frames.emplace_back(frame, frame + length);
+				assert_expr("chunk consumed", stream->inputLength == 0);
+			}
+			return frames;
+		};
+
+		for (size_t chunk = 1; chunk <= responseStream.size(); chunk++)
+		{
+			ModbusRTUStream stream;
+			modbusRTUStreamInit(&stream, MODBUS_RTU_STREAM_REQUESTS);
+			assert_expr("requests framed", split(&stream, requestStream, chunk) == requests);
+			assert_expr("request count", stream.frames == requests.size());
+
+			modbusRTUStreamInit(&stream, MODBUS_RTU_STREAM_RESPONSES);
+			assert_expr("responses framed", split(&stream, responseStream, chunk) == responses);
+			assert_expr("response count", stream.frames == responses.size());
+		}
+	});
+
+	run_test("[RTU] Stream frame completes on last byte", [](){
+		set_mode("rtu");
+		build_request({1, 16, 0, 5, 1, 2, 3, 4, 5});
+		assert_master_ok();
+
+		ModbusRTUStream stream;
+		modbusRTUStreamInit(&stream, MODBUS_RTU_STREAM_REQUESTS);
+		const uint8_t *frame;
+		uint16_t length;
+		for (size_t i = 0; i < request_data.size(); i++)
+		{
+			modbusRTUStreamFeed(&stream, &request_data[i], 1);
+			uint8_t found = modbusRTUStreamNext(&stream, &frame, &length);
+			assert_expr("frame boundary", found == (i == request_data.size() - 1));
+		}
+		assert_expr("frame returned", length == request_data.size() && std::equal(frame, frame + length, request_data.begin()));
+
+		// Corrupted CRC - frame is dropped byte by byte
+		request_data.back() ^= 0xff;
+		modbusRTUStreamFeed(&stream, request_data.data(), request_data.size());
+		assert_expr("bad CRC", !modbusRTUStreamNext(&stream, &frame, &length) && stream.errors >= 1 && stream.discarded >= 1);
+
+		// Prediction
+		uint8_t partial[] = {1, 3, 2};
+		assert_expr("needs function", modbusRTUStreamPredictLength(MODBUS_RTU_STREAM_RESPONSES, partial, 1) == 2);
+		assert_expr("needs byte count", modbusRTUStreamPredictLength(MODBUS_RTU_STREAM_RESPONSES, partial, 2) == 3);
+		assert_expr("response length", modbusRTUStreamPredictLength(MODBUS_RTU_STREAM_RESPONSES, partial, 3) == 7);
+		assert_expr("request length", modbusRTUStreamPredictLength(MODBUS_RTU_STREAM_REQUESTS, partial, 2) == 8);
+		partial[1] = 0x83;
+		assert_expr("exception response", modbusRTUStreamPredictLength(MODBUS_RTU_STREAM_RESPONSES, partial, 2) == 5);
+		assert_expr("no exception request", modbusRTUStreamPredictLength(MODBUS_RTU_STREAM_REQUESTS, partial, 2) == 0);
+	});
+
+	run_test("[RTU] Requests and responses over a stream", [](){
+		set_mode("rtu");
+		std::vector<std::vector<uint8_t>> requests, responses;
+		std::vector<uint8_t> requestStream;
+		for (int address : {1, 2, 0, 1})
+		{
+			build_request({address, 6, 1, address + 10});
+			assert_master_ok();
+			requests.push_back(request_data);
+			requestStream.insert(requestStream.end(), request_data.begin(), request_data.end());
+		}
+
+		// Slave side - requests for other slaves and broadcasts produce no response
+		ModbusRTUStream stream;
+		modbusRTUStreamInit(&stream, MODBUS_RTU_STREAM_REQUESTS);
+		for (size_t offset = 0; offset < requestStream.size(); offset += 5)
+		{
+			size_t length = std::min<size_t>(5, requestStream.size() - offset);
+			modbusRTUStreamFeed(&stream, &requestStream[offset], length);
+
+			uint8_t parsed;
+			while (1)
+			{
+				ModbusErrorInfo err = modbusParseRequestRTUStream(&slave, 1, &stream, &parsed);
+				if (!parsed)
+				{
+					assert_expr("no response", modbusIsOk(err) && !modbusSlaveGetResponseLength(&slave));
+					break;
+				}
+
+				if (modbusGetRequestError(err) == MODBUS_ERROR_ADDRESS)
+					continue;
+
+				assert_expr("request parsed", modbusIsOk(err));
+				if (modbusSlaveGetResponseLength(&slave))
+					responses.emplace_back(modbusSlaveGetResponse(&slave), modbusSlaveGetResponse(&slave) + modbusSlaveGetResponseLength(&slave));
+			}
+		}
+
+		assert_expr("response count", responses.size() == 2 && stream.frames == 4);
+		assert_reg(1, 11);
+
+		// Master side - both responses match the last request
+		std::vector<uint8_t> responseStream;
+		for (const auto &r : responses)
+			responseStream.insert(responseStream.end(), r.begin(), r.end());
+
+		modbusRTUStreamInit(&stream, MODBUS_RTU_STREAM_RESPONSES);
+		modbusRTUStreamFeed(&stream, responseStream.data(), responseStream.size());
+
+		uint8_t parsed;
+		ModbusErrorInfo err = modbusParseResponseRTUStream(&master, requests[3].data(), requests[3].size(), &stream, &parsed);
+		assert_expr("first response", parsed && modbusIsOk(err));
+		err = modbusParseResponseRTUStream(&master, requests[3].data(), requests[3].size(), &stream, &parsed);
+		assert_expr("second response", parsed && modbusIsOk(err));
+		err = modbusParseResponseRTUStream(&master, requests[3].data(), requests[3].size(), &stream, &parsed);
+		assert_expr("stream drained", !parsed && modbusIsOk(err));
+	});
+}
+
+void pipeline_tests()
+{
+	run_test("[PDU] Parse responses using request descriptors", [](){
+		set_mode("pdu");
+		std::vector<std::vector<int>> requests = {
+			{1, 3, 10, 4},
+			{1, 16, 20, 3, 0x1111, 0x2222, 0x3333},
+			{1, 15, 30, 9, 1, 0, 1, 0, 1, 0, 1, 0, 1},
+			{1, 22, 2, 0xff00, 0x00ff},
+		};
+
+		for (const auto &args : requests)
+		{
+			build_request(args);
+			assert_master_ok();
+			parse_request();
+			assert_slave_ok();
+
+			ModbusRequestDescriptor desc;
+			ModbusErrorInfo err = modbusRequestDescriptorInit(&desc, 1, request_data.data(), request_data.size());
+			assert_expr("descriptor created", modbusIsOk(err));
+			assert_expr("function", modbusRequestDescriptorGetFunction(&desc) == args.at(1));
+			assert_expr("index", modbusRequestDescriptorGetIndex(&desc) == args.at(2));
+			assert_expr("count", modbusRequestDescriptorGetCount(&desc) == args.at(3));
+
+			received_data.clear();
+			err = modbusParseResponseDescriptorPDU(&master, &desc, response_data.data(), response_data.size());
+			assert_expr("response parsed", modbusIsOk(err));
+			assert_expr("data reported", received_data.size() == (args.at(1) == 3 ? 4u : 0u));
+		}
+	});
+
+	run_test("[RTU] Descriptor extracted from built request", [](){
+		set_mode("rtu");
+		ModbusErrorInfo err = modbusBuildRequest03RTU(&master, 1, 2, 3);
+		assert_expr("request built", modbusIsOk(err));
+
+		ModbusRequestDescriptor desc;
+		err = modbusDescribeRequest(&desc, &master);
+		assert_expr("descriptor created", modbusIsOk(err));
+		assert_expr("address", desc.address == 1);
+		assert_expr("expected length", desc.expectedLength == 8);
+
+		// Request buffer no longer needed
+		request_data = std::vector<uint8_t>(modbusMasterGetRequest(&master), modbusMasterGetRequest(&master) + modbusMasterGetRequestLength(&master));
+		modbusMasterFreeRequest(&master);
+		parse_request();
+		assert_slave_ok();
+
+		received_data.clear();
+		err = modbusParseResponseDescriptorRTU(&master, &desc, response_data.data(), response_data.size());
+		assert_expr("response parsed", modbusIsOk(err) && received_data.size() == 3);
+
+		auto with_crc = [](std::vector<uint8_t> frame){
+			frame.resize(frame.size() + 2);
+			modbusWLE(&frame[frame.size() - 2], modbusCRC(frame.data(), frame.size() - 2));
+			return frame;
+		};
+
+		auto shorter = with_crc({1, 3, 2, 0, 0});
+		err = modbusParseResponseDescriptorRTU(&master, &desc, shorter.data(), shorter.size());
+		assert_expr("unexpected length", modbusGetResponseError(err) == MODBUS_ERROR_LENGTH);
+
+		auto exception = with_crc({1, 0x83, 2});
+		err = modbusParseResponseDescriptorRTU(&master, &desc, exception.data(), exception.size());
+		assert_expr("exception accepted", modbusIsOk(err));
+
+		auto other = with_crc({2, 3, 6, 0, 0, 0, 0, 0, 0});
+		err = modbusParseResponseDescriptorRTU(&master, &desc, other.data(), other.size());
+		assert_expr("bad address", modbusGetResponseError(err) == MODBUS_ERROR_ADDRESS);
+	});
+
+	run_test("[TCP] Descriptor extracted from built request", [](){
+		set_mode("tcp");
+		ModbusErrorInfo err = modbusBuildRequest16TCP(&master, 77, 1, 0, 2, std::vector<uint16_t>{5, 6}.data());
+		assert_expr("request built", modbusIsOk(err));
+
+		ModbusRequestDescriptor desc;
+		err = modbusDescribeRequest(&desc, &master);
+		assert_expr("descriptor created", modbusIsOk(err));
+		assert_expr("unit", desc.address == 1 && desc.expectedLength == 5);
+
+		request_data = std::vector<uint8_t>(modbusMasterGetRequest(&master), modbusMasterGetRequest(&master) + modbusMasterGetRequestLength(&master));
+		modbusMasterFreeRequest(&master);
+		parse_request();
+		assert_slave_ok();
+
+		err = modbusParseResponseDescriptorTCP(&master, &desc, 78, response_data.data(), response_data.size());
+		assert_expr("bad transaction", modbusGetResponseError(err) == MODBUS_ERROR_BAD_TRANSACTION);
+		err = modbusParseResponseDescriptorTCP(&master, &desc, 77, response_data.data(), response_data.size());
+		assert_expr("response parsed", modbusIsOk(err));
+
+		err = modbusDescribeRequest(&desc, &master);
+		assert_expr("no request", modbusGetGeneralError(err) == MODBUS_ERROR_LENGTH);
+	});
+
+	run_test("[TCP] Out-of-order responses", [](){
+		set_mode("tcp");
+		ModbusTransaction entries[4];
+		ModbusTransactionTable table;
+		ModbusErrorInfo err = modbusTransactionTableInit(&table, entries, 4);
+		assert_expr("table initialized", modbusIsOk(err));
+
+		std::vector<std::vector<uint8_t>> responses;
+		for (int i = 0; i < 4; i++)
+		{
+			build_request({1 + i, 3, 10 * i, i + 1});
+			assert_master_ok();
+
+			uint16_t tid;
+			err = modbusTransactionTableAdd(
+				&table,
+				request_data.data(),
+				request_data.size(),
+				1000,
+				&entries[i],
+				&tid);
+			assert_expr("transaction added", modbusIsOk(err));
+			assert_expr("transaction ID written", modbusRBE(&request_data.at(0)) == tid);
+
+			parse_request();
+			assert_slave_ok();
+			responses.push_back(response_data);
+		}
+
+		assert_expr("table full", modbusTransactionTableIsFull(&table));
+		err = modbusTransactionTableAdd(&table, request_data.data(), request_data.size(), 1000, NULL, NULL);
+		assert_expr("no free slots", modbusGetGeneralError(err) == MODBUS_ERROR_ALLOC);
+
+		for (int i = 3; i >= 0; i--)
+		{
+			ModbusTransaction completed;
+			received_data.clear();
+			err = modbusTransactionTableParseResponseTCP(
+				&table,
+				&master,
+				responses.at(i).data(),
+				responses.at(i).size(),
+				&completed);
+			assert_expr("response parsed", modbusIsOk(err));
+			assert_expr("matching context", completed.active && completed.context == &entries[i]);
+			assert_expr("matching unit", completed.request.address == 1 + i);
+			assert_expr("registers received", received_data.size() == (size_t)(i + 1));
+			assert_expr("first register", received_data.at(0).index == 10 * i && received_data.at(0).address == 1 + i);
+			assert_expr("count", modbusTransactionTableGetCount(&table) == (uint16_t) i);
+		}
+
+		ModbusTransaction unmatched;
+		err = modbusTransactionTableParseResponseTCP(&table, &master, responses.at(0).data(), responses.at(0).size(), &unmatched);
+		assert_expr("duplicate rejected", modbusGetResponseError(err) == MODBUS_ERROR_BAD_TRANSACTION);
+		assert_expr("not matched", !unmatched.active);
+	});
+
+	run_test("[TCP] Transaction expiry and ID wrap-around", [](){
+		set_mode("tcp");
+		ModbusTransaction entries[4];
+		ModbusTransactionTable table;
+		ModbusErrorInfo err = modbusTransactionTableInit(&table, entries, 4);
+		assert_expr("table initialized", modbusIsOk(err));
+		table.nextTransactionID = 0xfffe;
+
+		const uint32_t deadlines[] = {0xfffffff5, 0xfffffffa, 0x00000018};
+		std::vector<std::vector<uint8_t>> responses;
+		uint16_t tids[3];
+		for (int i = 0; i < 3; i++)
+		{
+			build_request({1, 4, i, 1});
+			err = modbusTransactionTableAdd(&table, request_data.data(), request_data.size(), deadlines[i], NULL, &tids[i]);
+			assert_expr("transaction added", modbusIsOk(err));
+			parse_request();
+			assert_slave_ok();
+			responses.push_back(response_data);
+		}
+		assert_expr("IDs wrap around", tids[0] == 0xfffe && tids[1] == 0xffff && tids[2] == 0);
+
+		uint32_t deadline;
+		assert_expr("next deadline", modbusTransactionTableNextDeadline(&table, &deadline) && deadline == 0xfffffff5);
+
+		ModbusTransaction expired;
+		assert_expr("first expired", modbusTransactionTablePopExpired(&table, 2, &expired) && expired.transactionID == 0xfffe);
+		assert_expr("second expired", modbusTransactionTablePopExpired(&table, 2, &expired) && expired.transactionID == 0xffff);
+		assert_expr("third pending", !modbusTransactionTablePopExpired(&table, 2, &expired));
+
+		err = modbusTransactionTableParseResponseTCP(&table, &master, responses.at(0).data(), responses.at(0).size(), NULL);
+		assert_expr("late response rejected", modbusGetResponseError(err) == MODBUS_ERROR_BAD_TRANSACTION);
+
+		responses.at(2).at(6) = 2;
+		err = modbusTransactionTableParseResponseTCP(&table, &master, responses.at(2).data(), responses.at(2).size(), NULL);
+		assert_expr("unit mismatch", modbusGetResponseError(err) == MODBUS_ERROR_ADDRESS);
+		assert_expr("table empty", modbusTransactionTableGetCount(&table) == 0);
+		assert_expr("no deadline", !modbusTransactionTableNextDeadline(&table, &deadline));
+	});
+}
+
+static std::vector<std::vector<uint8_t>> sent_frames;
+
+static ModbusError poll_transport(ModbusPollScheduler *scheduler, const ModbusPollGroup *group, const uint8_t *frame, uint16_t length)
+{
+	sent_frames.emplace_back(frame, frame + length);
+	return MODBUS_OK;
+}
+
+// Runs the scheduler and answers each request `latency` time units later
+static void run_scheduler(ModbusPollScheduler *scheduler, uint32_t start, uint32_t end, uint32_t latency)
+{
+	uint32_t answer_at = 0;
+	bool waiting = false;
+	for (uint32_t now = start; now != end; now++)
+	{
+		if (waiting && now == answer_at)
+		{
+			ModbusErrorInfo err = modbusPollSchedulerParseResponse(scheduler, response_data.data(), response_data.size(), now);
+			assert_expr("response parsed", modbusIsOk(err));
+			waiting = false;
+		}
+
+		size_t count = sent_frames.size();
+		ModbusErrorInfo err = modbusPollSchedulerRun(scheduler, now);
+		assert_expr("scheduler ok", modbusIsOk(err));
+		if (sent_frames.size() != count)
+		{
+			request_data = sent_frames.back();
+			parse_request();
+			assert_slave_ok();
+			answer_at = now + latency;
+			waiting = true;
+		}
+	}
+}
+
+void scheduler_tests()
+{
+	run_test("[PDU] Poll groups with different periods", [](){
+		set_mode("pdu");
+		sent_frames.clear();
+		ModbusPollGroup groups[2] = {};
+		groups[0].period = 10;
+		groups[0].function = 3;
+		groups[0].address = 1;
+		groups[0].index = 0;
+		groups[0].count = 2;
+		groups[1].period = 30;
+		groups[1].function = 1;
+		groups[1].address = 1;
+		groups[1].index = 5;
+		groups[1].count = 8;
+
+		ModbusPollScheduler scheduler;
+		ModbusErrorInfo err = modbusPollSchedulerInit(&scheduler, &master, MODBUS_POLL_PDU, poll_transport, groups, 2, 5, 0);
+		assert_expr("scheduler initialized", modbusIsOk(err));
+		run_scheduler(&scheduler, 0, 300, 1);
+
+		uint32_t wakeup;
+		assert_expr("wakeup time", modbusPollSchedulerNextWakeup(&scheduler, &wakeup) && wakeup == 300);
+		assert_expr("fast group polls", groups[0].stats.polls == 30 && groups[0].stats.responses == 30);
+		assert_expr("slow group polls", groups[1].stats.polls == 10 && groups[1].stats.responses == 10);
+		assert_expr("fast group period", modbusPollGroupGetAveragePeriod(&groups[0]) == 10);
+		assert_expr("slow group period", modbusPollGroupGetAveragePeriod(&groups[1]) == 30);
+		assert_expr("no overruns", groups[0].stats.overruns == 0 && groups[1].stats.overruns == 0);
+		assert_expr("jitter", groups[0].stats.maxJitter == 0 && groups[1].stats.maxJitter == 1);
+		assert_expr("jitter histogram", groups[0].stats.jitterHistogram[0] == 30 && groups[1].stats.jitterHistogram[1] == 10);
+		assert_expr("latency", groups[0].stats.maxLatency == 1);
+		assert_expr("bus occupancy", scheduler.busyTime == 40);
+
+		// Scheduler not run for a while
+		err = modbusPollSchedulerRun(&scheduler, 335);
+		assert_expr("late poll", modbusIsOk(err) && scheduler.pending == &groups[0]);
+		assert_expr("overrun", groups[0].stats.overruns == 1 && groups[0].stats.skipped == 2);
+		assert_expr("overrun histogram", groups[0].stats.overrunHistogram[5] == 1);
+		assert_expr("next release", groups[0].release == 340);
+		modbusMasterFreeRequest(&master);
+	});
+
+	run_test("[RTU] Saturated line is given to the most important group", [](){
+		set_mode("rtu");
+		sent_frames.clear();
+		ModbusPollGroup groups[3] = {};
+		for (int i = 0; i < 3; i++)
+		{
+			groups[i].period = 4;
+			groups[i].function = 4;
+			groups[i].address = 1;
+			groups[i].index = i;
+			groups[i].count = 1;
+		}
+		groups[2].priority = 1;
+
+		ModbusPollScheduler scheduler;
+		ModbusErrorInfo err = modbusPollSchedulerInit(&scheduler, &master, MODBUS_POLL_RTU, poll_transport, groups, 3, 5, 0);
+		assert_expr("scheduler initialized", modbusIsOk(err));
+		run_scheduler(&scheduler, 0, 100, 2);
+
+		assert_expr("important group keeps its period", groups[2].stats.maxPeriod == 4);
+		assert_expr("other groups overrun", groups[0].stats.overruns + groups[1].stats.overruns > 0);
+		uint32_t binned = 0;
+		for (int i = 0; i < MODBUS_POLL_HISTOGRAM_BINS; i++)
+			binned += groups[0].stats.overrunHistogram[i] + groups[1].stats.overrunHistogram[i];
+		assert_expr("overrun histogram", binned == groups[0].stats.overruns + groups[1].stats.overruns);
+		assert_expr("line saturated", scheduler.busyTime >= 96);
+	});
+
+	run_test("[TCP] Timeouts and stale responses", [](){
+		set_mode("tcp");
+		sent_frames.clear();
+		ModbusPollGroup groups[1] = {};
+		groups[0].period = 10;
+		groups[0].function = 3;
+		groups[0].address = 1;
+		groups[0].count = 1;
+
+		ModbusPollScheduler scheduler;
+		ModbusErrorInfo err = modbusPollSchedulerInit(&scheduler, &master, MODBUS_POLL_TCP, poll_transport, groups, 1, 5, 1000);
+		assert_expr("scheduler initialized", modbusIsOk(err));
+
+		err = modbusPollSchedulerRun(&scheduler, 1000);
+		assert_expr("request sent", modbusIsOk(err) && sent_frames.size() == 1);
+		request_data = sent_frames.back();
+		parse_request();
+		std::vector<uint8_t> stale = response_data;
+
+		uint32_t wakeup;
+		assert_expr("wakeup at timeout", modbusPollSchedulerNextWakeup(&scheduler, &wakeup) && wakeup == 1005);
+		err = modbusPollSchedulerRun(&scheduler, 1005);
+		assert_expr("timed out", modbusIsOk(err) && groups[0].stats.timeouts == 1 && sent_frames.size() == 1);
+
+		err = modbusPollSchedulerRun(&scheduler, 1010);
+		assert_expr("second request sent", modbusIsOk(err) && sent_frames.size() == 2);
+		err = modbusPollSchedulerParseResponse(&scheduler, stale.data(), stale.size(), 1011);
+		assert_expr("stale response rejected", modbusGetResponseError(err) == MODBUS_ERROR_BAD_TRANSACTION);
+
+		request_data = sent_frames.back();
+		parse_request();
+		err = modbusPollSchedulerParseResponse(&scheduler, response_data.data(), response_data.size(), 1012);
+		assert_expr("response parsed", modbusIsOk(err) && groups[0].stats.responses == 1);
+		err = modbusPollSchedulerParseResponse(&scheduler, response_data.data(), response_data.size(), 1012);
+		assert_expr("unexpected response", modbusGetResponseError(err) == MODBUS_ERROR_OTHER);
+	});
+
+	run_test("[RTU] Frames that aren't the response are ignored", [](){
+		set_mode("rtu");
+		sent_frames.clear();
+		ModbusPollGroup groups[1] = {};
+		groups[0].period = 10;
+		groups[0].function = 3;
+		groups[0].address = 1;
+		groups[0].count = 2;
+
+		ModbusRTTEntry entries[1];
+		ModbusRTTEstimator rtt;
+		ModbusErrorInfo err = modbusRTTEstimatorInit(&rtt, entries, 1, 50, 2, 100);
+		assert_expr("estimator initialized", modbusIsOk(err));
+
+		ModbusPollScheduler scheduler;
+		err = modbusPollSchedulerInit(&scheduler, &master, MODBUS_POLL_RTU, poll_transport, groups, 1, 50, 0);
+		assert_expr("scheduler initialized", modbusIsOk(err));
+		scheduler.rtt = &rtt;
+
+		err = modbusPollSchedulerRun(&scheduler, 0);
+		assert_expr("request sent", modbusIsOk(err) && sent_frames.size() == 1);
+		request_data = sent_frames.back();
+		parse_request();
+		std::vector<uint8_t> response = response_data;
+
+		auto with_crc = [](std::vector<uint8_t> frame){
+			modbusWLE(&frame[frame.size() - 2], modbusCRC(frame.data(), frame.size() - 2));
+			return frame;
+		};
+
+		std::vector<uint8_t> bad_crc = response;
+		bad_crc.back() ^= 1;
+		std::vector<uint8_t> other_slave = response;
+		other_slave[0] = 2;
+		std::vector<uint8_t> other_function = with_crc({1, 0x84, 2, 0, 0});
+		std::vector<std::vector<uint8_t>> glitches = {bad_crc, with_crc(other_slave), other_function, {0x55}};
+		for (const auto &frame : glitches)
+		{
+			err = modbusPollSchedulerParseResponse(&scheduler, frame.data(), frame.size(), 1);
+			assert_expr("frame rejected", !modbusIsOk(err));
+			assert_expr("request pending", scheduler.pending == &groups[0] && groups[0].stats.errors == 0);
+		}
+		assert_expr("no RTT sample", modbusRTTGetTimeout(&rtt, 1, 3) == 50);
+
+		err = modbusPollSchedulerParseResponse(&scheduler, response.data(), response.size(), 2);
+		assert_expr("response parsed", modbusIsOk(err) && !scheduler.pending && groups[0].stats.responses == 1);
+		assert_expr("RTT sample", modbusRTTGetTimeout(&rtt, 1, 3) == 6);
+
+		// A valid exception ends the request and is sampled too
+		err = modbusPollSchedulerRun(&scheduler, 10);
+		assert_expr("second request sent", modbusIsOk(err) && sent_frames.size() == 2);
+		std::vector<uint8_t> exception = with_crc({1, 0x83, 2, 0, 0});
+		err = modbusPollSchedulerParseResponse(&scheduler, exception.data(), exception.size(), 12);
+		assert_expr("exception parsed", modbusIsOk(err) && !scheduler.pending && groups[0].stats.responses == 2);
+		assert_expr("exception sampled", modbusRTTGetTimeout(&rtt, 1, 3) < 6);
+
+		// A malformed response of the right slave still ends the request, without a sample
+		uint32_t timeout = modbusRTTGetTimeout(&rtt, 1, 3);
+		err = modbusPollSchedulerRun(&scheduler, 20);
+		assert_expr("third request sent", modbusIsOk(err) && sent_frames.size() == 3);
+		std::vector<uint8_t> malformed = with_crc({1, 3, 2, 0, 0, 0, 0});
+		err = modbusPollSchedulerParseResponse(&scheduler, malformed.data(), malformed.size(), 21);
+		assert_expr("malformed response", modbusGetResponseError(err) == MODBUS_ERROR_LENGTH);
+		assert_expr("request finished", !scheduler.pending && groups[0].stats.errors == 1);
+		assert_expr("not sampled", modbusRTTGetTimeout(&rtt, 1, 3) == timeout);
+		modbusMasterFreeRequest(&master);
+	});
+
+	run_test("[PDU] Responses to other functions are ignored", [](){
+		set_mode("pdu");
+		sent_frames.clear();
+		ModbusPollGroup groups[1] = {};
+		groups[0].period = 10;
+		groups[0].function = 4;
+		groups[0].address = 1;
+		groups[0].count = 1;
+
+		ModbusPollScheduler scheduler;
+		ModbusErrorInfo err = modbusPollSchedulerInit(&scheduler, &master, MODBUS_POLL_PDU, poll_transport, groups, 1, 5, 0);
+		assert_expr("scheduler initialized", modbusIsOk(err));
+		err = modbusPollSchedulerRun(&scheduler, 0);
+		assert_expr("request sent", modbusIsOk(err) && sent_frames.size() == 1);
+
+		uint8_t other[] = {0x83, 2};
+		err = modbusPollSchedulerParseResponse(&scheduler, other, sizeof(other), 1);
+		assert_expr("frame rejected", modbusGetResponseError(err) == MODBUS_ERROR_FUNCTION && scheduler.pending);
+
+		uint8_t exception[] = {0x84, 2};
+		err = modbusPollSchedulerParseResponse(&scheduler, exception, sizeof(exception), 2);
+		assert_expr("exception parsed", modbusIsOk(err) && !scheduler.pending && groups[0].stats.responses == 1);
+		modbusMasterFreeRequest(&master);
+	});
+
+	run_test("Invalid poll group function", [](){
+		ModbusPollGroup group = {};
+		group.function = 16;
+		ModbusPollScheduler scheduler;
+		ModbusErrorInfo err = modbusPollSchedulerInit(&scheduler, &master, MODBUS_POLL_PDU, poll_transport, &group, 1, 5, 0);
+		assert_expr("init fails", modbusGetGeneralError(err) == MODBUS_ERROR_FUNCTION);
+	});
+}
+
+void rtt_tests()
+{
+	run_test("RTT estimation", [](){
+		ModbusRTTEntry entries[2];
+		ModbusRTTEstimator rtt;
+		ModbusErrorInfo err = modbusRTTEstimatorInit(&rtt, entries, 2, 50, 5, 100);
+		assert_expr("estimator initialized", modbusIsOk(err));
+		assert_expr("initial timeout", modbusRTTGetTimeout(&rtt, 1, 3) == 50);
+
+		modbusRTTAddSample(&rtt, 1, 3, 10);
+		assert_expr("first sample", modbusRTTGetTimeout(&rtt, 1, 3) == 30);
+		modbusRTTAddSample(&rtt, 1, 3, 10);
+		modbusRTTAddSample(&rtt, 1, 3, 10);
+		assert_expr("variance decays", modbusRTTGetTimeout(&rtt, 1, 3) == 22);
+		assert_expr("other function unaffected", modbusRTTGetTimeout(&rtt, 1, 4) == 50);
+
+		modbusRTTAddTimeout(&rtt, 1, 3);
+		assert_expr("backoff", modbusRTTGetTimeout(&rtt, 1, 3) == 44);
+		modbusRTTAddTimeout(&rtt, 1, 3);
+		modbusRTTAddTimeout(&rtt, 1, 3);
+		assert_expr("backoff limited", modbusRTTGetTimeout(&rtt, 1, 3) == 100);
+		modbusRTTAddSample(&rtt, 1, 3, 1);
+		assert_expr("backoff cleared", modbusRTTGetTimeout(&rtt, 1, 3) == 26);
+		modbusRTTAddSample(&rtt, 2, 3, 1);
+		assert_expr("lower bound", modbusRTTGetTimeout(&rtt, 2, 3) == 5);
+
+		// Storage full - new pair takes over the entry it hashes onto
+		modbusRTTAddSample(&rtt, 3, 3, 1);
+		assert_expr("new pair tracked", modbusRTTGetTimeout(&rtt, 3, 3) == 5);
+		assert_expr("evicted pair forgotten", modbusRTTGetTimeout(&rtt, 1, 3) == 50);
+		assert_expr("other pair kept", modbusRTTGetTimeout(&rtt, 2, 3) == 5);
+
+		err = modbusRTTEstimatorInit(&rtt, entries, 0, 50, 5, 100);
+		assert_expr("zero capacity", modbusGetGeneralError(err) == MODBUS_ERROR_COUNT);
+		err = modbusRTTEstimatorInit(&rtt, entries, 2, 500, 5, 100);
+		assert_expr("initial timeout out of range", modbusGetGeneralError(err) == MODBUS_ERROR_VALUE);
+	});
+
+	run_test("[PDU] Scheduler with adaptive timeouts", [](){
+		set_mode("pdu");
+		sent_frames.clear();
+		ModbusPollGroup groups[1] = {};
+		groups[0].period = 10;
+		groups[0].function = 3;
+		groups[0].address = 1;
+		groups[0].count = 1;
+
+		ModbusRTTEntry entries[4];
+		ModbusRTTEstimator rtt;
+		ModbusErrorInfo err = modbusRTTEstimatorInit(&rtt, entries, 4, 50, 2, 100);
+		assert_expr("estimator initialized", modbusIsOk(err));
+
+		ModbusPollScheduler scheduler;
+		err = modbusPollSchedulerInit(&scheduler, &master, MODBUS_POLL_PDU, poll_transport, groups, 1, 50, 0);
+		assert_expr("scheduler initialized", modbusIsOk(err));
+		scheduler.rtt = &rtt;
+		run_scheduler(&scheduler, 0, 100, 1);
+		assert_expr("samples collected", groups[0].stats.responses == 10 && modbusRTTGetTimeout(&rtt, 1, 3) == 3);
+
+		uint32_t wakeup;
+		err = modbusPollSchedulerRun(&scheduler, 100);
+		assert_expr("adaptive timeout", modbusIsOk(err) && modbusPollSchedulerNextWakeup(&scheduler, &wakeup) && wakeup == 103);
+		err = modbusPollSchedulerRun(&scheduler, 103);
+		assert_expr("timed out", modbusIsOk(err) && groups[0].stats.timeouts == 1);
+		assert_expr("timeout backed off", modbusRTTGetTimeout(&rtt, 1, 3) == 6);
+		modbusMasterFreeRequest(&master);
+	});
+}
+
+void cache_tests()
+{
+	run_test("[TCP] Read response cache", [](){
+		set_mode("tcp");
+		ModbusCacheRange ranges[] = {
+			{1, 3, 0, 10, 100},
+			{1, 1, 0, 16, 1000},
+		};
+		ModbusCacheEntry entries[2];
+		ModbusResponseCache cache;
+		ModbusErrorInfo err = modbusResponseCacheInit(&cache, ranges, 2, entries, 2);
+		assert_expr("cache initialized", modbusIsOk(err));
+
+		// Requests are served from the cache if possible, otherwise by the slave
+		uint8_t cached[MODBUS_TCP_ADU_MAX];
+		uint16_t cachedLength;
+		auto proxy = [&](const std::vector<int> &args, uint32_t now){
+			build_request(args);
+			if (modbusResponseCacheLookupTCP(&cache, request_data.data(), request_data.size(), now, cached, &cachedLength))
+			{
+				response_data = std::vector<uint8_t>(cached, cached + cachedLength);
+				return true;
+			}
+
+			parse_request();
+			assert_slave_ok();
+			modbusResponseCacheStoreTCP(&cache, request_data.data(), request_data.size(), response_data.data(), response_data.size(), now);
+			if (args[1] >= 5)
+				modbusResponseCacheInvalidate(&cache, args[0], request_data.data() + 7, request_data.size() - 7);
+			return false;
+		};
+
+		clear_regs(0);
+		regs.at(3) = 33;
+		assert_expr("first read misses", !proxy({1, 3, 2, 4}, 0));
+		std::vector<uint8_t> first = response_data;
+		regs.at(3) = 44;
+		assert_expr("repeated read hits", proxy({1, 3, 2, 4}, 50));
+		std::vector<uint8_t> second = response_data;
+		assert_expr("transaction ID rewritten", second[1] == first[1] + 1);
+		second[1] = first[1];
+		assert_expr("cached response", second == first);
+		parse_response();
+		assert_master_ok();
+
+		assert_expr("different count misses", !proxy({1, 3, 2, 5}, 50));
+		assert_expr("expired", !proxy({1, 3, 2, 4}, 100));
+		assert_expr("stored again", proxy({1, 3, 2, 4}, 150));
+
+		assert_expr("outside of ranges", !proxy({1, 3, 8, 4}, 150) && !proxy({1, 3, 8, 4}, 150));
+		assert_expr("other slave", !proxy({2, 3, 2, 4}, 150) && !proxy({2, 3, 2, 4}, 150));
+		assert_expr("input registers", !proxy({1, 4, 2, 4}, 150) && !proxy({1, 4, 2, 4}, 150));
+
+		// Writes invalidate overlapping reads only
+		assert_expr("coils", !proxy({1, 1, 0, 8}, 150) && proxy({1, 1, 0, 8}, 150));
+		assert_expr("write", !proxy({1, 6, 9, 1}, 150));
+		assert_expr("non-overlapping write", proxy({1, 3, 2, 4}, 150) && proxy({1, 1, 0, 8}, 150));
+		assert_expr("overlapping write", !proxy({1, 16, 5, 2, 1, 2}, 150));
+		assert_expr("invalidated", !proxy({1, 3, 2, 4}, 150) && proxy({1, 1, 0, 8}, 150));
+		assert_reg(5, 1);
+		assert_expr("coil write", !proxy({1, 5, 7, 1}, 150) && !proxy({1, 1, 0, 8}, 150));
+		assert_expr("statistics", cache.hits == 6 && cache.invalidations == 2);
+
+		// The entry closest to expiring is replaced
+		assert_expr("fill", proxy({1, 3, 2, 4}, 160) && proxy({1, 1, 0, 8}, 160));
+		assert_expr("replace", !proxy({1, 3, 0, 1}, 160) && proxy({1, 3, 0, 1}, 160));
+		assert_expr("replaced", !proxy({1, 3, 2, 4}, 160) && proxy({1, 1, 0, 8}, 160));
+
+		// Exceptions aren't cached, broadcasts and unknown requests invalidate
+		set_rlock(0, 1);
+		build_request({1, 3, 0, 2});
+		parse_request();
+		modbusResponseCacheStoreTCP(&cache, request_data.data(), request_data.size(), response_data.data(), response_data.size(), 160);
+		assert_expr("exception not cached", !proxy({1, 3, 0, 2}, 160));
+		set_rlock(0, 0);
+
+		uint8_t unknown[] = {0x2b, 0x0e};
+		modbusResponseCacheInvalidate(&cache, 1, unknown, sizeof(unknown));
+		assert_expr("unknown function", !proxy({1, 1, 0, 8}, 160));
+		uint8_t broadcast[] = {5, 0, 3, 0xff, 0};
+		modbusResponseCacheInvalidate(&cache, 0, broadcast, sizeof(broadcast));
+		assert_expr("broadcast", !proxy({1, 1, 0, 8}, 160));
+
+		ranges[0].function = 5;
+		err = modbusResponseCacheInit(&cache, ranges, 2, entries, 2);
+		assert_expr("not a read", modbusGetGeneralError(err) == MODBUS_ERROR_VALUE);
+	});
+}
+
+void shadow_tests()
+{
+	run_test("[RTU] Change-of-value filtering", [](){
+		set_mode("rtu");
+		uint16_t values[8], deadbands[8] = {0};
+		uint8_t known[1];
+		deadbands[2] = 5;
+		ModbusShadowRange range = {};
+		range.type = MODBUS_HOLDING_REGISTER;
+		range.address = 1;
+		range.index = 0;
+		range.count = 8;
+		range.values = values;
+		range.known = known;
+		range.deadbands = deadbands;
+
+		ModbusShadowCache cache;
+		ModbusErrorInfo err = modbusShadowCacheInit(&cache, &range, 1);
+		assert_expr("cache initialized", modbusIsOk(err));
+
+		auto poll = [&](){
+			build_request({1, 3, 0, 8});
+			parse_request();
+			received_data.clear();
+			parse_response();
+			assert_master_ok();
+
+			std::vector<uint16_t> changed;
+			for (const auto &args : received_data)
+				if (modbusShadowUpdate(&cache, &args))
+					changed.push_back(args.index);
+			return changed;
+		};
+
+		clear_regs(0);
+		assert_expr("first poll reports all", poll().size() == 8);
+		assert_expr("no changes", poll().empty());
+
+		regs.at(1) = 100;
+		regs.at(2) = 3;
+		assert_expr("change reported", poll() == std::vector<uint16_t>{1});
+		regs.at(2) = 6;
+		assert_expr("deadband exceeded", poll() == std::vector<uint16_t>{2});
+		regs.at(2) = 1;
+		assert_expr("deadband relative to last report", poll().empty());
+		assert_expr("statistics", cache.passed == 10 && cache.suppressed == 30);
+
+		ModbusDataCallbackArgs other = {MODBUS_INPUT_REGISTER, 0, 0, 4, 1};
+		assert_expr("outside of ranges", modbusShadowUpdate(&cache, &other) && modbusShadowUpdate(&cache, &other));
+
+		modbusShadowCacheInvalidate(&cache);
+		assert_expr("invalidated", poll().size() == 8);
+
+		range.count = 0;
+		err = modbusShadowCacheInit(&cache, &range, 1);
+		assert_expr("empty range", modbusGetGeneralError(err) == MODBUS_ERROR_VALUE);
+	});
+
+	run_test("[RTU] Change-of-value filtering of whole responses", [](){
+		set_mode("rtu");
+		static std::vector<ModbusDataCallbackArgs> values;
+		static std::vector<std::vector<uint16_t>> runs;
+
+		uint16_t regValues[16], coilValues[20], deadbands[16] = {0};
+		uint8_t regKnown[2], coilKnown[3];
+		deadbands[2] = 5;
+		ModbusShadowRange ranges[2] = {};
+		ranges[0].type = MODBUS_HOLDING_REGISTER;
+		ranges[0].address = 1;
+		ranges[0].index = 0;
+		ranges[0].count = 16;
+		ranges[0].values = regValues;
+		ranges[0].known = regKnown;
+		ranges[0].deadbands = deadbands;
+		ranges[1].type = MODBUS_COIL;
+		ranges[1].address = 1;
+		ranges[1].index = 4;
+		ranges[1].count = 20;
+		ranges[1].values = coilValues;
+		ranges[1].known = coilKnown;
+
+		ModbusShadowCache cache;
+		ModbusErrorInfo err = modbusShadowCacheInit(&cache, ranges, 2);
+		assert_expr("cache initialized", modbusIsOk(err));
+
+		static const ModbusMasterFunctionHandler functions[] = {
+			{1, modbusShadowParseResponse01020304},
+			{2, modbusShadowParseResponse01020304},
+			{3, modbusShadowParseResponse01020304},
+			{4, modbusShadowParseResponse01020304},
+		};
+		ModbusMaster filtered;
+		err = modbusMasterInit(
+			&filtered,
+			[](const ModbusMaster *m, const ModbusDataCallbackArgs *args){
+				values.push_back(*args);
+				return MODBUS_OK;
+			},
+			NULL,
+			modbusDefaultAllocator,
+			functions,
+			4);
+		assert_expr("master initialized", modbusIsOk(err));
+		modbusMasterSetUserPointer(&filtered, &cache);
+
+		// Returns indices of values passed to the data callback
+		auto poll = [&](int function, int index, int count){
+			build_request({1, function, index, count});
+			parse_request();
+			assert_slave_ok();
+			values.clear();
+			runs.clear();
+			err = modbusParseResponseRTU(&filtered, request_data.data(), request_data.size(), response_data.data(), response_data.size());
+			assert_expr("response parsed", modbusIsOk(err));
+
+			std::vector<uint16_t> indices;
+			for (const auto &args : values)
+				indices.push_back(args.index);
+			return indices;
+		};
+
+		clear_regs(0);
+		auto all = poll(3, 0, 20);
+		assert_expr("first poll reports all", all.size() == 20 && all.front() == 0 && all.back() == 19);
+		assert_expr("values outside of ranges always reported", poll(3, 0, 20) == std::vector<uint16_t>({16, 17, 18, 19}));
+		assert_expr("no changes", poll(3, 0, 16).empty());
+
+		regs.at(1) = 100;
+		regs.at(2) = 3;
+		regs.at(9) = 1;
+		regs.at(10) = 2;
+		regs.at(15) = 3;
+		assert_expr("changes reported", poll(3, 0, 16) == std::vector<uint16_t>({1, 9, 10, 15}));
+		assert_expr("values reported", values[0].value == 100 && values[3].value == 3 && values[3].function == 3);
+		regs.at(2) = 6;
+		assert_expr("deadband exceeded", poll(3, 2, 1) == std::vector<uint16_t>{2});
+
+		// Changed values in runs
+		cache.runCallback = [](const ModbusMaster *m, const ModbusShadowRun *run){
+			runs.push_back(std::vector<uint16_t>{run->index, run->count});
+			return MODBUS_OK;
+		};
+		for (int i = 4; i < 16; i++)
+			regs.at(i) = 1000 + i;
+		regs.at(7) = 0;
+		regs.at(1) = 101;
+		assert_expr("values outside of ranges", poll(3, 0, 18) == std::vector<uint16_t>({16, 17}));
+		assert_expr("changed runs", runs == std::vector<std::vector<uint16_t>>({{1, 1}, {4, 3}, {8, 8}}));
+		assert_expr("run values", regValues[4] == 1004 && regValues[15] == 1015);
+		cache.runCallback = NULL;
+
+		// Only the coils in the range are filtered
+		coils.at(5) = 1;
+		assert_expr("first coil poll", poll(1, 0, 30).size() == 30);
+		assert_expr("coils outside of range", poll(1, 0, 30) == std::vector<uint16_t>({0, 1, 2, 3, 24, 25, 26, 27, 28, 29}));
+		coils.at(5) = 0;
+		coils.at(23) = 1;
+		assert_expr("coil changes", poll(1, 4, 20) == std::vector<uint16_t>({5, 23}));
+
+		// Invalid responses are rejected as by the regular parser and don't affect the cache
+		build_request({1, 3, 0, 4});
+		parse_request();
+		uint32_t passed = cache.passed;
+		uint32_t suppressed = cache.suppressed;
+		response_data.pop_back();
+		ModbusErrorInfo expected = modbusParseResponseRTU(&master, request_data.data(), request_data.size(), response_data.data(), response_data.size());
+		err = modbusParseResponseRTU(&filtered, request_data.data(), request_data.size(), response_data.data(), response_data.size());
+		assert_expr("same error", !modbusIsOk(err) && err.error == expected.error && err.source == expected.source);
+		std::vector<uint8_t> pdu = {3, 7, 0, 0, 0, 0, 0, 0, 0};
+		std::vector<uint8_t> requestPDU = {3, 0, 0, 0, 4};
+		expected = modbusParseResponsePDU(&master, 1, requestPDU.data(), requestPDU.size(), pdu.data(), pdu.size());
+		err = modbusParseResponsePDU(&filtered, 1, requestPDU.data(), requestPDU.size(), pdu.data(), pdu.size());
+		assert_expr("same PDU error", !modbusIsOk(err) && err.error == expected.error && err.source == expected.source);
+		assert_expr("cache unchanged", cache.passed == passed && cache.suppressed == suppressed);
+
+		// Same decisions as filtering value by value
+		uint16_t refValues[16];
+		uint8_t refKnown[2];
+		ModbusShadowRange ref = ranges[0];
+		ref.values = refValues;
+		ref.known = refKnown;
+		ModbusShadowCache refCache;
+		err = modbusShadowCacheInit(&refCache, &ref, 1);
+		modbusShadowCacheInvalidate(&cache);
+		srand(1);
+		for (int n = 0; n < 50; n++)
+		{
+			for (int i = 0; i < 16; i++)
+				if (rand() % 4 == 0)
+					regs.at(i) = rand() % 16;
+
+			auto changed = poll(3, 0, 16);
+			std::vector<uint16_t> expectedChanged;
+			for (int i = 0; i < 16; i++)
+			{
+				ModbusDataCallbackArgs args = {MODBUS_HOLDING_REGISTER, (uint16_t) i, regs.at(i), 3, 1};
+				if (modbusShadowUpdate(&refCache, &args))
+					expectedChanged.push_back(i);
+			}
+			assert_expr("same as value by value", changed == expectedChanged);
+		}
+		assert_expr("same statistics", cache.passed == refCache.passed && cache.suppressed == refCache.suppressed);
+
+		modbusMasterDestroy(&filtered);
+	});
+}
+
+void rtubus_tests()
+{
+	run_test("RTU air time", [](){
+		assert_expr("char time", modbusRTUCharTime(9600) == 1146);
+		assert_expr("frame time", modbusRTUFrameTime(19200, 8) == 4584);
+		assert_expr("silence", modbusRTUSilence(9600) == 4011);
+		assert_expr("silence above 19200 baud", modbusRTUSilence(115200) == 1750);
+	});
+
+	run_test("Expected response length", [](){
+		const uint8_t read03[] = {3, 0, 0, 0, 2};
+		const uint8_t read01[] = {1, 0, 0, 0, 9};
+		const uint8_t write16[] = {16, 0, 0, 0, 1, 2, 0, 0};
+		const uint8_t tooMany[] = {3, 0, 0, 0, 200};
+		const uint8_t unknown[] = {0x2b, 0x0e, 1, 0};
+		assert_expr("FC03", modbusExpectedResponseLength(read03, sizeof(read03)) == 6);
+		assert_expr("FC01", modbusExpectedResponseLength(read01, sizeof(read01)) == 4);
+		assert_expr("FC16", modbusExpectedResponseLength(write16, sizeof(write16)) == 5);
+		assert_expr("invalid count", modbusExpectedResponseLength(tooMany, sizeof(tooMany)) == 0);
+		assert_expr("unknown function", modbusExpectedResponseLength(unknown, sizeof(unknown)) == 0);
+	});
+
+	run_test("[RTU] Multi-drop bus with unresponsive slaves", [](){
+		set_mode("rtu");
+		ModbusRTUSlave slaves[3] = {};
+		slaves[0].address = 1;
+		slaves[1].address = 2;
+		slaves[2].address = 3;
+
+		ModbusRTUBus bus;
+		ModbusErrorInfo err = modbusRTUBusInit(&bus, 19200, 1000, slaves, 3, 0);
+		assert_expr("bus initialized", modbusIsOk(err));
+		bus.backoffMin = 1000000;
+
+		// First request - deadline derived from air times
+		ModbusRTUSlave *s = modbusRTUBusNextSlave(&bus, 0);
+		assert_expr("first slave", s == &slaves[0]);
+		err = modbusBuildRequest03RTU(&master, s->address, 0, 2);
+		assert_master_ok();
+		err = modbusRTUBusBeginTransaction(&bus, s, &master, 0);
+		assert_expr("transaction started", modbusIsOk(err));
+		assert_expr("deadline", bus.deadline == 4584 + 2006 + 1000 + 5157);
+		assert_expr("bus busy", modbusRTUBusNextSlave(&bus, 100) == NULL);
+
+		request_data = std::vector<uint8_t>(modbusMasterGetRequest(&master), modbusMasterGetRequest(&master) + modbusMasterGetRequestLength(&master));
+		parse_request();
+		assert_slave_ok();
+		err = modbusRTUBusParseResponse(&bus, &master, response_data.data(), response_data.size(), 12000);
+		assert_expr("response parsed", modbusIsOk(err) && slaves[0].responses == 1);
+		assert_expr("t3.5 respected", modbusRTUBusNextSlave(&bus, 13000) == NULL);
+
+		// Slaves 2 and 3 never respond
+		uint32_t now = 14006;
+		for (int i = 0; i < 12; i++)
+		{
+			s = modbusRTUBusNextSlave(&bus, now);
+			assert_expr("slave selected", s != NULL);
+			err = modbusBuildRequest03RTU(&master, s->address, 0, 2);
+			err = modbusRTUBusBeginTransaction(&bus, s, &master, now);
+			assert_expr("transaction started", modbusIsOk(err));
+
+			uint32_t wakeup;
+			assert_expr("wakeup", modbusRTUBusNextWakeup(&bus, &wakeup) && wakeup == bus.deadline);
+			if (s->address == 1)
+			{
+				request_data = std::vector<uint8_t>(modbusMasterGetRequest(&master), modbusMasterGetRequest(&master) + modbusMasterGetRequestLength(&master));
+				parse_request();
+				now += 12000;
+				err = modbusRTUBusParseResponse(&bus, &master, response_data.data(), response_data.size(), now);
+				assert_expr("response parsed", modbusIsOk(err));
+			}
+			else
+			{
+				assert_expr("not timed out yet", !modbusRTUBusCheckTimeout(&bus, wakeup - 1));
+				now = wakeup;
+				assert_expr("timed out", modbusRTUBusCheckTimeout(&bus, now));
+			}
+			now += bus.t35;
+		}
+		modbusMasterFreeRequest(&master);
+
+		// Dead slaves end up in backoff and the responsive one gets the line
+		assert_expr("dead slaves in backoff", slaves[1].backoff == bus.backoffMin && slaves[2].backoff == bus.backoffMin);
+		assert_expr("timeouts counted", slaves[1].timeouts == 2 && slaves[2].timeouts == 2);
+		assert_expr("live slave served", slaves[0].responses == 9 && slaves[0].errors == 0);
+		assert_expr("bus occupancy", bus.busyTime == slaves[0].busyTime + slaves[1].busyTime + slaves[2].busyTime);
+		assert_expr("line fully utilized", bus.busyTime == now);
+
+		// Probe after backoff expires
+		s = modbusRTUBusNextSlave(&bus, slaves[1].probeAt);
+		assert_expr("slave probed", s == &slaves[1]);
+		err = modbusBuildRequest03RTU(&master, s->address, 0, 2);
+		err = modbusRTUBusBeginTransaction(&bus, s, &master, slaves[1].probeAt);
+
+		// Noise and frames that aren't the response don't end the transaction
+		std::vector<uint8_t> response = {2, 3, 4, 0, 0, 0, 0, 0, 0};
+		modbusWLE(&response[7], modbusCRC(response.data(), 7));
+		std::vector<uint8_t> bad_crc = response;
+		bad_crc.back() ^= 1;
+		std::vector<uint8_t> other_slave = response;
+		other_slave[0] = 1;
+		modbusWLE(&other_slave[7], modbusCRC(other_slave.data(), 7));
+		std::vector<uint8_t> other_function = {2, 0x84, 2, 0, 0};
+		modbusWLE(&other_function[3], modbusCRC(other_function.data(), 3));
+		std::vector<std::vector<uint8_t>> glitches = {bad_crc, other_slave, other_function, {0xff, 0x00}};
+		for (const auto &frame : glitches)
+		{
+			err = modbusRTUBusParseResponse(&bus, &master, frame.data(), frame.size(), slaves[1].probeAt + 100);
+			assert_expr("frame rejected", !modbusIsOk(err) && bus.pending == &slaves[1]);
+			assert_expr("still in backoff", slaves[1].backoff == bus.backoffMin && slaves[1].errors == 0);
+		}
+
+		assert_expr("timed out", modbusRTUBusCheckTimeout(&bus, bus.deadline));
+		assert_expr("backoff doubled", slaves[1].backoff == 2 * bus.backoffMin);
+
+		// A malformed response ends the transaction, but doesn't clear the backoff
+		now = bus.idleFrom;
+		err = modbusRTUBusBeginTransaction(&bus, s, &master, now);
+		assert_expr("slave probed again", modbusIsOk(err));
+		std::vector<uint8_t> malformed = {2, 3, 2, 0, 0, 0, 0, 0, 0};
+		modbusWLE(&malformed[7], modbusCRC(malformed.data(), 7));
+		err = modbusRTUBusParseResponse(&bus, &master, malformed.data(), malformed.size(), now + 100);
+		assert_expr("malformed response", modbusGetResponseError(err) == MODBUS_ERROR_LENGTH && bus.pending == NULL);
+		assert_expr("error counted", slaves[1].errors == 1 && slaves[1].backoff == 2 * bus.backoffMin);
+
+		// A valid exception brings the slave out of backoff
+		now = bus.idleFrom;
+		err = modbusRTUBusBeginTransaction(&bus, s, &master, now);
+		assert_expr("last probe", modbusIsOk(err));
+		std::vector<uint8_t> exception = {2, 0x83, 2, 0, 0};
+		modbusWLE(&exception[3], modbusCRC(exception.data(), 3));
+		err = modbusRTUBusParseResponse(&bus, &master, exception.data(), exception.size(), now + 100);
+		assert_expr("exception parsed", modbusIsOk(err) && bus.pending == NULL);
+		assert_expr("backoff cleared", slaves[1].backoff == 0 && slaves[1].failures == 0 && slaves[1].responses == 1);
+		modbusMasterFreeRequest(&master);
+	});
+
+	run_test("[RTU] Broadcast on multi-drop bus", [](){
+		ModbusRTUSlave slave = {};
+		slave.address = 1;
+		ModbusRTUBus bus;
+		ModbusErrorInfo err = modbusRTUBusInit(&bus, 115200, 500, &slave, 1, 0);
+		assert_expr("bus initialized", modbusIsOk(err));
+		err = modbusBuildRequest06RTU(&master, 0, 1, 1234);
+		err = modbusRTUBusBeginTransaction(&bus, &slave, &master, 0);
+		assert_expr("transaction started", modbusIsOk(err));
+		assert_expr("deadline", bus.deadline == modbusRTUFrameTime(115200, 8) + 500);
+		assert_expr("second transaction", modbusGetGeneralError(modbusRTUBusBeginTransaction(&bus, &slave, &master, 0)) == MODBUS_ERROR_OTHER);
+		assert_expr("broadcast done", !modbusRTUBusCheckTimeout(&bus, bus.deadline) && bus.pending == NULL);
+		assert_expr("no failures", slave.timeouts == 0 && slave.failures == 0);
+		modbusMasterFreeRequest(&master);
+
+		assert_expr("invalid baudrate", modbusGetGeneralError(modbusRTUBusInit(&bus, 0, 0, &slave, 1, 0)) == MODBUS_ERROR_VALUE);
+	});
+
+	run_test("[RTU] Multi-drop bus initialized late in the clock cycle", [](){
+		ModbusRTUSlave slaves[2] = {};
+		slaves[0].address = 1;
+		slaves[1].address = 2;
+		ModbusRTUBus bus;
+		const uint32_t start = 3000000000ul;
+		ModbusErrorInfo err = modbusRTUBusInit(&bus, 19200, 1000, slaves, 2, start);
+		assert_expr("bus initialized", modbusIsOk(err));
+
+		uint32_t wakeup;
+		assert_expr("wakeup now", modbusRTUBusNextWakeup(&bus, &wakeup) && wakeup == start);
+		ModbusRTUSlave *s = modbusRTUBusNextSlave(&bus, start);
+		assert_expr("slave available", s == &slaves[0]);
+
+		// Put the second slave into backoff right before the clock wraps around
+		uint32_t now = UINT32_MAX - 5000;
+		s = modbusRTUBusNextSlave(&bus, now);
+		assert_expr("second slave", s == &slaves[1]);
+		err = modbusBuildRequest03RTU(&master, s->address, 0, 2);
+		bus.failureThreshold = 1;
+		err = modbusRTUBusBeginTransaction(&bus, s, &master, now);
+		assert_expr("transaction started", modbusIsOk(err));
+		assert_expr("timed out", modbusRTUBusCheckTimeout(&bus, bus.deadline));
+		assert_expr("deadline wrapped", bus.deadline < start);
+		assert_expr("in backoff", slaves[1].backoff && slaves[1].probeAt == bus.deadline + bus.backoffMin);
+		assert_expr("bus idle after t3.5", modbusRTUBusNextSlave(&bus, bus.idleFrom) == &slaves[0]);
+		assert_expr("dead slave skipped", modbusRTUBusNextSlave(&bus, bus.idleFrom) == &slaves[0]);
+		assert_expr("probed after wrap", modbusRTUBusNextSlave(&bus, slaves[1].probeAt) == &slaves[1]);
+		modbusMasterFreeRequest(&master);
+	});
+}
+
+struct completed_write
+{
+	uintptr_t context;
+	ModbusWriteResult result;
+	ModbusExceptionCode code;
+};
+
+static std::vector<completed_write> completed_writes;
+
+static ModbusError coalesce_transport(ModbusWriteCoalescer *coalescer, const uint8_t *frame, uint16_t length)
+{
+	sent_frames.emplace_back(frame, frame + length);
+	return MODBUS_OK;
+}
+
+static void write_completed(ModbusWriteCoalescer *coalescer, const ModbusPendingWrite *write, ModbusWriteResult result, ModbusExceptionCode code)
+{
+	completed_writes.push_back({(uintptr_t) write->context, result, code});
+}
+
+void coalesce_tests()
+{
+	run_test("[RTU] Adjacent register writes merged into FC16", [](){
+		set_mode("rtu");
+		sent_frames.clear();
+		completed_writes.clear();
+		ModbusPendingWrite writes[8];
+		ModbusWriteCoalescer coalescer;
+		ModbusErrorInfo err = modbusWriteCoalescerInit(&coalescer, &master, MODBUS_COALESCE_RTU, coalesce_transport, write_completed, writes, 8, 10, 50);
+		assert_expr("coalescer initialized", modbusIsOk(err));
+
+		// Register 12 is written twice, 14 isn't adjacent
+		err = modbusWriteCoalescerAdd(&coalescer, 1, MODBUS_HOLDING_REGISTER, 12, 100, (void*) 1, 0);
+		err = modbusWriteCoalescerAdd(&coalescer, 1, MODBUS_HOLDING_REGISTER, 10, 200, (void*) 2, 1);
+		err = modbusWriteCoalescerAdd(&coalescer, 1, MODBUS_HOLDING_REGISTER, 11, 300, (void*) 3, 2);
+		err = modbusWriteCoalescerAdd(&coalescer, 1, MODBUS_HOLDING_REGISTER, 12, 400, (void*) 4, 3);
+		err = modbusWriteCoalescerAdd(&coalescer, 1, MODBUS_HOLDING_REGISTER, 14, 500, (void*) 5, 4);
+		assert_expr("writes queued", modbusIsOk(err) && coalescer.count == 5);
+
+		uint32_t wakeup;
+		assert_expr("wakeup when the first write is due", modbusWriteCoalescerNextWakeup(&coalescer, &wakeup) && wakeup == 10);
+		err = modbusWriteCoalescerRun(&coalescer, 9);
+		assert_expr("nothing sent before the window ends", modbusIsOk(err) && sent_frames.empty());
+
+		err = modbusWriteCoalescerRun(&coalescer, 10);
+		assert_expr("request sent", modbusIsOk(err) && sent_frames.size() == 1);
+		request_data = sent_frames.back();
+		assert_expr("FC16", request_data.at(1) == 16 && modbusRBE(&request_data.at(2)) == 10 && modbusRBE(&request_data.at(4)) == 3);
+		parse_request();
+		assert_slave_ok();
+		assert_reg(10, 200);
+		assert_reg(11, 300);
+		assert_reg(12, 400);
+
+		assert_expr("wakeup at timeout", modbusWriteCoalescerNextWakeup(&coalescer, &wakeup) && wakeup == 60);
+		err = modbusWriteCoalescerParseResponse(&coalescer, response_data.data(), response_data.size());
+		assert_expr("response parsed", modbusIsOk(err) && completed_writes.size() == 4 && coalescer.count == 1);
+		for (const auto &w : completed_writes)
+			assert_expr("write completed", w.context >= 1 && w.context <= 4 && w.result == MODBUS_WRITE_OK);
+
+		err = modbusWriteCoalescerRun(&coalescer, 14);
+		request_data = sent_frames.back();
+		assert_expr("FC06", sent_frames.size() == 2 && request_data.at(1) == 6);
+		parse_request();
+		assert_reg(14, 500);
+		err = modbusWriteCoalescerParseResponse(&coalescer, response_data.data(), response_data.size());
+		assert_expr("last write completed", modbusIsOk(err) && completed_writes.size() == 5 && completed_writes.back().context == 5);
+		assert_expr("statistics", coalescer.writesAdded == 5 && coalescer.requestsSent == 2);
+		assert_expr("nothing left", !modbusWriteCoalescerNextWakeup(&coalescer, &wakeup));
+	});
+
+	run_test("[TCP] Coil writes, exceptions and timeouts", [](){
+		set_mode("tcp");
+		sent_frames.clear();
+		completed_writes.clear();
+		ModbusPendingWrite writes[8];
+		ModbusWriteCoalescer coalescer;
+		ModbusErrorInfo err = modbusWriteCoalescerInit(&coalescer, &master, MODBUS_COALESCE_TCP, coalesce_transport, write_completed, writes, 8, 0, 50);
+		assert_expr("coalescer initialized", modbusIsOk(err));
+
+		err = modbusWriteCoalescerAdd(&coalescer, 1, MODBUS_COIL, 3, 1, (void*) 1, 0);
+		err = modbusWriteCoalescerAdd(&coalescer, 1, MODBUS_COIL, 4, 0, (void*) 2, 0);
+		err = modbusWriteCoalescerAdd(&coalescer, 1, MODBUS_COIL, 5, 0xff00, (void*) 3, 0);
+		err = modbusWriteCoalescerAdd(&coalescer, 2, MODBUS_COIL, 6, 1, (void*) 4, 0);
+		err = modbusWriteCoalescerRun(&coalescer, 0);
+		request_data = sent_frames.back();
+		assert_expr("FC15", modbusIsOk(err) && request_data.at(6) == 1 && request_data.at(7) == 15 && modbusRBE(&request_data.at(10)) == 3);
+		parse_request();
+		assert_slave_ok();
+		assert_coil(3, 1);
+		assert_coil(4, 0);
+		assert_coil(5, 1);
+		err = modbusWriteCoalescerParseResponse(&coalescer, response_data.data(), response_data.size());
+		assert_expr("coil writes completed", modbusIsOk(err) && completed_writes.size() == 3);
+
+		// Unit 2 doesn't respond
+		err = modbusWriteCoalescerRun(&coalescer, 0);
+		request_data = sent_frames.back();
+		assert_expr("FC05", modbusIsOk(err) && request_data.at(6) == 2 && request_data.at(7) == 5);
+		err = modbusWriteCoalescerRun(&coalescer, 49);
+		assert_expr("still pending", modbusIsOk(err) && coalescer.pending && completed_writes.size() == 3);
+		err = modbusWriteCoalescerRun(&coalescer, 50);
+		assert_expr("timed out", modbusIsOk(err) && !coalescer.pending && completed_writes.back().result == MODBUS_WRITE_TIMEOUT);
+
+		// Exception applies to all merged writes
+		set_wlock(8, 1);
+		err = modbusWriteCoalescerAdd(&coalescer, 1, MODBUS_HOLDING_REGISTER, 7, 1, (void*) 5, 60);
+		err = modbusWriteCoalescerAdd(&coalescer, 1, MODBUS_HOLDING_REGISTER, 8, 2, (void*) 6, 60);
+		err = modbusWriteCoalescerRun(&coalescer, 60);
+		request_data = sent_frames.back();
+		assert_expr("FC16", modbusIsOk(err) && request_data.at(7) == 16);
+		parse_request();
+		assert_slave_ex(MODBUS_EXCEP_SLAVE_FAILURE);
+		err = modbusWriteCoalescerParseResponse(&coalescer, response_data.data(), response_data.size());
+		assert_expr("exception", modbusIsOk(err) && completed_writes.size() == 6);
+		assert_expr("both writes failed",
+			completed_writes.at(4).result == MODBUS_WRITE_EXCEPTION && completed_writes.at(4).code == MODBUS_EXCEP_SLAVE_FAILURE
+			&& completed_writes.at(5).result == MODBUS_WRITE_EXCEPTION && completed_writes.at(5).code == MODBUS_EXCEP_SLAVE_FAILURE);
+		err = modbusWriteCoalescerParseResponse(&coalescer, response_data.data(), response_data.size());
+		assert_expr("unexpected response", modbusGetResponseError(err) == MODBUS_ERROR_OTHER);
+	});
+
+	run_test("Invalid batched writes", [](){
+		ModbusPendingWrite writes[2];
+		ModbusWriteCoalescer coalescer;
+		ModbusErrorInfo err = modbusWriteCoalescerInit(&coalescer, &master, MODBUS_COALESCE_RTU, coalesce_transport, NULL, writes, 2, 0, 50);
+		assert_expr("coalescer initialized", modbusIsOk(err));
+		err = modbusWriteCoalescerAdd(&coalescer, 1, MODBUS_INPUT_REGISTER, 0, 0, NULL, 0);
+		assert_expr("input registers can't be written", modbusGetGeneralError(err) == MODBUS_ERROR_VALUE);
+		err = modbusWriteCoalescerAdd(&coalescer, 0, MODBUS_HOLDING_REGISTER, 0, 0, NULL, 0);
+		assert_expr("no RTU broadcasts", modbusGetGeneralError(err) == MODBUS_ERROR_ADDRESS);
+		err = modbusWriteCoalescerAdd(&coalescer, 1, MODBUS_HOLDING_REGISTER, 0, 0, NULL, 0);
+		err = modbusWriteCoalescerAdd(&coalescer, 1, MODBUS_HOLDING_REGISTER, 0, 1, NULL, 0);
+		err = modbusWriteCoalescerAdd(&coalescer, 1, MODBUS_HOLDING_REGISTER, 1, 0, NULL, 0);
+		assert_expr("no free slots", modbusGetGeneralError(err) == MODBUS_ERROR_ALLOC);
+		assert_expr("init without slots", modbusGetGeneralError(modbusWriteCoalescerInit(&coalescer, &master, MODBUS_COALESCE_RTU, coalesce_transport, NULL, writes, 0, 0, 50)) == MODBUS_ERROR_VALUE);
+	});
+}
+
 void test_main()
 {
 	modbus_pdu_tests();
 	modbus_rtu_tests();
 	modbus_tcp_tests();
+	modbus_ascii_tests();
 	short_frames_tests();
 
 	illegal_function_test();
@@ -876,4 +2570,15 @@ void test_main()
 	last_register_tests();
 	max_read_tests();
 	invalid_response_tests();
+
+	frozen_request_tests();
+	request_coalesce_tests();
+	stream_tests();
+	cache_tests();
+	pipeline_tests();
+	scheduler_tests();
+	rtt_tests();
+	shadow_tests();
+	rtubus_tests();
+	coalesce_tests();
 }
\ No newline at end of file
@@ -12,6 +12,14 @@ using namespace std::string_literals;
 
 #define LIGHTMODBUS_FULL
 #define LIGHTMODBUS_DEBUG
+#define LIGHTMODBUS_STREAM
+#define LIGHTMODBUS_CACHE
+#define LIGHTMODBUS_PIPELINE
+#define LIGHTMODBUS_RTT
+#define LIGHTMODBUS_SHADOW
+#define LIGHTMODBUS_SCHEDULER
+#define LIGHTMODBUS_RTU_BUS
+#define LIGHTMODBUS_COALESCE
 #ifndef COVERAGE_TEST
 #define LIGHTMODBUS_IMPL
 #endif
@@ -27,7 +35,8 @@ enum modbus_flavor
 {
 	MODBUS_PDU,
 	MODBUS_RTU,
-	MODBUS_TCP
+	MODBUS_TCP,
+	MODBUS_ASCII
 };
 
 struct modbus_exception_info
@@ -208,6 +217,7 @@ void build_request(const std::vector<int> &args)
 		case MODBUS_PDU: master_error = modbusBeginRequestPDU(&master); break;
 		case MODBUS_RTU: master_error = modbusBeginRequestRTU(&master); break;
 		case MODBUS_TCP: master_error = modbusBeginRequestTCP(&master); break;
+		case MODBUS_ASCII: master_error = modbusBeginRequestASCII(&master); break;
 	}
 
 	if (!modbusIsOk(master_error))
@@ -290,6 +300,7 @@ void build_request(const std::vector<int> &args)
 		case MODBUS_PDU: master_error = modbusEndRequestPDU(&master); break;
 		case MODBUS_RTU: master_error = modbusEndRequestRTU(&master, address); break;
 		case MODBUS_TCP: master_error = modbusEndRequestTCP(&master, transaction_id++, address); break;
+		case MODBUS_ASCII: master_error = modbusEndRequestASCII(&master, address); break;
 	}
 
 	if (!modbusIsOk(master_error))
@@ -308,6 +319,7 @@ void build_exception(uint8_t address, uint8_t function, ModbusExceptionCode code
 		case MODBUS_PDU: slave_error = modbusBuildExceptionPDU(&slave, function, code); break;
 		case MODBUS_RTU: slave_error = modbusBuildExceptionRTU(&slave, address, function, code); break;
 		case MODBUS_TCP: slave_error = modbusBuildExceptionTCP(&slave, transaction_id - 1, address, function, code); break;
+		case MODBUS_ASCII: slave_error = modbusBuildExceptionASCII(&slave, address, function, code); break;
 	}
 
 	if (!modbusIsOk(slave_error))
@@ -350,6 +362,14 @@ void parse_request()
 				request_data.data(),
 				request_data.size());
 			break;
+
+		case MODBUS_ASCII:
+			slave_error = modbusParseRequestASCII(
+				&slave,
+				1,
+				request_data.data(),
+				request_data.size());
+			break;
 	}
 
 	if (!modbusIsOk(slave_error))
@@ -397,6 +417,15 @@ void parse_response()
 				response_data.data(),
 				response_data.size());
 			break;
+
+		case MODBUS_ASCII:
+			master_error = modbusParseResponseASCII(
+				&master,
+				request_data.data(),
+				request_data.size(),
+				response_data.data(),
+				response_data.size());
+			break;
 	}
 
 	if (received_data.size())
@@ -570,6 +599,8 @@ void set_mode(const std::string &m)
 		modbus_mode = MODBUS_RTU;
 	else if (m == "tcp")
 		modbus_mode = MODBUS_TCP;
+	else if (m == "ascii")
+		modbus_mode = MODBUS_ASCII;
 	else
 		throw std::runtime_error{"invalid Modbus mode "s + m};
 }
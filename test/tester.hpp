@@ -5,12 +5,23 @@
 #include <functional>
 
 #define LIGHTMODBUS_FULL
+#define LIGHTMODBUS_STREAM
+#define LIGHTMODBUS_CACHE
+#define LIGHTMODBUS_PIPELINE
+#define LIGHTMODBUS_RTT
+#define LIGHTMODBUS_SHADOW
+#define LIGHTMODBUS_SCHEDULER
+#define LIGHTMODBUS_RTU_BUS
+#define LIGHTMODBUS_COALESCE
 #include <lightmodbus/lightmodbus.h>
 
 extern std::vector<uint16_t> regs;
 extern std::vector<uint8_t> coils;
 extern std::vector<uint8_t> request_data;
 extern std::vector<uint8_t> response_data;
+extern std::vector<ModbusDataCallbackArgs> received_data;
+extern ModbusMaster master;
+extern ModbusSlave slave;
 
 void build_request(const std::vector<int> &args);
 void build_exception(uint8_t address, uint8_t function, ModbusExceptionCode code);